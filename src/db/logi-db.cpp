@@ -17,8 +17,14 @@
     Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 */
 
+#include <cerrno>
+#include <cstring>
 #include <exception>
 #include <future>
+#include <system_error>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
 
 #include <glib.h>
 
@@ -30,16 +36,16 @@ namespace logi
 Database::~Database()
 {
     stop();
-    while (statement_queue_.size())
-    {
-        delete statement_queue_.front();
-        statement_queue_.pop();
-    }
-    while (result_queue_.size())
-    {
-        delete result_queue_.front();
-        result_queue_.pop();
-    }
+    CurriedStatementBase *stmt;
+    // The thread has been joined, so it's safe to pop from here
+    while (pop_statement(stmt))
+        delete stmt;
+    while (result_queue_.pop(stmt))
+        delete stmt;
+    if (statement_fd_ != -1)
+        ::close(statement_fd_);
+    if (result_fd_ != -1)
+        ::close(result_fd_);
 }
 
 void Database::stop()
@@ -49,20 +55,54 @@ void Database::stop()
         return;
     }
     stop_ = true;
+    result_conn_.disconnect();
     if (thread_)
     {
-        std::unique_lock<std::mutex> lk(mut_);
-        cv_.notify_one();
-        lk.unlock();
+        // Bypass the pending flag, the thread must see stop_
+        std::uint64_t n = 1;
+        if (::write(statement_fd_, &n, sizeof(n)) < 0)
+        {
+            g_critical("Unable to wake database thread: %s",
+                    std::strerror(errno));
+        }
         if (thread_->joinable())
             thread_->join();
         delete thread_;
         thread_ = nullptr;
     }
+    auto stats = get_queue_stats();
+    g_debug("Database queue: %lu statements, %lu wakeups, max depth %lu, "
+            "mean/max latency %ld/%ldus; %lu results in %lu dispatches, "
+            "mean/max result latency %ld/%ldus, %lu overflowed",
+            (unsigned long) stats.statements, (unsigned long) stats.wakeups,
+            (unsigned long) stats.max_depth,
+            (long) (stats.statements ?
+                stats.total_latency / (std::int64_t) stats.statements : 0),
+            (long) stats.max_latency,
+            (unsigned long) stats.results,
+            (unsigned long) stats.result_dispatches,
+            (long) (stats.results ?
+                stats.total_result_latency / (std::int64_t) stats.results : 0),
+            (long) stats.max_result_latency,
+            (unsigned long) stats.overflows);
 }
 
 void Database::start()
 {
+    statement_fd_ = eventfd(0, EFD_CLOEXEC);
+    result_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (statement_fd_ == -1 || result_fd_ == -1)
+    {
+        throw std::system_error(errno, std::system_category(),
+                "Unable to create database eventfd");
+    }
+    // A single persistent source delivers all results to the main thread
+    result_conn_ = Glib::signal_io().connect(
+            sigc::mem_fun(*this, &Database::result_io_callback),
+            result_fd_, Glib::IO_IN);
+    // In case anything was queued before we started
+    wake(statement_fd_, statement_wake_pending_);
+
     std::promise<bool> prom;
     thread_ = new std::thread([this, &prom]()
     {
@@ -85,70 +125,134 @@ void Database::thread_main()
 {
     while (!stop_)
     {
-        std::unique_lock<std::mutex> lk(mut_);
-        cv_.wait(lk);
-        while (statement_queue_.size())
+        std::uint64_t n;
+
+        // Blocks until something has been queued since the last wakeup.
+        // Any statement queued before this point has already written to the
+        // eventfd, so it can't be missed.
+        if (::read(statement_fd_, &n, sizeof(n)) < 0)
         {
-            g_debug("Statement queue has %ld remaining items",
-                    statement_queue_.size());
-            auto stmt = statement_queue_.front();
-            statement_queue_.pop();
-            g_debug("Popped stmt %d, ", stmt->id());
-            if (statement_queue_.size())
-            {
-                g_debug("next %d, last %d",
-                        statement_queue_.front()->id(),
-                        statement_queue_.back()->id());
-            }
-            else
-            {
-                g_debug("no more items in queue");
-            }
-            lk.unlock();
-            try
-            {
-                stmt->execute();
-            }
-            catch (std::exception *x)
-            {
-                g_critical("Error on database thread: %s", x->what());
-                delete x;
-            }
-            catch (std::exception &x)
-            {
-                g_critical("Error on database thread: %s", x.what());
-            }
-            lk.lock();
+            if (errno == EINTR)
+                continue;
+            g_critical("Error waiting for database statements: %s",
+                    std::strerror(errno));
+            break;
+        }
+        // Clear the flag before draining so that anything queued while we're
+        // busy causes another wakeup.
+        statement_wake_pending_ = false;
+        ++n_wakeups_;
+
+        CurriedStatementBase *stmt;
+        while (!stop_ && pop_statement(stmt))
+        {
+            auto latency = g_get_monotonic_time() - stmt->queued_time();
+            total_latency_ += latency;
+            update_max(max_latency_, latency);
+            execute_safely(stmt);
             if (stmt->has_result())
-            {
-                result_queue_.push(stmt);
-                Glib::signal_idle().connect
-                    (sigc::mem_fun(*this, &Database::result_idle_callback));
-            }
+                queue_result(stmt);
+            else
+                delete stmt;
         }
     }
 }
 
+void Database::execute_safely(CurriedStatementBase *statement)
+{
+    try
+    {
+        statement->execute();
+    }
+    catch (std::exception *x)
+    {
+        g_critical("Error on database thread: %s", x->what());
+        delete x;
+    }
+    catch (std::exception &x)
+    {
+        g_critical("Error on database thread: %s", x.what());
+    }
+}
+
 void Database::queue_statement(CurriedStatementBase *statement)
 {
-    std::lock_guard<std::mutex> lk(mut_);
+    statement->set_queued_time(g_get_monotonic_time());
+    ++n_statements_;
+    update_max(max_depth_, ++depth_);
+
     statement_queue_.push(statement);
-    cv_.notify_one();
+    wake(statement_fd_, statement_wake_pending_);
 }
 
-bool Database::result_idle_callback()
+bool Database::pop_statement(CurriedStatementBase *&statement)
 {
-    std::unique_lock<std::mutex> lk(mut_);
-    while (result_queue_.size())
+    if (!statement_queue_.pop(statement))
+        return false;
+    --depth_;
+    return true;
+}
+
+void Database::queue_result(CurriedStatementBase *statement)
+{
+    result_queue_.push(statement);
+    wake(result_fd_, result_wake_pending_);
+}
+
+bool Database::result_io_callback(Glib::IOCondition)
+{
+    std::uint64_t n;
+
+    // The eventfd is non-blocking so this can't stall the main loop
+    if (::read(result_fd_, &n, sizeof(n)) < 0 && errno != EAGAIN)
+    {
+        g_critical("Error reading database result eventfd: %s",
+                std::strerror(errno));
+    }
+    result_wake_pending_ = false;
+    ++n_result_dispatches_;
+
+    CurriedStatementBase *stmt;
+    while (result_queue_.pop(stmt))
     {
-        auto stmt = result_queue_.front();
-        result_queue_.pop();
-        lk.unlock();
         stmt->forward_result();
+        auto latency = g_get_monotonic_time() - stmt->queued_time();
+        ++n_results_;
+        total_result_latency_ += latency;
+        update_max(max_result_latency_, latency);
         delete stmt;
-        lk.lock();
     }
-    return false;
+    return true;
+}
+
+void Database::wake(int fd, std::atomic<bool> &pending)
+{
+    if (fd == -1 || pending.exchange(true))
+        return;
+    std::uint64_t n = 1;
+    if (::write(fd, &n, sizeof(n)) < 0)
+    {
+        pending = false;
+        g_critical("Unable to write to database eventfd: %s",
+                std::strerror(errno));
+    }
+}
+
+void Database::update_max(std::atomic<std::int64_t> &max, std::int64_t val)
+{
+    auto old = max.load();
+    while (val > old && !max.compare_exchange_weak(old, val));
+}
+
+Database::QueueStats Database::get_queue_stats() const
+{
+    return QueueStats {
+        n_statements_, n_results_, n_wakeups_, n_result_dispatches_,
+        std::uint64_t(depth_.load()), std::uint64_t(max_depth_.load()),
+        total_latency_, max_latency_,
+        total_result_latency_, max_result_latency_,
+        statement_queue_.overflows() + result_queue_.overflows()
+    };
 }
 
 void Database::ensure_tables(const char *source)
@@ -173,6 +277,7 @@ void Database::ensure_tables_callback(const char *source)
     ensure_network_lcn_table(source);
     ensure_region_table(source);
     ensure_client_lcn_table(source);
+    ensure_epg_table(source);
 }
 
 int Database::CurriedStatementBase::index_ = 0;
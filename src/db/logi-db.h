@@ -19,18 +19,27 @@
     Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 */
 
-#include <condition_variable>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
 #include <memory>
-#include <mutex>
-#include <queue>
+#include <optional>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <tuple>
+#include <type_traits>
 #include <vector>
 
 #include <glibmm/main.h>
 #include <glibmm/ustring.h>
 
+#include "mpsc-queue.h"
+
 namespace logi
 {
 
@@ -55,6 +64,13 @@ public:
         virtual ~Query() = default;
 
         virtual Result query(const ArgsTuple &args) = 0;
+
+        /**
+         * Expected number of result rows, so that the result can be allocated
+         * once. Implementations may also adapt to the size of previous
+         * results.
+         */
+        virtual void set_reserve_hint(std::size_t) {}
     };
 
     template<class Result, typename... Args>
@@ -67,8 +83,32 @@ public:
         virtual ~Query() = default;
 
         virtual Result query() = 0;
+
+        virtual void set_reserve_hint(std::size_t) {}
+    };
+
+    /**
+     * A query which passes each result row to a visitor instead of
+     * collecting them in a Vector. Row is a Tuple whose elements may be
+     * std::string_view for text columns; those are only valid until the
+     * visitor returns. Use an empty Args for queries with no arguments.
+     */
+    template<class Row, typename... Args> class RowQuery
+    {
+    public:
+        using ArgsTuple = std::tuple<Args...>;
+        using Visitor = std::function<void(const Row &)>;
+
+        virtual ~RowQuery() = default;
+
+        /// Returns: The number of rows visited
+        virtual std::size_t visit(const ArgsTuple &args,
+                const Visitor &visitor) = 0;
     };
 
+    template<class Row, typename... Args>
+    using RowQueryPtr = std::shared_ptr<RowQuery<Row, Args...>>;
+
     /// An insertion/modification statement that takes multiple rows of input
     template<typename... Args>
     class Statement
@@ -102,8 +142,14 @@ private:
         virtual bool has_result() const = 0;
 
         int id() const { return id_; }
+
+        /// Monotonic time (in microseconds) when the statement was queued
+        std::int64_t queued_time() const { return queued_time_; }
+
+        void set_queued_time(std::int64_t t) { queued_time_ = t; }
     private:
         int id_;
+        std::int64_t queued_time_ = 0;
         static int index_;
     };
 
@@ -113,15 +159,15 @@ private:
     public:
         using ArgPtr = std::shared_ptr<std::tuple<Args...>>;
         using Slot = sigc::slot<void, Result>;
-        using Q = Query<Result, Args...>;
+        using Q = QueryPtr<Result, Args...>;
               
-        CurriedQuery(Q &query, ArgPtr args, Slot &callback)
+        CurriedQuery(Q query, ArgPtr args, const Slot &callback)
             : query_(query), args_(args), callback_(callback)
         {}
 
         virtual void execute() override
         {
-            result_ = query_.query(*args_);
+            result_ = query_->query(*args_);
         }
 
         virtual void forward_result() override
@@ -134,7 +180,7 @@ private:
             return true;
         }
     private:
-        Q &query_;
+        Q query_;
         ArgPtr args_;
         Result result_;
         Slot callback_;
@@ -218,9 +264,219 @@ private:
     private:
         Callback callback_;
     };
+
+    /// Runs a function on the database thread and passes its result (or
+    /// exception) to a std::promise on the main thread, then calls the
+    /// continuation, if any, with the ready future.
+    template<class Result> class PromisedCall : public CurriedStatementBase
+    {
+    public:
+        using Continuation = std::function<void(std::future<Result> &&)>;
+
+        PromisedCall(std::function<Result()> &&fn,
+                Continuation &&continuation = nullptr) :
+            fn_(std::move(fn)), continuation_(std::move(continuation))
+        {}
+
+        std::future<Result> get_future()
+        {
+            return promise_.get_future();
+        }
+
+        virtual void execute() override
+        {
+            try
+            {
+                run(value_, fn_);
+            }
+            catch (std::exception *x)
+            {
+                // Our database classes throw pointers, which would leak if
+                // they were passed on via the future.
+                error_ = std::make_exception_ptr(
+                            std::runtime_error(x->what()));
+                delete x;
+            }
+            catch (...)
+            {
+                error_ = std::current_exception();
+            }
+        }
+
+        virtual void forward_result() override
+        {
+            if (error_)
+                promise_.set_exception(error_);
+            else
+                fulfil(promise_, value_);
+            if (continuation_)
+                continuation_(promise_.get_future());
+        }
+
+        virtual bool has_result() const override
+        {
+            return true;
+        }
+    private:
+        using Stored = std::conditional_t<std::is_void<Result>::value,
+              bool, Result>;
+
+        template<class R>
+        static void run(std::optional<R> &v, std::function<R()> &fn)
+        {
+            v.emplace(fn());
+        }
+
+        static void run(std::optional<bool> &v, std::function<void()> &fn)
+        {
+            fn();
+            v.emplace(true);
+        }
+
+        template<class R>
+        static void fulfil(std::promise<R> &p, std::optional<R> &v)
+        {
+            p.set_value(std::move(*v));
+        }
+
+        static void fulfil(std::promise<void> &p, std::optional<bool> &)
+        {
+            p.set_value();
+        }
+
+        std::function<Result()> fn_;
+        Continuation continuation_;
+        std::optional<Stored> value_;
+        std::exception_ptr error_;
+        std::promise<Result> promise_;
+    };
+
+    /// Several of the above queued and executed as one
+    class BatchStatement : public CurriedStatementBase
+    {
+    public:
+        using Members = std::vector<std::unique_ptr<CurriedStatementBase>>;
+
+        BatchStatement(Members &&members) : members_(std::move(members))
+        {}
+
+        virtual void execute() override
+        {
+            for (auto &m: members_)
+                execute_safely(m.get());
+        }
+
+        virtual void forward_result() override
+        {
+            for (auto &m: members_)
+            {
+                if (m->has_result())
+                    m->forward_result();
+            }
+        }
+
+        virtual bool has_result() const override
+        {
+            return std::any_of(members_.begin(), members_.end(),
+                    [](const std::unique_ptr<CurriedStatementBase> &m)
+                    {
+                        return m->has_result();
+                    });
+        }
+    private:
+        Members members_;
+    };
 public:
+    /**
+     * Collects a number of queries and statements so that they can be passed
+     * to the database thread with a single queue_batch(). They are executed in
+     * the order they were added. Callbacks are called, and futures become
+     * ready, on the main thread after the whole batch has been executed.
+     */
+    class Batch
+    {
+    public:
+        template<class Result, typename... Args>
+        Batch &add_query(QueryPtr<Result, Args...> query,
+                std::shared_ptr<Tuple<Args...>> args,
+                const sigc::slot<void, Result> &callback)
+        {
+            members_.emplace_back(new CurriedQuery<Result, Args...>
+                    (query, args, callback));
+            return *this;
+        }
+
+        template<class Result, typename... Args>
+        std::future<Result> add_query(QueryPtr<Result, Args...> query,
+                std::shared_ptr<Tuple<Args...>> args)
+        {
+            return add_promise<Result>([query, args]()
+            {
+                return query->query(*args);
+            });
+        }
+
+        template<class Result>
+        std::future<Result> add_query(QueryPtr<Result, void> query)
+        {
+            return add_promise<Result>([query]() { return query->query(); });
+        }
+
+        template<typename... Args>
+        Batch &add_statement(StatementPtr<Args...> statement,
+                std::shared_ptr<Vector<Args...>> args)
+        {
+            members_.emplace_back(new CurriedStatement<Args...>
+                    (statement, args));
+            return *this;
+        }
+
+        bool empty() const
+        {
+            return members_.empty();
+        }
+
+        std::size_t size() const
+        {
+            return members_.size();
+        }
+    private:
+        friend class Database;
+
+        template<class Result>
+        std::future<Result> add_promise(std::function<Result()> &&fn)
+        {
+            auto p = new PromisedCall<Result>(std::move(fn));
+            members_.emplace_back(p);
+            return p->get_future();
+        }
+
+        BatchStatement::Members members_;
+    };
+
     using id_t = std::uint32_t;
 
+    /**
+     * Counters for monitoring the statement and result queues. Latencies are
+     * in microseconds. "latency" is from queueing a statement to the database
+     * thread starting to execute it; "result_latency" is from queueing to the
+     * result being forwarded on the main thread.
+     */
+    struct QueueStats
+    {
+        std::uint64_t statements;
+        std::uint64_t results;
+        std::uint64_t wakeups;
+        std::uint64_t result_dispatches;
+        std::uint64_t depth;
+        std::uint64_t max_depth;
+        std::int64_t total_latency;
+        std::int64_t max_latency;
+        std::int64_t total_result_latency;
+        std::int64_t max_result_latency;
+        std::uint64_t overflows;    // Items which didn't fit in the rings
+    };
+
     virtual ~Database();
 
     void start();
@@ -243,6 +499,13 @@ public:
     virtual StatementPtr<id_t, id_t, id_t, id_t, id_t>
         get_insert_tuning_statement(const char *source) = 0;
 
+    /**
+     * Deletes all of a transport stream's tuning properties.
+     * statement args: orig_nw_id, ts_id
+     */
+    virtual StatementPtr<id_t, id_t>
+        get_delete_tuning_statement(const char *source) = 0;
+
     /**
      * statement args: orig_nw_id, nw_id, ts_id, service_id
      */
@@ -262,13 +525,22 @@ public:
         get_insert_service_name_statement(const char *source) = 0;
 
     /**
+     * statement args: provider_id, provider_name
+     * The ids are assigned by the caller, see NameInterner.
+     */
+    virtual StatementPtr<id_t, Glib::ustring>
+    get_insert_provider_name_statement(const char *source) = 0;
+
+    /**
+     * Adds a provider name with a new id unless it's already present. Use
+     * get_provider_id_query to find the id.
      * statement args: provider_name
      */
     virtual StatementPtr<Glib::ustring>
-    get_insert_provider_name_statement(const char *source) = 0;
+    get_add_provider_name_statement(const char *source) = 0;
 
     /**
-     * statement args: orig_nw_id, service_id, provider_name
+     * statement args: orig_nw_id, service_id, provider_id
      */
     virtual StatementPtr<id_t, id_t, id_t>
     get_insert_service_provider_id_statement(const char *source) = 0;
@@ -361,6 +633,47 @@ public:
     virtual QueryPtr<Vector<id_t>, id_t>
     get_original_network_id_for_service_id_query(const char *source) = 0;
 
+    /**
+     * statement args: orig_nw_id, ts_id, service_id, event_id, start,
+     * duration, flags, content, title, summary, description
+     * start is seconds since the Unix epoch. flags holds running_status in
+     * bits 0-2, free_CA_mode in bit 3 and minimum age in bits 8-15. content
+     * is the first content descriptor's nibbles.
+     */
+    virtual StatementPtr<id_t, id_t, id_t, id_t, id_t, id_t, id_t, id_t,
+            Glib::ustring, Glib::ustring, Glib::ustring>
+    get_insert_epg_event_statement(const char *source) = 0;
+
+    /**
+     * Deletes one EPG event.
+     * statement args: orig_nw_id, ts_id, service_id, start
+     */
+    virtual StatementPtr<id_t, id_t, id_t, id_t>
+    get_delete_epg_event_statement(const char *source) = 0;
+
+    /**
+     * Deletes every service's EPG events which have finished.
+     * statement args: time
+     */
+    virtual StatementPtr<id_t>
+    get_delete_old_epg_events_statement(const char *source) = 0;
+
+    using EPGEventRow = Tuple<id_t, id_t, id_t, id_t, id_t, id_t, id_t, id_t,
+          std::string_view, std::string_view, std::string_view>;
+
+    /**
+     * result fields: as for get_insert_epg_event_statement, ordered by
+     * service and start time
+     */
+    virtual RowQueryPtr<EPGEventRow> get_epg_events_query(const char *source)
+        = 0;
+
+    /**
+     * Runs fn in a single transaction, which is rolled back if fn throws.
+     * Must be called on the database thread.
+     */
+    virtual void run_transaction(const std::function<void()> &fn) = 0;
+
     /**
      * Queues a query to be executed on the database thread. The result callback
      * is called on the Glib main thread.
@@ -374,6 +687,49 @@ public:
                 (query, args, callback));
     }
 
+    /// Called on the main thread with a future which is ready
+    template<class Result>
+    using Continuation = typename PromisedCall<Result>::Continuation;
+
+    /**
+     * Like queue_query but returns a std::future instead of using a callback.
+     * The result is passed back through the main loop like a callback's, so
+     * the future only becomes ready when the main loop has run; don't wait
+     * for it on the main thread. Exceptions thrown by the query are passed
+     * on by the future.
+     */
+    template<class Result, typename... Args>
+    std::future<Result> queue_query(QueryPtr<Result, Args...> query,
+            std::shared_ptr<Tuple<Args...>> args)
+    {
+        return queue_promise<Result>([query, args]()
+        {
+            return query->query(*args);
+        });
+    }
+
+    template<class Result>
+    std::future<Result> queue_query(QueryPtr<Result, void> query)
+    {
+        return queue_promise<Result>([query]() { return query->query(); });
+    }
+
+    /**
+     * Like the above, but @continuation is called on the main thread with the
+     * ready future, so that a sequence of dependent queries can be run from
+     * the main loop without blocking it.
+     */
+    template<class Result, typename... Args>
+    void queue_query(QueryPtr<Result, Args...> query,
+            std::shared_ptr<Tuple<Args...>> args,
+            Continuation<Result> &&continuation)
+    {
+        queue_statement(new PromisedCall<Result>([query, args]()
+        {
+            return query->query(*args);
+        }, std::move(continuation)));
+    }
+
     /**
      * Runs a query immediately. Must be called from database thread.
      */
@@ -390,6 +746,18 @@ public:
         return query->query();
     }
 
+    /**
+     * Passes each row of a RowQuery's result to visitor. Must be called from
+     * database thread.
+     */
+    template<class Row, typename... Args>
+    std::size_t run_row_query(RowQueryPtr<Row, Args...> query,
+            const Tuple<Args...> &args,
+            const typename RowQuery<Row, Args...>::Visitor &visitor)
+    {
+        return query->visit(args, visitor);
+    }
+
     /**
      * Like queue_query but for a statement with multiple inputs and no result.
      */
@@ -400,6 +768,39 @@ public:
         queue_statement(new CurriedStatement<Args...>(statement, args));
     }
 
+    /**
+     * Like queue_statement but the future becomes ready on the main thread
+     * when the statement has been executed.
+     */
+    template<typename... Args>
+    std::future<void> queue_statement_future(StatementPtr<Args...> statement,
+            std::shared_ptr<Vector<Args...>> args)
+    {
+        return queue_promise<void>([statement, args]()
+        {
+            statement->execute(*args);
+        });
+    }
+
+    /// As above, but calls @continuation on the main thread instead
+    template<typename... Args>
+    void queue_statement_future(StatementPtr<Args...> statement,
+            std::shared_ptr<Vector<Args...>> args,
+            Continuation<void> &&continuation)
+    {
+        queue_statement(new PromisedCall<void>([statement, args]()
+        {
+            statement->execute(*args);
+        }, std::move(continuation)));
+    }
+
+    /// Queues all of a batch's members for the database thread as one item.
+    void queue_batch(Batch &&batch)
+    {
+        if (!batch.empty())
+            queue_statement(new BatchStatement(std::move(batch.members_)));
+    }
+
     /**
      * Runs a statement immediately. Must be called from database thread.
      */
@@ -426,6 +827,29 @@ public:
 
     /// Ensures that all tables required by named source exist.
     void ensure_tables(const char *source);
+
+    /**
+     * Scans are committed to a staging copy of a source's tables and then
+     * published to the persistent tables in one step, so readers never see a
+     * partial commit and a failed scan leaves the old data intact. Pass the
+     * result of staging_source() instead of source to the get_*_statement
+     * and get_*_query methods to use the staging tables. begin_staging,
+     * publish_staging and discard_staging must be called on the database
+     * thread.
+     */
+    virtual std::string staging_source(const char *source) const = 0;
+
+    /// Creates empty staging copies of source's tables.
+    virtual void begin_staging(const char *source) = 0;
+
+    /// Replaces the contents of source's tables with the staging data and
+    /// discards the staging tables.
+    virtual void publish_staging(const char *source) = 0;
+
+    virtual void discard_staging() = 0;
+
+    /// A snapshot of the queue counters, may be called from any thread.
+    QueueStats get_queue_stats() const;
 protected:
     /**
      * Each of the ensure_* methods creates the required table if it doesn't
@@ -451,21 +875,62 @@ protected:
 
     virtual void ensure_client_lcn_table(const char *source) = 0;
 
+    virtual void ensure_epg_table(const char *source) = 0;
+
     virtual void ensure_source_table() = 0;
+
+    /// Database thread version of ensure_tables
+    void ensure_tables_callback(const char *source);
 private:
+    constexpr static std::size_t QUEUE_CAPACITY = 1024;
+
     void thread_main();
 
     void queue_statement(CurriedStatementBase *statement);
 
-    bool result_idle_callback();
+    template<class Result>
+    std::future<Result> queue_promise(std::function<Result()> &&fn)
+    {
+        auto p = new PromisedCall<Result>(std::move(fn));
+        auto f = p->get_future();
+        queue_statement(p);
+        return f;
+    }
+
+    /// Executes a statement, logging rather than propagating exceptions
+    static void execute_safely(CurriedStatementBase *statement);
 
-    void ensure_tables_callback(const char *source);
+    /// Only called on the database thread
+    bool pop_statement(CurriedStatementBase *&statement);
+
+    /// Only called on the database thread
+    void queue_result(CurriedStatementBase *statement);
+
+    bool result_io_callback(Glib::IOCondition cond);
+
+    /// Writes to fd, an eventfd, unless pending was already set, so that
+    /// bursts of statements/results only cause one wakeup.
+    static void wake(int fd, std::atomic<bool> &pending);
+
+    static void update_max(std::atomic<std::int64_t> &max, std::int64_t val);
 
     std::thread *thread_ = nullptr;
-    std::mutex mut_;
-    std::condition_variable cv_;
-    std::queue<CurriedStatementBase *> statement_queue_, result_queue_;
-    bool stop_ = false;
+    // Neither thread may wait for the other to make room: the main thread
+    // can be queueing statements while the database thread is queueing
+    // results for it, and the database thread queues statements for itself
+    OverflowMPSCQueue<CurriedStatementBase *> statement_queue_{QUEUE_CAPACITY};
+    OverflowMPSCQueue<CurriedStatementBase *> result_queue_{QUEUE_CAPACITY};
+    int statement_fd_ = -1, result_fd_ = -1;
+    std::atomic<bool> statement_wake_pending_{false};
+    std::atomic<bool> result_wake_pending_{false};
+    sigc::connection result_conn_;
+    std::atomic<bool> stop_{false};
+
+    std::atomic<std::uint64_t> n_statements_{0}, n_results_{0},
+        n_wakeups_{0}, n_result_dispatches_{0};
+    std::atomic<std::int64_t> depth_{0}, max_depth_{0},
+        total_latency_{0}, max_latency_{0},
+        total_result_latency_{0}, max_result_latency_{0};
 };
 
 }
@@ -54,6 +54,11 @@ Sqlite3Database::Sqlite3StatementBase::~Sqlite3StatementBase()
     }
 }
 
+const char *Sqlite3Database::Sqlite3StatementBase::get_sql() const
+{
+    return sqlite3_sql(stmt_);
+}
+
 void Sqlite3Database::Sqlite3StatementBase::bind(int pos, std::uint32_t val)
 {
     int result = sqlite3_bind_int(stmt_, pos, val);
@@ -64,11 +69,29 @@ void Sqlite3Database::Sqlite3StatementBase::bind(int pos, std::uint32_t val)
     }
 }
 
+void Sqlite3Database::Sqlite3StatementBase::bind(int pos, std::int64_t val)
+{
+    int result = sqlite3_bind_int64(stmt_, pos, val);
+    if (result != SQLITE_OK)
+    {
+        throw new Sqlite3Error(sqlite3_db_handle(stmt_),
+                result, "Error binding SQL int64");
+    }
+}
+
 void Sqlite3Database::Sqlite3StatementBase::bind(int pos,
         const Glib::ustring &val)
 {
-    int result = sqlite3_bind_text
-        (stmt_, pos, val.c_str(), -1, SQLITE_TRANSIENT);
+    bind(pos, std::string_view(val.raw()));
+}
+
+void Sqlite3Database::Sqlite3StatementBase::bind(int pos, std::string_view val)
+{
+    // Arguments always outlive the step() they're bound for, so sqlite
+    // doesn't need to take a copy. A null pointer would bind NULL rather
+    // than an empty string.
+    int result = sqlite3_bind_text(stmt_, pos,
+            val.data() ? val.data() : "", val.size(), SQLITE_STATIC);
     if (result != SQLITE_OK)
     {
         throw new Sqlite3Error(sqlite3_db_handle(stmt_),
@@ -81,10 +104,26 @@ void Sqlite3Database::Sqlite3StatementBase::fetch(int pos, std::uint32_t &val)
     val = sqlite3_column_int(stmt_, pos);
 }
 
+void Sqlite3Database::Sqlite3StatementBase::fetch(int pos, std::int64_t &val)
+{
+    val = sqlite3_column_int64(stmt_, pos);
+}
+
 void Sqlite3Database::Sqlite3StatementBase::fetch(int pos, Glib::ustring &val)
+{
+    std::string_view sv;
+    fetch(pos, sv);
+    val.assign(sv.data(), sv.size());
+}
+
+void Sqlite3Database::Sqlite3StatementBase::fetch(int pos,
+        std::string_view &val)
 {
     // Why do library writers insist on using unsigned char for text?
-    val = (const char *) sqlite3_column_text(stmt_, pos);
+    auto s = (const char *) sqlite3_column_text(stmt_, pos);
+    // sqlite3_column_bytes must be called after sqlite3_column_text
+    val = s ? std::string_view(s, sqlite3_column_bytes(stmt_, pos))
+        : std::string_view();
 }
 
 void Sqlite3Database::Sqlite3StatementBase::reset()
@@ -119,10 +158,13 @@ Sqlite3Database::~Sqlite3Database()
 
 void Sqlite3Database::open()
 {
-    std::string filename = Glib::build_filename(Glib::get_user_data_dir(),
-            "logi");
-    g_mkdir_with_parents(filename.c_str(), 0755);
-    filename = Glib::build_filename(filename, "database.sqlite3");
+    std::string filename = filename_;
+    if (filename.empty())
+    {
+        filename = Glib::build_filename(Glib::get_user_data_dir(), "logi");
+        g_mkdir_with_parents(filename.c_str(), 0755);
+        filename = Glib::build_filename(filename, "database.sqlite3");
+    }
     g_print("Creating database %s\n", filename.c_str());
     int result = sqlite3_open(filename.c_str(), &sqlite3_);
     if (result != SQLITE_OK)
@@ -161,6 +203,15 @@ Sqlite3Database::get_insert_tuning_statement(const char *source)
             "tuning_key", "tuning_val"});
 }
 
+Database::StatementPtr<id_t, id_t>
+Sqlite3Database::get_delete_tuning_statement(const char *source)
+{
+    return std::static_pointer_cast<Statement<id_t, id_t>>
+        (std::make_shared<Sqlite3Statement<id_t, id_t>>(sqlite3_,
+            "DELETE FROM " + build_table_name(source, TUNING_TABLE) +
+            " WHERE original_network_id = ? AND transport_stream_id = ?"));
+}
+
 Database::StatementPtr<id_t, id_t, id_t, id_t>
 Sqlite3Database::get_insert_transport_services_statement(const char *source)
 {
@@ -187,9 +238,17 @@ Sqlite3Database::get_insert_service_name_statement(const char *source)
             {"original_network_id", "service_id", "name"});
 }
 
-Database::StatementPtr<Glib::ustring>
+Database::StatementPtr<id_t, Glib::ustring>
 Sqlite3Database::get_insert_provider_name_statement(const char *source)
 {
+    return build_insert_statement<id_t, Glib::ustring>(source,
+            PROVIDER_NAME_TABLE, {"provider_id", "provider_name"});
+}
+
+Database::StatementPtr<Glib::ustring>
+Sqlite3Database::get_add_provider_name_statement(const char *source)
+{
+    // provider_name has a unique index, so an existing name is ignored
     return build_insert_statement<Glib::ustring>(source,
             PROVIDER_NAME_TABLE, {"provider_name"}, false);
 }
@@ -199,7 +258,7 @@ Sqlite3Database::get_insert_service_provider_id_statement(const char *source)
 {
     return build_insert_statement<id_t, id_t, id_t>(source,
             SERVICE_PROVIDER_ID_TABLE,
-            {"original_network_id", "service_id", "provider_id"}, false);
+            {"original_network_id", "service_id", "provider_id"});
 }
 
 Database::StatementPtr<id_t, id_t, id_t, id_t, id_t>
@@ -237,7 +296,7 @@ Database::QueryPtr<Database::Vector<id_t>, Glib::ustring>
 Sqlite3Database::get_provider_id_query(const char *source)
 {
     return build_query<Vector<id_t>, Glib::ustring>
-        (source, PROVIDER_NAME_TABLE, {"provider_name"},
+        (source, PROVIDER_NAME_TABLE, {"provider_id"},
         "provider_name = ?");
 }
 
@@ -315,6 +374,63 @@ Sqlite3Database::get_original_network_id_for_service_id_query
         {"original_network_id"}, "service_id = ?");
 }
 
+Database::StatementPtr<id_t, id_t, id_t, id_t, id_t, id_t, id_t, id_t,
+    Glib::ustring, Glib::ustring, Glib::ustring>
+Sqlite3Database::get_insert_epg_event_statement(const char *source)
+{
+    return build_insert_statement<id_t, id_t, id_t, id_t, id_t, id_t, id_t,
+           id_t, Glib::ustring, Glib::ustring, Glib::ustring>(source,
+            EPG_TABLE, {"original_network_id", "transport_stream_id",
+            "service_id", "event_id", "start", "duration", "flags",
+            "content", "title", "summary", "description"});
+}
+
+Database::StatementPtr<id_t, id_t, id_t, id_t>
+Sqlite3Database::get_delete_epg_event_statement(const char *source)
+{
+    return std::static_pointer_cast<Statement<id_t, id_t, id_t, id_t>>
+        (std::make_shared<Sqlite3Statement<id_t, id_t, id_t, id_t>>(sqlite3_,
+            "DELETE FROM " + build_table_name(source, EPG_TABLE) +
+            " WHERE original_network_id = ? AND transport_stream_id = ? "
+            "AND service_id = ? AND start = ?"));
+}
+
+Database::StatementPtr<id_t>
+Sqlite3Database::get_delete_old_epg_events_statement(const char *source)
+{
+    return std::static_pointer_cast<Statement<id_t>>
+        (std::make_shared<Sqlite3Statement<id_t>>(sqlite3_,
+            "DELETE FROM " + build_table_name(source, EPG_TABLE) +
+            // start + duration can't use an index, but start <= ?1 is
+            // implied by it and can
+            " WHERE start <= ?1 AND start + duration <= ?1"));
+}
+
+Database::RowQueryPtr<Database::EPGEventRow>
+Sqlite3Database::get_epg_events_query(const char *source)
+{
+    return build_row_query<EPGEventRow>(source, EPG_TABLE,
+            {"original_network_id", "transport_stream_id",
+            "service_id", "event_id", "start", "duration", "flags",
+            "content", "title", "summary", "description"}, nullptr,
+            "original_network_id, transport_stream_id, service_id, start");
+}
+
+void Sqlite3Database::run_transaction(const std::function<void()> &fn)
+{
+    execute("BEGIN IMMEDIATE");
+    try
+    {
+        fn();
+        execute("COMMIT");
+    }
+    catch (...)
+    {
+        rollback();
+        throw;
+    }
+}
+
 void Sqlite3Database::ensure_network_info_table(const char *source)
 {
     auto table_name = build_table_name(source, NETWORK_INFO_TABLE);
@@ -322,7 +438,10 @@ void Sqlite3Database::ensure_network_info_table(const char *source)
             {"network_id", INT_PRIM_KEY},
             {"name", "TEXT"}
     }));
-    // index is superfluous when we have an integer primary key
+    // Primary key index is superfluous when we have an integer primary key,
+    // but look-ups by name need one. network_id is the rowid, so it's covering.
+    execute(build_create_index_sql(table_name, table_name + "_name_index",
+                "(name)"));
 }
 
 void Sqlite3Database::ensure_tuning_table(const char *source)
@@ -350,8 +469,12 @@ void Sqlite3Database::ensure_transport_services_table(const char *source)
             {"service_id", "INTEGER"},
         },
         "PRIMARY KEY (original_network_id, service_id)"));
-    execute(build_create_index_sql(table_name, table_name + '_' + "index",
-                "(network_id, service_id)"));
+    // Superseded by the covering index below
+    execute("DROP INDEX IF EXISTS " + table_name + "_index");
+    // Covers get_original_network_id_for_network_and_service_id_query
+    execute(build_create_index_sql(table_name,
+                table_name + "_nw_service_index",
+                "(network_id, service_id, original_network_id)"));
 }
 
 void Sqlite3Database::ensure_service_id_table(const char *source)
@@ -365,6 +488,9 @@ void Sqlite3Database::ensure_service_id_table(const char *source)
             {"free_ca_mode", "INTEGER"},
         },
         "PRIMARY KEY (original_network_id, service_id)"));
+    // Covers get_original_network_id_for_service_id_query
+    execute(build_create_index_sql(table_name, table_name + "_service_index",
+                "(service_id, original_network_id)"));
 }
 
 void Sqlite3Database::ensure_service_name_table(const char *source)
@@ -381,9 +507,19 @@ void Sqlite3Database::ensure_service_name_table(const char *source)
 void Sqlite3Database::ensure_provider_name_table(const char *source)
 {
     auto table_name = build_table_name(source, PROVIDER_NAME_TABLE);
+    // Older versions only had a provider_name column and used the implicit
+    // rowid as the id. The table is rewritten by every scan so it's OK to
+    // discard it.
+    if (!column_exists(table_name, "provider_id"))
+        execute("DROP TABLE IF EXISTS " + table_name);
     execute(build_create_table_sql(table_name, {
-            {"provider_name", "TEXT PRIMARY KEY ON CONFLICT IGNORE"},
+            {"provider_id", INT_PRIM_KEY},
+            {"provider_name", "TEXT"},
         }));
+    // provider_id is the rowid, so this is a covering index for
+    // get_provider_id_query
+    execute(build_create_index_sql(table_name, table_name + "_name_index",
+                "(provider_name)", true));
 }
 
 void Sqlite3Database::ensure_service_provider_id_table(const char *source)
@@ -408,6 +544,12 @@ void Sqlite3Database::ensure_network_lcn_table(const char *source)
             {"freesat_id", "INTEGER"},
         },
         "PRIMARY KEY (network_id, region_code, lcn, freesat_id)"));
+    // Covers get_ids_for_network_lcn_query and get_network_lcns_query
+    execute(build_create_index_sql(table_name, table_name + "_lcn_index",
+                "(lcn, network_id, service_id, region_code, freesat_id)"));
+    // Covers get_lcns_for_network_query, including its ORDER BY
+    execute(build_create_index_sql(table_name,
+                table_name + "_network_lcn_index", "(network_id, lcn)"));
 }
 
 void Sqlite3Database::ensure_region_table(const char *source)
@@ -419,6 +561,10 @@ void Sqlite3Database::ensure_region_table(const char *source)
             {"region_name", "TEXT"},
         },
         "PRIMARY KEY (bouquet_id, region_code)"));
+    // Covers get_regions_for_bouquet_query and
+    // get_region_code_for_name_and_bouquet_query
+    execute(build_create_index_sql(table_name, table_name + "_bouquet_index",
+                "(bouquet_id, region_name, region_code)"));
 }
 
 void Sqlite3Database::ensure_client_lcn_table(const char *source)
@@ -434,6 +580,29 @@ void Sqlite3Database::ensure_client_lcn_table(const char *source)
         "PRIMARY KEY (lcn)"));
 }
 
+void Sqlite3Database::ensure_epg_table(const char *source)
+{
+    auto table_name = build_table_name(source, EPG_TABLE);
+    execute(build_create_table_sql(table_name, {
+            {"original_network_id", "INTEGER"},
+            {"transport_stream_id", "INTEGER"},
+            {"service_id", "INTEGER"},
+            {"event_id", "INTEGER"},
+            {"start", "INTEGER"},
+            {"duration", "INTEGER"},
+            {"flags", "INTEGER"},
+            {"content", "INTEGER"},
+            {"title", "TEXT"},
+            {"summary", "TEXT"},
+            {"description", "TEXT"},
+        },
+        "PRIMARY KEY (original_network_id, transport_stream_id, service_id, "
+        "start)"));
+    // For get_delete_old_epg_events_statement
+    execute(build_create_index_sql(table_name, table_name + "_start_index",
+                "(start)"));
+}
+
 void Sqlite3Database::ensure_source_table()
 {
     execute(build_create_table_sql(SOURCE_TABLE, {
@@ -441,6 +610,131 @@ void Sqlite3Database::ensure_source_table()
         }));
 }
 
+void Sqlite3Database::begin_staging(const char *source)
+{
+    if (staging_attached_)
+        discard_staging();
+    execute(Glib::ustring("ATTACH DATABASE ':memory:' AS ") + STAGING_SCHEMA);
+    staging_attached_ = true;
+    ensure_tables_callback(staging_source(source).c_str());
+}
+
+void Sqlite3Database::publish_staging(const char *source)
+{
+    // In case this is the first scan for source
+    ensure_tables_callback(source);
+    auto staging = staging_source(source);
+    execute("BEGIN IMMEDIATE");
+    try
+    {
+        // Name the columns in case the persistent tables were created by an
+        // older version, with columns added later at the end
+        for (auto table: SOURCE_TABLES)
+        {
+            auto dest = build_table_name(source, table);
+            auto columns = column_list(dest);
+            execute("DELETE FROM " + dest);
+            execute("INSERT INTO " + dest + " (" + columns + ") SELECT " +
+                    columns + " FROM " +
+                    build_table_name(staging.c_str(), table));
+        }
+        execute("COMMIT");
+    }
+    catch (...)
+    {
+        rollback();
+        discard_staging();
+        throw;
+    }
+    discard_staging();
+}
+
+void Sqlite3Database::discard_staging()
+{
+    if (staging_attached_)
+    {
+        execute(Glib::ustring("DETACH DATABASE ") + STAGING_SCHEMA);
+        staging_attached_ = false;
+    }
+}
+
+std::string Sqlite3Database::column_list(const std::string &table)
+{
+    sqlite3_stmt *stmt = nullptr;
+    auto sql = "SELECT * FROM " + table + " LIMIT 0";
+    int result = sqlite3_prepare_v2(sqlite3_, sql.c_str(), -1,
+            &stmt, nullptr);
+    if (result != SQLITE_OK)
+    {
+        sqlite3_finalize(stmt);
+        throw new Sqlite3Error(sqlite3_, result,
+                Glib::ustring("Error reading columns of ") + table);
+    }
+    std::string columns;
+    for (int n = 0; n < sqlite3_column_count(stmt); ++n)
+    {
+        if (n)
+            columns += ", ";
+        columns += sqlite3_column_name(stmt, n);
+    }
+    sqlite3_finalize(stmt);
+    return columns;
+}
+
+void Sqlite3Database::rollback()
+{
+    // We're already handling an exception, which is the one worth passing
+    // on; this one may only be because sqlite has rolled back by itself
+    try
+    {
+        execute("ROLLBACK");
+    }
+    catch (Sqlite3Error *x)
+    {
+        g_critical("%s", x->what());
+        delete x;
+    }
+}
+
+bool Sqlite3Database::column_exists(const std::string &table,
+        const char *column)
+{
+    sqlite3_stmt *stmt = nullptr;
+    auto sql = Glib::ustring("SELECT ") + column + " FROM " + table +
+        " LIMIT 0";
+    int result = sqlite3_prepare_v2(sqlite3_, sql.c_str(), -1,
+            &stmt, nullptr);
+    sqlite3_finalize(stmt);
+    return result == SQLITE_OK;
+}
+
+std::vector<std::string> Sqlite3Database::explain_query_plan(const char *sql)
+{
+    std::vector<std::string> plan;
+    auto explain = Glib::ustring("EXPLAIN QUERY PLAN ") + sql;
+    sqlite3_stmt *stmt;
+    int result = sqlite3_prepare_v2(sqlite3_, explain.c_str(), -1,
+            &stmt, nullptr);
+    if (result != SQLITE_OK)
+    {
+        throw new Sqlite3Error(sqlite3_, result,
+                Glib::ustring("Error compiling SQL {") + explain + "}");
+    }
+    // Columns are id, parent, notused, detail
+    while ((result = sqlite3_step(stmt)) == SQLITE_ROW)
+    {
+        auto detail = (const char *) sqlite3_column_text(stmt, 3);
+        plan.emplace_back(detail ? detail : "");
+    }
+    sqlite3_finalize(stmt);
+    if (result != SQLITE_DONE)
+    {
+        throw new Sqlite3Error(sqlite3_, result,
+                Glib::ustring("Error executing SQL {") + explain + "}");
+    }
+    return plan;
+}
+
 void Sqlite3Database::execute(const Glib::ustring &sql)
 {
     sqlite3_stmt *stmt;
@@ -450,8 +744,13 @@ void Sqlite3Database::execute(const Glib::ustring &sql)
         throw new Sqlite3Error(sqlite3_, result,
                 Glib::ustring("Error compiling SQL {") + sql + "}");
     }
-    sqlite3_step(stmt);
+    result = sqlite3_step(stmt);
     sqlite3_finalize(stmt);
+    if (result != SQLITE_DONE && result != SQLITE_ROW)
+    {
+        throw new Sqlite3Error(sqlite3_, result,
+                Glib::ustring("Error executing SQL {") + sql + "}");
+    }
 }
 
 Glib::ustring Sqlite3Database::build_insert_sql(const char *source,
@@ -546,7 +845,10 @@ Glib::ustring Sqlite3Database::build_create_index_sql(
     s += " INDEX IF NOT EXISTS ";
     s += index_name;
     s += " ON ";
-    s += table_name;
+    // If the index is in another schema (eg staging) its name is qualified
+    // but the table name mustn't be.
+    auto dot = table_name.find('.');
+    s += dot == std::string::npos ? table_name : table_name.substr(dot + 1);
     s += ' ';
     return s + details;
 }
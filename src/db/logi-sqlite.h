@@ -19,8 +19,10 @@
     Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 */
 
+#include <algorithm>
 #include <exception>
 #include <initializer_list>
+#include <string_view>
 #include <utility>
 
 #include "logi-db.h"
@@ -76,12 +78,21 @@ private:
 
         void bind(int pos, std::uint32_t val);
 
+        void bind(int pos, std::int64_t val);
+
         void bind(int pos, const Glib::ustring &val);
 
+        void bind(int pos, std::string_view val);
+
         void fetch(int pos, std::uint32_t &val);
 
+        void fetch(int pos, std::int64_t &val);
+
         void fetch(int pos, Glib::ustring &val);
 
+        /// val is only valid until the next step() or reset()
+        void fetch(int pos, std::string_view &val);
+
         template<class T> T fetch(int pos)
         {
             T val;
@@ -125,6 +136,22 @@ private:
                 v.push_back(fetch_row<RArgs...>());
             return v;
         }
+
+        /// Calls visitor with each row without collecting them
+        template<class Row, class Visitor>
+        std::size_t visit_rows(const Visitor &visitor)
+        {
+            std::size_t n = 0;
+            while (!step())
+            {
+                visitor(fetch_row<Row>(std::make_index_sequence
+                            <std::tuple_size<Row>::value>()));
+                ++n;
+            }
+            return n;
+        }
+
+        const char *get_sql() const;
     private:
         sqlite3_stmt *stmt_ = nullptr;
     };
@@ -153,6 +180,8 @@ private:
                 step();
             }
         }
+
+        using Sqlite3StatementBase::get_sql;
     };
 
     template<class Result, typename... Args>
@@ -175,8 +204,20 @@ private:
             reset();
             bind_tuple(row);
             Result v;
-            return fetch_rows(v);
+            v.reserve(std::max(reserve_hint_, last_size_));
+            fetch_rows(v);
+            last_size_ = v.size();
+            return v;
         }
+
+        virtual void set_reserve_hint(std::size_t hint) override
+        {
+            reserve_hint_ = hint;
+        }
+
+        using Sqlite3StatementBase::get_sql;
+    private:
+        std::size_t reserve_hint_ = 0, last_size_ = 0;
     };
 
     /// Query with no arguments
@@ -199,10 +240,55 @@ private:
         {
             reset();
             Result v;
-            return fetch_rows(v);
+            v.reserve(std::max(reserve_hint_, last_size_));
+            fetch_rows(v);
+            last_size_ = v.size();
+            return v;
+        }
+
+        virtual void set_reserve_hint(std::size_t hint) override
+        {
+            reserve_hint_ = hint;
         }
+
+        using Sqlite3StatementBase::get_sql;
+    private:
+        std::size_t reserve_hint_ = 0, last_size_ = 0;
+    };
+
+    template<class Row, typename... Args>
+    class Sqlite3RowQuery : public RowQuery<Row, Args...>, Sqlite3StatementBase
+    {
+    public:
+        using Parent = RowQuery<Row, Args...>;
+
+        Sqlite3RowQuery(sqlite3 *db, const char *sql) :
+            Sqlite3StatementBase(db, sql)
+        {}
+
+        Sqlite3RowQuery(sqlite3 *db, const Glib::ustring &sql) :
+            Sqlite3StatementBase(db, sql.c_str())
+        {}
+
+        virtual std::size_t visit(const typename Parent::ArgsTuple &args,
+                const typename Parent::Visitor &visitor) override
+        {
+            reset();
+            bind_tuple(args);
+            return visit_rows<Row>(visitor);
+        }
+
+        using Sqlite3StatementBase::get_sql;
     };
 public:
+    /**
+     * @filename:   If empty the default database in the user's data
+     *              directory is used. May be ":memory:" for testing.
+     */
+    Sqlite3Database(const std::string &filename = std::string()) :
+        filename_(filename)
+    {}
+
     ~Sqlite3Database();
 
     virtual void open() override;
@@ -220,6 +306,12 @@ public:
     virtual StatementPtr<id_t, id_t, id_t, id_t, id_t>
         get_insert_tuning_statement(const char *source) override;
 
+    /**
+     * statement args: orig_nw_id, ts_id
+     */
+    virtual StatementPtr<id_t, id_t>
+        get_delete_tuning_statement(const char *source) override;
+
     /**
      * statement args: orig_nw_id, nw_id, ts_id, service_id
      */
@@ -238,14 +330,21 @@ public:
     virtual StatementPtr<id_t, id_t, Glib::ustring>
         get_insert_service_name_statement(const char *source) override;
 
+    /**
+     * statement args: provider_id, provider_name
+     * The ids are assigned by the caller, see NameInterner.
+     */
+    virtual StatementPtr<id_t, Glib::ustring>
+    get_insert_provider_name_statement(const char *source) override;
+
     /**
      * statement args: provider_name
      */
     virtual StatementPtr<Glib::ustring>
-    get_insert_provider_name_statement(const char *source) override;
+    get_add_provider_name_statement(const char *source) override;
 
     /**
-     * statement args: orig_nw_id, service_id, provider_name
+     * statement args: orig_nw_id, service_id, provider_id
      */
     virtual StatementPtr<id_t, id_t, id_t>
     get_insert_service_provider_id_statement(const char *source) override;
@@ -338,6 +437,102 @@ public:
      */
     virtual QueryPtr<Vector<id_t>, id_t>
     get_original_network_id_for_service_id_query(const char *source) override;
+
+    /**
+     * statement args: orig_nw_id, ts_id, service_id, event_id, start,
+     * duration, flags, content, title, summary, description
+     */
+    virtual StatementPtr<id_t, id_t, id_t, id_t, id_t, id_t, id_t, id_t,
+            Glib::ustring, Glib::ustring, Glib::ustring>
+    get_insert_epg_event_statement(const char *source) override;
+
+    /**
+     * statement args: orig_nw_id, ts_id, service_id, start
+     */
+    virtual StatementPtr<id_t, id_t, id_t, id_t>
+    get_delete_epg_event_statement(const char *source) override;
+
+    /**
+     * statement args: time
+     */
+    virtual StatementPtr<id_t>
+    get_delete_old_epg_events_statement(const char *source) override;
+
+    virtual RowQueryPtr<EPGEventRow> get_epg_events_query(const char *source)
+        override;
+
+    virtual void run_transaction(const std::function<void()> &fn) override;
+
+    /// Staging tables are in an attached in-memory database
+    virtual std::string staging_source(const char *source) const override
+    {
+        return std::string(STAGING_SCHEMA) + '.' + source;
+    }
+
+    virtual void begin_staging(const char *source) override;
+
+    virtual void publish_staging(const char *source) override;
+
+    virtual void discard_staging() override;
+
+    /**
+     * The compile_sql_* methods and execute() are for ad hoc SQL, eg in tests
+     * and benchmarks. Like the other statements, they must only be used on the
+     * database thread.
+     */
+    template<typename... Args>
+    StatementPtr<Args...> compile_sql_statement(const std::string &sql)
+    {
+        return std::static_pointer_cast<Statement<Args...>>
+            (std::make_shared<Sqlite3Statement<Args...>>(sqlite3_, sql));
+    }
+
+    template<class Result, typename... Args>
+    QueryPtr<Result, Args...> compile_sql_query(const std::string &sql)
+    {
+        return std::static_pointer_cast<Query<Result, Args...>>
+            (std::make_shared<Sqlite3Query<Result, Args...>>(sqlite3_, sql));
+    }
+
+    template<class Row, typename... Args>
+    RowQueryPtr<Row, Args...> compile_sql_row_query(const std::string &sql)
+    {
+        return std::static_pointer_cast<RowQuery<Row, Args...>>
+            (std::make_shared<Sqlite3RowQuery<Row, Args...>>(sqlite3_, sql));
+    }
+
+    void execute(const Glib::ustring &sql);
+
+    /**
+     * Returns the detail column of EXPLAIN QUERY PLAN for query, which must
+     * have been created by this database, one element per step. This is for
+     * checking that queries use indexes.
+     */
+    template<class Result, typename... Args>
+    std::vector<std::string>
+    explain_query_plan(const QueryPtr<Result, Args...> &query)
+    {
+        return explain_query_plan(std::static_pointer_cast
+                <Sqlite3Query<Result, Args...>>(query)->get_sql());
+    }
+
+    template<typename... Args>
+    std::vector<std::string>
+    explain_query_plan(const StatementPtr<Args...> &statement)
+    {
+        return explain_query_plan(std::static_pointer_cast
+                <Sqlite3Statement<Args...>>(statement)->get_sql());
+    }
+
+    template<class Row, typename... Args>
+    std::vector<std::string>
+    explain_query_plan(const RowQueryPtr<Row, Args...> &query)
+    {
+        return explain_query_plan(std::static_pointer_cast
+                <Sqlite3RowQuery<Row, Args...>>(query)->get_sql());
+    }
+
+    std::vector<std::string> explain_query_plan(const char *sql);
 protected:
     virtual void ensure_network_info_table(const char *source) override;
 
@@ -360,6 +555,8 @@ protected:
 
     virtual void ensure_client_lcn_table(const char *source) override;
 
+    virtual void ensure_epg_table(const char *source) override;
+
     virtual void ensure_source_table() override;
 private:
     constexpr static auto NETWORK_INFO_TABLE = "network_info";
@@ -373,6 +570,18 @@ private:
     constexpr static auto CLIENT_LCN_TABLE = "client_lcns";
     constexpr static auto REGION_TABLE = "regions";
     constexpr static auto SOURCE_TABLE = "sources";
+    // Not in SOURCE_TABLES because it isn't replaced by a scan
+    constexpr static auto EPG_TABLE = "epg_events";
+
+    /// All the tables with a source prefix
+    constexpr static const char *SOURCE_TABLES[] = {
+        NETWORK_INFO_TABLE, TUNING_TABLE, TRANSPORT_SERVICES_TABLE,
+        SERVICE_ID_TABLE, SERVICE_NAME_TABLE, PROVIDER_NAME_TABLE,
+        SERVICE_PROVIDER_ID_TABLE, NETWORK_LCN_TABLE, CLIENT_LCN_TABLE,
+        REGION_TABLE
+    };
+
+    constexpr static auto STAGING_SCHEMA = "staging";
 
     template<typename... Args>
     StatementPtr<Args...> build_insert_statement(const char *source,
@@ -384,11 +593,16 @@ private:
                 (sqlite3_, build_insert_sql(source, table, keys, replace)));
     }
 
-    template<typename... Args>
-    StatementPtr<Args...> compile_sql_statement(const std::string &sql)
+    template<class Row, typename... Args>
+    RowQueryPtr<Row, Args...> build_row_query(const char *source,
+            const char *table, const std::initializer_list<const char *> &keys,
+            const char *where = nullptr,
+            const char *order_by = nullptr)
     {
-        return std::static_pointer_cast<Statement<Args...>>
-            (std::make_shared<Sqlite3Statement<Args...>>(sqlite3_, sql));
+        return std::static_pointer_cast<RowQuery<Row, Args...>>
+            (std::make_shared<Sqlite3RowQuery<Row, Args...>>
+                (sqlite3_,
+                 build_query_sql(source, table, keys, where, order_by)));
     }
 
     template<class Result, typename... Args>
@@ -403,15 +617,6 @@ private:
                  build_query_sql(source, table, keys, where, order_by)));
     }
 
-    template<class Result, typename... Args>
-    QueryPtr<Result, Args...> compile_sql_query(const std::string &sql)
-    {
-        return std::static_pointer_cast<Query<Result, Args...>>
-            (std::make_shared<Sqlite3Query<Result, Args...>>(sqlite3_, sql));
-    }
-
-    void execute(const Glib::ustring &sql);
-
     static std::string build_table_name(const char *source, const char *name)
     {
         return source ? (std::string(source) + '_' + name) : std::string(name);
@@ -431,11 +636,22 @@ private:
             const std::initializer_list<std::pair<const char *, const char *>>
                 &columns, const char *constraints = nullptr);
 
+    /// Returns: The table's column names, separated by commas
+    std::string column_list(const std::string &table);
+
+    /// Doesn't throw, because it's used while handling another exception
+    void rollback();
+
+    /// Also returns false if the table doesn't exist
+    bool column_exists(const std::string &table, const char *column);
+
     static Glib::ustring build_create_index_sql(const std::string &table_name,
             const std::string &index_name, const char *details,
             bool unique = false);
 
+    std::string filename_;
     sqlite3 *sqlite3_ = nullptr;
+    bool staging_attached_ = false;
 
     constexpr static auto INT_PRIM_KEY =
         "INTEGER PRIMARY KEY ON CONFLICT REPLACE";
@@ -0,0 +1,202 @@
+#pragma once
+
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+namespace logi
+{
+
+/**
+ * MPSCQueue:
+ * A bounded, lock-free queue which may be pushed to from any number of
+ * threads but must only be popped from one. Each cell carries a sequence
+ * number which tells producers and the consumer whose turn it is to use it
+ * (after Dmitry Vyukov's bounded MPMC queue).
+ * T should be cheap to move; Database uses raw pointers.
+ */
+template<class T> class MPSCQueue
+{
+public:
+    /// capacity is rounded up to a power of 2
+    MPSCQueue(std::size_t capacity = 1024)
+    {
+        std::size_t size = 2;
+        while (size < capacity)
+            size <<= 1;
+        mask_ = size - 1;
+        cells_.reset(new Cell[size]);
+        for (std::size_t n = 0; n < size; ++n)
+            cells_[n].seq.store(n, std::memory_order_relaxed);
+        enqueue_pos_.store(0, std::memory_order_relaxed);
+    }
+
+    MPSCQueue(const MPSCQueue &) = delete;
+    MPSCQueue(MPSCQueue &&) = delete;
+    MPSCQueue &operator=(const MPSCQueue &) = delete;
+    MPSCQueue &operator=(MPSCQueue &&) = delete;
+
+    /**
+     * push:
+     * May be called from any thread.
+     * Returns: false if the queue is full.
+     */
+    bool push(T item)
+    {
+        Cell *cell;
+        std::size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        while (true)
+        {
+            cell = &cells_[pos & mask_];
+            std::size_t seq = cell->seq.load(std::memory_order_acquire);
+            std::intptr_t dif = std::intptr_t(seq) - std::intptr_t(pos);
+            if (!dif)
+            {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+                            std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (dif < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = std::move(item);
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * pop:
+     * Must only be called from the consumer thread.
+     * Returns: false if the queue is empty.
+     */
+    bool pop(T &item)
+    {
+        Cell *cell = &cells_[dequeue_pos_ & mask_];
+        std::size_t seq = cell->seq.load(std::memory_order_acquire);
+        if (std::intptr_t(seq) - std::intptr_t(dequeue_pos_ + 1) < 0)
+            return false;
+        item = std::move(cell->data);
+        cell->seq.store(dequeue_pos_ + mask_ + 1, std::memory_order_release);
+        ++dequeue_pos_;
+        return true;
+    }
+
+    std::size_t capacity() const
+    {
+        return mask_ + 1;
+    }
+private:
+    struct Cell
+    {
+        std::atomic<std::size_t> seq;
+        T data;
+    };
+
+    std::unique_ptr<Cell[]> cells_;
+    std::size_t mask_;
+    // Keep the producers' and consumer's positions on separate cache lines
+    alignas(64) std::atomic<std::size_t> enqueue_pos_;
+    alignas(64) std::size_t dequeue_pos_ = 0;
+};
+
+/**
+ * OverflowMPSCQueue:
+ * An MPSCQueue which never refuses an item. When the ring is full, items go
+ * to a locked overflow list instead, and keep going there until the consumer
+ * has taken the list, so each producer's items stay in order. Producers
+ * therefore never have to wait for the consumer, which could deadlock when
+ * two threads are each other's consumers.
+ */
+template<class T> class OverflowMPSCQueue
+{
+public:
+    OverflowMPSCQueue(std::size_t capacity = 1024) : ring_(capacity)
+    {}
+
+    /// May be called from any thread
+    void push(T item)
+    {
+        if (!overflowing_.load(std::memory_order_acquire) &&
+                ring_.push(item))
+        {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        overflow_.push_back(std::move(item));
+        overflowing_.store(true, std::memory_order_release);
+        ++overflows_;
+    }
+
+    /**
+     * pop:
+     * Must only be called from the consumer thread.
+     * Returns: false if the queue is empty.
+     */
+    bool pop(T &item)
+    {
+        // Anything left from the last overflow is older than the ring's
+        // current contents
+        if (taken_.empty())
+        {
+            if (ring_.pop(item))
+                return true;
+            if (!overflowing_.load(std::memory_order_acquire))
+                return false;
+            std::lock_guard<std::mutex> lock(mutex_);
+            taken_.swap(overflow_);
+            overflowing_.store(false, std::memory_order_release);
+            if (taken_.empty())
+                return false;
+        }
+        item = std::move(taken_.front());
+        taken_.pop_front();
+        return true;
+    }
+
+    /// Returns: How many items have gone to the overflow list
+    std::uint64_t overflows() const
+    {
+        return overflows_.load();
+    }
+private:
+    MPSCQueue<T> ring_;
+    std::mutex mutex_;
+    std::deque<T> overflow_;
+    std::atomic<bool> overflowing_{false};
+    std::atomic<std::uint64_t> overflows_{0};
+    // Consumer only
+    std::deque<T> taken_;
+};
+
+}
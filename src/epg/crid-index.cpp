@@ -0,0 +1,250 @@
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <cstdio>
+
+#include "crid-index.h"
+
+#include "si/default-authority-descriptor.h"
+
+namespace logi
+{
+
+void CRIDIndex::set_default_authority(ServiceKey service,
+        std::string_view authority)
+{
+    authorities_[service] = authority;
+}
+
+void CRIDIndex::set_transport_authority(std::uint16_t orig_nw_id,
+        std::uint16_t ts_id, std::string_view authority)
+{
+    ts_authorities_[(std::uint64_t(orig_nw_id) << 16) | ts_id] = authority;
+}
+
+void CRIDIndex::process_sdt(const SDTSection &sec)
+{
+    auto onid = sec.original_network_id();
+    auto tsid = sec.transport_stream_id();
+    sec.for_each_service([this, onid, tsid](const SDTSectionServiceData &svc)
+    {
+        svc.for_each_descriptor([this, onid, tsid, &svc](const Descriptor &d)
+        {
+            if (d.tag() == Descriptor::DEFAULT_AUTHORITY)
+            {
+                set_default_authority((std::uint64_t(onid) << 32) |
+                        (std::uint64_t(tsid) << 16) | svc.service_id(),
+                        DefaultAuthorityDescriptor(d).authority());
+            }
+        });
+    });
+}
+
+void CRIDIndex::process_nit(const NITSection &sec)
+{
+    std::string_view network_authority;
+    bool has_network_authority = false;
+    sec.for_each_network_descriptor(
+            [&network_authority, &has_network_authority](const Descriptor &d)
+    {
+        if (d.tag() == Descriptor::DEFAULT_AUTHORITY)
+        {
+            network_authority = DefaultAuthorityDescriptor(d).authority();
+            has_network_authority = true;
+        }
+    });
+    sec.for_each_transport_stream([this, network_authority,
+            has_network_authority](const TSSectionData &ts)
+    {
+        auto authority = network_authority;
+        bool found = has_network_authority;
+        ts.for_each_transport_descriptor([&authority, &found]
+                (const Descriptor &d)
+        {
+            if (d.tag() == Descriptor::DEFAULT_AUTHORITY)
+            {
+                authority = DefaultAuthorityDescriptor(d).authority();
+                found = true;
+            }
+        });
+        if (found)
+        {
+            set_transport_authority(ts.original_network_id(),
+                    ts.transport_stream_id(), authority);
+        }
+    });
+}
+
+void CRIDIndex::add(ServiceKey service, std::uint16_t event_id,
+        std::uint32_t start, std::uint32_t duration,
+        std::string_view programme_crid,
+        const std::vector<std::string> &series_crids)
+{
+    auto key = event_key(service, event_id);
+    unindex(key);
+    if (programme_crid.empty() && series_crids.empty())
+        return;
+
+    Event ev { service, start, duration, event_id };
+    auto &crids = events_[key];
+    crids.start = start;
+    crids.programme = nullptr;
+    if (!programme_crid.empty())
+    {
+        resolve(service, programme_crid, crid_);
+        crids.programme = insert(programmes_, crid_, ev);
+    }
+    for (const auto &s: series_crids)
+    {
+        resolve(service, s, crid_);
+        // Guard against a broadcaster repeating a series CRID, which would
+        // list the event twice
+        if (std::find_if(crids.series.begin(), crids.series.end(),
+                    [this](const std::string *p) { return *p == crid_; }) ==
+                crids.series.end())
+        {
+            crids.series.push_back(insert(series_, crid_, ev));
+        }
+    }
+}
+
+void CRIDIndex::remove(ServiceKey service, std::uint16_t event_id,
+        std::uint32_t start)
+{
+    auto key = event_key(service, event_id);
+    auto it = events_.find(key);
+    if (it != events_.end() && it->second.start == start)
+        unindex(key);
+}
+
+void CRIDIndex::clear()
+{
+    events_.clear();
+    programmes_.clear();
+    series_.clear();
+}
+
+const CRIDIndex::EventCRIDs *CRIDIndex::find(ServiceKey service,
+        std::uint16_t event_id) const
+{
+    auto it = events_.find(event_key(service, event_id));
+    return it == events_.end() ? nullptr : &it->second;
+}
+
+std::string CRIDIndex::resolve(ServiceKey service, std::string_view crid)
+    const
+{
+    std::string out;
+    resolve(service, crid, out);
+    return out;
+}
+
+const CRIDIndex::Events &CRIDIndex::find(const CRIDMap &map,
+        std::string_view crid)
+{
+    static const Events none;
+    auto it = map.find(std::string(crid));
+    return it == map.end() ? none : it->second;
+}
+
+void CRIDIndex::resolve(ServiceKey service, std::string_view crid,
+        std::string &out) const
+{
+    constexpr std::string_view scheme = "crid://";
+    out.clear();
+    if (crid.size() < scheme.size() ||
+            !std::equal(scheme.begin(), scheme.end(), crid.begin(),
+                [](char a, char b) { return a == (b | 0x20); }))
+    {
+        out = scheme;
+        auto it = authorities_.find(service);
+        auto ts_it = ts_authorities_.find(service >> 16);
+        if (it != authorities_.end())
+        {
+            out += it->second;
+        }
+        else if (ts_it != ts_authorities_.end())
+        {
+            out += ts_it->second;
+        }
+        else
+        {
+            char buf[24];
+            snprintf(buf, sizeof(buf), "%04x.%04x.%04x.dvb",
+                    unsigned(service >> 32) & 0xffff,
+                    unsigned(service >> 16) & 0xffff,
+                    unsigned(service) & 0xffff);
+            out += buf;
+        }
+        if (crid.empty() || crid[0] != '/')
+            out += '/';
+    }
+    out += crid;
+    for (auto &c: out)
+    {
+        if (c >= 'A' && c <= 'Z')
+            c |= 0x20;
+    }
+}
+
+const std::string *CRIDIndex::insert(CRIDMap &map, const std::string &crid,
+        const Event &ev)
+{
+    auto it = map.find(crid);
+    if (it == map.end())
+        it = map.emplace(crid, Events()).first;
+    auto &evs = it->second;
+    // Usually added in order
+    auto pos = std::partition_point(evs.begin(), evs.end(),
+            [&ev](const Event &e) { return e.start <= ev.start; });
+    evs.insert(pos, ev);
+    return &it->first;
+}
+
+void CRIDIndex::erase(CRIDMap &map, const std::string *crid,
+        ServiceKey service, std::uint16_t event_id)
+{
+    auto it = map.find(*crid);
+    if (it == map.end())
+        return;
+    auto &evs = it->second;
+    evs.erase(std::remove_if(evs.begin(), evs.end(),
+                [service, event_id](const Event &e)
+                {
+                    return e.service == service && e.event_id == event_id;
+                }), evs.end());
+    if (evs.empty())
+        map.erase(it);
+}
+
+void CRIDIndex::unindex(std::uint64_t key)
+{
+    auto it = events_.find(key);
+    if (it == events_.end())
+        return;
+    auto service = key >> 16;
+    std::uint16_t event_id = key & 0xffff;
+    if (it->second.programme)
+        erase(programmes_, it->second.programme, service, event_id);
+    for (auto s: it->second.series)
+        erase(series_, s, service, event_id);
+    events_.erase(it);
+}
+
+}
@@ -0,0 +1,207 @@
+#pragma once
+
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "si/nit-section.h"
+#include "si/sdt-section.h"
+
+namespace logi
+{
+
+/**
+ * CRIDIndex:
+ * Maps TV-Anytime programme and series CRIDs to the events carrying them, so
+ * that a recording scheduler can find every showing of a programme, or every
+ * episode of a series, without scanning the EPG. Updated one event at a time
+ * as EPGStore adds, replaces and expires them.
+ * Relative CRIDs are resolved against the service's default authority,
+ * taken from the SDT, or its transport stream's, taken from the NIT, so
+ * that services which share an authority share CRIDs. Failing both, each
+ * service has its own pseudo-authority, because broadcasters sharing an
+ * original network don't share CRIDs. CRIDs are case-insensitive, so
+ * they're folded to lower case.
+ */
+class CRIDIndex
+{
+public:
+    using ServiceKey = std::uint64_t;
+
+    struct Event
+    {
+        ServiceKey service;
+        std::uint32_t start;
+        std::uint32_t duration;
+        std::uint16_t event_id;
+
+        std::uint32_t end() const
+        {
+            return start + duration;
+        }
+    };
+
+    /// In order of start time
+    using Events = std::vector<Event>;
+
+    /// The resolved CRIDs of an indexed event
+    struct EventCRIDs
+    {
+        std::uint32_t start;
+        const std::string *programme;   // nullptr if none
+        std::vector<const std::string *> series;
+    };
+
+    /// The parts of a split event are on the same service, with gaps of
+    /// less than this between them
+    constexpr static std::uint32_t SPLIT_GAP = 3 * 3600;
+private:
+    // Keys aren't moved by rehashing, so EventCRIDs can point to them
+    using CRIDMap = std::unordered_map<std::string, Events>;
+
+    CRIDMap programmes_;
+    CRIDMap series_;
+    std::unordered_map<std::uint64_t, EventCRIDs> events_;
+    std::unordered_map<ServiceKey, std::string> authorities_;
+    // Keyed by service >> 16, ie original_network_id and transport_stream_id
+    std::unordered_map<std::uint64_t, std::string> ts_authorities_;
+    std::string crid_;
+public:
+    CRIDIndex() = default;
+
+    CRIDIndex(const CRIDIndex &) = delete;
+    CRIDIndex &operator=(const CRIDIndex &) = delete;
+
+    /// Only affects events added afterwards
+    void set_default_authority(ServiceKey service,
+            std::string_view authority);
+
+    /// Applies to the transport stream's services without their own
+    void set_transport_authority(std::uint16_t orig_nw_id,
+            std::uint16_t ts_id, std::string_view authority);
+
+    /// Sets default authorities from an SDT's default_authority_descriptors
+    void process_sdt(const SDTSection &sec);
+
+    /// Sets transport streams' authorities from a NIT's transport stream
+    /// loop or, for those without one, its network loop
+    void process_nit(const NITSection &sec);
+
+    /**
+     * add:
+     * Adds or replaces the event with the same service and event_id. An
+     * event without any CRIDs is removed.
+     */
+    void add(ServiceKey service, std::uint16_t event_id, std::uint32_t start,
+            std::uint32_t duration, std::string_view programme_crid,
+            const std::vector<std::string> &series_crids);
+
+    /// Does nothing if the indexed event has a different start time, because
+    /// event_ids can be reused after a while
+    void remove(ServiceKey service, std::uint16_t event_id,
+            std::uint32_t start);
+
+    void clear();
+
+    /// Returns: Showings of a programme, including repeats and the parts of
+    ///          split events. @crid must be resolved.
+    const Events &programme(std::string_view crid) const
+    {
+        return find(programmes_, crid);
+    }
+
+    /// Returns: Events in a series. @crid must be resolved.
+    const Events &series(std::string_view crid) const
+    {
+        return find(series_, crid);
+    }
+
+    /// Calls @f(const Event &) for each event in a series that ends after @t
+    template<class F> void for_each_upcoming(std::string_view series_crid,
+            std::uint32_t t, F f) const
+    {
+        const auto &evs = series(series_crid);
+        auto it = std::partition_point(evs.begin(), evs.end(),
+                [t](const Event &ev) { return ev.start < t; });
+        // A long event may still be on
+        if (it != evs.begin() && std::prev(it)->end() > t)
+            f(*std::prev(it));
+        for (; it != evs.end(); ++it)
+            f(*it);
+    }
+
+    /// Returns: nullptr if the event isn't indexed
+    const EventCRIDs *find(ServiceKey service, std::uint16_t event_id) const;
+
+    /**
+     * resolve:
+     * Makes @crid absolute and folds it to lower case, as stored in the
+     * index.
+     */
+    std::string resolve(ServiceKey service, std::string_view crid) const;
+
+    /// Whether @b is a later part of the same split event as @a
+    static bool is_split(const Event &a, const Event &b)
+    {
+        return a.service == b.service && b.start >= a.end() &&
+            b.start - a.end() < SPLIT_GAP;
+    }
+
+    std::size_t num_events() const
+    {
+        return events_.size();
+    }
+
+    std::size_t num_programmes() const
+    {
+        return programmes_.size();
+    }
+
+    std::size_t num_series() const
+    {
+        return series_.size();
+    }
+private:
+    static std::uint64_t event_key(ServiceKey service, std::uint16_t event_id)
+    {
+        return (service << 16) | event_id;
+    }
+
+    static const Events &find(const CRIDMap &map, std::string_view crid);
+
+    void resolve(ServiceKey service, std::string_view crid, std::string &out)
+        const;
+
+    const std::string *insert(CRIDMap &map, const std::string &crid,
+            const Event &ev);
+
+    void erase(CRIDMap &map, const std::string *crid, ServiceKey service,
+            std::uint16_t event_id);
+
+    void unindex(std::uint64_t key);
+};
+
+}
@@ -0,0 +1,358 @@
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <thread>
+
+#include <glib.h>
+
+#include <glibmm/main.h>
+
+#include <linux/dvb/dmx.h>
+
+#include "eit-harvester.h"
+#include "eit-parser-pool.h"
+
+#include "si/content-descriptor.h"
+#include "si/content-identifier-descriptor.h"
+#include "si/extended-event-descriptor.h"
+#include "si/parental-rating-descriptor.h"
+#include "si/short-event-descriptor.h"
+
+namespace logi
+{
+
+void EITEvent::clear()
+{
+    min_age = 0;
+    language = 0;
+    title.clear();
+    summary.clear();
+    description.clear();
+    items.clear();
+    content.clear();
+    programme_crid.clear();
+    series_crids.clear();
+}
+
+EITHarvester::EITHarvester(std::shared_ptr<Receiver> rcv) : rcv_(rcv)
+{}
+
+EITHarvester::~EITHarvester()
+{
+    stop();
+    reap_conn_.disconnect();
+}
+
+void EITHarvester::use_parser_pool(unsigned num_workers)
+{
+    if (!num_workers && std::thread::hardware_concurrency() <= 1)
+    {
+        pool_.reset();
+        return;
+    }
+    pool_.reset(new EITParserPool(num_workers));
+    pool_->batch_signal().connect([this](EITParserPool::Batch &batch)
+    {
+        for (auto &res: batch)
+        {
+            stats_.events += res.events.size();
+            events_signal_.emit(*res.section, res.events);
+        }
+        if (complete_pending_ && !pool_->pending())
+        {
+            complete_pending_ = false;
+            complete_signal_.emit();
+        }
+    });
+}
+
+void EITHarvester::start(bool freesat)
+{
+    stop();
+    start_filter(Section::EIT_PID);
+    if (freesat)
+    {
+        start_filter(FREESAT_SCHEDULE_PID);
+        start_filter(FREESAT_PF_PID);
+    }
+}
+
+void EITHarvester::stop()
+{
+    // stop() may be called from a filter's callback, via one of our
+    // signals, so the filter can't be destroyed until that has returned
+    for (auto &f: filters_)
+    {
+        f->stop();
+        stopped_filters_.push_back(std::move(f));
+    }
+    filters_.clear();
+    if (!stopped_filters_.empty() && !reap_conn_.connected())
+    {
+        reap_conn_ = Glib::signal_idle().connect([this]()
+        {
+            stopped_filters_.clear();
+            return false;
+        });
+    }
+}
+
+void EITHarvester::reset()
+{
+    tracker_.reset();
+    segments_.clear();
+    stats_ = Stats();
+    complete_pending_ = false;
+}
+
+void EITHarvester::start_filter(std::uint16_t pid)
+{
+    // table_ids 0x40-0x7F, then we discard anything that isn't EIT
+    struct dmx_sct_filter_params params;
+    logi_priv::SectionFilterBase::get_params(params, pid, 0x40, 0, 0, 0xc0, 0);
+    filters_.emplace_back(new SectionFilter<EITSection, EITHarvester>
+            (rcv_, &params, *this, &EITHarvester::filter_cb, BUFFER_SIZE));
+    // Sections are kept until a worker has decoded them, so recycle them
+    if (pool_)
+    {
+        filters_.back()->set_allocator([this]()
+        {
+            return pool_->acquire();
+        });
+    }
+}
+
+void EITHarvester::filter_cb(int reason, std::shared_ptr<EITSection> section)
+{
+    if (reason == EOVERFLOW)
+    {
+        // The kernel has discarded some data, but the filter is still
+        // running and the carousel will repeat it
+        ++stats_.overflows;
+        g_warning("EIT filter overflowed");
+    }
+    else if (reason)
+    {
+        g_critical("EIT filter error: %s", std::strerror(reason));
+    }
+    else if (section)
+    {
+        process_section(section);
+    }
+}
+
+bool EITHarvester::track(const EITSection &sec)
+{
+    ++stats_.sections;
+    switch (tracker_.track(sec))
+    {
+        case TableTracker::OK:
+        case TableTracker::COMPLETE:
+            ++stats_.new_sections;
+            return true;
+        default:
+            return false;
+    }
+}
+
+void EITHarvester::process_section(const EITSection &sec)
+{
+    bool was_complete = tracker_.complete();
+    if (!track(sec))
+        return;
+
+    if (!tracker_.payload_changed(sec))
+    {
+        ++stats_.unchanged_sections;
+    }
+    else if (!events_signal_.empty())
+    {
+        events_.clear();
+        sec.for_each_event([this, &sec](const EITSectionEventData &ev)
+        {
+            events_.emplace_back();
+            auto &event = events_.back();
+            event.original_network_id = sec.original_network_id();
+            event.transport_stream_id = sec.transport_stream_id();
+            event.service_id = sec.service_id();
+            decode_event(ev, event);
+        });
+        stats_.events += events_.size();
+        events_signal_.emit(sec, events_);
+    }
+
+    check_segment(sec);
+    check_complete(was_complete);
+}
+
+void EITHarvester::process_section(std::shared_ptr<EITSection> sec)
+{
+    if (!pool_)
+    {
+        process_section(*sec);
+        return;
+    }
+
+    bool was_complete = tracker_.complete();
+    if (!track(*sec))
+        return;
+    if (!tracker_.payload_changed(*sec))
+        ++stats_.unchanged_sections;
+    else if (!events_signal_.empty())
+        pool_->submit(sec);
+    // Only needs the event headers, so doesn't have to wait for the pool
+    check_segment(*sec);
+    check_complete(was_complete);
+}
+
+void EITHarvester::check_segment(const EITSection &sec)
+{
+    if (sec.is_present_following() || segment_signal_.empty())
+        return;
+
+    unsigned seg = sec.section_number() / 8;
+    auto key = (std::uint64_t(sec.original_network_id()) << 48) |
+        (std::uint64_t(sec.transport_stream_id()) << 32) |
+        (std::uint64_t(sec.service_id()) << 16) |
+        (unsigned(sec.table_id()) << 8) | seg;
+    auto &se = segments_[key];
+    if (se.version_number != sec.version_number())
+    {
+        se = SegmentEvents();
+        se.version_number = sec.version_number();
+    }
+    sec.for_each_event([&se](const EITSectionEventData &ev)
+    {
+        se.event_ids.push_back(ev.event_id());
+        se.last_start = std::max(se.last_start, ev.start_time());
+    });
+
+    if (!tracker_.segment_complete(sec.original_network_id(),
+                sec.transport_stream_id(), sec.service_id(), sec.table_id(),
+                seg))
+    {
+        return;
+    }
+
+    // Each table covers 4 days from midnight, so the latest event tells us
+    // which day the segment is on. Don't trust a broadcaster whose events
+    // aren't in the right segment.
+    std::time_t start = se.last_start / SEGMENT_DURATION * SEGMENT_DURATION;
+    unsigned index = (sec.table_id() & 0x0f) * 32 + seg;
+    if (!se.event_ids.empty() && start &&
+            (start / SEGMENT_DURATION) % 8 == index % 8)
+    {
+        segment_.original_network_id = sec.original_network_id();
+        segment_.transport_stream_id = sec.transport_stream_id();
+        segment_.service_id = sec.service_id();
+        segment_.table_id = sec.table_id();
+        segment_.segment = seg;
+        segment_.start = start;
+        segment_.end = start + SEGMENT_DURATION;
+        segment_.event_ids.swap(se.event_ids);
+        std::sort(segment_.event_ids.begin(), segment_.event_ids.end());
+        ++stats_.segments;
+        segment_signal_.emit(segment_);
+    }
+    segments_.erase(key);
+}
+
+void EITHarvester::check_complete(bool was_complete)
+{
+    if (was_complete || !tracker_.complete())
+        return;
+    g_debug("EIT complete for %u service groups", tracker_.size());
+    // Let the pool deliver the last events first
+    if (pool_ && pool_->pending())
+        complete_pending_ = true;
+    else
+        complete_signal_.emit();
+}
+
+void EITHarvester::decode_event(const EITSectionEventData &ev,
+        EITEvent &event)
+{
+    event.clear();
+    event.event_id = ev.event_id();
+    event.start = ev.start_time();
+    event.duration = ev.duration();
+    event.running_status = ev.running_status();
+    event.free_CA_mode = ev.free_CA_mode();
+
+    ev.for_each_descriptor([&event](const Descriptor &desc)
+    {
+        switch (desc.tag())
+        {
+            case Descriptor::SHORT_EVENT:
+                // Only use the first language
+                if (!event.language)
+                {
+                    ShortEventDescriptor sed(desc);
+                    event.language = sed.language_code();
+                    event.title = sed.event_name();
+                    event.summary = sed.text();
+                }
+                break;
+            case Descriptor::EXTENDED_EVENT:
+            {
+                ExtendedEventDescriptor eed(desc);
+                eed.for_each_item([&event](Glib::ustring &&d,
+                            Glib::ustring &&i)
+                {
+                    event.items.emplace_back(std::move(d), std::move(i));
+                });
+                event.description += eed.text();
+                break;
+            }
+            case Descriptor::CONTENT:
+                ContentDescriptor(desc).for_each_content(
+                        [&event](std::uint8_t nibbles, std::uint8_t)
+                {
+                    event.content.push_back(nibbles);
+                });
+                break;
+            case Descriptor::CONTENT_IDENTIFIER:
+                ContentIdentifierDescriptor(desc).for_each_crid(
+                        [&event](auto type, std::string_view crid)
+                {
+                    if (type == ContentIdentifierDescriptor::PROGRAMME)
+                        event.programme_crid = crid;
+                    else if (type == ContentIdentifierDescriptor::SERIES)
+                        event.series_crids.emplace_back(crid);
+                });
+                break;
+            case Descriptor::PARENTAL_RATING:
+                ParentalRatingDescriptor(desc).for_each_rating(
+                        [&event](std::uint32_t, std::uint8_t rating)
+                {
+                    if (!event.min_age)
+                    {
+                        event.min_age =
+                            ParentalRatingDescriptor::min_age(rating);
+                    }
+                });
+                break;
+        }
+    });
+}
+
+}
@@ -0,0 +1,259 @@
+#pragma once
+
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <glibmm/ustring.h>
+#include <sigc++/sigc++.h>
+
+#include "receiver.h"
+#include "section-filter.h"
+#include "si/decode-string.h"
+#include "si/eit-section.h"
+#include "si/eit-tracker.h"
+
+namespace logi
+{
+
+class EITParserPool;
+
+/**
+ * EITEvent:
+ * An event decoded from an EIT section's event loop.
+ */
+struct EITEvent
+{
+    std::uint16_t original_network_id;
+    std::uint16_t transport_stream_id;
+    std::uint16_t service_id;
+    std::uint16_t event_id;
+    std::time_t start;              // Seconds since Unix epoch, UTC
+    std::uint32_t duration;         // Seconds
+    std::uint8_t running_status;
+    bool free_CA_mode;
+    std::uint8_t min_age;           // From the first parental rating, 0 if none
+    std::uint32_t language;         // ISO 639-2 code of short_event, packed
+    DecodedString title;            // Shared with DecodeCache
+    DecodedString summary;          // short_event text
+    Glib::ustring description;      // extended_event texts concatenated
+    std::vector<std::pair<Glib::ustring, Glib::ustring>> items;
+    std::vector<std::uint8_t> content;  // Nibbles from content descriptors
+    std::string programme_crid;     // As broadcast, usually relative
+    std::vector<std::string> series_crids;
+
+    void clear();
+};
+
+/**
+ * EITSegment:
+ * The event_ids listed by one segment of a schedule sub-table's current
+ * version, so that events which have been withdrawn can be removed.
+ */
+struct EITSegment
+{
+    std::uint16_t original_network_id;
+    std::uint16_t transport_stream_id;
+    std::uint16_t service_id;
+    std::uint8_t table_id;
+    std::uint8_t segment;           // 0-31 within the table
+    std::time_t start;              // The segment's 3 hour window
+    std::time_t end;
+    std::vector<std::uint16_t> event_ids;   // Sorted
+};
+
+/**
+ * EITHarvester:
+ * Collects EIT p/f and schedule sections from the current multiplex and
+ * decodes the new ones into EITEvents. Sections are only decoded if their
+ * version/section number hasn't been seen before, so a full schedule
+ * carousel costs little more than reading it once it has been collected.
+ * When a sub-table's version changes, sections whose events are the same as
+ * in the previous version aren't decoded either, so only the segments that
+ * have actually changed reach the EPG.
+ */
+class EITHarvester
+{
+public:
+    constexpr static std::uint16_t FREESAT_SCHEDULE_PID = 3842;
+    constexpr static std::uint16_t FREESAT_PF_PID = 3843;
+
+    /// Several seconds' worth of a busy EIT PID, so that the demux doesn't
+    /// overflow while the main loop is busy elsewhere
+    constexpr static unsigned BUFFER_SIZE = 1024 * 1024;
+
+    struct Stats
+    {
+        unsigned long sections = 0;
+        unsigned long new_sections = 0;
+        unsigned long unchanged_sections = 0;   // New version, same events
+        unsigned long events = 0;
+        unsigned long segments = 0;
+        unsigned long overflows = 0;
+    };
+
+    /**
+     * EventsSignal:
+     * Raised for each new section with the events it contains. The vector is
+     * reused, so handlers must copy anything they want to keep.
+     */
+    using EventsSignal = sigc::signal<void, const EITSection &,
+          const std::vector<EITEvent> &>;
+
+    /**
+     * SegmentSignal:
+     * Raised when every section of a schedule segment's current version has
+     * been received. Segments with no events are ignored, because their time
+     * window can't be checked against the events.
+     */
+    using SegmentSignal = sigc::signal<void, const EITSegment &>;
+
+    /// Schedule segments are 3 hours each
+    constexpr static unsigned SEGMENT_DURATION = 3 * 3600;
+private:
+    struct SegmentEvents
+    {
+        std::int8_t version_number = -1;
+        std::time_t last_start = 0;
+        std::vector<std::uint16_t> event_ids;
+    };
+
+    using FilterPtr = std::unique_ptr<SectionFilter<EITSection, EITHarvester>>;
+
+    std::shared_ptr<Receiver> rcv_;
+    std::vector<FilterPtr> filters_;
+    // Stopped filters wait for an idle callback to destroy them
+    std::vector<FilterPtr> stopped_filters_;
+    sigc::connection reap_conn_;
+    EITTracker tracker_;
+    Stats stats_;
+    std::vector<EITEvent> events_;
+    EventsSignal events_signal_;
+    std::unordered_map<std::uint64_t, SegmentEvents> segments_;
+    EITSegment segment_;
+    SegmentSignal segment_signal_;
+    sigc::signal<void> complete_signal_;
+    std::unique_ptr<EITParserPool> pool_;
+    // Complete, but waiting for the pool to deliver the last events
+    bool complete_pending_ = false;
+public:
+    EITHarvester(std::shared_ptr<Receiver> rcv);
+
+    ~EITHarvester();
+
+    EITHarvester(const EITHarvester &) = delete;
+    EITHarvester(EITHarvester &&) = delete;
+    EITHarvester &operator=(const EITHarvester &) = delete;
+    EITHarvester &operator=(EITHarvester &&) = delete;
+
+    /**
+     * start:
+     * Starts filtering the standard EIT PID and, if @freesat is true,
+     * Freesat's private EIT PIDs. The receiver must already be tuned.
+     */
+    void start(bool freesat = false);
+
+    /// Stops the filters but keeps track of what has been received
+    void stop();
+
+    /// Forgets which sections have been received
+    void reset();
+
+    /**
+     * use_parser_pool:
+     * Decodes new sections on @num_workers threads instead of the main
+     * thread. events_signal() is still raised on the main thread, and in
+     * order for each service. Call before start(). Not used by default.
+     * @num_workers: 0 for one per CPU, in which case sections are still
+     *               decoded on the main thread if there's only one CPU,
+     *               because handing them over only adds overhead.
+     */
+    void use_parser_pool(unsigned num_workers = 0);
+
+    /// Returns: nullptr unless use_parser_pool() has started a pool
+    EITParserPool *parser_pool()
+    {
+        return pool_.get();
+    }
+
+    /**
+     * process_section:
+     * Called for each section received. Public so that sections can be fed
+     * from other sources. This version always decodes on the calling thread.
+     */
+    void process_section(const EITSection &sec);
+
+    /// As above, but uses the parser pool if there is one
+    void process_section(std::shared_ptr<EITSection> sec);
+
+    EventsSignal &events_signal()
+    {
+        return events_signal_;
+    }
+
+    SegmentSignal &segment_signal()
+    {
+        return segment_signal_;
+    }
+
+    /**
+     * complete_signal:
+     * Raised when every service seen so far has a complete set of p/f and
+     * schedule tables. Schedules are interleaved, so by the time the first
+     * one is complete every service should have been seen.
+     */
+    sigc::signal<void> &complete_signal()
+    {
+        return complete_signal_;
+    }
+
+    const EITTracker &tracker() const
+    {
+        return tracker_;
+    }
+
+    const Stats &stats() const
+    {
+        return stats_;
+    }
+
+    /// Fills in @event's fields except for the service ids
+    static void decode_event(const EITSectionEventData &ev, EITEvent &event);
+private:
+    void start_filter(std::uint16_t pid);
+
+    void filter_cb(int reason, std::shared_ptr<EITSection> section);
+
+    /// Returns: true if sec is new
+    bool track(const EITSection &sec);
+
+    /// Collects the event_ids of a new schedule section
+    void check_segment(const EITSection &sec);
+
+    void check_complete(bool was_complete);
+};
+
+}
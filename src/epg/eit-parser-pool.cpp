@@ -0,0 +1,295 @@
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include <glib.h>
+
+#include "eit-parser-pool.h"
+
+namespace logi
+{
+
+EITParserPool::EITParserPool(unsigned num_workers) :
+    lanes_(new Lane[NUM_LANES])
+{
+    if (!num_workers)
+        num_workers = std::thread::hardware_concurrency();
+    if (!num_workers)
+        num_workers = 1;
+
+    result_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (result_fd_ == -1)
+    {
+        throw std::system_error(errno, std::system_category(),
+                "Unable to create EIT parser eventfd");
+    }
+    result_conn_ = Glib::signal_io().connect(
+            sigc::mem_fun(*this, &EITParserPool::result_io_callback),
+            result_fd_, Glib::IO_IN);
+
+    for (unsigned w = 0; w < num_workers; ++w)
+        workers_.emplace_back(new Worker());
+    for (unsigned w = 0; w < num_workers; ++w)
+        workers_[w]->thread = std::thread([this, w]() { worker_main(w); });
+}
+
+EITParserPool::~EITParserPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+        stop_ = true;
+    }
+    idle_cond_.notify_all();
+    for (auto &w: workers_)
+    {
+        if (w->thread.joinable())
+            w->thread.join();
+    }
+    result_conn_.disconnect();
+    Batch *batch;
+    while (result_queue_.pop(batch))
+        delete batch;
+    if (result_fd_ != -1)
+        ::close(result_fd_);
+}
+
+std::shared_ptr<EITSection> EITParserPool::acquire()
+{
+    if (free_sections_.empty())
+        return std::make_shared<EITSection>();
+    auto sec = std::move(free_sections_.back());
+    free_sections_.pop_back();
+    return sec;
+}
+
+unsigned EITParserPool::lane_for(const EITSection &sec)
+{
+    std::uint32_t h = (std::uint32_t(sec.original_network_id()) * 31 +
+            sec.transport_stream_id()) * 31 + sec.service_id();
+    h ^= h >> 16;
+    h *= 0x45d9f3b;
+    h ^= h >> 16;
+    return h % NUM_LANES;
+}
+
+void EITParserPool::submit(std::shared_ptr<EITSection> sec)
+{
+    unsigned lane = lane_for(*sec);
+    auto &l = lanes_[lane];
+    bool newly_ready;
+    {
+        std::lock_guard<std::mutex> lock(l.mutex);
+        l.sections.push_back(std::move(sec));
+        newly_ready = !l.scheduled;
+        l.scheduled = true;
+    }
+    ++pending_;
+    ++stats_.sections;
+    if (newly_ready)
+        schedule(lane, lane % workers_.size());
+}
+
+void EITParserPool::schedule(unsigned lane, unsigned w)
+{
+    {
+        std::lock_guard<std::mutex> lock(workers_[w]->mutex);
+        workers_[w]->lanes.push_back(lane);
+        ++ready_lanes_;
+    }
+    // Taking the mutex means a worker can't miss the notification between
+    // checking ready_lanes_ and waiting
+    {
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+    }
+    idle_cond_.notify_one();
+}
+
+bool EITParserPool::next_lane(unsigned w, unsigned &lane)
+{
+    {
+        auto &own = *workers_[w];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (own.lanes.size())
+        {
+            lane = own.lanes.front();
+            own.lanes.pop_front();
+            --ready_lanes_;
+            return true;
+        }
+    }
+    // Steal from the back of another worker's deque
+    for (unsigned n = 1; n < workers_.size(); ++n)
+    {
+        auto &other = *workers_[(w + n) % workers_.size()];
+        std::lock_guard<std::mutex> lock(other.mutex);
+        if (other.lanes.size())
+        {
+            lane = other.lanes.back();
+            other.lanes.pop_back();
+            --ready_lanes_;
+            ++steals_;
+            return true;
+        }
+    }
+    return false;
+}
+
+void EITParserPool::worker_main(unsigned w)
+{
+    while (true)
+    {
+        unsigned lane;
+        if (next_lane(w, lane))
+        {
+            process_lane(w, lane);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(idle_mutex_);
+        idle_cond_.wait(lock, [this]() { return stop_ || ready_lanes_; });
+        if (stop_)
+            break;
+    }
+}
+
+void EITParserPool::process_lane(unsigned w, unsigned lane)
+{
+    auto &l = lanes_[lane];
+    auto batch = new Batch();
+    {
+        std::lock_guard<std::mutex> lock(l.mutex);
+        while (l.sections.size() && batch->size() < MAX_BATCH)
+        {
+            batch->emplace_back();
+            batch->back().section = std::move(l.sections.front());
+            l.sections.pop_front();
+        }
+    }
+
+    for (auto &res: *batch)
+    {
+        const auto &sec = *res.section;
+        sec.for_each_event([&res, &sec](const EITSectionEventData &ev)
+        {
+            res.events.emplace_back();
+            auto &event = res.events.back();
+            event.original_network_id = sec.original_network_id();
+            event.transport_stream_id = sec.transport_stream_id();
+            event.service_id = sec.service_id();
+            EITHarvester::decode_event(ev, event);
+        });
+    }
+
+    // The batch must be queued before anyone else can take the lane, or a
+    // later batch of the same services could overtake it
+    queue_result(batch);
+
+    bool more;
+    {
+        std::lock_guard<std::mutex> lock(l.mutex);
+        more = l.sections.size();
+        if (!more)
+            l.scheduled = false;
+    }
+    if (more)
+        schedule(lane, w);
+}
+
+void EITParserPool::queue_result(Batch *batch)
+{
+    while (!result_queue_.push(batch))
+    {
+        wake();
+        std::this_thread::yield();
+    }
+    wake();
+}
+
+void EITParserPool::wake()
+{
+    if (result_wake_pending_.exchange(true))
+        return;
+    std::uint64_t n = 1;
+    if (::write(result_fd_, &n, sizeof(n)) < 0)
+    {
+        result_wake_pending_ = false;
+        g_critical("Unable to write to EIT parser eventfd: %s",
+                std::strerror(errno));
+    }
+}
+
+bool EITParserPool::result_io_callback(Glib::IOCondition)
+{
+    dispatch_results();
+    return true;
+}
+
+void EITParserPool::dispatch_results()
+{
+    std::uint64_t n;
+
+    // The eventfd is non-blocking so this can't stall the main loop
+    if (::read(result_fd_, &n, sizeof(n)) < 0 && errno != EAGAIN)
+    {
+        g_critical("Error reading EIT parser eventfd: %s",
+                std::strerror(errno));
+    }
+    result_wake_pending_ = false;
+    ++stats_.dispatches;
+
+    Batch *batch;
+    while (result_queue_.pop(batch))
+    {
+        ++stats_.batches;
+        pending_ -= batch->size();
+        batch_signal_.emit(*batch);
+        for (auto &res: *batch)
+        {
+            if (res.section.use_count() == 1 &&
+                    free_sections_.size() < MAX_FREE_SECTIONS)
+            {
+                free_sections_.push_back(std::move(res.section));
+            }
+        }
+        delete batch;
+    }
+}
+
+void EITParserPool::flush()
+{
+    while (pending_)
+    {
+        struct pollfd pfd = { result_fd_, POLLIN, 0 };
+        if (::poll(&pfd, 1, -1) < 0 && errno != EINTR)
+        {
+            g_critical("Error waiting for EIT parser: %s",
+                    std::strerror(errno));
+            return;
+        }
+        dispatch_results();
+    }
+}
+
+}
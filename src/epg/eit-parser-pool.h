@@ -0,0 +1,196 @@
+#pragma once
+
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <glibmm/main.h>
+#include <sigc++/sigc++.h>
+
+#include "db/mpsc-queue.h"
+#include "eit-harvester.h"
+
+namespace logi
+{
+
+/**
+ * EITParserPool:
+ * Decodes EIT sections into EITEvents on worker threads, so that string and
+ * Huffman decoding don't hold up the main loop. Services are partitioned
+ * into lanes, and a lane is only ever processed by one worker at a time, so
+ * each service's sections are decoded and delivered in the order they were
+ * submitted. Each worker has a deque of lanes with work to do; an idle
+ * worker steals lanes from the others. Results are passed back through a
+ * lock-free queue and an eventfd, like Database's, and delivered on the
+ * main thread in batches.
+ */
+class EITParserPool
+{
+public:
+    struct Result
+    {
+        std::shared_ptr<EITSection> section;
+        std::vector<EITEvent> events;
+    };
+
+    using Batch = std::vector<Result>;
+
+    /**
+     * BatchSignal:
+     * Raised on the main thread for each batch of decoded sections. The
+     * sections are recycled afterwards, so handlers must copy anything they
+     * want to keep.
+     */
+    using BatchSignal = sigc::signal<void, Batch &>;
+
+    /// Services are hashed into this many partitions
+    constexpr static unsigned NUM_LANES = 256;
+
+    /// Maximum number of sections a worker takes from a lane at a time
+    constexpr static unsigned MAX_BATCH = 32;
+
+    constexpr static std::size_t QUEUE_CAPACITY = 1024;
+
+    /// Number of spare section buffers kept for acquire()
+    constexpr static std::size_t MAX_FREE_SECTIONS = 1024;
+
+    struct Stats
+    {
+        unsigned long sections = 0;
+        unsigned long batches = 0;
+        unsigned long dispatches = 0;
+        unsigned long steals = 0;
+    };
+private:
+    struct Lane
+    {
+        std::mutex mutex;
+        std::deque<std::shared_ptr<EITSection>> sections;
+        // true while the lane is in a worker's deque or being processed
+        bool scheduled = false;
+    };
+
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<unsigned> lanes;
+        std::thread thread;
+    };
+
+    std::unique_ptr<Lane[]> lanes_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+
+    std::mutex idle_mutex_;
+    std::condition_variable idle_cond_;
+    std::atomic<unsigned> ready_lanes_{0};
+    std::atomic<bool> stop_{false};
+    std::atomic<unsigned long> steals_{0};
+
+    MPSCQueue<Batch *> result_queue_{QUEUE_CAPACITY};
+    int result_fd_ = -1;
+    std::atomic<bool> result_wake_pending_{false};
+    sigc::connection result_conn_;
+
+    // Main thread only from here
+    std::vector<std::shared_ptr<EITSection>> free_sections_;
+    std::size_t pending_ = 0;
+    Stats stats_;
+    BatchSignal batch_signal_;
+public:
+    /// @num_workers: 0 for one per CPU
+    EITParserPool(unsigned num_workers = 0);
+
+    ~EITParserPool();
+
+    EITParserPool(const EITParserPool &) = delete;
+    EITParserPool(EITParserPool &&) = delete;
+    EITParserPool &operator=(const EITParserPool &) = delete;
+    EITParserPool &operator=(EITParserPool &&) = delete;
+
+    /**
+     * acquire:
+     * Returns: A section whose buffer can be read into, recycled from an
+     *          earlier batch if possible. Suitable for
+     *          SectionFilter::set_allocator().
+     */
+    std::shared_ptr<EITSection> acquire();
+
+    /// Queues a section to be decoded
+    void submit(std::shared_ptr<EITSection> sec);
+
+    /**
+     * flush:
+     * Blocks until every section submitted so far has been delivered
+     * through batch_signal().
+     */
+    void flush();
+
+    /// Sections submitted but not yet delivered
+    std::size_t pending() const
+    {
+        return pending_;
+    }
+
+    unsigned num_workers() const
+    {
+        return workers_.size();
+    }
+
+    BatchSignal &batch_signal()
+    {
+        return batch_signal_;
+    }
+
+    Stats stats() const
+    {
+        auto st = stats_;
+        st.steals = steals_;
+        return st;
+    }
+private:
+    static unsigned lane_for(const EITSection &sec);
+
+    /// Puts a lane in worker w's deque and wakes a worker
+    void schedule(unsigned lane, unsigned w);
+
+    bool next_lane(unsigned w, unsigned &lane);
+
+    void worker_main(unsigned w);
+
+    void process_lane(unsigned w, unsigned lane);
+
+    /// Called on a worker thread
+    void queue_result(Batch *batch);
+
+    bool result_io_callback(Glib::IOCondition cond);
+
+    void dispatch_results();
+
+    void wake();
+};
+
+}
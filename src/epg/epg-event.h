@@ -0,0 +1,53 @@
+#pragma once
+
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <cstdint>
+
+#include "string-arena.h"
+
+namespace logi
+{
+
+/**
+ * EPGEvent:
+ * Compact form of an event for EPGStore; strings are refs into the store's
+ * arena, or into an EPGSnapshot's string table if they have
+ * EPGSnapshot::REF_FLAG set.
+ */
+struct EPGEvent
+{
+    std::uint32_t start;            // Seconds since Unix epoch, UTC
+    std::uint32_t duration;         // Seconds
+    StringArena::ref_t title;       // Interned
+    StringArena::ref_t summary;
+    StringArena::ref_t description;
+    std::uint16_t event_id;
+    std::uint8_t flags;             // running_status | free_CA_mode << 3
+    std::uint8_t min_age;
+    std::uint8_t content;           // First content descriptor's nibbles
+
+    std::uint32_t end() const
+    {
+        return start + duration;
+    }
+};
+
+}
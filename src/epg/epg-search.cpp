@@ -0,0 +1,277 @@
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <algorithm>
+
+#include "epg-search.h"
+
+namespace logi
+{
+
+void EPGSearchIndex::normalise(std::string_view s, std::string &out)
+{
+    out.assign(1, ' ');
+    for (char c: s)
+    {
+        auto u = std::uint8_t(c);
+        if (u >= 0x80 || (u >= '0' && u <= '9') || (u >= 'a' && u <= 'z'))
+            out += c;
+        else if (u >= 'A' && u <= 'Z')
+            out += char(u + 'a' - 'A');
+        else if (out.back() != ' ')
+            out += ' ';
+    }
+}
+
+void EPGSearchIndex::add(ServiceKey service, std::uint16_t event_id,
+        std::uint32_t start, std::string_view title, std::string_view summary)
+{
+    auto key = doc_key(service, event_id);
+    auto it = doc_index_.find(key);
+    if (it != doc_index_.end())
+        remove(service, event_id, docs_[it->second].start);
+
+    std::uint32_t d;
+    if (free_docs_.size())
+    {
+        d = free_docs_.back();
+        free_docs_.pop_back();
+    }
+    else
+    {
+        d = docs_.size();
+        docs_.emplace_back();
+    }
+    doc_index_.emplace(key, d);
+
+    Doc doc;
+    doc.service = service;
+    doc.start = start;
+    doc.event_id = event_id;
+    doc.strings[TITLE] = ref_string(title, d, doc.positions[TITLE]);
+    doc.strings[SUMMARY] = ref_string(summary, d, doc.positions[SUMMARY]);
+    docs_[d] = doc;
+}
+
+void EPGSearchIndex::remove(ServiceKey service, std::uint16_t event_id,
+        std::uint32_t start)
+{
+    auto it = doc_index_.find(doc_key(service, event_id));
+    if (it == doc_index_.end() || docs_[it->second].start != start)
+        return;
+    auto d = it->second;
+    doc_index_.erase(it);
+    const auto &doc = docs_[d];
+    for (unsigned f = 0; f < NUM_FIELDS; ++f)
+    {
+        if (doc.strings[f] != NO_STRING)
+            unref_string(doc.strings[f], doc.positions[f]);
+    }
+    free_docs_.push_back(d);
+
+    if (dead_strings_.size() > 1024 &&
+            dead_strings_.size() > string_index_.size() / 4)
+    {
+        purge();
+    }
+}
+
+void EPGSearchIndex::clear()
+{
+    strings_.clear();
+    string_index_.clear();
+    free_strings_.clear();
+    dead_strings_.clear();
+    postings_.clear();
+    docs_.clear();
+    free_docs_.clear();
+    doc_index_.clear();
+}
+
+std::uint32_t EPGSearchIndex::ref_string(std::string_view s,
+        std::uint32_t doc, std::uint32_t &position)
+{
+    normalise(s, norm_);
+    if (norm_.size() < 2)
+        return NO_STRING;
+
+    std::uint32_t id;
+    auto it = string_index_.find(norm_);
+    if (it != string_index_.end())
+    {
+        id = it->second;
+    }
+    else
+    {
+        if (free_strings_.size())
+        {
+            id = free_strings_.back();
+            free_strings_.pop_back();
+        }
+        else
+        {
+            id = strings_.size();
+            strings_.emplace_back();
+        }
+        auto &str = strings_[id];
+        str.text = norm_;
+        string_index_.emplace(str.text, id);
+
+        trigrams_.clear();
+        for (std::size_t n = 0; n + 3 <= norm_.size(); ++n)
+            trigrams_.push_back(trigram(norm_.data() + n));
+        std::sort(trigrams_.begin(), trigrams_.end());
+        trigrams_.erase(std::unique(trigrams_.begin(), trigrams_.end()),
+                trigrams_.end());
+        for (auto t: trigrams_)
+            postings_[t].push_back(id);
+    }
+
+    auto &docs = strings_[id].docs;
+    position = docs.size();
+    docs.push_back(doc);
+    return id;
+}
+
+void EPGSearchIndex::unref_string(std::uint32_t id, std::uint32_t position)
+{
+    auto &str = strings_[id];
+    auto &docs = str.docs;
+    std::uint32_t last = docs.size() - 1;
+    if (position != last)
+    {
+        // Move the last doc into the gap and tell it where it went
+        auto &moved = docs_[docs[last]];
+        for (unsigned f = 0; f < NUM_FIELDS; ++f)
+        {
+            if (moved.strings[f] == id && moved.positions[f] == last)
+            {
+                moved.positions[f] = position;
+                break;
+            }
+        }
+        docs[position] = docs[last];
+    }
+    docs.pop_back();
+
+    if (docs.empty())
+    {
+        string_index_.erase(str.text);
+        str.text.clear();
+        str.text.shrink_to_fit();
+        dead_strings_.push_back(id);
+    }
+}
+
+void EPGSearchIndex::purge()
+{
+    std::vector<bool> dead(strings_.size());
+    for (auto id: dead_strings_)
+        dead[id] = true;
+    for (auto it = postings_.begin(); it != postings_.end(); )
+    {
+        auto &v = it->second;
+        v.erase(std::remove_if(v.begin(), v.end(),
+                    [&dead](std::uint32_t id) { return dead[id]; }),
+                v.end());
+        if (v.empty())
+            it = postings_.erase(it);
+        else
+            ++it;
+    }
+    free_strings_.insert(free_strings_.end(),
+            dead_strings_.begin(), dead_strings_.end());
+    dead_strings_.clear();
+}
+
+std::vector<EPGSearchIndex::Hit> EPGSearchIndex::search(
+        std::string_view query, std::size_t limit) const
+{
+    std::vector<Hit> hits;
+    std::string q;
+    normalise(query, q);
+    while (q.size() > 1 && q.back() == ' ')
+        q.pop_back();
+    if (q.size() < 3)
+        return hits;
+
+    // A two character query keeps its leading space to make a trigram, so
+    // it only matches the start of a word. Longer ones match anywhere.
+    std::string_view needle(q);
+    if (needle.size() > 3)
+        needle.remove_prefix(1);
+
+    // Candidates come from the shortest posting list
+    const std::vector<std::uint32_t> *best = nullptr;
+    for (std::size_t n = 0; n + 3 <= needle.size(); ++n)
+    {
+        auto it = postings_.find(trigram(needle.data() + n));
+        if (it == postings_.end())
+            return hits;
+        if (!best || it->second.size() < best->size())
+            best = &it->second;
+    }
+
+    std::vector<std::uint32_t> matches;
+    for (auto id: *best)
+    {
+        // Dead strings have no text
+        const auto &str = strings_[id];
+        if (str.text.find(needle) != std::string::npos)
+            matches.insert(matches.end(), str.docs.begin(), str.docs.end());
+    }
+    // An event can match in its title and summary
+    std::sort(matches.begin(), matches.end());
+    matches.erase(std::unique(matches.begin(), matches.end()), matches.end());
+
+    hits.reserve(matches.size());
+    for (auto d: matches)
+    {
+        const auto &doc = docs_[d];
+        hits.push_back({ doc.service, doc.start, doc.event_id });
+    }
+    std::sort(hits.begin(), hits.end(), [](const Hit &a, const Hit &b)
+    {
+        return a.start < b.start ||
+            (a.start == b.start && a.service < b.service);
+    });
+    if (limit && hits.size() > limit)
+        hits.resize(limit);
+    return hits;
+}
+
+std::size_t EPGSearchIndex::memory_size() const
+{
+    std::size_t size = docs_.capacity() * sizeof(Doc) +
+        doc_index_.size() * (sizeof(std::uint64_t) + 2 * sizeof(void *)) +
+        string_index_.size() * (sizeof(std::string_view) + 3 * sizeof(void *));
+    for (const auto &str: strings_)
+    {
+        size += sizeof(String) + str.text.capacity() +
+            str.docs.capacity() * sizeof(std::uint32_t);
+    }
+    for (const auto &p: postings_)
+    {
+        size += sizeof(p) + 2 * sizeof(void *) +
+            p.second.capacity() * sizeof(std::uint32_t);
+    }
+    return size;
+}
+
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace logi
+{
+
+/**
+ * EPGSearchIndex:
+ * An inverted index of trigrams over event titles and summaries, updated
+ * one event at a time as EPGStore adds and expires them. Each distinct
+ * string is only indexed once, however many events share it, and candidates
+ * are checked against the string itself so there are no false matches.
+ * Text is folded to lower case ASCII with punctuation treated as spaces;
+ * other UTF-8 is matched exactly. A two character query only matches the
+ * start of a word, and a shorter one matches nothing.
+ */
+class EPGSearchIndex
+{
+public:
+    using ServiceKey = std::uint64_t;
+
+    struct Hit
+    {
+        ServiceKey service;
+        std::uint32_t start;
+        std::uint16_t event_id;
+    };
+
+    constexpr static std::uint32_t NO_STRING = ~std::uint32_t(0);
+private:
+    enum { TITLE, SUMMARY, NUM_FIELDS };
+
+    struct String
+    {
+        std::string text;           // Normalised, with a leading space
+        std::vector<std::uint32_t> docs;
+    };
+
+    struct Doc
+    {
+        ServiceKey service;
+        std::uint32_t start;
+        std::uint16_t event_id;
+        std::uint32_t strings[NUM_FIELDS];
+        // Position in each string's docs
+        std::uint32_t positions[NUM_FIELDS];
+    };
+
+    std::deque<String> strings_;
+    std::unordered_map<std::string_view, std::uint32_t> string_index_;
+    std::vector<std::uint32_t> free_strings_;
+    // Strings which are unused but still in postings_
+    std::vector<std::uint32_t> dead_strings_;
+    std::unordered_map<std::uint32_t, std::vector<std::uint32_t>> postings_;
+
+    std::vector<Doc> docs_;
+    std::vector<std::uint32_t> free_docs_;
+    std::unordered_map<std::uint64_t, std::uint32_t> doc_index_;
+
+    std::string norm_;
+    std::vector<std::uint32_t> trigrams_;
+public:
+    EPGSearchIndex() = default;
+
+    EPGSearchIndex(const EPGSearchIndex &) = delete;
+    EPGSearchIndex &operator=(const EPGSearchIndex &) = delete;
+
+    /// Adds or replaces the event with the same service and event_id
+    void add(ServiceKey service, std::uint16_t event_id, std::uint32_t start,
+            std::string_view title, std::string_view summary);
+
+    /// Does nothing if the indexed event has a different start time, because
+    /// event_ids can be reused after a while
+    void remove(ServiceKey service, std::uint16_t event_id,
+            std::uint32_t start);
+
+    void clear();
+
+    /**
+     * search:
+     * Returns: Events whose title or summary contains @query, in order of
+     *          start time, at most @limit of them if @limit isn't 0. Empty
+     *          if @query has fewer than two characters once normalised.
+     */
+    std::vector<Hit> search(std::string_view query,
+            std::size_t limit = 0) const;
+
+    std::size_t num_events() const
+    {
+        return doc_index_.size();
+    }
+
+    /// Distinct strings indexed
+    std::size_t num_strings() const
+    {
+        return string_index_.size();
+    }
+
+    /// Approximate memory used, in bytes
+    std::size_t memory_size() const;
+
+    /// Folds @s for indexing or searching
+    static void normalise(std::string_view s, std::string &out);
+private:
+    static std::uint64_t doc_key(ServiceKey service, std::uint16_t event_id)
+    {
+        return (service << 16) | event_id;
+    }
+
+    static std::uint32_t trigram(const char *s)
+    {
+        return (std::uint32_t(std::uint8_t(s[0])) << 16) |
+            (std::uint32_t(std::uint8_t(s[1])) << 8) | std::uint8_t(s[2]);
+    }
+
+    std::uint32_t ref_string(std::string_view s, std::uint32_t doc,
+            std::uint32_t &position);
+
+    void unref_string(std::uint32_t id, std::uint32_t position);
+
+    /// Removes dead strings from the posting lists
+    void purge();
+};
+
+}
@@ -0,0 +1,279 @@
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <algorithm>
+#include <cerrno>
+#include <ctime>
+#include <system_error>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#include "epg-snapshot.h"
+
+namespace logi
+{
+
+static std::uint64_t align8(std::uint64_t n)
+{
+    return (n + 7) & ~std::uint64_t(7);
+}
+
+EPGSnapshot::~EPGSnapshot()
+{
+    if (map_)
+        munmap(map_, map_size_);
+}
+
+std::shared_ptr<EPGSnapshot> EPGSnapshot::open(const std::string &path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        if (errno != ENOENT)
+        {
+            g_warning("Unable to open EPG snapshot %s: %s",
+                    path.c_str(), std::strerror(errno));
+        }
+        return nullptr;
+    }
+
+    struct stat st;
+    std::shared_ptr<EPGSnapshot> snap(new EPGSnapshot());
+    if (fstat(fd, &st) < 0 || std::size_t(st.st_size) < sizeof(Header))
+    {
+        g_warning("EPG snapshot %s is too short", path.c_str());
+        ::close(fd);
+        return nullptr;
+    }
+    snap->map_size_ = st.st_size;
+    snap->map_ = mmap(nullptr, snap->map_size_, PROT_READ, MAP_PRIVATE,
+            fd, 0);
+    // The mapping keeps the file open
+    ::close(fd);
+    if (snap->map_ == MAP_FAILED)
+    {
+        snap->map_ = nullptr;
+        g_warning("Unable to map EPG snapshot %s: %s",
+                path.c_str(), std::strerror(errno));
+        return nullptr;
+    }
+    if (!snap->validate(path.c_str()))
+        return nullptr;
+    return snap;
+}
+
+bool EPGSnapshot::validate(const char *path)
+{
+    auto base = static_cast<const char *>(map_);
+    header_ = reinterpret_cast<const Header *>(base);
+    const auto &h = *header_;
+    const char *problem = nullptr;
+
+    if (std::memcmp(h.magic, MAGIC, sizeof(MAGIC)))
+        problem = "not an EPG snapshot";
+    else if (h.version != VERSION)
+        problem = "wrong version";
+    else if (h.byte_order != BYTE_ORDER_MARK ||
+            h.event_size != sizeof(EPGEvent))
+        problem = "written on a different architecture";
+    else if (h.file_size != map_size_)
+        problem = "truncated";
+    else if (h.services_offset % 8 || h.events_offset % 8 ||
+            h.services_offset < sizeof(Header) ||
+            h.services_offset + std::uint64_t(h.num_services) *
+                sizeof(ServiceEntry) > h.events_offset ||
+            h.events_offset + h.num_events * sizeof(EPGEvent) >
+                h.strings_offset ||
+            h.strings_offset + h.strings_size > h.file_size)
+        problem = "tables overlap";
+    if (!problem)
+    {
+        services_ = reinterpret_cast<const ServiceEntry *>(
+                base + h.services_offset);
+        events_ = reinterpret_cast<const EPGEvent *>(base + h.events_offset);
+        strings_ = base + h.strings_offset;
+
+        // Only the service index is checked, events are read on demand
+        for (std::uint32_t n = 0; n < h.num_services && !problem; ++n)
+        {
+            const auto &svc = services_[n];
+            if (std::uint64_t(svc.first_event) + svc.num_events >
+                    h.num_events || (n && services_[n - 1].key >= svc.key))
+            {
+                problem = "bad service index";
+            }
+        }
+    }
+    if (problem)
+    {
+        g_warning("EPG snapshot %s is unusable: %s", path, problem);
+        return false;
+    }
+    return true;
+}
+
+const EPGSnapshot::ServiceEntry *EPGSnapshot::find(ServiceKey key) const
+{
+    auto it = std::lower_bound(services_begin(), services_end(), key,
+            [](const ServiceEntry &svc, ServiceKey k) { return svc.key < k; });
+    return it != services_end() && it->key == key ? it : nullptr;
+}
+
+static void write_all(int fd, const void *data, std::size_t len,
+        const std::string &path)
+{
+    auto p = static_cast<const char *>(data);
+    while (len)
+    {
+        auto n = ::write(fd, p, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            throw std::system_error(errno, std::system_category(),
+                    "Unable to write EPG snapshot " + path);
+        }
+        p += n;
+        len -= n;
+    }
+}
+
+EPGSnapshot::Image EPGSnapshot::build(const std::vector<Service> &services,
+        const StringGetter &get_string)
+{
+    auto sorted = services;
+    std::sort(sorted.begin(), sorted.end(),
+            [](const Service &a, const Service &b) { return a.key < b.key; });
+
+    Image image;
+    auto &entries = image.entries;
+    auto &events = image.events;
+    auto &strings = image.strings;
+    std::unordered_map<std::string_view, StringArena::ref_t> titles;
+    entries.reserve(sorted.size());
+
+    auto add_string = [&strings](std::string_view s) -> StringArena::ref_t
+    {
+        if (s.empty())
+            return 0;
+        StringArena::ref_t ref = REF_FLAG | strings.size();
+        std::uint16_t len = s.size();
+        strings.append(reinterpret_cast<const char *>(&len), 2);
+        strings.append(s.data(), len);
+        return ref;
+    };
+
+    for (const auto &svc: sorted)
+    {
+        if (!svc.num_events)
+            continue;
+        entries.push_back({ svc.key, std::uint32_t(events.size()),
+                std::uint32_t(svc.num_events) });
+        for (std::size_t n = 0; n < svc.num_events; ++n)
+        {
+            EPGEvent ev = svc.events[n];
+            // Titles repeat a lot, so share them
+            auto title = get_string(ev.title);
+            auto it = titles.find(title);
+            if (it == titles.end())
+                it = titles.emplace(title, add_string(title)).first;
+            ev.title = it->second;
+            ev.summary = add_string(get_string(ev.summary));
+            ev.description = add_string(get_string(ev.description));
+            events.push_back(ev);
+        }
+    }
+
+    auto &h = image.header;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+    h.version = VERSION;
+    h.byte_order = BYTE_ORDER_MARK;
+    h.event_size = sizeof(EPGEvent);
+    h.num_services = entries.size();
+    h.num_events = events.size();
+    h.services_offset = align8(sizeof(Header));
+    h.events_offset = align8(h.services_offset +
+            entries.size() * sizeof(ServiceEntry));
+    h.strings_offset = align8(h.events_offset +
+            events.size() * sizeof(EPGEvent));
+    h.strings_size = strings.size();
+    h.file_size = h.strings_offset + h.strings_size;
+    h.created = std::time(nullptr);
+    return image;
+}
+
+void EPGSnapshot::write(const std::string &path, const Image &image)
+{
+    const auto &h = image.header;
+    auto tmp = path + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+            0644);
+    if (fd < 0)
+    {
+        throw std::system_error(errno, std::system_category(),
+                "Unable to create EPG snapshot " + tmp);
+    }
+    try
+    {
+        static const char zeros[8] = { 0 };
+        std::uint64_t pos = 0;
+        auto put = [fd, &pos, &tmp](const void *data, std::size_t len,
+                std::uint64_t offset)
+        {
+            write_all(fd, zeros, offset - pos, tmp);
+            write_all(fd, data, len, tmp);
+            pos = offset + len;
+        };
+        put(&h, sizeof(h), 0);
+        put(image.entries.data(),
+                image.entries.size() * sizeof(ServiceEntry),
+                h.services_offset);
+        put(image.events.data(), image.events.size() * sizeof(EPGEvent),
+                h.events_offset);
+        put(image.strings.data(), image.strings.size(), h.strings_offset);
+        if (fsync(fd) < 0)
+        {
+            throw std::system_error(errno, std::system_category(),
+                    "Unable to sync EPG snapshot " + tmp);
+        }
+    }
+    catch (...)
+    {
+        ::close(fd);
+        ::unlink(tmp.c_str());
+        throw;
+    }
+    ::close(fd);
+    if (::rename(tmp.c_str(), path.c_str()) < 0)
+    {
+        int err = errno;
+        ::unlink(tmp.c_str());
+        throw std::system_error(err, std::system_category(),
+                "Unable to rename EPG snapshot to " + path);
+    }
+}
+
+}
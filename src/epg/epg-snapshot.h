@@ -0,0 +1,211 @@
+#pragma once
+
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "epg-event.h"
+#include "string-arena.h"
+
+namespace logi
+{
+
+/**
+ * EPGSnapshot:
+ * A read-only EPG mapped from a file written by save(), so that a restarted
+ * daemon can use its EPG straight away instead of rebuilding it from the
+ * database or waiting for the EIT carousels. The file is laid out so that it
+ * can be used in place:
+ *
+ *   Header
+ *   ServiceEntry[num_services], sorted by key
+ *   EPGEvent[num_events], grouped by service and sorted by start time
+ *   string table: 16-bit length + bytes, as in StringArena
+ *
+ * String refs in the events are offsets into the string table with REF_FLAG
+ * set, so they can't be confused with StringArena refs. Everything is in
+ * host byte order; a file from a different architecture is rejected.
+ */
+class EPGSnapshot
+{
+public:
+    using ServiceKey = std::uint64_t;
+
+    constexpr static std::uint32_t VERSION = 1;
+    constexpr static StringArena::ref_t REF_FLAG = 0x80000000;
+
+    struct Header
+    {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t byte_order;       // BYTE_ORDER_MARK in host order
+        std::uint32_t event_size;       // sizeof(EPGEvent)
+        std::uint32_t num_services;
+        std::uint64_t num_events;
+        std::uint64_t services_offset;
+        std::uint64_t events_offset;
+        std::uint64_t strings_offset;
+        std::uint64_t strings_size;
+        std::uint64_t file_size;
+        std::int64_t created;           // Seconds since Unix epoch
+    };
+
+    struct ServiceEntry
+    {
+        ServiceKey key;
+        std::uint32_t first_event;
+        std::uint32_t num_events;
+    };
+
+    /// An input to save()
+    struct Service
+    {
+        ServiceKey key;
+        const EPGEvent *events;
+        std::size_t num_events;
+    };
+
+    using StringGetter = std::function<std::string_view(StringArena::ref_t)>;
+
+    /// A snapshot file's contents, from build()
+    struct Image
+    {
+        Header header;
+        std::vector<ServiceEntry> entries;
+        std::vector<EPGEvent> events;
+        std::string strings;
+    };
+
+    constexpr static char MAGIC[8] = { 'L', 'O', 'G', 'I', 'E', 'P', 'G', 0 };
+    constexpr static std::uint32_t BYTE_ORDER_MARK = 0x01020304;
+private:
+    void *map_ = nullptr;
+    std::size_t map_size_ = 0;
+    const Header *header_ = nullptr;
+    const ServiceEntry *services_ = nullptr;
+    const EPGEvent *events_ = nullptr;
+    const char *strings_ = nullptr;
+
+    EPGSnapshot() = default;
+public:
+    ~EPGSnapshot();
+
+    EPGSnapshot(const EPGSnapshot &) = delete;
+    EPGSnapshot &operator=(const EPGSnapshot &) = delete;
+
+    /**
+     * open:
+     * Maps @path and checks its header and tables, but doesn't read the
+     * events.
+     * Returns: nullptr if the file doesn't exist or isn't a usable snapshot.
+     */
+    static std::shared_ptr<EPGSnapshot> open(const std::string &path);
+
+    /**
+     * build:
+     * Lays out @services' events and strings as they'll be written, copying
+     * everything so that the store can carry on changing while the image is
+     * written by another thread. @get_string returns the text of the
+     * events' refs.
+     */
+    static Image build(const std::vector<Service> &services,
+            const StringGetter &get_string);
+
+    /**
+     * write:
+     * Writes @image to a temporary file and renames it to @path, so a
+     * reader never sees a partial snapshot. Throws std::system_error.
+     */
+    static void write(const std::string &path, const Image &image);
+
+    /// build() and write()
+    static void save(const std::string &path,
+            const std::vector<Service> &services,
+            const StringGetter &get_string)
+    {
+        write(path, build(services, get_string));
+    }
+
+    const Header &header() const
+    {
+        return *header_;
+    }
+
+    std::uint32_t num_services() const
+    {
+        return header_->num_services;
+    }
+
+    std::size_t num_events() const
+    {
+        return header_->num_events;
+    }
+
+    const ServiceEntry *services_begin() const
+    {
+        return services_;
+    }
+
+    const ServiceEntry *services_end() const
+    {
+        return services_ + header_->num_services;
+    }
+
+    /// Returns: nullptr if @key isn't in the snapshot
+    const ServiceEntry *find(ServiceKey key) const;
+
+    const EPGEvent *events_begin(const ServiceEntry &svc) const
+    {
+        return events_ + svc.first_event;
+    }
+
+    const EPGEvent *events_end(const ServiceEntry &svc) const
+    {
+        return events_ + svc.first_event + svc.num_events;
+    }
+
+    static bool is_snapshot_ref(StringArena::ref_t ref)
+    {
+        return ref & REF_FLAG;
+    }
+
+    /// @ref must have REF_FLAG set. Out of range refs give an empty string.
+    std::string_view get_string(StringArena::ref_t ref) const
+    {
+        std::uint64_t offset = ref & ~REF_FLAG;
+        if (offset + 2 > header_->strings_size)
+            return std::string_view();
+        std::uint16_t len;
+        std::memcpy(&len, strings_ + offset, 2);
+        if (offset + 2 + len > header_->strings_size)
+            return std::string_view();
+        return std::string_view(strings_ + offset + 2, len);
+    }
+private:
+    bool validate(const char *path);
+};
+
+}
@@ -0,0 +1,598 @@
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include <glib.h>
+
+#include <glibmm/main.h>
+
+#include "db/logi-db.h"
+#include "epg-store.h"
+
+namespace logi
+{
+
+void EPGStore::add_events(const EITSection &sec,
+        const std::vector<EITEvent> &events)
+{
+    auto key = service_key(sec.original_network_id(),
+            sec.transport_stream_id(), sec.service_id());
+    for (const auto &ev: events)
+        add_event(key, ev);
+
+    if (sec.is_present_following())
+    {
+        // Share the schedule's copy of the event and its strings
+        const EPGEvent *stored = nullptr;
+        if (events.size())
+        {
+            stored = event_at(key, events[0].start);
+            if (stored && stored->event_id != events[0].event_id)
+                stored = nullptr;
+        }
+        set_now_next(key, sec.section_number(), stored);
+    }
+}
+
+void EPGStore::add_event(ServiceKey service, const EITEvent &event)
+{
+    // Unchanged repeats are common, and re-adding them would fill the arena
+    // with copies of their strings. They're compared in place so that a
+    // service isn't copied out of the snapshot unless it changes.
+    bool changed = true;
+    auto idx = index_.find(service);
+    if (idx != index_.end())
+    {
+        const auto &svc = services_[idx->second];
+        auto last = events_end(svc);
+        auto it = std::partition_point(events_begin(svc), last,
+                [&event](const EPGEvent &ev)
+                {
+                    return ev.start < std::uint32_t(event.start);
+                });
+        changed = it == last || !same_event(*it, event);
+    }
+    if (changed)
+        merge_event(get_service(service), make_event(event));
+
+    // CRIDs aren't stored in EPGEvent, so same_event doesn't compare them.
+    // This must come after merge_event, which unindexes replaced events.
+    if (crids_)
+    {
+        crids_->add(service, event.event_id, std::uint32_t(event.start),
+                event.duration, event.programme_crid, event.series_crids);
+    }
+}
+
+void EPGStore::merge_event(ServiceEvents &svc, const EPGEvent &ev)
+{
+    auto &v = svc.events;
+    svc.dirty = true;
+    snapshot_dirty_ = true;
+
+    svc.changed.push_back(ev.start);
+
+    // Events usually arrive in order
+    if (v.empty() || v.back().end() <= ev.start)
+    {
+        v.push_back(ev);
+        ++num_events_;
+        index_event(svc.key, ev);
+        return;
+    }
+
+    auto first = std::partition_point(v.begin(), v.end(),
+            [&ev](const EPGEvent &e) { return e.end() <= ev.start; });
+    auto last = std::partition_point(first, v.end(),
+            [&ev](const EPGEvent &e) { return e.start < ev.end(); });
+    // A zero-length event at the same time doesn't overlap but is replaced
+    if (first == last && first != v.end() && first->start == ev.start)
+        ++last;
+
+    for (auto it = first; it != last; ++it)
+    {
+        unindex_event(svc.key, *it);
+        // One with the same start is replaced in the database
+        if (it->start != ev.start)
+            svc.deleted.push_back(it->start);
+    }
+    index_event(svc.key, ev);
+
+    if (first == last)
+    {
+        v.insert(first, ev);
+        ++num_events_;
+    }
+    else
+    {
+        *first = ev;
+        num_events_ -= last - first - 1;
+        v.erase(first + 1, last);
+    }
+}
+
+void EPGStore::expire(std::uint32_t t)
+{
+    for (auto &svc: services_)
+    {
+        if (svc.snapshot && events_begin(svc) != events_end(svc) &&
+                events_begin(svc)->end() <= t)
+        {
+            materialise(svc);
+        }
+        auto &v = svc.events;
+        auto it = std::partition_point(v.begin(), v.end(),
+                [t](const EPGEvent &ev) { return ev.end() <= t; });
+        if (it != v.begin())
+        {
+            snapshot_dirty_ = true;
+            for (auto e = v.begin(); e != it; ++e)
+                unindex_event(svc.key, *e);
+            num_events_ -= it - v.begin();
+            v.erase(v.begin(), it);
+            expired_ = std::max(expired_, t);
+        }
+    }
+}
+
+void EPGStore::apply_segment(const EITSegment &seg)
+{
+    auto it = index_.find(service_key(seg.original_network_id,
+                seg.transport_stream_id, seg.service_id));
+    if (it == index_.end())
+        return;
+    auto &svc = services_[it->second];
+
+    auto withdrawn = [&seg](const EPGEvent &ev)
+    {
+        return !std::binary_search(seg.event_ids.begin(),
+                seg.event_ids.end(), ev.event_id);
+    };
+    auto begin = events_begin(svc);
+    auto first = std::partition_point(begin, events_end(svc),
+            [&seg](const EPGEvent &ev)
+            {
+                return ev.start < std::uint32_t(seg.start);
+            });
+    auto last = std::partition_point(first, events_end(svc),
+            [&seg](const EPGEvent &ev)
+            {
+                return ev.start < std::uint32_t(seg.end);
+            });
+    // Usually nothing has been withdrawn, so don't copy from the snapshot
+    if (std::none_of(first, last, withdrawn))
+        return;
+
+    auto lo = first - begin;
+    auto hi = last - begin;
+    materialise(svc);
+    auto &v = svc.events;
+    auto out = v.begin() + lo;
+    for (auto in = out; in != v.begin() + hi; ++in)
+    {
+        if (withdrawn(*in))
+        {
+            unindex_event(svc.key, *in);
+            svc.deleted.push_back(in->start);
+        }
+        else
+        {
+            *out++ = *in;
+        }
+    }
+    num_events_ -= v.begin() + hi - out;
+    v.erase(out, v.begin() + hi);
+    svc.dirty = true;
+    snapshot_dirty_ = true;
+}
+
+void EPGStore::compact()
+{
+    StringArena arena;
+    auto copy = [this, &arena](EPGEvent &ev)
+    {
+        ev.title = arena.intern(get_string(ev.title));
+        ev.summary = arena.add(get_string(ev.summary));
+        ev.description = arena.add(get_string(ev.description));
+    };
+
+    for (auto &svc: services_)
+    {
+        for (auto &ev: svc.events)
+            copy(ev);
+    }
+
+    // Now/next events are usually also in the schedule, so share its copies
+    // of their strings
+    auto share = [this, &copy](ServiceKey key, EPGEvent &ev)
+    {
+        auto sched = event_at(key, ev.start);
+        if (sched && sched->event_id == ev.event_id &&
+                sched->start == ev.start && sched->duration == ev.duration)
+        {
+            ev = *sched;
+        }
+        else
+        {
+            copy(ev);
+        }
+    };
+    for (auto &nn: now_next_)
+    {
+        if (nn.has_present)
+            share(nn.service, nn.present);
+        if (nn.has_following)
+            share(nn.service, nn.following);
+    }
+
+    g_debug("Compacted EPG strings from %zu to %zu bytes",
+            strings_.bytes(), arena.bytes());
+    strings_ = std::move(arena);
+}
+
+void EPGStore::clear()
+{
+    services_.clear();
+    index_.clear();
+    now_next_.clear();
+    strings_.clear();
+    num_events_ = 0;
+    if (search_)
+        search_->clear();
+    if (crids_)
+        crids_->clear();
+    snapshot_.reset();
+    snapshot_dirty_ = true;
+}
+
+void EPGStore::enable_search()
+{
+    if (search_)
+        return;
+    search_.reset(new EPGSearchIndex());
+    for (const auto &svc: services_)
+    {
+        for (auto ev = events_begin(svc); ev != events_end(svc); ++ev)
+            index_event(svc.key, *ev);
+    }
+}
+
+void EPGStore::enable_crid_index()
+{
+    if (!crids_)
+        crids_.reset(new CRIDIndex());
+}
+
+const EPGEvent *EPGStore::event_at(ServiceKey service, std::uint32_t t) const
+{
+    auto it = index_.find(service);
+    if (it == index_.end())
+        return nullptr;
+    const auto &svc = services_[it->second];
+    auto last = events_end(svc);
+    auto ev = std::partition_point(events_begin(svc), last,
+            [t](const EPGEvent &e) { return e.end() <= t; });
+    if (ev != last && ev->start <= t)
+        return ev;
+    return nullptr;
+}
+
+const EPGStore::NowNext *EPGStore::now_next(ServiceKey service) const
+{
+    auto it = index_.find(service);
+    if (it == index_.end())
+        return nullptr;
+    const auto &nn = now_next_[it->second];
+    return (nn.has_present || nn.has_following) ? &nn : nullptr;
+}
+
+unsigned EPGStore::service_index(ServiceKey service)
+{
+    auto it = index_.find(service);
+    if (it != index_.end())
+        return it->second;
+    unsigned n = services_.size();
+    index_.emplace(service, n);
+    services_.emplace_back();
+    services_.back().key = service;
+    now_next_.emplace_back();
+    now_next_.back().service = service;
+    return n;
+}
+
+EPGStore::ServiceEvents &EPGStore::get_service(ServiceKey service)
+{
+    auto &svc = services_[service_index(service)];
+    materialise(svc);
+    return svc;
+}
+
+std::string_view EPGStore::description_of(const EITEvent &event)
+{
+    if (event.items.empty())
+        return event.description.raw();
+    description_buf_.clear();
+    for (const auto &item: event.items)
+    {
+        description_buf_ += item.first.raw();
+        description_buf_ += ": ";
+        description_buf_ += item.second.raw();
+        description_buf_ += '\n';
+    }
+    description_buf_ += event.description.raw();
+    return description_buf_;
+}
+
+EPGEvent EPGStore::make_event(const EITEvent &event)
+{
+    EPGEvent ev;
+    ev.start = event.start;
+    ev.duration = event.duration;
+    ev.title = strings_.intern(event.title.raw());
+    ev.summary = strings_.add(event.summary.raw());
+    ev.description = strings_.add(description_of(event));
+    ev.event_id = event.event_id;
+    ev.flags = event.running_status | (event.free_CA_mode << 3);
+    ev.min_age = event.min_age;
+    ev.content = event.content.size() ? event.content[0] : 0;
+    return ev;
+}
+
+bool EPGStore::same_event(const EPGEvent &ev, const EITEvent &event)
+{
+    return ev.event_id == event.event_id &&
+        ev.start == std::uint32_t(event.start) &&
+        ev.duration == event.duration &&
+        ev.flags == (event.running_status | (event.free_CA_mode << 3)) &&
+        ev.min_age == event.min_age &&
+        ev.content == (event.content.size() ? event.content[0] : 0) &&
+        get_string(ev.title) == event.title.raw() &&
+        get_string(ev.summary) == event.summary.raw() &&
+        get_string(ev.description) == description_of(event);
+}
+
+void EPGStore::set_now_next(ServiceKey service, unsigned section_number,
+        const EPGEvent *event)
+{
+    auto &nn = now_next_[service_index(service)];
+    bool &has = section_number ? nn.has_following : nn.has_present;
+    EPGEvent &slot = section_number ? nn.following : nn.present;
+
+    bool changed = has != bool(event) || (event &&
+            (slot.event_id != event->event_id ||
+             slot.start != event->start ||
+             slot.duration != event->duration));
+    has = event;
+    if (event)
+        slot = *event;
+    if (changed)
+        now_next_signal_.emit(service);
+}
+
+void EPGStore::commit_to_database(Database &db, const char *source)
+{
+    using id_t = Database::id_t;
+    using DeleteVector = Database::Vector<id_t, id_t, id_t, id_t>;
+    using InsertVector = Database::Vector<id_t, id_t, id_t, id_t, id_t, id_t,
+          id_t, id_t, Glib::ustring, Glib::ustring, Glib::ustring>;
+
+    auto dels = std::make_shared<DeleteVector>();
+    auto ins = std::make_shared<InsertVector>();
+    for (auto &svc: services_)
+    {
+        if (!svc.dirty)
+            continue;
+        id_t onid = (svc.key >> 32) & 0xffff;
+        id_t tsid = (svc.key >> 16) & 0xffff;
+        id_t sid = svc.key & 0xffff;
+        for (auto start: svc.deleted)
+            dels->emplace_back(onid, tsid, sid, start);
+
+        // An event may have been changed several times, or since removed
+        auto &changed = svc.changed;
+        std::sort(changed.begin(), changed.end());
+        changed.erase(std::unique(changed.begin(), changed.end()),
+                changed.end());
+        auto ev = events_begin(svc);
+        auto end = events_end(svc);
+        for (auto start: changed)
+        {
+            ev = std::partition_point(ev, end, [start](const EPGEvent &e)
+            {
+                return e.start < start;
+            });
+            if (ev == end || ev->start != start)
+                continue;
+            ins->emplace_back(onid, tsid, sid, ev->event_id, ev->start,
+                    ev->duration, ev->flags | (id_t(ev->min_age) << 8),
+                    ev->content,
+                    Glib::ustring(std::string(get_string(ev->title))),
+                    Glib::ustring(std::string(get_string(ev->summary))),
+                    Glib::ustring(std::string(get_string(ev->description))));
+        }
+        changed.clear();
+        svc.deleted.clear();
+        svc.dirty = false;
+    }
+    auto expired = expired_;
+    expired_ = 0;
+    if (dels->empty() && ins->empty() && !expired)
+        return;
+
+    g_debug("Committing EPG changes: %zu events, %zu deletions",
+            ins->size(), dels->size());
+    auto dbp = &db;
+    db.queue_function([dbp, dels, ins, expired, src = std::string(source)]()
+    {
+        dbp->run_transaction([dbp, &dels, &ins, expired, &src]()
+        {
+            if (expired)
+            {
+                dbp->run_statement(dbp->get_delete_old_epg_events_statement(
+                            src.c_str()), Database::Vector<id_t>{{ expired }});
+            }
+            // Deletions first, in case an event has been replaced by
+            // another at the same time
+            dbp->run_statement(dbp->get_delete_epg_event_statement(
+                        src.c_str()), *dels);
+            dbp->run_statement(dbp->get_insert_epg_event_statement(
+                        src.c_str()), *ins);
+        });
+    });
+}
+
+void EPGStore::load_from_database(Database &db, const char *source,
+        sigc::slot<void> done)
+{
+    using Rows = std::vector<std::pair<ServiceKey, EITEvent>>;
+    auto rows = std::make_shared<Rows>();
+    auto dbp = &db;
+    db.queue_function([dbp, rows, src = std::string(source)]()
+    {
+        dbp->run_row_query(dbp->get_epg_events_query(src.c_str()),
+                Database::Tuple<>(),
+                [&rows](const Database::EPGEventRow &row)
+        {
+            rows->emplace_back();
+            auto &r = rows->back();
+            auto &ev = r.second;
+            r.first = service_key(std::get<0>(row), std::get<1>(row),
+                    std::get<2>(row));
+            ev.clear();
+            ev.event_id = std::get<3>(row);
+            ev.start = std::get<4>(row);
+            ev.duration = std::get<5>(row);
+            auto flags = std::get<6>(row);
+            ev.running_status = flags & 7;
+            ev.free_CA_mode = (flags & 8) != 0;
+            ev.min_age = flags >> 8;
+            if (std::get<7>(row))
+                ev.content.push_back(std::get<7>(row));
+            ev.title = Glib::ustring(std::string(std::get<8>(row)));
+            ev.summary = Glib::ustring(std::string(std::get<9>(row)));
+            ev.description = Glib::ustring(std::string(std::get<10>(row)));
+        });
+    });
+    db.queue_callback([this, rows, done]()
+    {
+        for (const auto &r: *rows)
+        {
+            auto &svc = get_service(r.first);
+            bool was_dirty = svc.dirty;
+            auto num_changed = svc.changed.size();
+            auto num_deleted = svc.deleted.size();
+            add_event(r.first, r.second);
+            // It's already in the database
+            svc.dirty = was_dirty;
+            svc.changed.resize(num_changed);
+            svc.deleted.resize(num_deleted);
+        }
+        g_debug("Loaded %zu EPG events", rows->size());
+        done();
+    });
+}
+
+void EPGStore::use_snapshot(std::shared_ptr<EPGSnapshot> snap)
+{
+    clear();
+    snapshot_ = snap;
+    for (auto entry = snap->services_begin(); entry != snap->services_end();
+            ++entry)
+    {
+        index_.emplace(entry->key, services_.size());
+        services_.emplace_back();
+        auto &svc = services_.back();
+        svc.key = entry->key;
+        svc.snapshot = entry;
+        now_next_.emplace_back();
+        now_next_.back().service = entry->key;
+        num_events_ += entry->num_events;
+        if (search_)
+        {
+            for (auto ev = events_begin(svc); ev != events_end(svc); ++ev)
+                index_event(svc.key, *ev);
+        }
+    }
+    snapshot_dirty_ = false;
+    g_debug("Using EPG snapshot with %u services, %zu events",
+            snap->num_services(), snap->num_events());
+}
+
+EPGSnapshot::Image EPGStore::build_snapshot() const
+{
+    std::vector<EPGSnapshot::Service> services;
+    services.reserve(services_.size());
+    for (const auto &svc: services_)
+    {
+        services.push_back({ svc.key, events_begin(svc),
+                std::size_t(events_end(svc) - events_begin(svc)) });
+    }
+    return EPGSnapshot::build(services, [this](StringArena::ref_t ref)
+    {
+        return get_string(ref);
+    });
+}
+
+void EPGStore::save_snapshot(const std::string &path)
+{
+    EPGSnapshot::write(path, build_snapshot());
+    snapshot_dirty_ = false;
+}
+
+sigc::connection EPGStore::save_snapshot_periodically(Database &db,
+        const std::string &path, unsigned interval)
+{
+    return Glib::signal_timeout().connect_seconds([this, &db, path]()
+    {
+        if (!snapshot_dirty_ || snapshot_saving_)
+            return true;
+        // Writing and syncing a whole EPG would stall the main loop
+        auto image = std::make_shared<EPGSnapshot::Image>(build_snapshot());
+        auto error = std::make_shared<std::string>();
+        snapshot_dirty_ = false;
+        snapshot_saving_ = true;
+        db.queue_function([path, image, error]()
+        {
+            try
+            {
+                EPGSnapshot::write(path, *image);
+            }
+            catch (std::exception &x)
+            {
+                *error = x.what();
+            }
+        });
+        db.queue_callback([this, error]()
+        {
+            snapshot_saving_ = false;
+            if (!error->empty())
+            {
+                g_warning("%s", error->c_str());
+                snapshot_dirty_ = true;
+            }
+        });
+        return true;
+    }, interval);
+}
+
+}
@@ -0,0 +1,356 @@
+#pragma once
+
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <sigc++/sigc++.h>
+
+#include "crid-index.h"
+#include "eit-harvester.h"
+#include "epg-event.h"
+#include "epg-search.h"
+#include "epg-snapshot.h"
+#include "string-arena.h"
+
+namespace logi
+{
+
+class Database;
+
+/**
+ * EPGStore:
+ * Keeps each service's events in a vector sorted by start time, so that
+ * range and grid queries are binary searches over contiguous memory rather
+ * than database queries. Strings are kept in a shared arena with titles
+ * interned. Present/following events from p/f tables are kept in a separate
+ * flat index for "what's on now" across all services.
+ * Changes are written to the database asynchronously by
+ * commit_to_database(), which only writes the events that have been added,
+ * changed or removed since the last commit.
+ * At startup the store can use a mapped EPGSnapshot in place. A service's
+ * events are only copied out of the snapshot when live EIT changes them.
+ */
+class EPGStore
+{
+public:
+    using ServiceKey = std::uint64_t;
+
+    struct NowNext
+    {
+        ServiceKey service;
+        bool has_present = false;
+        bool has_following = false;
+        EPGEvent present;
+        EPGEvent following;
+    };
+private:
+    struct ServiceEvents
+    {
+        ServiceKey key;
+        std::vector<EPGEvent> events;
+        bool dirty = false;
+        // Start times of events to write to or delete from the database
+        std::vector<std::uint32_t> changed;
+        std::vector<std::uint32_t> deleted;
+        // If set, the events are still in the snapshot and events is empty
+        const EPGSnapshot::ServiceEntry *snapshot = nullptr;
+    };
+
+    std::vector<ServiceEvents> services_;
+    std::unordered_map<ServiceKey, std::uint32_t> index_;
+    // Parallel to services_
+    std::vector<NowNext> now_next_;
+    StringArena strings_;
+    std::size_t num_events_ = 0;
+    // Events which ended before this haven't been deleted from the database
+    std::uint32_t expired_ = 0;
+    std::string description_buf_;
+    sigc::signal<void, ServiceKey> now_next_signal_;
+    std::unique_ptr<EPGSearchIndex> search_;
+    std::unique_ptr<CRIDIndex> crids_;
+    std::shared_ptr<EPGSnapshot> snapshot_;
+    // Whether anything has changed since the last save_snapshot()
+    bool snapshot_dirty_ = false;
+    // Whether a periodic snapshot is being written
+    bool snapshot_saving_ = false;
+public:
+    EPGStore() = default;
+
+    EPGStore(const EPGStore &) = delete;
+    EPGStore(EPGStore &&) = delete;
+    EPGStore &operator=(const EPGStore &) = delete;
+    EPGStore &operator=(EPGStore &&) = delete;
+
+    static ServiceKey service_key(std::uint16_t orig_nw_id,
+            std::uint16_t ts_id, std::uint16_t service_id)
+    {
+        return (ServiceKey(orig_nw_id) << 32) | (ServiceKey(ts_id) << 16) |
+            service_id;
+    }
+
+    /**
+     * add_events:
+     * Suitable for connecting to EITHarvester::events_signal(). Schedule
+     * events replace any stored events they overlap. p/f events also update
+     * the now/next index.
+     */
+    void add_events(const EITSection &sec, const std::vector<EITEvent> &events);
+
+    /// Adds or replaces an event in a service's schedule
+    void add_event(ServiceKey service, const EITEvent &event);
+
+    /**
+     * apply_segment:
+     * Suitable for connecting to EITHarvester::segment_signal(). Removes
+     * events in the segment's time window which it no longer lists.
+     */
+    void apply_segment(const EITSegment &seg);
+
+    /// Removes events which ended before @t
+    void expire(std::uint32_t t);
+
+    /**
+     * compact:
+     * Rebuilds the string arena from the events still stored, to reclaim
+     * space used by replaced and expired events.
+     */
+    void compact();
+
+    void clear();
+
+    /**
+     * enable_search:
+     * Starts keeping a search index of titles and summaries, beginning with
+     * the events already stored. It's then updated as events are added,
+     * replaced and expired.
+     */
+    void enable_search();
+
+    /// Returns: nullptr unless enable_search() has been called
+    const EPGSearchIndex *search_index() const
+    {
+        return search_.get();
+    }
+
+    /**
+     * enable_crid_index:
+     * Starts indexing events by programme and series CRID as they arrive.
+     * CRIDs aren't saved with the EPG, so events loaded from the database
+     * or a snapshot aren't indexed until they're broadcast again.
+     */
+    void enable_crid_index();
+
+    /// Returns: nullptr unless enable_crid_index() has been called. Pass
+    ///          it SDT and NIT sections so it can resolve relative CRIDs.
+    CRIDIndex *crid_index()
+    {
+        return crids_.get();
+    }
+
+    /**
+     * for_each_in_range:
+     * Calls @f(const EPGEvent &) for each of @service's events which overlap
+     * [@from, @to), in order.
+     */
+    template<class F> void for_each_in_range(ServiceKey service,
+            std::uint32_t from, std::uint32_t to, F f) const
+    {
+        auto it = index_.find(service);
+        if (it != index_.end())
+        {
+            const auto &svc = services_[it->second];
+            for_each_in_range(events_begin(svc), events_end(svc),
+                    from, to, f);
+        }
+    }
+
+    /**
+     * grid:
+     * Calls @f(ServiceKey, const EPGEvent &) for every event of each of
+     * @services which overlaps [@from, @to), grouped by service in the
+     * order given.
+     */
+    template<class F> void grid(const std::vector<ServiceKey> &services,
+            std::uint32_t from, std::uint32_t to, F f) const
+    {
+        for (auto key: services)
+        {
+            for_each_in_range(key, from, to, [key, &f](const EPGEvent &ev)
+            {
+                f(key, ev);
+            });
+        }
+    }
+
+    /// Returns: The event on @service at time @t, or nullptr
+    const EPGEvent *event_at(ServiceKey service, std::uint32_t t) const;
+
+    /// Indexed in the order services were first seen
+    const std::vector<NowNext> &now_next() const
+    {
+        return now_next_;
+    }
+
+    /// Returns: nullptr if the service has no p/f data
+    const NowNext *now_next(ServiceKey service) const;
+
+    /// Raised when a service's present or following event changes
+    sigc::signal<void, ServiceKey> &now_next_signal()
+    {
+        return now_next_signal_;
+    }
+
+    std::string_view get_string(StringArena::ref_t ref) const
+    {
+        if (EPGSnapshot::is_snapshot_ref(ref))
+            return snapshot_ ? snapshot_->get_string(ref) : std::string_view();
+        return strings_.get(ref);
+    }
+
+    const StringArena &strings() const
+    {
+        return strings_;
+    }
+
+    std::size_t num_services() const
+    {
+        return services_.size();
+    }
+
+    std::size_t num_events() const
+    {
+        return num_events_;
+    }
+
+    /**
+     * commit_to_database:
+     * Copies the events of services which have changed since the last
+     * commit and queues a transaction to replace them in the database.
+     * Returns immediately.
+     */
+    void commit_to_database(Database &db, const char *source);
+
+    /**
+     * load_from_database:
+     * Reads events stored by commit_to_database on the database thread and
+     * adds them to the store on the main thread, then calls @done.
+     */
+    void load_from_database(Database &db, const char *source,
+            sigc::slot<void> done);
+
+    /**
+     * use_snapshot:
+     * Replaces the store's contents with @snap's, without copying its
+     * events. The snapshot stays mapped until the store is cleared.
+     */
+    void use_snapshot(std::shared_ptr<EPGSnapshot> snap);
+
+    /// Writes the whole EPG to @path atomically. Throws std::system_error.
+    void save_snapshot(const std::string &path);
+
+    /**
+     * save_snapshot_periodically:
+     * Saves a snapshot every @interval seconds if anything has changed. The
+     * snapshot is built on the main thread but written and synced on @db's
+     * thread. Disconnect the returned connection to stop.
+     */
+    sigc::connection save_snapshot_periodically(Database &db,
+            const std::string &path, unsigned interval);
+private:
+    template<class F> static void for_each_in_range(
+            const EPGEvent *first, const EPGEvent *last,
+            std::uint32_t from, std::uint32_t to, F f)
+    {
+        // Events don't overlap, so end times are also in order
+        auto it = std::partition_point(first, last,
+                [from](const EPGEvent &ev) { return ev.end() <= from; });
+        for (; it != last && it->start < to; ++it)
+            f(*it);
+    }
+
+    const EPGEvent *events_begin(const ServiceEvents &svc) const
+    {
+        return svc.snapshot ? snapshot_->events_begin(*svc.snapshot) :
+            svc.events.data();
+    }
+
+    const EPGEvent *events_end(const ServiceEvents &svc) const
+    {
+        return svc.snapshot ? snapshot_->events_end(*svc.snapshot) :
+            svc.events.data() + svc.events.size();
+    }
+
+    /// Copies a service's events out of the snapshot so they can be changed
+    void materialise(ServiceEvents &svc)
+    {
+        if (svc.snapshot)
+        {
+            svc.events.assign(events_begin(svc), events_end(svc));
+            svc.snapshot = nullptr;
+        }
+    }
+
+    EPGSnapshot::Image build_snapshot() const;
+
+    /// Adds the service if necessary
+    unsigned service_index(ServiceKey service);
+
+    /// Adds the service if necessary, and materialises it for changing
+    ServiceEvents &get_service(ServiceKey service);
+
+    EPGEvent make_event(const EITEvent &event);
+
+    /// Items are prepended to the text as "description: item" lines
+    std::string_view description_of(const EITEvent &event);
+
+    bool same_event(const EPGEvent &ev, const EITEvent &event);
+
+    /// Adds ev, replacing any events it overlaps
+    void merge_event(ServiceEvents &svc, const EPGEvent &ev);
+
+    void set_now_next(ServiceKey service, unsigned section_number,
+            const EPGEvent *event);
+
+    void index_event(ServiceKey service, const EPGEvent &ev)
+    {
+        if (search_)
+        {
+            search_->add(service, ev.event_id, ev.start,
+                    get_string(ev.title), get_string(ev.summary));
+        }
+    }
+
+    void unindex_event(ServiceKey service, const EPGEvent &ev)
+    {
+        if (search_)
+            search_->remove(service, ev.event_id, ev.start);
+        if (crids_)
+            crids_->remove(service, ev.event_id, ev.start);
+    }
+};
+
+}
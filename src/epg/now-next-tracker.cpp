@@ -0,0 +1,186 @@
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <cerrno>
+#include <cstring>
+
+#include <glib.h>
+
+#include <glibmm/main.h>
+
+#include <linux/dvb/dmx.h>
+
+#include "eit-harvester.h"
+#include "now-next-tracker.h"
+
+#include "si/short-event-descriptor.h"
+
+namespace logi
+{
+
+void NowNextTracker::start(bool freesat)
+{
+    stop();
+    start_filter(Section::EIT_PID);
+    if (freesat)
+        start_filter(EITHarvester::FREESAT_PF_PID);
+}
+
+void NowNextTracker::stop()
+{
+    // A changed_signal handler may stop or restart us from inside a
+    // filter's callback, so the filters are destroyed when that has returned
+    for (auto &f: filters_)
+    {
+        f->stop();
+        stopped_filters_.push_back(std::move(f));
+    }
+    filters_.clear();
+    if (!stopped_filters_.empty() && !reap_conn_.connected())
+    {
+        reap_conn_ = Glib::signal_idle().connect([this]()
+        {
+            stopped_filters_.clear();
+            return false;
+        });
+    }
+}
+
+void NowNextTracker::clear()
+{
+    slots_.clear();
+    index_.clear();
+    stats_ = Stats();
+}
+
+void NowNextTracker::start_filter(std::uint16_t pid)
+{
+    // 0x4E and 0x4F only; the default buffer is plenty for p/f
+    struct dmx_sct_filter_params params;
+    logi_priv::SectionFilterBase::get_params(params, pid,
+            Section::EIT_PF_TABLE, 0, 0, 0xfe, 0);
+    filters_.emplace_back(new SectionFilter<EITSection, NowNextTracker>
+            (rcv_, &params, *this, &NowNextTracker::filter_cb));
+}
+
+void NowNextTracker::filter_cb(int reason,
+        std::shared_ptr<EITSection> section)
+{
+    if (reason == EOVERFLOW)
+        g_warning("EIT p/f filter overflowed");
+    else if (reason)
+        g_critical("EIT p/f filter error: %s", std::strerror(reason));
+    else if (section)
+        process_section(*section);
+}
+
+const NowNextTracker::Slot *NowNextTracker::find(ServiceKey service) const
+{
+    auto it = index_.find(service);
+    return it == index_.end() ? nullptr : &slots_[it->second];
+}
+
+void NowNextTracker::process_section(const EITSection &sec)
+{
+    ++stats_.sections;
+    auto secnum = sec.section_number();
+    if (!sec.is_present_following() || secnum > 1)
+        return;
+
+    auto key = service_key(sec.original_network_id(),
+            sec.transport_stream_id(), sec.service_id());
+    auto it = index_.find(key);
+    Slot *slot;
+    if (it == index_.end())
+    {
+        index_.emplace(key, slots_.size());
+        slots_.emplace_back();
+        slot = &slots_.back();
+        slot->original_network_id = sec.original_network_id();
+        slot->transport_stream_id = sec.transport_stream_id();
+        slot->service_id = sec.service_id();
+    }
+    else
+    {
+        slot = &slots_[it->second];
+        if (slot->version_number == sec.version_number() &&
+                (slot->sections_seen & (1 << secnum)))
+        {
+            return;
+        }
+    }
+
+    if (slot->version_number != sec.version_number())
+    {
+        slot->version_number = sec.version_number();
+        slot->sections_seen = 0;
+    }
+    slot->sections_seen |= 1 << secnum;
+    ++stats_.updates;
+
+    if (update_event(sec, secnum ? slot->following : slot->present))
+    {
+        ++stats_.changes;
+        changed_signal_.emit(*slot, secnum ? FOLLOWING : PRESENT);
+    }
+}
+
+bool NowNextTracker::update_event(const EITSection &sec, Event &event)
+{
+    bool found = false;
+    bool changed = false;
+
+    sec.for_each_event([&](const EITSectionEventData &ev)
+    {
+        // Only one event is allowed per section
+        if (found)
+            return;
+        found = true;
+        std::time_t start = ev.start_time();
+        std::uint32_t duration = ev.duration();
+        std::uint8_t running_status = ev.running_status();
+        bool same_event = event.valid && event.event_id == ev.event_id() &&
+            event.start == start && event.duration == duration;
+        if (same_event && event.running_status == running_status)
+            return;
+        changed = true;
+        event.running_status = running_status;
+        if (same_event)
+            return;
+        event.valid = true;
+        event.event_id = ev.event_id();
+        event.start = start;
+        event.duration = duration;
+        event.title.clear();
+        ev.for_each_descriptor([&event](const Descriptor &desc)
+        {
+            if (desc.tag() == Descriptor::SHORT_EVENT && event.title.empty())
+                event.title = ShortEventDescriptor(desc).event_name();
+        });
+    });
+
+    if (!found && event.valid)
+    {
+        event = Event();
+        changed = true;
+    }
+    return changed;
+}
+
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <glibmm/ustring.h>
+#include <sigc++/sigc++.h>
+
+#include "receiver.h"
+#include "section-filter.h"
+#include "si/eit-section.h"
+
+namespace logi
+{
+
+/**
+ * NowNextTracker:
+ * Follows EIT present/following tables only, for showing what's on every
+ * channel without collecting schedules. Each service has one slot, updated
+ * in place; a section whose version and section number have already been
+ * seen is discarded after reading its header, so following the p/f PID of
+ * any multiplex costs very little.
+ */
+class NowNextTracker
+{
+public:
+    using ServiceKey = std::uint64_t;
+
+    /// Flags for ChangedSignal
+    enum
+    {
+        PRESENT = 1,
+        FOLLOWING = 2,
+    };
+
+    struct Event
+    {
+        bool valid = false;
+        std::uint8_t running_status = 0;
+        std::uint16_t event_id = 0;
+        std::time_t start = 0;
+        std::uint32_t duration = 0;
+        Glib::ustring title;
+    };
+
+    struct Slot
+    {
+        std::uint16_t original_network_id;
+        std::uint16_t transport_stream_id;
+        std::uint16_t service_id;
+        std::int8_t version_number = -1;
+        // Bit per section number, for the current version
+        std::uint8_t sections_seen = 0;
+        Event present;
+        Event following;
+    };
+
+    struct Stats
+    {
+        unsigned long sections = 0;
+        unsigned long updates = 0;
+        unsigned long changes = 0;
+    };
+
+    /**
+     * ChangedSignal:
+     * Raised when a service's present and/or following event changes, with
+     * PRESENT and/or FOLLOWING flags saying which.
+     */
+    using ChangedSignal = sigc::signal<void, const Slot &, unsigned>;
+private:
+    using FilterPtr =
+        std::unique_ptr<SectionFilter<EITSection, NowNextTracker>>;
+
+    std::shared_ptr<Receiver> rcv_;
+    std::vector<FilterPtr> filters_;
+    // Stopped filters wait for an idle callback to destroy them
+    std::vector<FilterPtr> stopped_filters_;
+    sigc::connection reap_conn_;
+    std::vector<Slot> slots_;
+    std::unordered_map<ServiceKey, unsigned> index_;
+    Stats stats_;
+    ChangedSignal changed_signal_;
+public:
+    /// @rcv may be null if sections are fed with process_section()
+    NowNextTracker(std::shared_ptr<Receiver> rcv = nullptr) : rcv_(rcv)
+    {}
+
+    ~NowNextTracker()
+    {
+        stop();
+        reap_conn_.disconnect();
+    }
+
+    NowNextTracker(const NowNextTracker &) = delete;
+    NowNextTracker(NowNextTracker &&) = delete;
+    NowNextTracker &operator=(const NowNextTracker &) = delete;
+    NowNextTracker &operator=(NowNextTracker &&) = delete;
+
+    static ServiceKey service_key(std::uint16_t orig_nw_id,
+            std::uint16_t ts_id, std::uint16_t service_id)
+    {
+        return (ServiceKey(orig_nw_id) << 32) | (ServiceKey(ts_id) << 16) |
+            service_id;
+    }
+
+    /**
+     * start:
+     * Filters tables 0x4E/0x4F on the standard EIT PID and, if @freesat is
+     * true, Freesat's p/f PID. The receiver must already be tuned, but can
+     * be on any multiplex because 0x4F covers the others.
+     */
+    void start(bool freesat = false);
+
+    /// Stops the filters but keeps the slots
+    void stop();
+
+    /// Forgets all services
+    void clear();
+
+    /// Public so that sections can be fed from other sources
+    void process_section(const EITSection &sec);
+
+    /// Returns nullptr if the service hasn't been seen. Adding a service
+    /// may move the slots, so don't keep the pointer.
+    const Slot *find(ServiceKey service) const;
+
+    const std::vector<Slot> &slots() const
+    {
+        return slots_;
+    }
+
+    ChangedSignal &changed_signal()
+    {
+        return changed_signal_;
+    }
+
+    const Stats &stats() const
+    {
+        return stats_;
+    }
+private:
+    void start_filter(std::uint16_t pid);
+
+    void filter_cb(int reason, std::shared_ptr<EITSection> section);
+
+    // Returns true if @event changed
+    static bool update_event(const EITSection &sec, Event &event);
+};
+
+}
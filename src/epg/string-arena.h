@@ -0,0 +1,131 @@
+#pragma once
+
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace logi
+{
+
+/**
+ * StringArena:
+ * Stores strings back to back in large chunks, so that thousands of EPG
+ * strings don't each need their own allocation, and refers to them with a
+ * 32-bit ref_t. Strings are never freed individually; rebuild the arena to
+ * reclaim space. Titles repeat a lot, so they can be interned.
+ */
+class StringArena
+{
+public:
+    /// 0 is always the empty string
+    using ref_t = std::uint32_t;
+
+    constexpr static unsigned CHUNK_SHIFT = 20;
+    constexpr static std::size_t CHUNK_SIZE = std::size_t(1) << CHUNK_SHIFT;
+    /// Each string is prefixed by a 16-bit length
+    constexpr static std::size_t MAX_LENGTH = 0xffff;
+
+    StringArena() = default;
+
+    StringArena(const StringArena &) = delete;
+    StringArena &operator=(const StringArena &) = delete;
+    StringArena(StringArena &&) = default;
+    StringArena &operator=(StringArena &&) = default;
+
+    /// Copies s into the arena. Strings longer than MAX_LENGTH are truncated.
+    ref_t add(std::string_view s)
+    {
+        if (s.empty())
+            return 0;
+        if (s.size() > MAX_LENGTH)
+            s = s.substr(0, MAX_LENGTH);
+        std::size_t need = s.size() + 2;
+        if (chunks_.empty() || used_ + need > CHUNK_SIZE)
+        {
+            chunks_.emplace_back(new char[CHUNK_SIZE]);
+            // Offset 0 of chunk 0 would look like the empty string
+            used_ = chunks_.size() == 1 ? 1 : 0;
+        }
+        char *p = chunks_.back().get() + used_;
+        std::uint16_t len = s.size();
+        std::memcpy(p, &len, 2);
+        std::memcpy(p + 2, s.data(), s.size());
+        ref_t ref = ((chunks_.size() - 1) << CHUNK_SHIFT) | used_;
+        used_ += need;
+        bytes_ += need;
+        return ref;
+    }
+
+    /// Like add(), but returns the same ref for equal strings
+    ref_t intern(std::string_view s)
+    {
+        if (s.empty())
+            return 0;
+        auto it = interned_.find(s);
+        if (it != interned_.end())
+            return it->second;
+        auto ref = add(s);
+        // The key refers to the arena's copy, which never moves
+        interned_.emplace(get(ref), ref);
+        return ref;
+    }
+
+    std::string_view get(ref_t ref) const
+    {
+        if (!ref)
+            return std::string_view();
+        const char *p = chunks_[ref >> CHUNK_SHIFT].get() +
+            (ref & (CHUNK_SIZE - 1));
+        std::uint16_t len;
+        std::memcpy(&len, p, 2);
+        return std::string_view(p + 2, len);
+    }
+
+    /// Bytes used by strings, including their length prefixes
+    std::size_t bytes() const
+    {
+        return bytes_;
+    }
+
+    std::size_t interned_size() const
+    {
+        return interned_.size();
+    }
+
+    void clear()
+    {
+        interned_.clear();
+        chunks_.clear();
+        used_ = 0;
+        bytes_ = 0;
+    }
+private:
+    std::vector<std::unique_ptr<char[]>> chunks_;
+    std::size_t used_ = 0;
+    std::size_t bytes_ = 0;
+    std::unordered_map<std::string_view, ref_t> interned_;
+};
+
+}
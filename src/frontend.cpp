@@ -101,7 +101,10 @@ void Frontend::tune(const TuningProperties &tuning_props)
                 "Unable to clear tuning properties");
     }
 
-    if (ioctl(fd, FE_SET_PROPERTY, tuning_props.get_props()) < 0)
+    struct dtv_property props[TuningProperties::MAX_KERNEL_PROPS];
+    struct dtv_properties dtv_props = { .num = tuning_props.expand(props),
+        .props = props };
+    if (ioctl(fd, FE_SET_PROPERTY, &dtv_props) < 0)
     {
         throw report_errno(FrontendError::TUNE,
                 "Unable to set tuning properties");
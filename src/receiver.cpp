@@ -49,8 +49,7 @@ Receiver::Receiver(std::shared_ptr<Frontend> frontend,
     }
 }
 
-void Receiver::tune(std::shared_ptr<TuningProperties> tuning_props,
-        guint timeout)
+void Receiver::tune(const TuningProperties &tuning_props, guint timeout)
 {
     lock_conn_.disconnect();
     timeout_conn_.disconnect();
@@ -65,11 +64,11 @@ void Receiver::tune(std::shared_ptr<TuningProperties> tuning_props,
                 fd, Glib::IO_IN | Glib::IO_ERR | Glib::IO_PRI | Glib::IO_HUP);
         timeout_conn_ = Glib::signal_timeout().connect(
                 sigc::mem_fun(*this, &Receiver::timeout_cb), timeout);
-        frontend_->tune(*tuned_to_);
+        frontend_->tune(tuned_to_);
     }
     catch (...)
     {
-        tuned_to_.reset();
+        tuned_to_.clear();
         nolock_signal_.emit();
         throw;
     }
@@ -79,7 +78,7 @@ void Receiver::cancel()
 {
     if (lock_conn_.connected())
     {
-        tuned_to_.reset();
+        tuned_to_.clear();
         lock_conn_.disconnect();
     }
     timeout_conn_.disconnect();
@@ -39,7 +39,7 @@ class Receiver
 {
 private:
     std::shared_ptr<Frontend> frontend_;
-    std::shared_ptr<TuningProperties> tuned_to_;
+    TuningProperties tuned_to_;
     sigc::connection lock_conn_, timeout_conn_;
     fe_delivery_system_t sd_delsys_, hd_delsys_;
     sigc::signal<void> lock_signal_, nolock_signal_, detune_signal_;
@@ -83,9 +83,9 @@ public:
      * different channel.
      * @timeout: In milliseconds.
      */
-    void tune(std::shared_ptr<TuningProperties> tuning_props, guint timeout);
+    void tune(const TuningProperties &tuning_props, guint timeout);
 
-    std::shared_ptr<TuningProperties> current_tuning()
+    const TuningProperties &current_tuning() const
     {
         return tuned_to_;
     }
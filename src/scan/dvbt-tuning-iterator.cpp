@@ -28,12 +28,12 @@ DvbtTuningIterator::DvbtTuningIterator(guint32 first_f, guint32 last_f,
     bandwidth_{bandwidth ? bandwidth : step}
 {}
 
-std::shared_ptr<TuningProperties> DvbtTuningIterator::next()
+TuningProperties DvbtTuningIterator::next()
 {
     if (current_ > last_)
-        return nullptr;
+        return TuningProperties();
 
-    TuningProperties *props = new TuningProperties(
+    TuningProperties props(
         {
             {DTV_DELIVERY_SYSTEM, SYS_DVBT},
             {DTV_FREQUENCY, current_},
@@ -42,7 +42,7 @@ std::shared_ptr<TuningProperties> DvbtTuningIterator::next()
 
     current_ += step_;
 
-    return std::shared_ptr<TuningProperties>(props);
+    return props;
 }
 
 void DvbtTuningIterator::reset()
@@ -43,7 +43,7 @@ public:
 
     // Default copy/move are OK
 
-    std::shared_ptr<TuningProperties> next() override;
+    TuningProperties next() override;
 
     void reset() override;
 };
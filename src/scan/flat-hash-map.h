@@ -0,0 +1,156 @@
+#pragma once
+
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <cstdint>
+#include <deque>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace logi
+{
+
+/**
+ * FlatHashMap:
+ * A map for integer keys which never has elements removed, only cleared.
+ * The elements are kept in insertion order in a deque, so references to
+ * them stay valid as the map grows, and they're found via an open-addressing
+ * (linear probing) table of indices, which is much friendlier to the cache
+ * than std::map's tree. Iterating yields std::pair<const K, V> like std::map,
+ * but in insertion order instead of key order.
+ */
+template<class K, class V> class FlatHashMap
+{
+public:
+    using value_type = std::pair<const K, V>;
+    using iterator = typename std::deque<value_type>::iterator;
+    using const_iterator = typename std::deque<value_type>::const_iterator;
+
+    FlatHashMap()
+    {
+        slots_.resize(MIN_SLOTS);
+    }
+
+    /// Returns the existing value for key or a new default-constructed one
+    V &operator[](K key)
+    {
+        auto &slot = find_slot(key);
+        if (slot)
+            return elements_[slot - 1].second;
+        if ((elements_.size() + 1) * 2 > slots_.size())
+        {
+            grow();
+            return insert(find_slot(key), key);
+        }
+        return insert(slot, key);
+    }
+
+    /// Returns nullptr if key isn't present
+    V *find(K key)
+    {
+        auto slot = find_slot(key);
+        return slot ? &elements_[slot - 1].second : nullptr;
+    }
+
+    const V *find(K key) const
+    {
+        return const_cast<FlatHashMap *>(this)->find(key);
+    }
+
+    std::size_t count(K key) const
+    {
+        return find(key) ? 1 : 0;
+    }
+
+    std::size_t size() const
+    {
+        return elements_.size();
+    }
+
+    bool empty() const
+    {
+        return elements_.empty();
+    }
+
+    void clear()
+    {
+        elements_.clear();
+        slots_.assign(MIN_SLOTS, 0);
+        shift_ = MIN_SHIFT;
+    }
+
+    iterator begin() { return elements_.begin(); }
+    iterator end() { return elements_.end(); }
+    const_iterator begin() const { return elements_.begin(); }
+    const_iterator end() const { return elements_.end(); }
+private:
+    constexpr static std::size_t MIN_SLOTS = 16;
+    // 64 - log2(MIN_SLOTS)
+    constexpr static unsigned MIN_SHIFT = 60;
+
+    // Each slot holds an index into elements_ + 1, or 0 if it's empty
+    std::vector<std::uint32_t> slots_;
+    std::deque<value_type> elements_;
+    // 64 - log2(slots_.size())
+    unsigned shift_ = MIN_SHIFT;
+
+    std::size_t hash(K key) const
+    {
+        // Fibonacci hashing spreads sequential and packed keys evenly, but
+        // only in the top bits of the product, so those are the ones we use
+        return (std::uint64_t(key) * 0x9E3779B97F4A7C15ull) >> shift_;
+    }
+
+    std::uint32_t &find_slot(K key)
+    {
+        std::size_t mask = slots_.size() - 1;
+        for (std::size_t i = hash(key); ; i = (i + 1) & mask)
+        {
+            auto &slot = slots_[i];
+            if (!slot || elements_[slot - 1].first == key)
+                return slot;
+        }
+    }
+
+    V &insert(std::uint32_t &slot, K key)
+    {
+        elements_.emplace_back(std::piecewise_construct,
+                std::forward_as_tuple(key), std::forward_as_tuple());
+        slot = elements_.size();
+        return elements_.back().second;
+    }
+
+    void grow()
+    {
+        slots_.assign(slots_.size() * 2, 0);
+        --shift_;
+        std::size_t mask = slots_.size() - 1;
+        for (std::uint32_t n = 0; n < elements_.size(); ++n)
+        {
+            auto i = hash(elements_[n].first);
+            while (slots_[i])
+                i = (i + 1) & mask;
+            slots_[i] = n + 1;
+        }
+    }
+};
+
+}
@@ -179,11 +179,12 @@ void FreesatBATProcessor::process_descriptor(const Descriptor &desc)
                     std::uint32_t key = (current_nw_id_ << 16) |
                         r.region_code();
                     auto &rn = regions_[key];
-                    if (!rn.size())
+                    if (!rn)
                     {
-                        rn = r.name();
+                        rn = region_names_.intern(r.name());
                         g_debug("Discovered region %04x:%04x %s",
-                                current_nw_id_, r.region_code(), rn.c_str());
+                                current_nw_id_, r.region_code(),
+                                rn ? region_names_[rn].c_str() : "");
                     }
                 }
             }
@@ -233,7 +234,7 @@ void FreesatChannelScanner::start(MultiScanner *multi_scanner)
     bat_filter_.reset(new SectionFilter<BATSection, FreesatChannelScanner>(
             multi_scanner->get_receiver(), *this,
             &FreesatChannelScanner::bat_filter_cb,
-            FS_BAT_PID, Section::BAT_TABLE, 0, 5000, 0xff, 0));
+            FS_BAT_PID, Section::BAT_TABLE, 0, filter_timeout(), 0xff, 0));
     SingleChannelScanner::start(multi_scanner);
 }
 
@@ -272,7 +273,8 @@ std::unique_ptr<NITProcessor> FreesatChannelScanner::new_nit_processor()
 
 std::unique_ptr<NITProcessor> FreesatChannelScanner::new_bat_processor()
 {
-    return std::unique_ptr<NITProcessor>(new FreesatBATProcessor(regions_));
+    return std::unique_ptr<NITProcessor>(new FreesatBATProcessor(regions_,
+                region_names_));
 }
 
 bool FreesatChannelScanner::filter_trackers_complete() const
@@ -306,6 +308,15 @@ void FreesatChannelScanner::bat_filter_cb(int reason,
             bat_status_ = TableTracker::OK;
     }
 
+    // There's a sub-table for each bouquet so the filter can't be restricted
+    // to a new version
+    if (monitoring_)
+    {
+        if (bd)
+            monitor_section(*section, bd->nit_proc->last_result());
+        return;
+    }
+
     if (!section || bat_status_ == TableTracker::COMPLETE
         || bat_status_ == TableTracker::ERROR)
     {
@@ -331,7 +342,8 @@ void FreesatChannelScanner::commit_extras_to_database(Database &db,
     for (const auto &reg: regions_)
     {
         const auto k = reg.first;
-        reg_v.emplace_back((k >> 16) & 0xffff, k & 0xffff, reg.second);
+        reg_v.emplace_back((k >> 16) & 0xffff, k & 0xffff,
+                reg.second ? region_names_[reg.second] : Glib::ustring());
     }
     g_print("Inserting regions\n");
     db.run_statement(ins_reg, reg_v);
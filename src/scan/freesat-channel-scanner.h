@@ -22,13 +22,15 @@
 #include <map>
 #include <memory>
 
+#include "name-interner.h"
 #include "single-channel-scanner.h"
 
 namespace logi
 {
 
-// Key is (bouquet_id << 16) | region_code
-using FreesatRegionMap = std::map<std::uint32_t, std::string>;
+// Key is (bouquet_id << 16) | region_code, value is an id from an interner
+// because each bouquet repeats most of the same region names.
+using FreesatRegionMap = std::map<std::uint32_t, NameInterner::id_t>;
 
 class FreesatNITProcessor: public NITProcessor
 {
@@ -39,7 +41,8 @@ protected:
 class FreesatBATProcessor: public NITProcessor
 {
 public:
-    FreesatBATProcessor(FreesatRegionMap &rmap) : regions_(rmap)
+    FreesatBATProcessor(FreesatRegionMap &rmap, NameInterner &names) :
+        regions_(rmap), region_names_(names)
     {}
 protected:
     virtual void process_descriptor(const Descriptor &desc);
@@ -49,6 +52,7 @@ private:
     constexpr static std::uint32_t FREESAT_PRIVATE_DATA_SPECIFIER = 0x46534154;
 
     FreesatRegionMap &regions_;
+    NameInterner &region_names_;
 };
 
 /**
@@ -68,6 +72,7 @@ private:
     TableTracker::Result bat_status_;
     BouquetData::MapT bouquets_;
     FreesatRegionMap regions_;
+    NameInterner region_names_;
 public:
     virtual void start(MultiScanner *multi_scanner) override;
 
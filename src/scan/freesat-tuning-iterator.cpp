@@ -22,13 +22,13 @@
 namespace logi
 {
 
-std::shared_ptr<TuningProperties> FreesatTuningIterator::next()
+TuningProperties FreesatTuningIterator::next()
 {
     auto s = presets_[iter_];
     if (!s)
-        return nullptr;
+        return TuningProperties();
     ++iter_;
-    return std::make_shared<TuningProperties>(s);
+    return TuningProperties(s);
 }
 
 void FreesatTuningIterator::reset()
@@ -31,7 +31,7 @@ public:
 
     // Default copy/move are OK
 
-    std::shared_ptr<TuningProperties> next() override;
+    TuningProperties next() override;
 
     void reset() override;
 private:
@@ -0,0 +1,57 @@
+#pragma once
+
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <utility>
+#include <vector>
+
+#include "tuning-iterator.h"
+
+namespace logi
+{
+
+/**
+ * ListTuningIterator:
+ * Yields tunings from a list, eg one loaded by TuningImporter.
+ */
+class ListTuningIterator : public TuningIterator
+{
+public:
+    ListTuningIterator(std::vector<TuningProperties> tunings) :
+        tunings_(std::move(tunings)), iter_(0)
+    {}
+
+    TuningProperties next() override
+    {
+        if (iter_ >= tunings_.size())
+            return TuningProperties();
+        return tunings_[iter_++];
+    }
+
+    void reset() override
+    {
+        iter_ = 0;
+    }
+private:
+    std::vector<TuningProperties> tunings_;
+    std::size_t iter_;
+};
+
+}
@@ -18,14 +18,20 @@
 */
 
 #include <algorithm>
+#include <map>
+
+#include <glibmm/main.h>
 
 #include "single-channel-scanner.h"
 #include "multi-scanner.h"
 
+#include "si/cell-frequency-link-descriptor.h"
+#include "si/frequency-list-descriptor.h"
 #include "si/network-name-descriptor.h"
 #include "si/service-descriptor.h"
 #include "si/service-list-descriptor.h"
 #include "si/sat-delsys-descriptor.h"
+#include "si/t2-delsys-descriptor.h"
 #include "si/terr-delsys-descriptor.h"
 
 namespace logi
@@ -55,6 +61,9 @@ void MultiScanner::cancel()
 
     lock_conn_.disconnect();
     nolock_conn_.disconnect();
+    monitor_lock_conn_.disconnect();
+    monitor_flush_conn_.disconnect();
+    monitoring_ = false;
 
     channel_scanner_->cancel();
 
@@ -71,10 +80,16 @@ void MultiScanner::channel_finished(bool success)
 
     if (current_ts_data_)
     {
-        current_ts_data_->set_scan_status(success ?
-                TransportStreamData::SCANNED : TransportStreamData::PENDING);
+        if (success)
+            current_ts_data_->set_scan_status(TransportStreamData::SCANNED);
+        else
+            retry_current_transport();
     }
 
+    // Let the database write what we've found while we tune to the next
+    // channel.
+    stream_commit_batch();
+
     next();
 }
 
@@ -91,10 +106,10 @@ void MultiScanner::next()
     for (const auto &tspair: ts_data_)
     {
         const auto &tsdat = tspair.second;
-        auto props = tsdat.get_tuning();
+        const auto &props = tsdat.get_tuning();
         g_debug("  id %d/%d, desc %s, status %d",
                 tspair.first, tsdat.get_transport_stream_id(),
-                props ? props->describe().c_str() : "null",
+                props ? props.describe().c_str() : "null",
                 tsdat.get_scan_status());
     }
     */
@@ -102,22 +117,34 @@ void MultiScanner::next()
     // Loop in case tune fails
     while (true)
     {
-        std::shared_ptr<TuningProperties> props = nullptr;
+        TuningProperties props;
         current_ts_data_ = nullptr;
-        std::uint32_t eq;
 
         // First look for any discovered (in NIT) transports that haven't been
         // scanned yet.
-        for (auto &tsdat: ts_data_)
+        while (!pending_ts_queue_.empty())
         {
-            if (tsdat.second.get_scan_status() == TransportStreamData::PENDING
-                    && (props = tsdat.second.get_tuning()) != nullptr
-                    && !scanned_equivalences_.count
-                        (eq = props->get_equivalence_value()))
+            auto tsdat = pending_ts_queue_.top().second;
+            pending_ts_queue_.pop();
+            if (tsdat->get_scan_status() != TransportStreamData::PENDING)
+                continue;
+            // Try the delivery system descriptor's frequency first, then
+            // alternatives from frequency list and cell descriptors
+            props = tsdat->next_candidate(
+                    [this](const TuningProperties &t)
+                    {
+                        return scanned_tunings_.count(t.get_scan_key()) != 0;
+                    });
+            if (!props)
             {
-                current_ts_data_ = &tsdat.second;
-                break;
+                // Every candidate has been visited, including by the sweep,
+                // without yielding this transport, so don't let it hold up
+                // check_harvest()
+                tsdat->set_scan_status(TransportStreamData::FAILED);
+                continue;
             }
+            current_ts_data_ = tsdat;
+            break;
         }
 
         // If there's nothing to be scanned in NIT go through the iterator.
@@ -126,8 +153,8 @@ void MultiScanner::next()
             do
             {
                 props = iter_->next();
-            } while (props && scanned_equivalences_.count
-                    (eq = props->get_equivalence_value()));
+            } while (props &&
+                    scanned_tunings_.count(props.get_scan_key()));
         }
 
         if (!props)
@@ -136,8 +163,8 @@ void MultiScanner::next()
             return;
         }
 
-        scanned_equivalences_.insert(eq);
-        g_print("Tuning to %s... ", props->describe().c_str());
+        scanned_tunings_.insert(props.get_scan_key());
+        g_print("Tuning to %s... ", props.describe().c_str());
         try
         {
             rcv_->tune(props, 5000);
@@ -159,33 +186,53 @@ void MultiScanner::lock_cb()
 
 void MultiScanner::nolock_cb()
 {
-    if (current_ts_data_)
-        current_ts_data_->set_scan_status(TransportStreamData::FAILED);
     g_print("No lock\n");
+    if (current_ts_data_)
+        retry_current_transport();
     next();
 }
 
+void MultiScanner::retry_current_transport()
+{
+    // Queue it again so that next() tries its next candidate frequency, or
+    // marks it as failed if there aren't any more
+    auto tsdat = current_ts_data_;
+    tsdat->set_scan_status(TransportStreamData::PENDING);
+    pending_ts_queue_.emplace((std::uint32_t(tsdat->get_original_network_id())
+                << 16) | tsdat->get_transport_stream_id(), tsdat);
+}
+
 TransportStreamData &
 MultiScanner::get_transport_stream_data(std::uint16_t orig_nw_id,
         std::uint16_t ts_id)
 {
     std::uint32_t key = (std::uint32_t(orig_nw_id) << 16) |
         (std::uint32_t) ts_id;
-    auto &tsdat = ts_data_[key];
-    tsdat.set_transport_stream_id(ts_id);
-    tsdat.set_original_network_id(orig_nw_id);
-    current_ts_data_ = &tsdat;
-    return tsdat;
+    auto tsdat = ts_data_.find(key);
+    if (!tsdat)
+    {
+        tsdat = &ts_data_[key];
+        tsdat->set_transport_stream_id(ts_id);
+        tsdat->set_original_network_id(orig_nw_id);
+        tsdat->attach_counters(&counters_);
+    }
+    return *tsdat;
 }
 
 ServiceData &
 MultiScanner::get_service_data(std::uint16_t orig_nw_id,
         std::uint16_t service_id)
 {
-    auto &sdat = service_data_[(orig_nw_id << 16) | service_id];
-    sdat.set_original_network_id(orig_nw_id);
-    sdat.set_service_id(service_id);
-    return sdat;
+    std::uint32_t key = (std::uint32_t(orig_nw_id) << 16) | service_id;
+    auto sdat = service_data_.find(key);
+    if (!sdat)
+    {
+        sdat = &service_data_[key];
+        sdat->set_original_network_id(orig_nw_id);
+        sdat->set_service_id(service_id);
+        sdat->attach_counters(&counters_);
+    }
+    return *sdat;
 }
 
 void MultiScanner::process_service_list_descriptor(std::uint16_t orig_nw_id,
@@ -195,13 +242,12 @@ void MultiScanner::process_service_list_descriptor(std::uint16_t orig_nw_id,
 
     auto &tsdat = get_transport_stream_data(orig_nw_id, ts_id);
     tsdat.set_network_id(nw_id);
-    const auto &svcs = sd.get_services();
-    for (const auto &s: svcs)
+    sd.for_each_service([&](const ServiceInfo &s)
     {
         tsdat.add_service_id(s.service_id());
         auto &sdat = get_service_data(orig_nw_id, s.service_id());
         sdat.set_ts_id(ts_id);
-    }
+    });
 
     /*
     g_print("Services on ts %d:\n", ts_id);
@@ -216,39 +262,94 @@ void MultiScanner::process_service_list_descriptor(std::uint16_t orig_nw_id,
 void MultiScanner::process_delivery_system_descriptor(std::uint16_t nw_id,
         std::uint16_t orig_nw_id, std::uint16_t ts_id, const Descriptor &desc)
 {
-    TuningProperties *tuning = nullptr;
+    auto &tsdat = get_transport_stream_data(orig_nw_id, ts_id);
+    tsdat.set_network_id(nw_id);
+    // The NIT repeats throughout the scan, so only build properties for
+    // transports we haven't seen before. A monitor only sees new versions of
+    // the NIT, which may have changed the tuning.
+    if (tsdat.get_tuning() && !monitoring_)
+        return;
+
+    TuningProperties tuning;
     if (desc.tag() == Descriptor::TERRESTRIAL_DELIVERY_SYSTEM)
     {
-        TerrestrialDeliverySystemDescriptor d(desc);
-        tuning = d.get_tuning_properties();
+        tuning = TerrestrialDeliverySystemDescriptor(desc)
+            .get_tuning_properties();
     }
     else if (desc.tag() == Descriptor::SATELLITE_DELIVERY_SYSTEM)
     {
-        SatelliteDeliverySystemDescriptor d(desc);
-        tuning = d.get_tuning_properties();
+        tuning = SatelliteDeliverySystemDescriptor(desc)
+            .get_tuning_properties();
     }
-    auto &tsdat = get_transport_stream_data(orig_nw_id, ts_id);
-    tsdat.set_network_id(nw_id);
-    if (!tsdat.get_tuning())
-        g_debug("  New TS %d: %s", ts_id, tuning->describe().c_str());
-    else
-        g_debug("  Known TS %d: %s", ts_id, tuning->describe().c_str());
+    else if (desc.tag() == Descriptor::EXTENSION &&
+            ExtensionDescriptor(desc).tag_extension() ==
+                ExtensionDescriptor::T2_DELIVERY_SYSTEM)
+    {
+        // Without this Freeview's T2 muxes can only be found by sweeping
+        tuning = T2DeliverySystemDescriptor(desc).get_tuning_properties();
+    }
+    if (!tuning)
+        return;
+    if (monitoring_)
+    {
+        tsdat.update_tuning(tuning);
+        return;
+    }
+    g_debug("  New TS %d: %s", ts_id, tuning.describe().c_str());
     tsdat.set_tuning(tuning);
+    // If the sweep has tuned to this transport without knowing its ts_id
+    // claim it now, so that it counts as scanned when this channel finishes.
+    // Compare scan keys, because == treats T and T2, and all of a T2
+    // channel's PLPs, as the same.
+    if (!current_ts_data_ && rcv_ &&
+            tuning.get_scan_key() == rcv_->current_tuning().get_scan_key())
+        current_ts_data_ = &tsdat;
+    if (tsdat.get_scan_status() == TransportStreamData::PENDING)
+    {
+        pending_ts_queue_.emplace((std::uint32_t(orig_nw_id) << 16) | ts_id,
+                &tsdat);
+    }
+}
+
+void MultiScanner::process_frequency_list_descriptor(std::uint16_t orig_nw_id,
+        std::uint16_t ts_id, const Descriptor &desc)
+{
+    auto &tsdat = get_transport_stream_data(orig_nw_id, ts_id);
+
+    // Rank the broadcaster's list of alternatives first, then the main
+    // frequency of each cell, then transposers
+    if (desc.tag() == Descriptor::FREQUENCY_LIST)
+    {
+        FrequencyListDescriptor(desc).for_each_frequency(
+                [&tsdat](std::uint32_t freq)
+        {
+            tsdat.add_alternative_frequency(freq, 0);
+        });
+    }
+    else if (desc.tag() == Descriptor::CELL_FREQUENCY_LINK)
+    {
+        CellFrequencyLinkDescriptor(desc).for_each_frequency(
+                [&tsdat](std::uint16_t, std::uint32_t freq, bool transposer)
+        {
+            tsdat.add_alternative_frequency(freq, transposer ? 2 : 1);
+        });
+    }
 }
 
 void MultiScanner::process_service_descriptor(std::uint16_t orig_nw_id,
         std::uint16_t ts_id, std::uint16_t service_id, const Descriptor &desc)
 {
     ServiceDescriptor sdesc(desc);
+    // Decode each string once; they're moved or interned below
+    auto name = sdesc.service_name();
+    auto provider = sdesc.service_provider_name();
     g_debug("Service %d onw %d type %d name '%s' provider '%s'",
-            service_id, orig_nw_id,
-            sdesc.service_type(),
-            sdesc.service_name().c_str(),
-            sdesc.service_provider_name().c_str());
+            service_id, orig_nw_id, sdesc.service_type(),
+            name.c_str(), provider.c_str());
     auto &sdat = get_service_data(orig_nw_id, service_id);
     sdat.set_scanned();
-    sdat.set_name(sdesc.service_name());
-    sdat.set_provider_name(sdesc.service_provider_name());
+    sdat.set_name(std::move(name));
+    sdat.set_provider_id(provider_names_.intern(provider));
     sdat.set_ts_id(ts_id);
     sdat.set_service_type(sdesc.service_type());
 }
@@ -256,9 +357,16 @@ void MultiScanner::process_service_descriptor(std::uint16_t orig_nw_id,
 void MultiScanner::set_lcn(std::uint16_t nw_id, std::uint16_t service_id,
         std::uint16_t region_code, std::uint16_t lcn, std::uint16_t freesat_id)
 {
-    lcn_data_[(std::uint64_t(freesat_id) << 48) |
+    std::uint64_t key = (std::uint64_t(freesat_id) << 48) |
         (std::uint64_t(region_code) << 32) |
-        (std::uint64_t(nw_id) << 16) | service_id] = lcn;
+        (std::uint64_t(nw_id) << 16) | service_id;
+    auto &value = lcn_data_[key];
+    if (value != lcn)
+    {
+        value = lcn;
+        if (monitoring_)
+            dirty_lcns_.push_back(key);
+    }
 }
 
 bool MultiScanner::check_harvest()
@@ -279,38 +387,16 @@ bool MultiScanner::check_harvest()
     }
 
     if ((policy & SingleChannelScanner::SCAN_ALL_DISCOVERED_TS) &&
-        !std::all_of(ts_data_.begin(), ts_data_.end(),
-        [](const std::pair<std::uint16_t, const TransportStreamData &> &ts)
-        {
-            return ts.second.get_scan_status() != TransportStreamData::PENDING;
-        }))
+            counters_.pending_transports)
     {
-        /*
-        g_print("Outstanding transports:\n");
-        for (const auto &ts: ts_data_)
-        {
-            if (ts.second.get_scan_status() == TransportStreamData::PENDING)
-                g_print("%d ", ts.second.get_transport_stream_id());
-        }
-        g_print("\n");
-        */
         return false;
     }
 
+    // Incomplete until every service referred to by a service list has been
+    // found in an SDT
     if ((policy & SingleChannelScanner::FIND_ALL_SERVICES) &&
-        std::all_of(service_data_.begin(), service_data_.end(),
-        [](const std::pair<std::uint16_t, const ServiceData &> &s)
-        { return s.second.get_scanned(); }))
+            counters_.unscanned_services)
     {
-        /*
-        g_print("Outstanding services:\n");
-        for (const auto &s: service_data_)
-        {
-            if (!s.second.get_scanned())
-                g_print("%d:%d ", s.first & 0xffff, s.second.get_ts_id());
-        }
-        g_print("\n");
-        */
         return false;
     }
 
@@ -321,130 +407,330 @@ bool MultiScanner::check_harvest()
 void MultiScanner::process_network_name(std::uint16_t network_id,
         const Glib::ustring &name)
 {
-    nw_data_[network_id] = NetworkNameData(network_id, name);
+    auto &nw = nw_data_[network_id];
+    if (nw.get_network_name() != name)
+    {
+        nw = NetworkNameData(network_id, name);
+        dirty_networks_.push_back(network_id);
+    }
 }
 
-void MultiScanner::commit_to_database(Database &db, const char *source)
+void MultiScanner::set_streaming_commit(Database &db, const char *source)
+{
+    stream_db_ = &db;
+    stream_source_ = source;
+}
+
+void MultiScanner::take_commit_batch(CommitBatch &batch, bool extras)
 {
-    db.queue_function([this, &db, source]()
-    {
-        auto ins_nw = db.get_insert_network_info_statement(source);
-        auto ins_tuning = db.get_insert_tuning_statement(source);
-        auto ins_trans_serv =
-            db.get_insert_transport_services_statement(source);
-        auto ins_serv_id = db.get_insert_service_id_statement(source);
-        auto ins_serv_name = db.get_insert_service_name_statement(source);
-        auto ins_prov_nm = db.get_insert_provider_name_statement(source);
-        auto ins_serv_prov =
-            db.get_insert_service_provider_id_statement(source);
-        auto ins_nw_lcn = db.get_insert_network_lcn_statement(source);
-        auto query_prov_id = db.get_provider_id_query(source);
-
-        std::vector<std::tuple<id_t, Glib::ustring>>            nw_v;
-        std::vector<std::tuple<id_t, id_t, id_t, id_t, id_t >>  tuning_v;
-        std::vector<std::tuple<id_t, id_t, id_t, id_t>>         trans_serv_v;
-        std::vector<std::tuple<id_t, id_t, id_t, id_t, id_t>>   serv_id_v;
-        std::vector<std::tuple<id_t, id_t, Glib::ustring>>      serv_name_v;
-        std::vector<std::tuple<Glib::ustring>>                  prov_nm_v;
-        std::vector<std::tuple<id_t, id_t, id_t>>               serv_prov_v;
-        std::vector<std::tuple<id_t, id_t, id_t, id_t, id_t>>   nw_lcn_v;
-
-        g_print("Committing data...\n");
-
-        for (const auto &nw: nw_data_)
+    for (auto nw_id: dirty_networks_)
+    {
+        batch.networks.emplace_back(nw_id,
+                nw_data_[nw_id].get_network_name());
+    }
+    dirty_networks_.clear();
+
+    for (auto key: counters_.dirty_transports)
+    {
+        auto p = ts_data_.find(key);
+        if (!p || !p->is_dirty())
+            continue;
+        auto &ts = *p;
+        const auto &tuning = ts.get_tuning();
+        if (extras && tuning)
         {
-            g_debug("  Network %s", nw.second.get_network_name().c_str());
-            nw_v.emplace_back(nw.first, nw.second.get_network_name());
+            batch.retuned.emplace_back(ts.get_original_network_id(),
+                    ts.get_transport_stream_id());
         }
-        g_print("Inserting networks\n");
-        db.run_statement(ins_nw, nw_v);
-
-        for (const auto &tsp: ts_data_)
+        for (const auto &prop: tuning)
         {
-            const auto &ts = tsp.second;
-            auto tuning = ts.get_tuning();
-            if (tuning)
-            {
-                //g_print("%s\n", tuning->linuxtv_description().c_str());
-                auto props = tuning->get_props();
-                for (std::uint32_t n = 0; n < props->num; ++n)
-                {
-                    const auto &prop = props->props[n];
-                    tuning_v.emplace_back(ts.get_original_network_id(),
-                            ts.get_transport_stream_id(),
-                            ts.get_network_id(),
-                            prop.cmd, prop.u.data);
-                }
-            }
-            for (const auto &s: ts.get_service_ids())
-            {
-                g_debug("  service %d onw %d nw %d", s,
-                        ts.get_original_network_id(), ts.get_network_id());
-                trans_serv_v.emplace_back(ts.get_original_network_id(),
-                        ts.get_network_id(), ts.get_transport_stream_id(),
-                        s);
-
-            }
+            batch.tuning.emplace_back(ts.get_original_network_id(),
+                    ts.get_transport_stream_id(),
+                    ts.get_network_id(),
+                    prop.cmd, prop.data);
+        }
+        for (const auto &s: ts.get_service_ids())
+        {
+            batch.trans_serv.emplace_back(ts.get_original_network_id(),
+                    ts.get_network_id(), ts.get_transport_stream_id(), s);
         }
-        g_print("Inserting tuning data\n");
-        db.run_statement(ins_tuning, tuning_v);
-        g_print("Inserting services per transport\n");
-        db.run_statement(ins_trans_serv, trans_serv_v);
+        ts.clear_dirty();
+    }
+    counters_.dirty_transports.clear();
 
-        for (const auto &sp: service_data_)
+    for (auto key: counters_.dirty_services)
+    {
+        auto p = service_data_.find(key);
+        if (!p || !p->is_dirty())
+            continue;
+        auto &s = *p;
+        batch.serv_ids.emplace_back(s.get_original_network_id(),
+                s.get_service_id(), s.get_ts_id(), s.get_service_type(),
+                s.get_free_ca_mode());
+        if (extras && s.get_provider_id())
         {
-            const auto &s = sp.second;
-            serv_id_v.emplace_back(s.get_original_network_id(),
-                    s.get_service_id(), s.get_ts_id(), s.get_service_type(),
-                    s.get_free_ca_mode());
-            const auto &sn = s.get_name();
-            g_debug("  %d onw %d %s", s.get_service_id(),
-                    s.get_original_network_id(), sn.c_str());
-            if (sn.size())
-            {
-                serv_name_v.emplace_back(s.get_original_network_id(),
-                        s.get_service_id(), sn);
-            }
-            const auto &spn = s.get_provider_name();
-            if (spn.size())
-            {
-                prov_nm_v.emplace_back(spn);
-            }
+            batch.serv_provs.emplace_back(s.get_original_network_id(),
+                    s.get_service_id(), provider_names_[s.get_provider_id()]);
         }
-        // Global provider names have to be inserted before
-        // service_provider_names
-        g_print("Inserting provider names\n");
-        db.run_statement(ins_prov_nm, prov_nm_v);
-        g_print("Inserting %ld service ids\n", serv_id_v.size());
-        db.run_statement(ins_serv_id, serv_id_v);
-        g_print("Inserting %ld service names\n", serv_name_v.size());
-        db.run_statement(ins_serv_name, serv_name_v);
-        // Now read back rowids of provider names and build a vector mapping
-        // service_ids to provider ids.
-        for (const auto &sp: service_data_)
+        if (s.get_name().size())
+        {
+            batch.serv_names.emplace_back(s.get_original_network_id(),
+                    s.get_service_id(), s.get_name());
+        }
+        s.clear_dirty();
+    }
+    counters_.dirty_services.clear();
+
+    if (!extras)
+        return;
+
+    for (auto ns: dirty_lcns_)
+    {
+        batch.lcns.emplace_back((ns >> 16) & 0xffff, ns & 0xffff,
+                (ns >> 32) & 0xffff, lcn_data_[ns], (ns >> 48) & 0xffff);
+    }
+    dirty_lcns_.clear();
+}
+
+void MultiScanner::stream_commit_batch()
+{
+    if (!stream_db_)
+        return;
+    auto batch = std::make_shared<CommitBatch>();
+    take_commit_batch(*batch);
+    if (!batch->empty())
+        queue_commit_batch(batch);
+}
+
+void MultiScanner::queue_commit_batch(std::shared_ptr<CommitBatch> batch)
+{
+    auto db = stream_db_;
+    stream_db_->queue_function([db, batch, src = stream_source_]()
+    {
+        write_commit_batch(*db, src.c_str(), *batch);
+    });
+}
+
+void MultiScanner::write_commit_batch(Database &db, const char *source,
+        const CommitBatch &batch)
+{
+    g_print("Committing %ld networks, %ld transports' services, "
+            "%ld services\n", batch.networks.size(),
+            batch.trans_serv.size(), batch.serv_ids.size());
+    if (batch.networks.size())
+        db.run_statement(db.get_insert_network_info_statement(source),
+                batch.networks);
+    if (batch.retuned.size())
+        db.run_statement(db.get_delete_tuning_statement(source),
+                batch.retuned);
+    if (batch.tuning.size())
+        db.run_statement(db.get_insert_tuning_statement(source),
+                batch.tuning);
+    if (batch.trans_serv.size())
+    {
+        db.run_statement(db.get_insert_transport_services_statement(source),
+                batch.trans_serv);
+    }
+    if (batch.serv_ids.size())
+        db.run_statement(db.get_insert_service_id_statement(source),
+                batch.serv_ids);
+    if (batch.serv_names.size())
+        db.run_statement(db.get_insert_service_name_statement(source),
+                batch.serv_names);
+    if (batch.serv_provs.size())
+    {
+        auto add_prov = db.get_add_provider_name_statement(source);
+        auto prov_id_q = db.get_provider_id_query(source);
+        std::map<Glib::ustring, Database::id_t> prov_ids;
+        Database::Vector<Database::id_t, Database::id_t, Database::id_t>
+            serv_provs;
+        serv_provs.reserve(batch.serv_provs.size());
+        for (const auto &sp: batch.serv_provs)
         {
-            const auto &s = sp.second;
-            std::tuple<Glib::ustring> a(s.get_provider_name());
-            auto prov = db.run_query(query_prov_id, a);
-            if (prov.size())
+            const auto &name = std::get<2>(sp);
+            auto it = prov_ids.find(name);
+            if (it == prov_ids.end())
             {
-                serv_prov_v.emplace_back(s.get_original_network_id(),
-                        s.get_service_id(), std::get<0>(prov[0]));
+                db.run_statement(add_prov, {{name}});
+                auto ids = db.run_query(prov_id_q, {name});
+                if (ids.empty())
+                    continue;
+                it = prov_ids.emplace(name, std::get<0>(ids[0])).first;
             }
+            serv_provs.emplace_back(std::get<0>(sp), std::get<1>(sp),
+                    it->second);
         }
-        g_print("Inserting service_id:provider_id data\n");
-        db.run_statement(ins_serv_prov, serv_prov_v);
+        db.run_statement(db.get_insert_service_provider_id_statement(source),
+                serv_provs);
+    }
+    if (batch.lcns.size())
+        db.run_statement(db.get_insert_network_lcn_statement(source),
+                batch.lcns);
+}
+
+void MultiScanner::start_monitor(Database &db, const char *source)
+{
+    set_streaming_commit(db, source);
+    // Anything found so far has already been committed
+    dirty_lcns_.clear();
 
-        for (const auto &lp: lcn_data_)
+    // A monitor doesn't finish
+    finished_ = true;
+    lock_conn_.disconnect();
+    nolock_conn_.disconnect();
+    monitoring_ = true;
+    current_ts_data_ = nullptr;
+    // Without a receiver (in tests) the channel scanner is fed directly
+    if (!rcv_)
+    {
+        channel_scanner_->start_monitor(this);
+        return;
+    }
+    monitor_lock_conn_ = rcv_->lock_signal().connect(
+            sigc::mem_fun(*this, &MultiScanner::monitor_lock_cb));
+    if (rcv_->is_tuned())
+        monitor_lock_cb();
+}
+
+void MultiScanner::stop_monitor()
+{
+    if (!monitoring_)
+        return;
+    monitor_lock_conn_.disconnect();
+    channel_scanner_->cancel();
+    flush_monitor();
+    monitoring_ = false;
+}
+
+void MultiScanner::monitor_lock_cb()
+{
+    g_print("Monitoring SI on %s\n",
+            rcv_->current_tuning().describe().c_str());
+    channel_scanner_->cancel();
+    channel_scanner_->start_monitor(this);
+}
+
+void MultiScanner::monitor_changed()
+{
+    if (!monitor_flush_conn_.connected())
+    {
+        monitor_flush_conn_ = Glib::signal_timeout().connect([this]()
         {
-            auto ns = lp.first;
-            nw_lcn_v.emplace_back((ns >> 16) &0xffff, ns & 0xffff,
-                    (ns >> 32) &0xffff, lp.second, (ns >> 48) & 0xffff);
+            flush_monitor();
+            return false;
+        }, 1000);
+    }
+}
+
+void MultiScanner::flush_monitor()
+{
+    monitor_flush_conn_.disconnect();
+
+    auto batch = std::make_shared<CommitBatch>();
+    take_commit_batch(*batch, true);
+    if (batch->empty())
+        return;
+
+    MonitorChanges changes;
+    for (const auto &t: batch->tuning)
+    {
+        changes.transports.push_back((std::get<0>(t) << 16) |
+                std::get<1>(t));
+    }
+    for (const auto &ts: batch->trans_serv)
+    {
+        changes.transports.push_back((std::get<0>(ts) << 16) |
+                std::get<2>(ts));
+    }
+    for (const auto &sid: batch->serv_ids)
+    {
+        changes.services.push_back((std::get<0>(sid) << 16) |
+                std::get<1>(sid));
+    }
+    for (const auto &sp: batch->serv_provs)
+    {
+        changes.services.push_back((std::get<0>(sp) << 16) |
+                std::get<1>(sp));
+    }
+    for (auto v: {&changes.transports, &changes.services})
+    {
+        std::sort(v->begin(), v->end());
+        v->erase(std::unique(v->begin(), v->end()), v->end());
+    }
+    changes.networks = batch->networks.size();
+    changes.lcns = batch->lcns.size();
+
+    g_print("Monitor: %zu transports, %zu services, %u LCNs changed\n",
+            changes.transports.size(), changes.services.size(),
+            changes.lcns);
+    // Readers shouldn't see a partial update
+    auto db = stream_db_;
+    db->queue_function([db, batch, src = stream_source_]()
+    {
+        db->run_transaction([&]()
+        {
+            write_commit_batch(*db, src.c_str(), *batch);
+        });
+    });
+    changed_signal_.emit(*this, changes);
+}
+
+void MultiScanner::commit_to_database(Database &db, const char *source)
+{
+    // Whatever hasn't already been streamed
+    auto batch = std::make_shared<CommitBatch>();
+    take_commit_batch(*batch);
+
+    // Provider ids and LCNs are only final once the scan has finished, so
+    // they're always written here, and the provider ids were assigned by the
+    // interner during the scan so there's no need to read them back.
+    using ProvNameVector = std::vector<std::tuple<id_t, Glib::ustring>>;
+    using ServProvVector = std::vector<std::tuple<id_t, id_t, id_t>>;
+    using LCNVector = std::vector<std::tuple<id_t, id_t, id_t, id_t, id_t>>;
+    auto prov_nm_v = std::make_shared<ProvNameVector>();
+    auto serv_prov_v = std::make_shared<ServProvVector>();
+    auto nw_lcn_v = std::make_shared<LCNVector>();
+
+    prov_nm_v->reserve(provider_names_.size());
+    for (NameInterner::id_t id = 1; id <= provider_names_.size(); ++id)
+        prov_nm_v->emplace_back(id, provider_names_[id]);
+
+    for (const auto &sp: service_data_)
+    {
+        const auto &s = sp.second;
+        auto prov_id = s.get_provider_id();
+        if (prov_id)
+        {
+            serv_prov_v->emplace_back(s.get_original_network_id(),
+                    s.get_service_id(), prov_id);
         }
-        g_print("Inserting %ld lcns\n", nw_lcn_v.size());
-        db.run_statement(ins_nw_lcn, nw_lcn_v);
+    }
 
-        channel_scanner_->commit_extras_to_database(db, source);
+    nw_lcn_v->reserve(lcn_data_.size());
+    for (const auto &lp: lcn_data_)
+    {
+        auto ns = lp.first;
+        nw_lcn_v->emplace_back((ns >> 16) &0xffff, ns & 0xffff,
+                (ns >> 32) &0xffff, lp.second, (ns >> 48) & 0xffff);
+    }
+
+    auto channel_scanner = channel_scanner_;
+    // source may be a temporary, eg a staging source name
+    db.queue_function([&db, batch, prov_nm_v, serv_prov_v, nw_lcn_v,
+            channel_scanner, src = std::string(source)]()
+    {
+        auto source = src.c_str();
+        write_commit_batch(db, source, *batch);
+        g_print("Inserting %ld provider names\n", prov_nm_v->size());
+        db.run_statement(db.get_insert_provider_name_statement(source),
+                *prov_nm_v);
+        g_print("Inserting service_id:provider_id data\n");
+        db.run_statement(db.get_insert_service_provider_id_statement(source),
+                *serv_prov_v);
+        g_print("Inserting %ld lcns\n", nw_lcn_v->size());
+        db.run_statement(db.get_insert_network_lcn_statement(source),
+                *nw_lcn_v);
+        channel_scanner->commit_extras_to_database(db, source);
     });
 }
 
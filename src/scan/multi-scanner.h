@@ -19,10 +19,18 @@
     Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 */
 
+#include <functional>
 #include <map>
+#include <queue>
+#include <string>
+#include <tuple>
+#include <unordered_set>
+#include <vector>
 
 #include "receiver.h"
 
+#include "flat-hash-map.h"
+#include "name-interner.h"
 #include "scan-data.h"
 #include "tuning-iterator.h"
 
@@ -48,6 +56,19 @@ public:
         PARTIAL,    /// Some data has been collected.
         COMPLETE    /// All data has been collected.
     };
+
+    /**
+     * MonitorChanges:
+     * What changed in one batch of monitor updates. Keys are
+     * (original_network_id << 16) | transport_stream_id or service_id.
+     */
+    struct MonitorChanges
+    {
+        std::vector<std::uint32_t> transports;
+        std::vector<std::uint32_t> services;
+        unsigned networks = 0;
+        unsigned lcns = 0;
+    };
 private:
     int successful_scans_ = 0;
     std::shared_ptr<Receiver> rcv_;
@@ -61,17 +82,76 @@ private:
     // For Freesat nw_data_ is really bouquet data, and ts_data_ network_ids
     // are really bouquet_ids
     std::map<std::uint16_t, NetworkNameData> nw_data_;
-    std::map<std::uint32_t, TransportStreamData> ts_data_;
-    TransportStreamData *current_ts_data_;
+    // Key is (original_network_id << 16) | transport_stream_id.
+    // FlatHashMap doesn't move its elements, so current_ts_data_ stays valid
+    // when more transports are discovered.
+    FlatHashMap<std::uint32_t, TransportStreamData> ts_data_;
+    TransportStreamData *current_ts_data_ = nullptr;
+
+    // Transports which have tuning data and haven't been scanned yet, in
+    // order of key. Entries which have since been scanned, or whose tuning
+    // is equivalent to one that has, are discarded when they're popped.
+    using PendingTS = std::pair<std::uint32_t, TransportStreamData *>;
+    std::priority_queue<PendingTS, std::vector<PendingTS>,
+        std::greater<PendingTS>> pending_ts_queue_;
 
     // Key is (original_network_id << 16) | service_id
-    std::map<std::uint32_t, ServiceData> service_data_;
+    FlatHashMap<std::uint32_t, ServiceData> service_data_;
+    HarvestCounters counters_;
+
+    // Many services share a handful of provider names
+    NameInterner provider_names_;
+
+    // Networks whose names have changed since the last commit batch
+    std::vector<std::uint16_t> dirty_networks_;
+
+    // For pipelined committing, see set_streaming_commit()
+    Database *stream_db_ = nullptr;
+    std::string stream_source_;
+
+    // See start_monitor()
+    bool monitoring_ = false;
+    sigc::connection monitor_lock_conn_, monitor_flush_conn_;
+    sigc::signal<void, MultiScanner &, const MonitorChanges &>
+        changed_signal_;
+    std::vector<std::uint64_t> dirty_lcns_;
+
+    /**
+     * Data discovered since the previous batch, in the form of the tuples
+     * which are written to the database.
+     */
+    struct CommitBatch
+    {
+        using id_t = Database::id_t;
+
+        std::vector<std::tuple<id_t, Glib::ustring>>            networks;
+        std::vector<std::tuple<id_t, id_t, id_t, id_t, id_t>>   tuning;
+        std::vector<std::tuple<id_t, id_t, id_t, id_t>>         trans_serv;
+        std::vector<std::tuple<id_t, id_t, id_t, id_t, id_t>>   serv_ids;
+        std::vector<std::tuple<id_t, id_t, Glib::ustring>>      serv_names;
+
+        // Only used when monitoring; a scan writes these all at the end.
+        // Providers are given by name because our ids needn't match the
+        // ones already in the database.
+        std::vector<std::tuple<id_t, id_t, Glib::ustring>>      serv_provs;
+        std::vector<std::tuple<id_t, id_t, id_t, id_t, id_t>>   lcns;
+        // Transports whose old tuning rows must be deleted first
+        std::vector<std::tuple<id_t, id_t>>                     retuned;
+
+        bool empty() const
+        {
+            return networks.empty() && tuning.empty() && trans_serv.empty()
+                && serv_ids.empty() && serv_names.empty()
+                && serv_provs.empty() && lcns.empty();
+        }
+    };
 
     // Key is (freesat_id << 48) | (region_code << 32) |
     // (network_id << 16) | service_id
-    std::map<std::uint64_t, std::uint16_t> lcn_data_;
-    // Used to avoid trying to scan the same channel more than once
-    std::set<std::uint32_t> scanned_equivalences_;
+    FlatHashMap<std::uint64_t, std::uint16_t> lcn_data_;
+    // Used to avoid trying to scan the same channel more than once, keyed by
+    // TuningProperties::get_scan_key()
+    std::unordered_set<std::uint64_t> scanned_tunings_;
 public:
     MultiScanner(std::shared_ptr<Receiver> rcv,
             std::shared_ptr<SingleChannelScanner> channel_scanner,
@@ -100,6 +180,11 @@ public:
         return finished_signal_;
     }
 
+    Status get_status() const
+    {
+        return status_;
+    }
+
     std::shared_ptr<Receiver> get_receiver()
     {
         return rcv_;
@@ -125,6 +210,13 @@ public:
             std::uint16_t orig_nw_id, std::uint16_t ts_id,
             const Descriptor &desc);
 
+    /**
+     * Handles frequency list and cell frequency link descriptors, whose
+     * frequencies are tried if a transport's main frequency fails to lock.
+     */
+    void process_frequency_list_descriptor(std::uint16_t orig_nw_id,
+            std::uint16_t ts_id, const Descriptor &desc);
+
     void process_service_descriptor(std::uint16_t orig_nw_id,
             std::uint16_t ts_id, std::uint16_t service_id, 
             const Descriptor &desc);
@@ -140,8 +232,56 @@ public:
             std::uint16_t region_code, std::uint16_t lcn,
             std::uint16_t freesat_id);
 
-    /// All the work is done on the database thread, so both this scanner and
-    /// the database must persist until the job is done:- use a
+    /**
+     * Enables pipelined committing. Each time a channel has been scanned, the
+     * data discovered since the previous channel is copied into a batch, which
+     * is written on the database thread while the scan moves on to the next
+     * channel. commit_to_database() then only has to write what's left and
+     * reconcile LCNs and provider ids. db must outlive the scan; source is
+     * copied and should be the same as the one passed to
+     * commit_to_database(). Use a staging source so that a failed scan
+     * doesn't leave partial data in the published tables.
+     */
+    void set_streaming_commit(Database &db, const char *source);
+
+    /**
+     * start_monitor:
+     * Keeps watching the SI of whatever the receiver is tuned to, eg while
+     * it's recording, including after it's retuned. Only sections of new
+     * table versions are parsed, and the networks, transports, services and
+     * LCNs they touch are written to db in one transaction, after which
+     * changed_signal is emitted. A changed transport's tuning rows are
+     * replaced, but services and LCNs which disappear from the SI aren't
+     * deleted until the next full scan. Provider ids are looked up in db by
+     * name. Call after the scan has finished and been committed, or on a
+     * scanner which hasn't been started. Client LCNs aren't regenerated;
+     * that's up to the changed_signal handler.
+     */
+    void start_monitor(Database &db, const char *source);
+
+    /// Writes any pending changes and stops monitoring
+    void stop_monitor();
+
+    bool is_monitoring() const
+    {
+        return monitoring_;
+    }
+
+    /**
+     * Called by the channel scanner in monitor mode after it has processed a
+     * section of a new table version. Changes are written after a short
+     * delay so that a whole table's changes go in one batch.
+     */
+    void monitor_changed();
+
+    sigc::signal<void, MultiScanner &, const MonitorChanges &>
+    changed_signal()
+    {
+        return changed_signal_;
+    }
+
+    /// The data is prepared on the calling thread and written on the database
+    /// thread, so the database must persist until the job is done:- use a
     /// Database::PseudoQuery.
     void commit_to_database(Database &db, const char *source);
 
@@ -149,15 +289,41 @@ public:
      * Called by ChannelScanner when it's completed scanning a channel.
      */
     void channel_finished(bool success);
+
+    /**
+     * Returns true if harvest appears to be complete according to the
+     * channel scanner's CheckHarvestPolicy, and updates the status which
+     * will be passed to finished_signal.
+     */
+    bool check_harvest();
 private:
     void next();
 
+    /**
+     * Moves everything that's dirty into batch. If extras is true service
+     * providers and LCNs are included too, and transports' old tuning is
+     * replaced.
+     */
+    void take_commit_batch(CommitBatch &batch, bool extras = false);
+
+    /// Queues the current batch for writing if streaming is enabled
+    void stream_commit_batch();
+
+    void queue_commit_batch(std::shared_ptr<CommitBatch> batch);
+
+    void monitor_lock_cb();
+
+    void flush_monitor();
+
+    /// Called on the database thread
+    static void write_commit_batch(Database &db, const char *source,
+            const CommitBatch &batch);
+
     void lock_cb();
 
     void nolock_cb();
 
-    /// Returns true if harvest appears to be complete
-    bool check_harvest();
+    void retry_current_transport();
 };
 
 }
@@ -0,0 +1,83 @@
+#pragma once
+
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <cstdint>
+#include <deque>
+#include <string_view>
+#include <unordered_map>
+
+#include <glibmm.h>
+
+namespace logi
+{
+
+/**
+ * NameInterner:
+ * Assigns a small integer id to each distinct name so that names which are
+ * repeated many times during a scan, eg provider names, are only stored once
+ * and can be written to the database with explicit ids. Ids start at 1 and
+ * are dense; 0 means no name.
+ */
+class NameInterner
+{
+public:
+    using id_t = std::uint32_t;
+
+    /// Returns the id of name, assigning a new one if it hasn't been seen
+    /// before. The empty string is always 0.
+    id_t intern(const Glib::ustring &name)
+    {
+        if (name.empty())
+            return 0;
+        auto it = ids_.find(std::string_view(name.raw()));
+        if (it != ids_.end())
+            return it->second;
+        // deque doesn't move its elements when it grows, so the key can
+        // refer to the stored copy.
+        names_.push_back(name);
+        id_t id = names_.size();
+        ids_.emplace(std::string_view(names_.back().raw()), id);
+        return id;
+    }
+
+    /// id must be non-zero and have been returned by intern()
+    const Glib::ustring &operator[](id_t id) const
+    {
+        return names_[id - 1];
+    }
+
+    /// Number of names, which is also the highest id
+    std::size_t size() const
+    {
+        return names_.size();
+    }
+
+    void clear()
+    {
+        ids_.clear();
+        names_.clear();
+    }
+private:
+    std::deque<Glib::ustring> names_;
+    std::unordered_map<std::string_view, id_t> ids_;
+};
+
+}
@@ -35,7 +35,8 @@ bool NITProcessor::process(std::shared_ptr<NITSection> sec, MultiScanner *ms)
 
     mscanner_ = ms;
 
-    switch (tracker_.track(*sec))
+    last_result_ = tracker_.track(*sec);
+    switch (last_result_)
     {
         case TableTracker::REPEAT:
             g_debug("Repeat NIT section number %d", sec->section_number());
@@ -69,21 +70,17 @@ bool NITProcessor::process(std::shared_ptr<NITSection> sec, MultiScanner *ms)
 
     g_debug("Network descriptors (len %d):",
             sec->network_descriptors_length());
-    auto descs = sec->get_network_descriptors();
-    for (auto &desc: descs)
+    sec->for_each_network_descriptor([this](const Descriptor &desc)
     {
         g_debug("0x%02x+%d  ", desc.tag(), desc.length());
-    }
-    for (auto &desc: descs)
-    {
         process_descriptor(desc);
-    }
+    });
     if (network_name_.size())
         g_debug("Network name '%s'", network_name_.c_str());
 
     g_debug("Transport streams (len %d):",
             sec->transport_stream_loop_length());
-    for (auto &ts: sec->get_transport_stream_loop())
+    sec->for_each_transport_stream([this](const TSSectionData &ts)
     {
         current_orig_nw_id_ = ts.original_network_id();
         //g_debug("  TS subsection offset %d len %d (%x) + 6",
@@ -93,7 +90,7 @@ bool NITProcessor::process(std::shared_ptr<NITSection> sec, MultiScanner *ms)
         //g_debug("  from parent section %d",
         //        sec->word12(ts.get_offset() + 4));
         process_ts_data(ts);
-    }
+    });
 
     return complete;
 }
@@ -113,17 +110,11 @@ void NITProcessor::process_ts_data(const TSSectionData &ts)
     mscanner_->get_transport_stream_data(ts.original_network_id(),
             current_ts_id_);
 
-    auto descs = ts.get_transport_descriptors();
-    /*
-    for (auto &desc: descs)
-    {
-        g_debug("    0x%02x+%d", desc.tag(), desc.length());
-    }
-    */
-    for (auto &desc: descs)
+    ts.for_each_transport_descriptor([this](const Descriptor &desc)
     {
+        //g_debug("    0x%02x+%d", desc.tag(), desc.length());
         process_descriptor(desc);
-    }
+    });
 }
 
 void NITProcessor::process_descriptor(const Descriptor &desc)
@@ -151,6 +142,19 @@ void NITProcessor::process_descriptor(const Descriptor &desc)
             mscanner_->process_delivery_system_descriptor(current_nw_id_,
                     current_orig_nw_id_, current_ts_id_, desc);
             break;
+        case Descriptor::FREQUENCY_LIST:
+        case Descriptor::CELL_FREQUENCY_LINK:
+            mscanner_->process_frequency_list_descriptor(current_orig_nw_id_,
+                    current_ts_id_, desc);
+            break;
+        case Descriptor::EXTENSION:
+            if (ExtensionDescriptor(desc).tag_extension() ==
+                    ExtensionDescriptor::T2_DELIVERY_SYSTEM)
+            {
+                mscanner_->process_delivery_system_descriptor(current_nw_id_,
+                        current_orig_nw_id_, current_ts_id_, desc);
+            }
+            break;
     }
 }
 
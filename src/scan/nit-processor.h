@@ -39,6 +39,7 @@ class NITProcessor
 {
 protected:
     TableTracker tracker_;
+    TableTracker::Result last_result_ = TableTracker::BLANK;
     Glib::ustring network_name_;
     MultiScanner *mscanner_;
     std::uint16_t current_ts_id_, current_nw_id_, current_orig_nw_id_;
@@ -53,6 +54,12 @@ public:
     {
         tracker_.reset();
     }
+
+    /// The tracker's result for the section most recently passed to process()
+    TableTracker::Result last_result() const
+    {
+        return last_result_;
+    }
 protected:
     virtual void process_ts_data(const TSSectionData &ts);
 
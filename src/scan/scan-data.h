@@ -20,8 +20,11 @@
 */
 
 #include <algorithm>
+#include <functional>
 #include <memory>
-#include <set>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "nit-processor.h"
 #include "tuning.h"
@@ -59,8 +62,8 @@ class NetworkNameData
 public:
     NetworkNameData() : network_id_(0) {}
 
-    NetworkNameData(std::uint16_t nw_id, const Glib::ustring &name)
-        : network_id_(nw_id), network_name_(name)
+    NetworkNameData(std::uint16_t nw_id, Glib::ustring name)
+        : network_id_(nw_id), network_name_(std::move(name))
     {}
 
     NetworkNameData(const NetworkNameData &) = default;
@@ -82,6 +85,23 @@ private:
 
 using BouquetNameData = NetworkNameData;
 
+/**
+ * HarvestCounters:
+ * Running totals which let MultiScanner check whether a scan is complete,
+ * and find what to commit, without iterating over all its data. Transports
+ * and services which have been attached to the counters update them
+ * whenever their status changes, and add their keys to the dirty lists
+ * when they become dirty.
+ */
+struct HarvestCounters
+{
+    unsigned pending_transports = 0;
+    unsigned unscanned_services = 0;
+    // (original_network_id << 16) | transport_stream_id or service_id
+    std::vector<std::uint32_t> dirty_transports;
+    std::vector<std::uint32_t> dirty_services;
+};
+
 class TransportStreamData
 {
 public:
@@ -95,7 +115,7 @@ public:
     TransportStreamData(std::uint16_t transport_stream_id = 0,
             std::uint16_t network_id = 0,
             std::uint16_t orig_network_id = 0,
-            std::shared_ptr<TuningProperties> tuning = nullptr) :
+            const TuningProperties &tuning = TuningProperties()) :
         transport_stream_id_(transport_stream_id),
         network_id_(network_id),
         original_network_id_(orig_network_id),
@@ -114,7 +134,11 @@ public:
 
     void set_network_id(std::uint16_t network_id)
     {
-        network_id_ = network_id;
+        if (network_id != network_id_)
+        {
+            network_id_ = network_id;
+            mark_dirty();
+        }
     }
 
     std::uint16_t get_network_id() const
@@ -132,35 +156,118 @@ public:
         return original_network_id_;
     }
 
-    void set_tuning(TuningProperties *tuning)
+    void set_tuning(const TuningProperties &tuning)
     {
         if (!tuning_)
-            tuning_ = std::shared_ptr<TuningProperties>(tuning);
+        {
+            tuning_ = tuning;
+            mark_dirty();
+        }
     }
 
-    void set_tuning(std::shared_ptr<TuningProperties> tuning)
+    /**
+     * Unlike set_tuning() this replaces an existing tuning, if any of its
+     * properties are different. Used when monitoring for changes.
+     */
+    void update_tuning(const TuningProperties &tuning)
     {
-        if (!tuning_)
+        if (tuning_.size() != tuning.size() ||
+                !std::equal(tuning.begin(), tuning.end(), tuning_.begin(),
+                    [](const TuningProperties::Property &a,
+                        const TuningProperties::Property &b)
+                    {
+                        return a.cmd == b.cmd && a.data == b.data;
+                    }))
+        {
             tuning_ = tuning;
+            mark_dirty();
+        }
     }
 
-    std::shared_ptr<TuningProperties> get_tuning() const
+    /// Returns an empty TuningProperties if the tuning isn't known yet
+    const TuningProperties &get_tuning() const
     {
         return tuning_;
     }
 
+    /**
+     * Adds a frequency the transport can also be received on, to be tried if
+     * the main tuning fails. Lower ranks are tried first, and frequencies
+     * with the same rank in the order they were added. Frequencies are in
+     * the units used by TuningProperties::with_frequency().
+     */
+    void add_alternative_frequency(std::uint32_t freq, unsigned rank)
+    {
+        for (const auto &alt: alt_frequencies_)
+        {
+            if (alt.frequency == freq)
+                return;
+        }
+        auto it = std::upper_bound(alt_frequencies_.begin(),
+                alt_frequencies_.end(), rank,
+                [](unsigned r, const AltFrequency &alt)
+                {
+                    return r < alt.rank;
+                });
+        // Don't let a late arrival hide behind candidates already tried
+        if (unsigned(it - alt_frequencies_.begin()) < next_alt_)
+            it = alt_frequencies_.end();
+        alt_frequencies_.insert(it, AltFrequency{freq, rank});
+    }
+
+    /**
+     * Returns: The next candidate tuning, or an empty one when all the
+     * alternatives have been tried. The first candidate is get_tuning().
+     * tried(candidate) should return true if the candidate has already been
+     * tuned, eg by a sweep or as a candidate for another transport.
+     */
+    template<class F> TuningProperties next_candidate(F tried)
+    {
+        if (!tuning_)
+            return TuningProperties();
+        if (!tuning_tried_)
+        {
+            tuning_tried_ = true;
+            if (!tried(tuning_))
+                return tuning_;
+        }
+        while (next_alt_ < alt_frequencies_.size())
+        {
+            auto candidate = tuning_.with_frequency(
+                    alt_frequencies_[next_alt_++].frequency);
+            if (!tried(candidate))
+                return candidate;
+        }
+        return TuningProperties();
+    }
+
     void add_service_id(std::uint16_t service_id)
     {
-        service_ids_.insert(service_id);
+        // Kept sorted; the same NIT is seen many times during a scan, so
+        // most calls find the id already present.
+        auto it = std::lower_bound(service_ids_.begin(), service_ids_.end(),
+                service_id);
+        if (it == service_ids_.end() || *it != service_id)
+        {
+            service_ids_.insert(it, service_id);
+            mark_dirty();
+        }
     }
 
-    const std::set<std::uint16_t> get_service_ids() const
+    const std::vector<std::uint16_t> &get_service_ids() const
     {
         return service_ids_;
     }
 
     void set_scan_status(ScanStatus status)
     {
+        if (counters_ && (status == PENDING) != (scan_status_ == PENDING))
+        {
+            if (status == PENDING)
+                ++counters_->pending_transports;
+            else
+                --counters_->pending_transports;
+        }
         scan_status_ = status;
     }
 
@@ -168,12 +275,60 @@ public:
     {
         return scan_status_;
     }
+
+    /// Should only be called once, by MultiScanner when it creates this
+    void attach_counters(HarvestCounters *counters)
+    {
+        counters_ = counters;
+        if (scan_status_ == PENDING)
+            ++counters_->pending_transports;
+        if (dirty_)
+            counters_->dirty_transports.push_back(key());
+    }
+
+    /**
+     * A transport is dirty if its tuning, network_id or list of services has
+     * changed since it was last committed to the database.
+     */
+    bool is_dirty() const
+    {
+        return dirty_;
+    }
+
+    void clear_dirty()
+    {
+        dirty_ = false;
+    }
 private:
+    std::uint32_t key() const
+    {
+        return (std::uint32_t(original_network_id_) << 16) |
+            transport_stream_id_;
+    }
+
+    void mark_dirty()
+    {
+        if (!dirty_ && counters_)
+            counters_->dirty_transports.push_back(key());
+        dirty_ = true;
+    }
+
     std::uint16_t transport_stream_id_;
     std::uint16_t network_id_, original_network_id_;
-    std::shared_ptr<TuningProperties> tuning_;
-    std::set<std::uint16_t> service_ids_;
+    struct AltFrequency
+    {
+        std::uint32_t frequency;
+        unsigned rank;
+    };
+
+    TuningProperties tuning_;
+    std::vector<AltFrequency> alt_frequencies_;
+    unsigned next_alt_ = 0;
+    bool tuning_tried_ = false;
+    std::vector<std::uint16_t> service_ids_;
     ScanStatus scan_status_;
+    HarvestCounters *counters_ = nullptr;
+    bool dirty_ = true;
 };
 
 class ServiceData
@@ -215,7 +370,11 @@ public:
 
     void set_ts_id(std::uint16_t ts_id)
     {
-        ts_id_ = ts_id;
+        if (ts_id != ts_id_)
+        {
+            ts_id_ = ts_id;
+            mark_dirty();
+        }
     }
 
     std::uint16_t get_ts_id() const
@@ -225,7 +384,11 @@ public:
 
     void set_service_type(std::uint8_t service_type)
     {
-        service_type_ = service_type;
+        if (service_type != service_type_)
+        {
+            service_type_ = service_type;
+            mark_dirty();
+        }
     }
 
     std::uint8_t get_service_type() const
@@ -235,7 +398,10 @@ public:
 
     template<class S> void set_name(S &&name)
     {
-        name_ = name;
+        if (name_ == name)
+            return;
+        name_ = std::forward<S>(name);
+        mark_dirty();
     }
 
     const Glib::ustring &get_name() const
@@ -243,19 +409,28 @@ public:
         return name_;
     }
 
-    template<class S> void set_provider_name(S &&name)
+    /// id is from MultiScanner's provider name interner, 0 for none
+    void set_provider_id(std::uint32_t id)
     {
-        provider_name_ = name;
+        if (id != provider_id_)
+        {
+            provider_id_ = id;
+            mark_dirty();
+        }
     }
 
-    const Glib::ustring &get_provider_name() const
+    std::uint32_t get_provider_id() const
     {
-        return provider_name_;
+        return provider_id_;
     }
 
     void set_free_ca_mode(bool encrypted)
     {
-        free_ca_mode_ = encrypted;
+        if (encrypted != free_ca_mode_)
+        {
+            free_ca_mode_ = encrypted;
+            mark_dirty();
+        }
     }
 
     bool get_free_ca_mode() const
@@ -265,6 +440,8 @@ public:
 
     void set_scanned()
     {
+        if (counters_ && !scanned_)
+            --counters_->unscanned_services;
         scanned_ = true;
     }
 
@@ -272,14 +449,50 @@ public:
     {
         return scanned_;
     }
+
+    /// Should only be called once, by MultiScanner when it creates this
+    void attach_counters(HarvestCounters *counters)
+    {
+        counters_ = counters;
+        if (!scanned_)
+            ++counters_->unscanned_services;
+        if (dirty_)
+            counters_->dirty_services.push_back(key());
+    }
+
+    /// A service is dirty if it has changed since it was last committed
+    bool is_dirty() const
+    {
+        return dirty_;
+    }
+
+    void clear_dirty()
+    {
+        dirty_ = false;
+    }
 private:
+    std::uint32_t key() const
+    {
+        return (std::uint32_t(original_network_id_) << 16) | service_id_;
+    }
+
+    void mark_dirty()
+    {
+        if (!dirty_ && counters_)
+            counters_->dirty_services.push_back(key());
+        dirty_ = true;
+    }
+
     std::uint16_t service_id_;
     std::uint16_t original_network_id_;
     std::uint16_t ts_id_;
     std::uint8_t service_type_;
-    Glib::ustring name_, provider_name_;
+    Glib::ustring name_;
+    std::uint32_t provider_id_ = 0;
     bool free_ca_mode_;
     bool scanned_;
+    HarvestCounters *counters_ = nullptr;
+    bool dirty_ = true;
 };
 
 }
@@ -66,13 +66,10 @@ SDTProcessor::process(std::shared_ptr<SDTSection> sec, MultiScanner *ms)
     current_orig_nw_id_ = sec->original_network_id();
     current_ts_id_ = sec->transport_stream_id();
 
-    auto services = sec->get_services();
-
-    g_debug("%ld services", services.size());
-    for (auto &svc: services)
+    sec->for_each_service([this](const SDTSectionServiceData &svc)
     {
         process_service_data(svc);
-    }
+    });
 
     return result;
 }
@@ -82,11 +79,10 @@ void SDTProcessor::process_service_data(const SDTSectionServiceData &svc)
     g_debug("  service_id 0x%04x at offset %d",
             svc.service_id(), svc.get_offset());
     current_service_id_ = svc.service_id();
-    auto descs = svc.get_descriptors();
-    for (auto &desc: descs)
+    svc.for_each_descriptor([this](const Descriptor &desc)
     {
         process_descriptor(desc);
-    }
+    });
 }
 
 void SDTProcessor::process_descriptor(const Descriptor &desc)
@@ -20,6 +20,9 @@
 #include <cstring>
 
 #include <glib.h>
+#include <linux/dvb/dmx.h>
+
+#include <glibmm/main.h>
 
 #include "multi-scanner.h"
 #include "single-channel-scanner.h"
@@ -48,7 +51,11 @@ void SingleChannelScanner::start(MultiScanner *multi_scanner)
     }
 
     have_current_ts_id_ = false;
+    open_filters();
+}
 
+void SingleChannelScanner::open_filters()
+{
     std::uint16_t pid;
     std::uint8_t table_id;
 
@@ -57,9 +64,9 @@ void SingleChannelScanner::start(MultiScanner *multi_scanner)
     if (get_filter_params(pid, table_id))
     {
         nit_filter_.reset(new SectionFilter<NITSection, SingleChannelScanner>(
-                multi_scanner->get_receiver(), *this,
+                multi_scanner_->get_receiver(), *this,
                 &SingleChannelScanner::nit_filter_cb,
-                pid, table_id, 0, 5000, 0xff, 0));
+                pid, table_id, 0, filter_timeout(), 0xff, 0));
     }
     else
     {
@@ -71,9 +78,9 @@ void SingleChannelScanner::start(MultiScanner *multi_scanner)
     {
         this_sdt_filter_.reset(
                 new SectionFilter<SDTSection, SingleChannelScanner>(
-                multi_scanner->get_receiver(), *this,
+                multi_scanner_->get_receiver(), *this,
                 &SingleChannelScanner::this_sdt_filter_cb,
-                pid, table_id, 0, 5000, 0xff, 0));
+                pid, table_id, 0, filter_timeout(), 0xff, 0));
     }
     else
     {
@@ -85,9 +92,9 @@ void SingleChannelScanner::start(MultiScanner *multi_scanner)
     {
         other_sdt_filter_.reset(
                 new SectionFilter<SDTSection, SingleChannelScanner>(
-                multi_scanner->get_receiver(), *this,
+                multi_scanner_->get_receiver(), *this,
                 &SingleChannelScanner::other_sdt_filter_cb,
-                pid, table_id, 0, 5000, 0xff, 0));
+                pid, table_id, 0, filter_timeout(), 0xff, 0));
     }
     else
     {
@@ -95,8 +102,17 @@ void SingleChannelScanner::start(MultiScanner *multi_scanner)
     }
 }
 
+void SingleChannelScanner::start_monitor(MultiScanner *multi_scanner)
+{
+    monitoring_ = true;
+    start(multi_scanner);
+}
+
 void SingleChannelScanner::cancel()
 {
+    monitoring_ = false;
+    nit_rearm_conn_.disconnect();
+    this_sdt_rearm_conn_.disconnect();
     if (nit_filter_)
     {
         nit_filter_->stop();
@@ -152,6 +168,26 @@ void SingleChannelScanner::nit_filter_cb(int reason,
             nit_status_ = TableTracker::OK;
     }
 
+    if (monitoring_)
+    {
+        // NIT actual only has one sub-table, but Freesat's NIT other may
+        // have more
+        if (nd)
+        {
+            if (networks_.size() == 1)
+            {
+                monitor_section(*section, nd->nit_proc->last_result(),
+                        &nit_rearm_conn_,
+                        &SingleChannelScanner::rearm_nit_filter);
+            }
+            else
+            {
+                monitor_section(*section, nd->nit_proc->last_result());
+            }
+        }
+        return;
+    }
+
     if (!section || nit_status_ == TableTracker::REPEAT_COMPLETE
         || nit_status_ == TableTracker::ERROR)
     {
@@ -172,8 +208,9 @@ void SingleChannelScanner::this_sdt_filter_cb(int reason,
     {
         auto &ts = multi_scanner_->get_transport_stream_data(
                 section->original_network_id(), section->transport_stream_id());
-        if (!ts.get_tuning())
-            ts.set_tuning(multi_scanner_->get_receiver()->current_tuning());
+        auto rcv = multi_scanner_->get_receiver();
+        if (!ts.get_tuning() && rcv)
+            ts.set_tuning(rcv->current_tuning());
         ts.set_scan_status(TransportStreamData::SCANNED);
         have_current_ts_id_ = true;
         g_print("Current ts_id %d\n", section->transport_stream_id());
@@ -224,6 +261,23 @@ TableTracker::Result SingleChannelScanner::sdt_filter_cb(int reason,
         }
     }
 
+    if (monitoring_)
+    {
+        if (section)
+        {
+            if (&sdt_filter == &this_sdt_filter_)
+            {
+                monitor_section(*section, result, &this_sdt_rearm_conn_,
+                        &SingleChannelScanner::rearm_this_sdt_filter);
+            }
+            else
+            {
+                monitor_section(*section, result);
+            }
+        }
+        return result;
+    }
+
     if (!section || sdt_status == TableTracker::REPEAT_COMPLETE)
     {
         sdt_filter->stop();
@@ -234,6 +288,68 @@ TableTracker::Result SingleChannelScanner::sdt_filter_cb(int reason,
     return result;
 }
 
+void SingleChannelScanner::monitor_section(const Section &section,
+        TableTracker::Result result, sigc::connection *rearm_conn,
+        void (SingleChannelScanner::*rearm)(std::uint16_t, std::uint8_t))
+{
+    switch (result)
+    {
+        case TableTracker::OK:
+        case TableTracker::COMPLETE:
+            g_debug("Monitor: table 0x%02x/%d version %d changed",
+                    section.table_id(), section.section_id(),
+                    section.version_number());
+            multi_scanner_->monitor_changed();
+            break;
+        case TableTracker::REPEAT_COMPLETE:
+            // The filter can't be replaced from its own callback
+            if (rearm_conn && !rearm_conn->connected())
+            {
+                auto id = section.section_id();
+                auto version = section.version_number();
+                *rearm_conn = Glib::signal_idle().connect([this, rearm,
+                        id, version]()
+                {
+                    (this->*rearm)(id, version);
+                    return false;
+                });
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+void SingleChannelScanner::rearm_nit_filter(std::uint16_t network_id,
+        std::uint8_t version)
+{
+    std::uint16_t pid = Section::NIT_PID;
+    std::uint8_t table_id = Section::NIT_TABLE;
+    struct dmx_sct_filter_params params;
+
+    get_filter_params(pid, table_id);
+    logi_priv::SectionFilterBase::get_version_change_params(params,
+            pid, table_id, network_id, version);
+    nit_filter_.reset(new SectionFilter<NITSection, SingleChannelScanner>(
+            multi_scanner_->get_receiver(), &params, *this,
+            &SingleChannelScanner::nit_filter_cb));
+}
+
+void SingleChannelScanner::rearm_this_sdt_filter(std::uint16_t ts_id,
+        std::uint8_t version)
+{
+    std::uint16_t pid = Section::SDT_PID;
+    std::uint8_t table_id = Section::SDT_TABLE;
+    struct dmx_sct_filter_params params;
+
+    get_filter_params(pid, table_id);
+    logi_priv::SectionFilterBase::get_version_change_params(params,
+            pid, table_id, ts_id, version);
+    this_sdt_filter_.reset(new SectionFilter<SDTSection, SingleChannelScanner>(
+            multi_scanner_->get_receiver(), &params, *this,
+            &SingleChannelScanner::this_sdt_filter_cb));
+}
+
 std::unique_ptr<NITProcessor> SingleChannelScanner::new_nit_processor()
 {
     return std::unique_ptr<NITProcessor>(new NITProcessor());
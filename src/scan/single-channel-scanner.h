@@ -54,11 +54,27 @@ protected:
 
     bool have_current_ts_id_;
     bool successful_ = false;
+
+    // See start_monitor()
+    bool monitoring_ = false;
+    sigc::connection nit_rearm_conn_, this_sdt_rearm_conn_;
 public:
     virtual ~SingleChannelScanner() = default;
 
     virtual void start(MultiScanner *multi_scanner);
 
+    /**
+     * start_monitor:
+     * Like start(), but for watching the SI of a channel which has already
+     * been scanned. The filters have no timeout and stay open until cancel(),
+     * and finished() isn't called. Sections of new table versions are
+     * processed as usual, and MultiScanner::monitor_changed() is called for
+     * each of them. Once an actual NIT or SDT is complete its filter is
+     * replaced with one that only passes a different version, so an unchanged
+     * table causes no wakeups at all.
+     */
+    void start_monitor(MultiScanner *multi_scanner);
+
     /**
      * @cancel:
      * Cancel the current scan, either to interrupt it, or when current channel
@@ -77,7 +93,8 @@ public:
          */
         SCAN_ALL_DISCOVERED_TS = 2,
 
-        /* Freeview's DVB-T2 multiplexes don't get described in DVB-T NIT so
+        /* Freeview's DVB-T2 multiplexes are only described in NIT by a T2
+         * delivery system extension descriptor, which some networks omit, so
          * continuing scan until all referenced services are discovered is
          * another way we can check for completeness.
          */
@@ -110,6 +127,33 @@ protected:
 
     virtual std::unique_ptr<SDTProcessor> new_sdt_processor();
 
+    /// Filters have no timeout in monitor mode
+    unsigned filter_timeout() const
+    {
+        return monitoring_ ? 0 : 5000;
+    }
+
+    /**
+     * monitor_section:
+     * Handles the result of processing a section in monitor mode.
+     * @rearm: Called from idle to replace the filter with one for a new
+     *      version once the table is complete. Only usable if the filter
+     *      covers a single sub-table.
+     */
+    void monitor_section(const Section &section, TableTracker::Result result,
+            sigc::connection *rearm_conn = nullptr,
+            void (SingleChannelScanner::*rearm)(std::uint16_t, std::uint8_t)
+                = nullptr);
+
+    /// Opens the NIT and SDT filters; called by start()
+    virtual void open_filters();
+
+    virtual void rearm_nit_filter(std::uint16_t network_id,
+            std::uint8_t version);
+
+    virtual void rearm_this_sdt_filter(std::uint16_t ts_id,
+            std::uint8_t version);
+
     NetworkData *get_network_data(std::uint16_t network_id);
 
     void nit_filter_cb(int reason, std::shared_ptr<NITSection> section);
@@ -0,0 +1,962 @@
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <tuple>
+
+#include <glib.h>
+
+#include "tuning-importer.h"
+
+#include "db/logi-db.h"
+
+namespace logi
+{
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+struct Token
+{
+    std::string_view name;
+    std::uint32_t value;
+};
+
+constexpr std::uint32_t token_hash(std::string_view s, std::uint32_t seed)
+{
+    // FNV-1a
+    std::uint32_t h = 2166136261u ^ seed;
+    for (auto c: s)
+    {
+        h ^= std::uint8_t(c);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// At least n squared, so a collision-free seed is found after a few tries
+constexpr std::size_t token_slots(std::size_t n)
+{
+    std::size_t s = 16;
+    while (s < n * n)
+        s <<= 1;
+    return s;
+}
+
+/**
+ * TokenTable:
+ * Maps a fixed set of names to values with a perfect hash. The constructor
+ * runs at compile time and picks a hash seed which gives every name its own
+ * slot, so a lookup is one hash and one comparison.
+ */
+template<std::size_t N> class TokenTable
+{
+public:
+    constexpr TokenTable(const Token (&tokens)[N]) :
+        tokens_{}, slots_{}, seed_(0)
+    {
+        while (!try_seed(tokens))
+            ++seed_;
+    }
+
+    bool lookup(std::string_view name, std::uint32_t &value) const
+    {
+        auto slot = slots_[token_hash(name, seed_) & MASK];
+        if (!slot || tokens_[slot - 1].name != name)
+            return false;
+        value = tokens_[slot - 1].value;
+        return true;
+    }
+private:
+    constexpr static std::size_t SLOTS = token_slots(N);
+    constexpr static std::size_t MASK = SLOTS - 1;
+
+    std::array<Token, N> tokens_;
+    // Index into tokens_ + 1, or 0 if empty
+    std::array<std::uint8_t, SLOTS> slots_;
+    std::uint32_t seed_;
+
+    constexpr bool try_seed(const Token (&tokens)[N])
+    {
+        for (std::size_t i = 0; i < SLOTS; ++i)
+            slots_[i] = 0;
+        for (std::size_t n = 0; n < N; ++n)
+        {
+            auto &slot = slots_[token_hash(tokens[n].name, seed_) & MASK];
+            if (slot)
+                return false;
+            slot = std::uint8_t(n + 1);
+            tokens_[n] = tokens[n];
+        }
+        return true;
+    }
+};
+
+// zap (tzap) channels.conf
+
+constexpr Token zap_inversion_tokens[] = {
+    { "INVERSION_OFF", INVERSION_OFF },
+    { "INVERSION_ON", INVERSION_ON },
+    { "INVERSION_AUTO", INVERSION_AUTO },
+};
+constexpr TokenTable zap_inversion(zap_inversion_tokens);
+
+constexpr Token zap_bandwidth_tokens[] = {
+    { "BANDWIDTH_8_MHZ", 8000000 },
+    { "BANDWIDTH_7_MHZ", 7000000 },
+    { "BANDWIDTH_6_MHZ", 6000000 },
+    { "BANDWIDTH_5_MHZ", 5000000 },
+    { "BANDWIDTH_10_MHZ", 10000000 },
+    { "BANDWIDTH_1_712_MHZ", 1712000 },
+    { "BANDWIDTH_AUTO", 0 },
+};
+constexpr TokenTable zap_bandwidth(zap_bandwidth_tokens);
+
+constexpr Token zap_code_rate_tokens[] = {
+    { "FEC_NONE", FEC_NONE },
+    { "FEC_1_2", FEC_1_2 },
+    { "FEC_2_3", FEC_2_3 },
+    { "FEC_3_4", FEC_3_4 },
+    { "FEC_4_5", FEC_4_5 },
+    { "FEC_5_6", FEC_5_6 },
+    { "FEC_6_7", FEC_6_7 },
+    { "FEC_7_8", FEC_7_8 },
+    { "FEC_8_9", FEC_8_9 },
+    { "FEC_3_5", FEC_3_5 },
+    { "FEC_9_10", FEC_9_10 },
+    { "FEC_AUTO", FEC_AUTO },
+};
+constexpr TokenTable zap_code_rate(zap_code_rate_tokens);
+
+constexpr Token zap_modulation_tokens[] = {
+    { "QPSK", QPSK },
+    { "QAM_16", QAM_16 },
+    { "QAM_32", QAM_32 },
+    { "QAM_64", QAM_64 },
+    { "QAM_128", QAM_128 },
+    { "QAM_256", QAM_256 },
+    { "QAM_AUTO", QAM_AUTO },
+};
+constexpr TokenTable zap_modulation(zap_modulation_tokens);
+
+constexpr Token zap_transmission_mode_tokens[] = {
+    { "TRANSMISSION_MODE_1K", TRANSMISSION_MODE_1K },
+    { "TRANSMISSION_MODE_2K", TRANSMISSION_MODE_2K },
+    { "TRANSMISSION_MODE_4K", TRANSMISSION_MODE_4K },
+    { "TRANSMISSION_MODE_8K", TRANSMISSION_MODE_8K },
+    { "TRANSMISSION_MODE_16K", TRANSMISSION_MODE_16K },
+    { "TRANSMISSION_MODE_32K", TRANSMISSION_MODE_32K },
+    { "TRANSMISSION_MODE_AUTO", TRANSMISSION_MODE_AUTO },
+};
+constexpr TokenTable zap_transmission_mode(zap_transmission_mode_tokens);
+
+constexpr Token zap_guard_interval_tokens[] = {
+    { "GUARD_INTERVAL_1_32", GUARD_INTERVAL_1_32 },
+    { "GUARD_INTERVAL_1_16", GUARD_INTERVAL_1_16 },
+    { "GUARD_INTERVAL_1_8", GUARD_INTERVAL_1_8 },
+    { "GUARD_INTERVAL_1_4", GUARD_INTERVAL_1_4 },
+    { "GUARD_INTERVAL_1_128", GUARD_INTERVAL_1_128 },
+    { "GUARD_INTERVAL_19_128", GUARD_INTERVAL_19_128 },
+    { "GUARD_INTERVAL_19_256", GUARD_INTERVAL_19_256 },
+    { "GUARD_INTERVAL_AUTO", GUARD_INTERVAL_AUTO },
+};
+constexpr TokenTable zap_guard_interval(zap_guard_interval_tokens);
+
+constexpr Token zap_hierarchy_tokens[] = {
+    { "HIERARCHY_NONE", HIERARCHY_NONE },
+    { "HIERARCHY_1", HIERARCHY_1 },
+    { "HIERARCHY_2", HIERARCHY_2 },
+    { "HIERARCHY_4", HIERARCHY_4 },
+    { "HIERARCHY_AUTO", HIERARCHY_AUTO },
+};
+constexpr TokenTable zap_hierarchy(zap_hierarchy_tokens);
+
+// dvbv5 .conf
+
+enum Dvbv5Key : std::uint32_t
+{
+    DVBV5_DELIVERY_SYSTEM,
+    DVBV5_FREQUENCY,
+    DVBV5_BANDWIDTH_HZ,
+    DVBV5_CODE_RATE_HP,
+    DVBV5_CODE_RATE_LP,
+    DVBV5_INNER_FEC,
+    DVBV5_MODULATION,
+    DVBV5_TRANSMISSION_MODE,
+    DVBV5_GUARD_INTERVAL,
+    DVBV5_HIERARCHY,
+    DVBV5_INVERSION,
+    DVBV5_POLARIZATION,
+    DVBV5_SYMBOL_RATE,
+    DVBV5_ROLLOFF,
+    DVBV5_STREAM_ID,
+};
+
+constexpr Token dvbv5_key_tokens[] = {
+    { "DELIVERY_SYSTEM", DVBV5_DELIVERY_SYSTEM },
+    { "FREQUENCY", DVBV5_FREQUENCY },
+    { "BANDWIDTH_HZ", DVBV5_BANDWIDTH_HZ },
+    { "CODE_RATE_HP", DVBV5_CODE_RATE_HP },
+    { "CODE_RATE_LP", DVBV5_CODE_RATE_LP },
+    { "INNER_FEC", DVBV5_INNER_FEC },
+    { "MODULATION", DVBV5_MODULATION },
+    { "TRANSMISSION_MODE", DVBV5_TRANSMISSION_MODE },
+    { "GUARD_INTERVAL", DVBV5_GUARD_INTERVAL },
+    { "HIERARCHY", DVBV5_HIERARCHY },
+    { "INVERSION", DVBV5_INVERSION },
+    { "POLARIZATION", DVBV5_POLARIZATION },
+    { "SYMBOL_RATE", DVBV5_SYMBOL_RATE },
+    { "ROLLOFF", DVBV5_ROLLOFF },
+    { "STREAM_ID", DVBV5_STREAM_ID },
+};
+constexpr TokenTable dvbv5_keys(dvbv5_key_tokens);
+
+constexpr Token dvbv5_delivery_system_tokens[] = {
+    { "DVBT", SYS_DVBT },
+    { "DVBT2", SYS_DVBT2 },
+    { "DVBS", SYS_DVBS },
+    { "DVBS2", SYS_DVBS2 },
+};
+constexpr TokenTable dvbv5_delivery_system(dvbv5_delivery_system_tokens);
+
+constexpr Token dvbv5_code_rate_tokens[] = {
+    { "NONE", FEC_NONE },
+    { "1/2", FEC_1_2 },
+    { "2/3", FEC_2_3 },
+    { "3/4", FEC_3_4 },
+    { "4/5", FEC_4_5 },
+    { "5/6", FEC_5_6 },
+    { "6/7", FEC_6_7 },
+    { "7/8", FEC_7_8 },
+    { "8/9", FEC_8_9 },
+    { "3/5", FEC_3_5 },
+    { "9/10", FEC_9_10 },
+    { "AUTO", FEC_AUTO },
+};
+constexpr TokenTable dvbv5_code_rate(dvbv5_code_rate_tokens);
+
+constexpr Token dvbv5_modulation_tokens[] = {
+    { "QPSK", QPSK },
+    { "QAM/16", QAM_16 },
+    { "QAM/32", QAM_32 },
+    { "QAM/64", QAM_64 },
+    { "QAM/128", QAM_128 },
+    { "QAM/256", QAM_256 },
+    { "QAM/AUTO", QAM_AUTO },
+    { "PSK/8", PSK_8 },
+    { "APSK/16", APSK_16 },
+    { "APSK/32", APSK_32 },
+    { "DQPSK", DQPSK },
+};
+constexpr TokenTable dvbv5_modulation(dvbv5_modulation_tokens);
+
+constexpr Token dvbv5_transmission_mode_tokens[] = {
+    { "1K", TRANSMISSION_MODE_1K },
+    { "2K", TRANSMISSION_MODE_2K },
+    { "4K", TRANSMISSION_MODE_4K },
+    { "8K", TRANSMISSION_MODE_8K },
+    { "16K", TRANSMISSION_MODE_16K },
+    { "32K", TRANSMISSION_MODE_32K },
+    { "AUTO", TRANSMISSION_MODE_AUTO },
+};
+constexpr TokenTable dvbv5_transmission_mode(dvbv5_transmission_mode_tokens);
+
+constexpr Token dvbv5_guard_interval_tokens[] = {
+    { "1/32", GUARD_INTERVAL_1_32 },
+    { "1/16", GUARD_INTERVAL_1_16 },
+    { "1/8", GUARD_INTERVAL_1_8 },
+    { "1/4", GUARD_INTERVAL_1_4 },
+    { "1/128", GUARD_INTERVAL_1_128 },
+    { "19/128", GUARD_INTERVAL_19_128 },
+    { "19/256", GUARD_INTERVAL_19_256 },
+    { "AUTO", GUARD_INTERVAL_AUTO },
+};
+constexpr TokenTable dvbv5_guard_interval(dvbv5_guard_interval_tokens);
+
+constexpr Token dvbv5_hierarchy_tokens[] = {
+    { "NONE", HIERARCHY_NONE },
+    { "1", HIERARCHY_1 },
+    { "2", HIERARCHY_2 },
+    { "4", HIERARCHY_4 },
+    { "AUTO", HIERARCHY_AUTO },
+};
+constexpr TokenTable dvbv5_hierarchy(dvbv5_hierarchy_tokens);
+
+constexpr Token dvbv5_inversion_tokens[] = {
+    { "OFF", INVERSION_OFF },
+    { "ON", INVERSION_ON },
+    { "AUTO", INVERSION_AUTO },
+};
+constexpr TokenTable dvbv5_inversion(dvbv5_inversion_tokens);
+
+constexpr Token dvbv5_polarization_tokens[] = {
+    { "HORIZONTAL", SEC_VOLTAGE_18 },
+    { "VERTICAL", SEC_VOLTAGE_13 },
+    { "LEFT", SEC_VOLTAGE_18 },
+    { "RIGHT", SEC_VOLTAGE_13 },
+    { "OFF", SEC_VOLTAGE_OFF },
+};
+constexpr TokenTable dvbv5_polarization(dvbv5_polarization_tokens);
+
+constexpr Token dvbv5_rolloff_tokens[] = {
+    { "35", ROLLOFF_35 },
+    { "25", ROLLOFF_25 },
+    { "20", ROLLOFF_20 },
+    { "AUTO", ROLLOFF_AUTO },
+};
+constexpr TokenTable dvbv5_rolloff(dvbv5_rolloff_tokens);
+
+// VDR encodes parameters as numbers, so a switch does the mapping
+
+bool vdr_code_rate(std::uint32_t v, std::uint32_t &fec)
+{
+    switch (v)
+    {
+        case 0: fec = FEC_NONE; return true;
+        case 12: fec = FEC_1_2; return true;
+        case 23: fec = FEC_2_3; return true;
+        case 34: fec = FEC_3_4; return true;
+        case 35: fec = FEC_3_5; return true;
+        case 45: fec = FEC_4_5; return true;
+        case 56: fec = FEC_5_6; return true;
+        case 67: fec = FEC_6_7; return true;
+        case 78: fec = FEC_7_8; return true;
+        case 89: fec = FEC_8_9; return true;
+        case 910: fec = FEC_9_10; return true;
+        case 999: fec = FEC_AUTO; return true;
+    }
+    return false;
+}
+
+bool vdr_modulation(std::uint32_t v, std::uint32_t &mod)
+{
+    switch (v)
+    {
+        case 2: mod = QPSK; return true;
+        case 5: mod = PSK_8; return true;
+        case 6: mod = APSK_16; return true;
+        case 7: mod = APSK_32; return true;
+        case 10: mod = VSB_8; return true;
+        case 11: mod = VSB_16; return true;
+        case 12: mod = DQPSK; return true;
+        case 16: mod = QAM_16; return true;
+        case 32: mod = QAM_32; return true;
+        case 64: mod = QAM_64; return true;
+        case 128: mod = QAM_128; return true;
+        case 256: mod = QAM_256; return true;
+        case 999: mod = QAM_AUTO; return true;
+    }
+    return false;
+}
+
+bool vdr_guard_interval(std::uint32_t v, std::uint32_t &gi)
+{
+    switch (v)
+    {
+        case 4: gi = GUARD_INTERVAL_1_4; return true;
+        case 8: gi = GUARD_INTERVAL_1_8; return true;
+        case 16: gi = GUARD_INTERVAL_1_16; return true;
+        case 32: gi = GUARD_INTERVAL_1_32; return true;
+        case 128: gi = GUARD_INTERVAL_1_128; return true;
+        case 19128: gi = GUARD_INTERVAL_19_128; return true;
+        case 19256: gi = GUARD_INTERVAL_19_256; return true;
+        case 999: gi = GUARD_INTERVAL_AUTO; return true;
+    }
+    return false;
+}
+
+bool vdr_transmission_mode(std::uint32_t v, std::uint32_t &tm)
+{
+    switch (v)
+    {
+        case 1: tm = TRANSMISSION_MODE_1K; return true;
+        case 2: tm = TRANSMISSION_MODE_2K; return true;
+        case 4: tm = TRANSMISSION_MODE_4K; return true;
+        case 8: tm = TRANSMISSION_MODE_8K; return true;
+        case 16: tm = TRANSMISSION_MODE_16K; return true;
+        case 32: tm = TRANSMISSION_MODE_32K; return true;
+        case 999: tm = TRANSMISSION_MODE_AUTO; return true;
+    }
+    return false;
+}
+
+bool vdr_hierarchy(std::uint32_t v, std::uint32_t &h)
+{
+    switch (v)
+    {
+        case 0: h = HIERARCHY_NONE; return true;
+        case 1: h = HIERARCHY_1; return true;
+        case 2: h = HIERARCHY_2; return true;
+        case 4: h = HIERARCHY_4; return true;
+        case 999: h = HIERARCHY_AUTO; return true;
+    }
+    return false;
+}
+
+bool vdr_rolloff(std::uint32_t v, std::uint32_t &r)
+{
+    switch (v)
+    {
+        case 0: r = ROLLOFF_AUTO; return true;
+        case 20: r = ROLLOFF_20; return true;
+        case 25: r = ROLLOFF_25; return true;
+        case 35: r = ROLLOFF_35; return true;
+    }
+    return false;
+}
+
+std::string_view trim(std::string_view s)
+{
+    while (!s.empty() && std::strchr(" \t\r", s.front()))
+        s.remove_prefix(1);
+    while (!s.empty() && std::strchr(" \t\r", s.back()))
+        s.remove_suffix(1);
+    return s;
+}
+
+bool parse_uint(std::string_view s, std::uint32_t &v)
+{
+    auto end = s.data() + s.size();
+    auto result = std::from_chars(s.data(), end, v);
+    return result.ec == std::errc() && result.ptr == end;
+}
+
+bool starts_with(std::string_view s, std::string_view prefix)
+{
+    return s.substr(0, prefix.size()) == prefix;
+}
+
+/**
+ * split:
+ * Splits @line at colons into at most @max fields.
+ * Returns: The number of fields.
+ */
+unsigned split(std::string_view line, std::string_view *f, unsigned max)
+{
+    unsigned n = 0;
+    while (n < max)
+    {
+        auto colon = line.find(':');
+        f[n++] = line.substr(0, colon);
+        if (colon == std::string_view::npos)
+            break;
+        line.remove_prefix(colon + 1);
+    }
+    return n;
+}
+
+}   // namespace
+
+void TuningImporter::Fields::reset()
+{
+    delivery_system = SYS_UNDEFINED;
+    frequency = 0;
+    bandwidth = 0;
+    code_rate_hp = FEC_AUTO;
+    code_rate_lp = FEC_AUTO;
+    modulation = QAM_AUTO;
+    transmission_mode = TRANSMISSION_MODE_AUTO;
+    guard_interval = GUARD_INTERVAL_AUTO;
+    hierarchy = HIERARCHY_AUTO;
+    inversion = INVERSION_AUTO;
+    voltage = SEC_VOLTAGE_OFF;
+    symbol_rate = 0;
+    rolloff = ROLLOFF_AUTO;
+    stream_id = NO_STREAM_ID_FILTER;
+    original_network_id = 0;
+    transport_stream_id = 0;
+}
+
+bool TuningImporter::Fields::to_properties(TuningProperties &props) const
+{
+    props.clear();
+    if (!frequency)
+        return false;
+
+    // Properties are in the same order as TuningProperties(const char *)
+    switch (delivery_system)
+    {
+        case SYS_DVBT:
+        case SYS_DVBT2:
+        {
+            auto f = frequency;
+            if (f < 1000)
+                f *= 1000000;
+            else if (f < 1000000)
+                f *= 1000;
+            props.append_prop(DTV_DELIVERY_SYSTEM, delivery_system);
+            if (delivery_system == SYS_DVBT2 &&
+                    stream_id != NO_STREAM_ID_FILTER)
+            {
+                props.append_prop(DTV_STREAM_ID, stream_id);
+            }
+            props.append_prop(DTV_FREQUENCY, f);
+            if (bandwidth)
+                props.append_prop(DTV_BANDWIDTH_HZ, bandwidth);
+            props.append_prop(DTV_CODE_RATE_HP, code_rate_hp);
+            props.append_prop(DTV_CODE_RATE_LP, code_rate_lp);
+            props.append_prop(DTV_MODULATION, modulation);
+            props.append_prop(DTV_TRANSMISSION_MODE, transmission_mode);
+            props.append_prop(DTV_GUARD_INTERVAL, guard_interval);
+            props.append_prop(DTV_HIERARCHY, hierarchy);
+            break;
+        }
+        case SYS_DVBS:
+        case SYS_DVBS2:
+        {
+            if (!symbol_rate)
+                return false;
+            // MHz or kHz; symbol rate may be in kSym/s
+            std::uint32_t f = frequency < 1000000 ?
+                frequency * 1000 : frequency;
+            std::uint32_t tone;
+            TuningProperties::sat_freq_to_props(f, tone);
+            props.append_prop(DTV_DELIVERY_SYSTEM, delivery_system);
+            props.append_prop(DTV_FREQUENCY, f);
+            props.append_prop(DTV_TONE, tone);
+            props.append_prop(DTV_VOLTAGE, voltage);
+            props.append_prop(DTV_SYMBOL_RATE, symbol_rate < 1000000 ?
+                    symbol_rate * 1000 : symbol_rate);
+            props.append_prop(DTV_INNER_FEC, code_rate_hp);
+            if (delivery_system == SYS_DVBS2)
+            {
+                props.append_prop(DTV_PILOT, PILOT_AUTO);
+                props.append_prop(DTV_ROLLOFF, rolloff);
+                props.append_prop(DTV_MODULATION,
+                        modulation == QAM_AUTO ? std::uint32_t(QPSK) : modulation);
+            }
+            break;
+        }
+        default:
+            return false;
+    }
+    props.append_prop(DTV_INVERSION, inversion);
+    return true;
+}
+
+void TuningImporter::import_file(const char *filename)
+{
+    // Big enough for any sane line; grows if not
+    constexpr std::size_t CHUNK_SIZE = 64 * 1024;
+
+    auto start = Clock::now();
+    std::unique_ptr<std::FILE, int (*)(std::FILE *)>
+        fp(std::fopen(filename, "r"), std::fclose);
+    if (!fp)
+        throw report_errno("Unable to open", filename);
+
+    std::vector<char> buf(CHUNK_SIZE);
+    std::size_t len = 0;
+    while (true)
+    {
+        auto n = std::fread(buf.data() + len, 1, buf.size() - len, fp.get());
+        if (!n)
+        {
+            if (std::ferror(fp.get()))
+                throw report_errno("Error reading", filename);
+            break;
+        }
+        len += n;
+        auto consumed = parse_lines(buf.data(), len, false);
+        len -= consumed;
+        std::memmove(buf.data(), buf.data() + consumed, len);
+        if (len == buf.size())
+            buf.resize(buf.size() * 2);
+    }
+    parse_lines(buf.data(), len, true);
+    finish_dvbv5_block();
+
+    std::chrono::duration<double> t = Clock::now() - start;
+    stats_.seconds += t.count();
+}
+
+void TuningImporter::import_data(const char *data, std::size_t len)
+{
+    auto start = Clock::now();
+    parse_lines(data, len, true);
+    finish_dvbv5_block();
+    std::chrono::duration<double> t = Clock::now() - start;
+    stats_.seconds += t.count();
+}
+
+std::vector<TuningProperties> TuningImporter::get_tunings() const
+{
+    std::vector<TuningProperties> tunings;
+    tunings.reserve(entries_.size());
+    for (const auto &e: entries_)
+        tunings.push_back(e.tuning);
+    return tunings;
+}
+
+void TuningImporter::commit_to_database(Database &db, const char *source)
+    const
+{
+    using TuningVector = std::vector<std::tuple<Database::id_t, Database::id_t,
+          Database::id_t, Database::id_t, Database::id_t>>;
+    auto v = std::make_shared<TuningVector>();
+    for (const auto &e: entries_)
+    {
+        if (!e.original_network_id || !e.transport_stream_id)
+            continue;
+        // VDR's NID is the original network id and there's no separate
+        // network_id, but they're nearly always the same anyway
+        for (const auto &prop: e.tuning)
+        {
+            v->emplace_back(e.original_network_id, e.transport_stream_id,
+                    e.original_network_id, prop.cmd, prop.data);
+        }
+    }
+    if (v->size())
+        db.queue_statement(db.get_insert_tuning_statement(source), v);
+}
+
+void TuningImporter::clear()
+{
+    entries_.clear();
+    seen_.clear();
+    stats_ = Stats();
+    in_dvbv5_block_ = false;
+    dvbv5_bad_ = false;
+}
+
+std::size_t TuningImporter::parse_lines(const char *data, std::size_t len,
+        bool at_end)
+{
+    std::size_t o = 0;
+    while (o < len)
+    {
+        auto nl = static_cast<const char *>(std::memchr(data + o, '\n',
+                    len - o));
+        if (!nl && !at_end)
+            break;
+        std::size_t e = nl ? nl - data : len;
+        ++stats_.lines;
+        parse_line(std::string_view(data + o, e - o));
+        o = nl ? e + 1 : len;
+    }
+    return o;
+}
+
+void TuningImporter::parse_line(std::string_view line)
+{
+    line = trim(line);
+    if (line.empty() || line[0] == '#')
+        return;
+
+    if (format_ == DVBV5 || (format_ == AUTO && (line[0] == '[' ||
+            (in_dvbv5_block_ && line.find('=') != std::string_view::npos))))
+    {
+        parse_dvbv5(line);
+        return;
+    }
+    finish_dvbv5_block();
+
+    // VDR uses lines starting with ':' for group names
+    if (line[0] == ':')
+        return;
+
+    constexpr unsigned MAX_FIELDS = 13;
+    std::string_view f[MAX_FIELDS];
+    auto n = split(line, f, MAX_FIELDS);
+    Fields fields;
+    bool ok;
+
+    if (format_ == ZAP)
+        ok = parse_zap(f, n, fields);
+    else if (format_ == VDR)
+        ok = parse_vdr(f, n, fields);
+    else if (n == MAX_FIELDS && !starts_with(f[2], "INVERSION_"))
+        ok = parse_vdr(f, n, fields);
+    else
+        ok = parse_zap(f, n, fields);
+
+    if (ok)
+        add(fields);
+    else
+        ++stats_.rejected;
+}
+
+bool TuningImporter::parse_zap(const std::string_view *f, unsigned n,
+        Fields &fields)
+{
+    if (n < 8 || !parse_uint(f[1], fields.frequency))
+        return false;
+
+    if (starts_with(f[2], "INVERSION_"))
+    {
+        // name:freq:inversion:bandwidth:fec_hp:fec_lp:modulation:
+        // transmission_mode:guard_interval:hierarchy:vpid:apid:sid
+        fields.delivery_system = SYS_DVBT;
+        return n >= 10 &&
+            zap_inversion.lookup(f[2], fields.inversion) &&
+            zap_bandwidth.lookup(f[3], fields.bandwidth) &&
+            zap_code_rate.lookup(f[4], fields.code_rate_hp) &&
+            zap_code_rate.lookup(f[5], fields.code_rate_lp) &&
+            zap_modulation.lookup(f[6], fields.modulation) &&
+            zap_transmission_mode.lookup(f[7], fields.transmission_mode) &&
+            zap_guard_interval.lookup(f[8], fields.guard_interval) &&
+            zap_hierarchy.lookup(f[9], fields.hierarchy);
+    }
+
+    // szap: name:freq_MHz:polarisation:sat_no:symbol_rate_k:vpid:apid:sid
+    fields.delivery_system = SYS_DVBS;
+    if (f[2].size() != 1)
+        return false;
+    switch (f[2][0])
+    {
+        case 'h': case 'H': case 'l': case 'L':
+            fields.voltage = SEC_VOLTAGE_18;
+            break;
+        case 'v': case 'V': case 'r': case 'R':
+            fields.voltage = SEC_VOLTAGE_13;
+            break;
+        default:
+            return false;
+    }
+    return parse_uint(f[4], fields.symbol_rate);
+}
+
+bool TuningImporter::parse_vdr(const std::string_view *f, unsigned n,
+        Fields &fields)
+{
+    // name:freq:params:source:srate:vpid:apid:tpid:caid:sid:nid:tid:rid
+    if (n < 12 || f[3].empty() || !parse_uint(f[1], fields.frequency))
+        return false;
+
+    bool satellite;
+    if (f[3][0] == 'S')
+        satellite = true;
+    else if (f[3][0] == 'T')
+        satellite = false;
+    else
+        return false;
+
+    // Parameters are letters, most followed by a number
+    bool gen2 = false;
+    auto params = f[2];
+    while (!params.empty())
+    {
+        char c = params[0];
+        std::size_t l = 1;
+        while (l < params.size() && params[l] >= '0' && params[l] <= '9')
+            ++l;
+        std::uint32_t v = 0;
+        if (l > 1 && !parse_uint(params.substr(1, l - 1), v))
+            return false;
+        params.remove_prefix(l);
+
+        bool ok = true;
+        switch (c)
+        {
+            case 'B':
+                fields.bandwidth = v == 1712 ? 1712000 : v * 1000000;
+                break;
+            case 'C':
+                ok = vdr_code_rate(v, fields.code_rate_hp);
+                break;
+            case 'D':
+                ok = vdr_code_rate(v, fields.code_rate_lp);
+                break;
+            case 'G':
+                ok = vdr_guard_interval(v, fields.guard_interval);
+                break;
+            case 'H': case 'h': case 'L': case 'l':
+                fields.voltage = SEC_VOLTAGE_18;
+                break;
+            case 'V': case 'v': case 'R': case 'r':
+                fields.voltage = SEC_VOLTAGE_13;
+                break;
+            case 'I':
+                fields.inversion = v == 0 ? INVERSION_OFF :
+                    v == 1 ? INVERSION_ON : INVERSION_AUTO;
+                break;
+            case 'M':
+                ok = vdr_modulation(v, fields.modulation);
+                break;
+            case 'O':
+                ok = vdr_rolloff(v, fields.rolloff);
+                break;
+            case 'P':
+                fields.stream_id = v;
+                break;
+            case 'S':
+                gen2 = v == 1;
+                break;
+            case 'T':
+                ok = vdr_transmission_mode(v, fields.transmission_mode);
+                break;
+            case 'Y':
+                ok = vdr_hierarchy(v, fields.hierarchy);
+                break;
+            default:
+                // Other parameters don't affect tuning
+                break;
+        }
+        if (!ok)
+            return false;
+    }
+
+    if (satellite)
+    {
+        fields.delivery_system = gen2 ? SYS_DVBS2 : SYS_DVBS;
+        if (!parse_uint(f[4], fields.symbol_rate))
+            return false;
+    }
+    else
+    {
+        fields.delivery_system = gen2 ? SYS_DVBT2 : SYS_DVBT;
+    }
+
+    std::uint32_t nid, tid;
+    if (parse_uint(f[10], nid) && parse_uint(f[11], tid))
+    {
+        fields.original_network_id = nid;
+        fields.transport_stream_id = tid;
+    }
+    return true;
+}
+
+void TuningImporter::parse_dvbv5(std::string_view line)
+{
+    if (line[0] == '[')
+    {
+        finish_dvbv5_block();
+        in_dvbv5_block_ = true;
+        dvbv5_bad_ = false;
+        dvbv5_fields_.reset();
+        return;
+    }
+
+    auto eq = line.find('=');
+    if (!in_dvbv5_block_ || eq == std::string_view::npos)
+    {
+        ++stats_.rejected;
+        return;
+    }
+
+    auto key = trim(line.substr(0, eq));
+    auto val = trim(line.substr(eq + 1));
+    std::uint32_t k;
+    // Other keys, eg PIDs, don't affect tuning
+    if (!dvbv5_keys.lookup(key, k))
+        return;
+
+    auto &fields = dvbv5_fields_;
+    bool ok = false;
+    switch (Dvbv5Key(k))
+    {
+        case DVBV5_DELIVERY_SYSTEM:
+            ok = dvbv5_delivery_system.lookup(val, fields.delivery_system);
+            break;
+        case DVBV5_FREQUENCY:
+            ok = parse_uint(val, fields.frequency);
+            break;
+        case DVBV5_BANDWIDTH_HZ:
+            ok = parse_uint(val, fields.bandwidth);
+            break;
+        case DVBV5_CODE_RATE_HP:
+        case DVBV5_INNER_FEC:
+            ok = dvbv5_code_rate.lookup(val, fields.code_rate_hp);
+            break;
+        case DVBV5_CODE_RATE_LP:
+            ok = dvbv5_code_rate.lookup(val, fields.code_rate_lp);
+            break;
+        case DVBV5_MODULATION:
+            ok = dvbv5_modulation.lookup(val, fields.modulation);
+            break;
+        case DVBV5_TRANSMISSION_MODE:
+            ok = dvbv5_transmission_mode.lookup(val,
+                    fields.transmission_mode);
+            break;
+        case DVBV5_GUARD_INTERVAL:
+            ok = dvbv5_guard_interval.lookup(val, fields.guard_interval);
+            break;
+        case DVBV5_HIERARCHY:
+            ok = dvbv5_hierarchy.lookup(val, fields.hierarchy);
+            break;
+        case DVBV5_INVERSION:
+            ok = dvbv5_inversion.lookup(val, fields.inversion);
+            break;
+        case DVBV5_POLARIZATION:
+            ok = dvbv5_polarization.lookup(val, fields.voltage);
+            break;
+        case DVBV5_SYMBOL_RATE:
+            ok = parse_uint(val, fields.symbol_rate);
+            break;
+        case DVBV5_ROLLOFF:
+            ok = dvbv5_rolloff.lookup(val, fields.rolloff);
+            break;
+        case DVBV5_STREAM_ID:
+            ok = parse_uint(val, fields.stream_id);
+            break;
+    }
+    if (!ok)
+        dvbv5_bad_ = true;
+}
+
+void TuningImporter::finish_dvbv5_block()
+{
+    if (!in_dvbv5_block_)
+        return;
+    in_dvbv5_block_ = false;
+    if (dvbv5_bad_)
+        ++stats_.rejected;
+    else
+        add(dvbv5_fields_);
+}
+
+void TuningImporter::add(const Fields &fields)
+{
+    Entry entry;
+    if (!fields.to_properties(entry.tuning))
+    {
+        ++stats_.rejected;
+        return;
+    }
+    if (!seen_.insert(entry.tuning.get_scan_key()).second)
+    {
+        ++stats_.duplicates;
+        return;
+    }
+    entry.original_network_id = fields.original_network_id;
+    entry.transport_stream_id = fields.transport_stream_id;
+    entries_.push_back(entry);
+    ++stats_.tunings;
+}
+
+Glib::Error TuningImporter::report_errno(const char *msg,
+        const char *filename)
+{
+    char *s = g_strdup_printf("%s tuning file '%s': %s", msg, filename,
+            std::strerror(errno));
+    Glib::Error err(TuningProperties::get_error_quark(),
+            (int) TuningError::IMPORT, s);
+    g_free(s);
+    return err;
+}
+
+}
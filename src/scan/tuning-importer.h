@@ -0,0 +1,183 @@
+#pragma once
+
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <cstdint>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+#include "tuning.h"
+
+namespace logi
+{
+
+class Database;
+
+/**
+ * TuningImporter:
+ * Loads tunings in bulk from channels.conf files in zap (szap/tzap) or VDR
+ * format, or from dvbv5 .conf files. Input is read in chunks and each line is
+ * parsed in place, without allocating per token, so files with thousands of
+ * channels load quickly. Most such files have a line per channel, so
+ * transports which are equivalent to one already loaded are skipped.
+ * Only satellite and terrestrial tunings are supported; other lines are
+ * counted as rejected.
+ */
+class TuningImporter
+{
+public:
+    enum Format
+    {
+        AUTO,       /// Detect each line's format
+        ZAP,
+        VDR,
+        DVBV5,
+    };
+
+    struct Entry
+    {
+        TuningProperties tuning;
+        /// These are 0 unless the format provides them (only VDR does)
+        std::uint16_t original_network_id;
+        std::uint16_t transport_stream_id;
+    };
+
+    struct Stats
+    {
+        unsigned lines = 0;
+        unsigned tunings = 0;       /// Unique tunings loaded
+        unsigned duplicates = 0;
+        unsigned rejected = 0;
+        double seconds = 0;
+
+        double lines_per_second() const
+        {
+            return seconds > 0 ? lines / seconds : 0;
+        }
+    };
+
+    TuningImporter(Format format = AUTO) : format_(format)
+    {}
+
+    TuningImporter(const TuningImporter &) = delete;
+    TuningImporter &operator=(const TuningImporter &) = delete;
+
+    /**
+     * import_file:
+     * May be called repeatedly to merge several files.
+     * Throws: Glib::Error (TuningError::IMPORT) if the file can't be read.
+     */
+    void import_file(const char *filename);
+
+    /// Imports a whole file's worth of data which is already in memory
+    void import_data(const char *data, std::size_t len);
+
+    const std::vector<Entry> &get_entries() const
+    {
+        return entries_;
+    }
+
+    /// Returns: A copy of the tunings, eg for a ListTuningIterator
+    std::vector<TuningProperties> get_tunings() const;
+
+    const Stats &get_stats() const
+    {
+        return stats_;
+    }
+
+    /**
+     * commit_to_database:
+     * Queues the tunings of entries which have network and transport ids
+     * for writing to the tuning table.
+     */
+    void commit_to_database(Database &db, const char *source) const;
+
+    void clear();
+
+    /**
+     * Accumulates a tuning's fields, which may arrive in any order for
+     * dvbv5, until they can be converted to TuningProperties.
+     */
+    struct Fields
+    {
+        std::uint32_t delivery_system;
+        std::uint32_t frequency;            /// Hz, or kHz for satellite
+        std::uint32_t bandwidth;
+        std::uint32_t code_rate_hp;
+        std::uint32_t code_rate_lp;
+        std::uint32_t modulation;
+        std::uint32_t transmission_mode;
+        std::uint32_t guard_interval;
+        std::uint32_t hierarchy;
+        std::uint32_t inversion;
+        std::uint32_t voltage;
+        std::uint32_t symbol_rate;
+        std::uint32_t rolloff;
+        std::uint32_t stream_id;
+        std::uint16_t original_network_id;
+        std::uint16_t transport_stream_id;
+
+        Fields()
+        {
+            reset();
+        }
+
+        void reset();
+
+        bool to_properties(TuningProperties &props) const;
+    };
+private:
+    Format format_;
+    std::vector<Entry> entries_;
+    // Keyed by TuningProperties::get_scan_key(), because == treats a T2
+    // channel's PLPs as the same
+    std::unordered_set<std::uint64_t> seen_;
+    Stats stats_;
+
+    // dvbv5 entries span several lines
+    bool in_dvbv5_block_ = false;
+    bool dvbv5_bad_ = false;
+    Fields dvbv5_fields_;
+
+    /**
+     * parse_lines:
+     * @at_end: Whether to parse a final line with no newline.
+     * Returns: Number of bytes consumed.
+     */
+    std::size_t parse_lines(const char *data, std::size_t len, bool at_end);
+
+    void parse_line(std::string_view line);
+
+    // @f: Colon-separated fields of a line
+    bool parse_zap(const std::string_view *f, unsigned n, Fields &fields);
+
+    bool parse_vdr(const std::string_view *f, unsigned n, Fields &fields);
+
+    void parse_dvbv5(std::string_view line);
+
+    void finish_dvbv5_block();
+
+    void add(const Fields &fields);
+
+    static Glib::Error report_errno(const char *msg, const char *filename);
+};
+
+}
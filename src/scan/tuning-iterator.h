@@ -19,8 +19,6 @@
     Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 */
 
-#include <memory>
-
 #include "tuning.h"
 
 namespace logi
@@ -35,7 +33,8 @@ public:
     virtual ~TuningIterator()
     {}
 
-    virtual std::shared_ptr<TuningProperties> next() = 0;
+    /// Returns: Next tuning, or an empty one at the end
+    virtual TuningProperties next() = 0;
 
     virtual void reset() = 0;
 };
@@ -49,6 +49,13 @@ void SectionFilterBase::start(struct dmx_sct_filter_params *params)
                 "Unable to open section filter");
     }
 
+    // The kernel refuses to resize the buffer once the filter has started
+    if (buffer_size_ && ioctl(fd_, DMX_SET_BUFFER_SIZE, buffer_size_) < 0)
+    {
+        throw fe->report_errno(FrontendError::FILTER,
+                "Unable to set section filter buffer size");
+    }
+
     params->flags |= DMX_IMMEDIATE_START;
     if (ioctl(fd_, DMX_SET_FILTER, params) < 0)
     {
@@ -56,7 +63,7 @@ void SectionFilterBase::start(struct dmx_sct_filter_params *params)
                 "Unable to start section filter");
     }
 
-    rcv_->detune_signal().connect(sigc::mem_fun(*this,
+    detune_conn_ = rcv_->detune_signal().connect(sigc::mem_fun(*this,
                 &SectionFilterBase::stop));
     io_conn_ = Glib::signal_io().connect(
             sigc::mem_fun(*this, &SectionFilterBase::io_cb),
@@ -86,13 +93,44 @@ bool SectionFilterBase::io_cb(Glib::IOCondition cond)
         Section *sec = construct_section();
 
         if (sec->read_from_fd(fd_) < 0)
+        {
             callback(errno, nullptr);
-        else
+            return true;
+        }
+        callback(0, sec);
+
+        // Drain whatever else is buffered, so that a busy PID doesn't need
+        // a main loop iteration per section. The callback may have stopped
+        // the filter.
+        for (unsigned n = 1; buffer_size_ && fd_ >= 0 && n < MAX_BATCH; ++n)
+        {
+            sec = construct_section();
+            if (sec->read_from_fd(fd_) < 0)
+            {
+                if (errno != EAGAIN)
+                    callback(errno, nullptr);
+                break;
+            }
             callback(0, sec);
+        }
     }
     return true;
 }
 
+void SectionFilterBase::get_version_change_params(
+        struct dmx_sct_filter_params &params,
+        std::uint16_t pid, std::uint8_t table_id, std::uint16_t section_id,
+        std::uint8_t version)
+{
+    get_params(params, pid, table_id, section_id, 0);
+    // filter[3] is byte 5 of the section because the kernel skips the
+    // section_length bytes. Setting mode bits makes them a negative match.
+    params.filter.filter[3] = version << 1;
+    params.filter.mask[3] = 0x3e;
+    params.filter.mode[3] = 0x3e;
+    g_debug("  version != %d", version);
+}
+
 void SectionFilterBase::get_params(struct dmx_sct_filter_params &params,
         std::uint16_t pid, std::uint8_t table_id, std::uint16_t section_id,
         unsigned timeout,
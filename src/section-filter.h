@@ -20,6 +20,7 @@
 */
 
 #include <cerrno>
+#include <functional>
 #include <memory>
 
 #include "receiver.h"
@@ -35,17 +36,30 @@ class SectionFilterBase
 private:
     std::shared_ptr<Receiver> rcv_;
     int fd_;
+    unsigned buffer_size_;
     sigc::connection detune_conn_;
     sigc::connection io_conn_;
 protected:
+    /// Maximum number of sections read per wakeup by a high-rate filter
+    constexpr static unsigned MAX_BATCH = 64;
+
     SectionFilterBase(std::shared_ptr<Receiver> rcv) :
-        rcv_(rcv), fd_(-1)
+        rcv_(rcv), fd_(-1), buffer_size_(0)
     {}
 
+    /**
+     * @buffer_size:    If non-zero, the kernel's buffer is enlarged to this
+     *                  many bytes, and each wakeup reads up to MAX_BATCH
+     *                  sections. This is for filters with high data rates,
+     *                  eg EIT. Their handlers must stop() the filter rather
+     *                  than delete it from a callback.
+     */
     SectionFilterBase(std::shared_ptr<Receiver> rcv,
-            struct dmx_sct_filter_params *params) :
+            struct dmx_sct_filter_params *params,
+            unsigned buffer_size = 0) :
         SectionFilterBase(rcv)
     {
+        buffer_size_ = buffer_size;
         start(params);
     }
 
@@ -77,16 +91,27 @@ public:
      * because callback() is virtual and stop() is called from destructor).
      */
     void stop();
-private:
-    void start(struct dmx_sct_filter_params *params);
-
-    bool io_cb(Glib::IOCondition cond);
 
+    /**
+     * get_version_change_params:
+     * Fills in params for a filter with no timeout which only passes sections
+     * of the sub-table whose version isn't version, so that a table that
+     * hasn't changed costs nothing to monitor.
+     */
     static void get_params(struct dmx_sct_filter_params &params,
             std::uint16_t pid, std::uint8_t table_id, std::uint16_t section_id,
             unsigned timeout = 5000,
             std::uint8_t table_id_mask = 0xff,
             std::uint16_t section_id_mask = 0xffff);
+
+    static void get_version_change_params(
+            struct dmx_sct_filter_params &params,
+            std::uint16_t pid, std::uint8_t table_id, std::uint16_t section_id,
+            std::uint8_t version);
+private:
+    void start(struct dmx_sct_filter_params *params);
+
+    bool io_cb(Glib::IOCondition cond);
 };
 
 }
@@ -111,11 +136,17 @@ private:
     T &handler_;
     Method method_;
     std::shared_ptr<S> current_section_;
+public:
+    /// Supplies a new section when the handler has kept the last one
+    using Allocator = std::function<std::shared_ptr<S>()>;
+private:
+    Allocator allocator_;
 public:
     SectionFilter(std::shared_ptr<Receiver> rcv,
             struct dmx_sct_filter_params *params,
-            T &handler, Method method) :
-        logi_priv::SectionFilterBase(rcv, params),
+            T &handler, Method method,
+            unsigned buffer_size = 0) :
+        logi_priv::SectionFilterBase(rcv, params, buffer_size),
         handler_{handler}, method_{method}
     {}
 
@@ -130,9 +161,22 @@ public:
         handler_{handler}, method_{method}
     {}
 
+    /// For handlers which keep sections and can recycle their buffers
+    void set_allocator(Allocator allocator)
+    {
+        allocator_ = allocator;
+    }
+
     Section *construct_section() override
     {
-        current_section_.reset(new S());
+        // Reuse the last section's buffer unless the handler kept it
+        if (!current_section_ || current_section_.use_count() > 1)
+        {
+            if (allocator_)
+                current_section_ = allocator_();
+            else
+                current_section_.reset(new S());
+        }
         return current_section_.get();
     }
 
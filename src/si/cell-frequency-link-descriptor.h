@@ -0,0 +1,62 @@
+#pragma once
+
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "descriptor.h"
+
+namespace logi
+{
+
+/**
+ * CellFrequencyLinkDescriptor:
+ * Describes the cells of a terrestrial network, the frequency used in each
+ * and the transposers within each cell.
+ */
+class CellFrequencyLinkDescriptor : public Descriptor
+{
+public:
+    CellFrequencyLinkDescriptor(const Descriptor &source) :
+        Descriptor(source)
+    {}
+
+    /**
+     * for_each_frequency:
+     * Calls f(cell_id, frequency, transposer) for each cell's frequency
+     * followed by its transposers' frequencies. Frequencies are in Hz.
+     */
+    template<class F> void for_each_frequency(F f) const
+    {
+        unsigned end = length() + 2;
+        unsigned o = 2;
+
+        while (o + 7 <= end)
+        {
+            std::uint16_t cell_id = word16(o);
+            f(cell_id, word32(o + 2) * 10, false);
+            o += 6;
+            unsigned subcell_end = o + 1 + word8(o);
+            for (o += 1; o + 5 <= subcell_end && o + 5 <= end; o += 5)
+                f(cell_id, word32(o + 1) * 10, true);
+            o = subcell_end;
+        }
+    }
+};
+
+}
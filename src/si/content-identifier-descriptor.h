@@ -0,0 +1,99 @@
+#pragma once
+
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <string_view>
+
+#include "descriptor.h"
+
+namespace logi
+{
+
+/**
+ * ContentIdentifierDescriptor:
+ * TV-Anytime CRIDs (ETSI TS 102 323) identifying an event's programme and
+ * the series it belongs to. UK broadcasters use the D-book's crid_type
+ * values 0x31-0x33 rather than TS 102 323's 0x01-0x03.
+ */
+class ContentIdentifierDescriptor : public Descriptor
+{
+public:
+    enum CRIDType
+    {
+        PROGRAMME,
+        SERIES,
+        RECOMMENDATION,
+        OTHER,
+    };
+
+    ContentIdentifierDescriptor(const Descriptor &source) : Descriptor(source)
+    {}
+
+    static CRIDType crid_type(std::uint8_t type)
+    {
+        switch (type)
+        {
+            case 0x01:
+            case 0x31:
+                return PROGRAMME;
+            case 0x02:
+            case 0x32:
+                return SERIES;
+            case 0x03:
+            case 0x33:
+                return RECOMMENDATION;
+            default:
+                return OTHER;
+        }
+    }
+
+    /**
+     * for_each_crid:
+     * Calls @f(CRIDType, std::string_view crid) for each CRID carried in the
+     * descriptor. CRIDs are usually relative to the service's default
+     * authority, starting with '/'. References to a CRID in a CIT
+     * (crid_location 1) are skipped.
+     */
+    template<class F> void for_each_crid(F f) const
+    {
+        unsigned end = unsigned(length()) + 2;
+        for (unsigned o = 2; o + 1 < end; )
+        {
+            auto b = word8(o);
+            if ((b & 3) == 1)
+            {
+                o += 3;
+                continue;
+            }
+            else if (b & 3)
+            {
+                break;
+            }
+            unsigned len = word8(o + 1);
+            if (o + 2 + len > end)
+                break;
+            f(crid_type(b >> 2), std::string_view(reinterpret_cast<const char *>
+                        (get_data().data() + get_offset() + o + 2), len));
+            o += 2 + len;
+        }
+    }
+};
+
+}
@@ -0,0 +1,151 @@
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "decode-cache.h"
+
+namespace logi
+{
+
+DecodeCache::DecodeCache(std::size_t capacity) :
+    shard_capacity_(capacity / NUM_SHARDS ? capacity / NUM_SHARDS : 1)
+{
+    for (auto &shard: shards_)
+    {
+        shard.slots.reserve(shard_capacity_);
+        shard.index.reserve(shard_capacity_);
+    }
+}
+
+DecodeCache::Value DecodeCache::get(const std::vector<std::uint8_t> &vec,
+        unsigned offset, unsigned len, Decoder decode)
+{
+    const std::uint8_t *raw = vec.data() + offset;
+    auto h = hash(raw, len);
+    auto &shard = shard_for(h);
+    auto matches = [raw, len](const Slot &slot)
+    {
+        return slot.raw.size() == len && !slot.raw.compare(0, len,
+                reinterpret_cast<const char *>(raw), len);
+    };
+
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.index.find(h);
+        if (it != shard.index.end())
+        {
+            auto &slot = shard.slots[it->second];
+            if (matches(slot))
+            {
+                ++shard.hits;
+                slot.referenced = true;
+                return slot.value;
+            }
+        }
+        ++shard.misses;
+    }
+
+    // Decode without holding the lock; another thread may decode the same
+    // string at the same time, in which case the first to finish wins
+    Value value = std::make_shared<const Glib::ustring>(
+            decode(vec, offset, len));
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(h);
+    if (it != shard.index.end())
+    {
+        auto &slot = shard.slots[it->second];
+        if (matches(slot))
+            return slot.value;
+        // A hash collision; the newer string replaces the older one
+        slot.raw.assign(reinterpret_cast<const char *>(raw), len);
+        slot.value = value;
+        slot.referenced = false;
+        ++shard.evictions;
+        return value;
+    }
+
+    unsigned n;
+    if (shard.slots.size() < shard_capacity_)
+    {
+        n = shard.slots.size();
+        shard.slots.emplace_back();
+    }
+    else
+    {
+        n = evict(shard);
+    }
+    auto &slot = shard.slots[n];
+    slot.hash = h;
+    slot.raw.assign(reinterpret_cast<const char *>(raw), len);
+    slot.value = value;
+    slot.referenced = false;
+    shard.index.emplace(h, n);
+    return value;
+}
+
+unsigned DecodeCache::evict(Shard &shard)
+{
+    // Give each recently used slot a second chance
+    while (shard.slots[shard.hand].referenced)
+    {
+        shard.slots[shard.hand].referenced = false;
+        if (++shard.hand == shard.slots.size())
+            shard.hand = 0;
+    }
+    unsigned n = shard.hand;
+    if (++shard.hand == shard.slots.size())
+        shard.hand = 0;
+    shard.index.erase(shard.slots[n].hash);
+    ++shard.evictions;
+    return n;
+}
+
+DecodeCache::Stats DecodeCache::stats() const
+{
+    Stats st;
+    for (const auto &shard: shards_)
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        st.hits += shard.hits;
+        st.misses += shard.misses;
+        st.evictions += shard.evictions;
+        st.size += shard.slots.size();
+    }
+    return st;
+}
+
+void DecodeCache::clear()
+{
+    for (auto &shard: shards_)
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.slots.clear();
+        shard.index.clear();
+        shard.hand = 0;
+        shard.hits = shard.misses = shard.evictions = 0;
+    }
+}
+
+DecodeCache &DecodeCache::shared()
+{
+    static DecodeCache cache;
+    return cache;
+}
+
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <glibmm/ustring.h>
+
+namespace logi
+{
+
+/**
+ * DecodeCache:
+ * Memoises decoded SI strings, keyed by their raw encoded bytes, which
+ * include the leading control code and Huffman table selector. EIT carousels
+ * repeat the same titles and descriptions every cycle, so most Freesat
+ * strings only need to be Huffman decoded once. The cache is split into
+ * shards, each with its own mutex, so it can be shared by parser threads.
+ * Each shard has a fixed number of slots, recycled with the CLOCK algorithm.
+ */
+class DecodeCache
+{
+public:
+    using Value = std::shared_ptr<const Glib::ustring>;
+
+    /// Signature of decode_string_uncached()
+    using Decoder = Glib::ustring (*)(const std::vector<std::uint8_t> &vec,
+            unsigned offset, unsigned len);
+
+    constexpr static unsigned SHARD_BITS = 4;
+    constexpr static unsigned NUM_SHARDS = 1 << SHARD_BITS;
+    constexpr static std::size_t DEFAULT_CAPACITY = 32768;
+
+    struct Stats
+    {
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+        std::uint64_t evictions = 0;
+        std::size_t size = 0;
+
+        double hit_rate() const
+        {
+            return hits + misses ? double(hits) / (hits + misses) : 0;
+        }
+    };
+private:
+    struct Slot
+    {
+        std::uint64_t hash = 0;
+        std::string raw;
+        Value value;
+        bool referenced = false;
+    };
+
+    struct Shard
+    {
+        mutable std::mutex mutex;
+        std::vector<Slot> slots;
+        std::unordered_map<std::uint64_t, unsigned> index;
+        unsigned hand = 0;
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+        std::uint64_t evictions = 0;
+    };
+
+    Shard shards_[NUM_SHARDS];
+    std::size_t shard_capacity_;
+public:
+    /// capacity is the total number of strings, shared between the shards
+    DecodeCache(std::size_t capacity = DEFAULT_CAPACITY);
+
+    DecodeCache(const DecodeCache &) = delete;
+    DecodeCache &operator=(const DecodeCache &) = delete;
+
+    /**
+     * get:
+     * Returns the cached string for the len bytes at vec[offset], calling
+     * decode on a miss. Identical encodings always share the same Value
+     * while it's cached.
+     */
+    Value get(const std::vector<std::uint8_t> &vec, unsigned offset,
+            unsigned len, Decoder decode);
+
+    Stats stats() const;
+
+    /// Empties the cache and zeroes the stats
+    void clear();
+
+    std::size_t capacity() const { return shard_capacity_ * NUM_SHARDS; }
+
+    /// 64-bit FNV-1a
+    static std::uint64_t hash(const std::uint8_t *raw, unsigned len)
+    {
+        std::uint64_t h = 0xcbf29ce484222325ull;
+        for (unsigned n = 0; n < len; ++n)
+        {
+            h ^= raw[n];
+            h *= 0x100000001b3ull;
+        }
+        return h;
+    }
+
+    /// The cache used by decode_string()
+    static DecodeCache &shared();
+private:
+    Shard &shard_for(std::uint64_t h)
+    {
+        return shards_[h >> (64 - SHARD_BITS)];
+    }
+
+    unsigned evict(Shard &shard);
+};
+
+}
@@ -19,6 +19,7 @@
 
 #include <glibmm.h>
 
+#include "decode-cache.h"
 #include "decode-string.h"
 #include "huffman.h"
 
@@ -73,10 +74,12 @@ constexpr static guint16 table[] =
     0x00fe, 0x0167, 0x014b, 0x00ad,     // fc
 };
 
-static Glib::ustring decode_latin(std::vector<std::uint8_t> v,
+static Glib::ustring decode_latin(const std::vector<std::uint8_t> &v,
         unsigned o, unsigned l)
 {
     Glib::ustring s;
+    // Service names are almost all ASCII so this is usually exact
+    s.reserve(l);
     for (auto i = o; i < o + l; ++i)
     {
         auto c = v[i];
@@ -95,7 +98,17 @@ Glib::ustring iso8859_n(int n)
     return Glib::ustring::compose("ISO_8859-%1", n);
 }
 
-Glib::ustring decode_string(const std::vector<std::uint8_t> &vec,
+DecodedString decode_string(const std::vector<std::uint8_t> &vec,
+        unsigned offset, unsigned len)
+{
+    // Plain strings are quicker to decode than to look up
+    if (!len || vec[offset] >= 0x20)
+        return decode_string_uncached(vec, offset, len);
+    return DecodeCache::shared().get(vec, offset, len,
+            decode_string_uncached);
+}
+
+Glib::ustring decode_string_uncached(const std::vector<std::uint8_t> &vec,
         unsigned offset, unsigned len)
 {
     Glib::ustring from_enc;
@@ -19,6 +19,10 @@
     Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 */
 
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include <glibmm/ustring.h>
@@ -26,6 +30,74 @@
 namespace logi
 {
 
+/**
+ * DecodedString:
+ * An immutable decoded string, which can share its value with DecodeCache so
+ * that a cache hit doesn't copy it. An uncached string is held inline, so it
+ * costs no more than a Glib::ustring. Converts to const Glib::ustring &.
+ */
+class DecodedString
+{
+private:
+    // Null if the value is held in value_
+    std::shared_ptr<const Glib::ustring> shared_;
+    Glib::ustring value_;
+public:
+    DecodedString() = default;
+
+    DecodedString(std::shared_ptr<const Glib::ustring> value) :
+        shared_(std::move(value))
+    {}
+
+    DecodedString(Glib::ustring &&s) : value_(std::move(s))
+    {}
+
+    DecodedString(const Glib::ustring &s) : value_(s)
+    {}
+
+    DecodedString(const char *s) : value_(s)
+    {}
+
+    const Glib::ustring &get() const
+    {
+        return shared_ ? *shared_ : value_;
+    }
+
+    operator const Glib::ustring &() const
+    {
+        return get();
+    }
+
+    /// Moves the value out unless it's shared, in which case it's copied
+    Glib::ustring take() &&
+    {
+        if (shared_)
+            return *shared_;
+        return std::move(value_);
+    }
+
+    const std::string &raw() const
+    {
+        return get().raw();
+    }
+
+    const char *c_str() const
+    {
+        return get().c_str();
+    }
+
+    bool empty() const
+    {
+        return get().empty();
+    }
+
+    void clear()
+    {
+        shared_.reset();
+        value_.clear();
+    }
+};
+
 /**
  * decode_string:
  * Global function to decode a string from SI data.
@@ -33,8 +105,17 @@ namespace logi
  * @offset: Offset of start of string in the vector
  *          (including any leading control code).
  * @len: Length of SI-encoded string (including above control code).
+ * Strings with a leading control code, including all Huffman-encoded
+ * strings, are memoised in DecodeCache::shared().
+ */
+DecodedString decode_string(const std::vector<std::uint8_t> &vec,
+        unsigned offset, unsigned len);
+
+/**
+ * decode_string_uncached:
+ * As decode_string() but always does the full decoding.
  */
-Glib::ustring decode_string(const std::vector<std::uint8_t> &vec,
+Glib::ustring decode_string_uncached(const std::vector<std::uint8_t> &vec,
         unsigned offset, unsigned len);
 
 }
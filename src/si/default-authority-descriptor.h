@@ -0,0 +1,49 @@
+#pragma once
+
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <string_view>
+
+#include "descriptor.h"
+
+namespace logi
+{
+
+/**
+ * DefaultAuthorityDescriptor:
+ * The authority which relative CRIDs are resolved against (ETSI TS 102 323).
+ * It may be in an SDT's service loop, or a NIT's transport stream or network
+ * loop, in order of precedence.
+ */
+class DefaultAuthorityDescriptor : public Descriptor
+{
+public:
+    DefaultAuthorityDescriptor(const Descriptor &source) : Descriptor(source)
+    {}
+
+    /// A DNS name, without the "crid://" prefix
+    std::string_view authority() const
+    {
+        return std::string_view(reinterpret_cast<const char *>
+                (get_data().data() + get_offset() + 2), length());
+    }
+};
+
+}
@@ -22,6 +22,7 @@
 #include <linux/dvb/frontend.h>
 
 #include "descriptor.h"
+#include "tuning.h"
 
 namespace logi
 {
@@ -41,8 +42,7 @@ public:
 
     static fe_transmit_mode_t transmission_mode(std::uint8_t t);
 
-    /// Result is heap-allocated
-    virtual class TuningProperties *get_tuning_properties() const = 0;
+    virtual TuningProperties get_tuning_properties() const = 0;
 };
 
 }
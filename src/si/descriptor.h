@@ -32,7 +32,16 @@ public:
     constexpr static std::uint8_t SATELLITE_DELIVERY_SYSTEM = 0x43;
     constexpr static std::uint8_t BOUQUET_NAME = 0x47;
     constexpr static std::uint8_t SERVICE = 0x48;
+    constexpr static std::uint8_t SHORT_EVENT = 0x4D;
+    constexpr static std::uint8_t EXTENDED_EVENT = 0x4E;
+    constexpr static std::uint8_t CONTENT = 0x54;
+    constexpr static std::uint8_t PARENTAL_RATING = 0x55;
+    constexpr static std::uint8_t LOCAL_TIME_OFFSET = 0x58;
     constexpr static std::uint8_t TERRESTRIAL_DELIVERY_SYSTEM = 0x5A;
+    constexpr static std::uint8_t FREQUENCY_LIST = 0x62;
+    constexpr static std::uint8_t CELL_FREQUENCY_LINK = 0x6D;
+    constexpr static std::uint8_t DEFAULT_AUTHORITY = 0x73;
+    constexpr static std::uint8_t CONTENT_IDENTIFIER = 0x76;
     constexpr static std::uint8_t EXTENSION = 0x7F;
 public:
     Descriptor(const SectionData &sec, unsigned offset) :
@@ -65,6 +74,8 @@ public:
 
 class ExtensionDescriptor: public Descriptor
 {
+public:
+    constexpr static std::uint8_t T2_DELIVERY_SYSTEM = 0x04;
 public:
     ExtensionDescriptor(const Descriptor &desc) : Descriptor(desc)
     {}
@@ -79,4 +90,18 @@ public:
     }
 };
 
+template<class F> void SectionData::for_each_descriptor(unsigned o, F f) const
+{
+    unsigned end = o + word12(o) + 2;
+
+    o += 2;
+    while (o < end)
+    {
+        unsigned e = o + word8(o + 1) + 2;
+
+        f(Descriptor(*this, o + offset_));
+        o = e;
+    }
+}
+
 }
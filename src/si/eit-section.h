@@ -0,0 +1,129 @@
+#pragma once
+
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <ctime>
+
+#include "descriptor.h"
+#include "section.h"
+
+namespace logi
+{
+
+class EITSectionEventData : public SectionData
+{
+public:
+    EITSectionEventData(const std::vector<uint8_t> &data, unsigned offset) :
+        SectionData(data, offset)
+    {}
+
+    std::uint16_t event_id() const { return word16(0); }
+
+    /// Seconds since the Unix epoch, 0 if undefined
+    std::time_t start_time() const { return mjd_time(2); }
+
+    /// In seconds
+    std::uint32_t duration() const { return bcd_time(7); }
+
+    /// Same values as SDTSectionServiceData::RunningStatus
+    std::uint8_t running_status() const { return (word8(10) & 0xe0) >> 5; }
+
+    /// true = encrypted
+    bool free_CA_mode() const { return (word8(10) & 0x10) != 0; }
+
+    std::uint16_t descriptors_loop_length() const { return word12(10); }
+
+    std::vector<Descriptor> get_descriptors() const
+    {
+        return SectionData::get_descriptors(10);
+    }
+
+    template<class F> void for_each_descriptor(F f) const
+    {
+        SectionData::for_each_descriptor(10, f);
+    }
+};
+
+/**
+ * EITSection:
+ * Covers present/following (0x4E/0x4F) and schedule (0x50-0x6F) tables.
+ * Schedule sub-tables are divided into segments of 8 sections, each covering
+ * 3 hours, and a segment's unused section numbers are skipped, so
+ * last_section_number alone doesn't say which sections to expect.
+ */
+class EITSection : public Section
+{
+public:
+    /// EIT sections can be up to 4096 bytes, unlike NIT/SDT/BAT
+    EITSection() : Section(4096)
+    {}
+
+    std::uint16_t service_id() const
+    {
+        return section_id();
+    }
+
+    std::uint16_t transport_stream_id() const
+    {
+        return word16(8);
+    }
+
+    std::uint16_t original_network_id() const
+    {
+        return word16(10);
+    }
+
+    std::uint8_t segment_last_section_number() const
+    {
+        return word8(12);
+    }
+
+    std::uint8_t last_table_id() const
+    {
+        return word8(13);
+    }
+
+    bool is_present_following() const
+    {
+        return table_id() < EIT_SCHEDULE_TABLE;
+    }
+
+    bool is_actual() const
+    {
+        return table_id() == EIT_PF_TABLE ||
+            (table_id() & 0xf0) == EIT_SCHEDULE_TABLE;
+    }
+
+    std::vector<EITSectionEventData> get_events() const;
+
+    /// Calls @f with each EITSectionEventData without building a vector
+    template<class F> void for_each_event(F f) const
+    {
+        unsigned o = 14;
+        while (o < unsigned(section_length())
+                + 3 /* table_id and length */ - 4 /* CRC */)
+        {
+            f(EITSectionEventData(get_data(), get_offset() + o));
+            o += 12 + word12(o + 10);
+        }
+    }
+};
+
+}
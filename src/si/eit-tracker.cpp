@@ -0,0 +1,198 @@
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <algorithm>
+#include <cstring>
+
+#include "eit-section.h"
+#include "eit-tracker.h"
+
+namespace logi
+{
+
+// Every new section is hashed, so this works a word at a time, unlike the
+// FNV-1a used for strings
+static std::uint64_t hash_payload(const std::uint8_t *p, unsigned len)
+{
+    std::uint64_t h = len;
+    for (; len >= 8; p += 8, len -= 8)
+    {
+        std::uint64_t w;
+        std::memcpy(&w, p, 8);
+        h = (h ^ w) * 0x9e3779b97f4a7c15ull;
+        h ^= h >> 29;
+    }
+    for (; len; --len)
+        h = (h ^ *p++) * 0x100000001b3ull;
+    return h;
+}
+
+void EITTracker::reset()
+{
+    sub_tables_.clear();
+    groups_.clear();
+    complete_groups_ = 0;
+}
+
+EITTracker::Result EITTracker::track(const EITSection &sec)
+{
+    auto table_id = sec.table_id();
+    if (table_id < Section::EIT_PF_TABLE || table_id > Section::LAST_EIT_TABLE)
+        return TableTracker::ERROR;
+
+    auto skey = service_key(sec.original_network_id(),
+            sec.transport_stream_id(), sec.service_id());
+    auto group = group_for_table(table_id);
+    auto &grp = groups_[(skey << 2) | group];
+    auto &tab = sub_tables_[(skey << 8) | table_id];
+    bool was_complete = group_complete(grp);
+
+    if (group == PF_ACTUAL || group == PF_OTHER)
+    {
+        grp.required_tables = 1 << (table_id & 0xf);
+    }
+    else
+    {
+        // Keep last_table_id within this table's actual/other range
+        unsigned last = std::min(std::max(sec.last_table_id(), table_id),
+                std::uint8_t(table_id | 0x0f));
+        grp.required_tables = (2u << (last & 0xf)) - 1;
+    }
+
+    auto vn = sec.version_number();
+    if (vn != tab.version_number)
+    {
+        auto payloads = std::move(tab.payloads);
+        tab = SubTable();
+        tab.payloads = std::move(payloads);
+        tab.version_number = vn;
+        tab.last_section_number = sec.last_section_number();
+        grp.complete_tables &= ~(1 << (table_id & 0xf));
+    }
+
+    Result result;
+    unsigned sn = sec.section_number();
+    if (tab.received.test(sn))
+    {
+        result = TableTracker::REPEAT;
+    }
+    else
+    {
+        tab.received.set(sn);
+        unsigned seg = sn / 8;
+        if (!tab.segments_seen.test(seg))
+        {
+            tab.segments_seen.set(seg);
+            unsigned last = std::max(sn, std::min(
+                        unsigned(sec.segment_last_section_number()),
+                        seg * 8 + 7));
+            for (unsigned n = seg * 8; n <= last; ++n)
+                tab.expected.set(n);
+        }
+        if (sub_table_complete(tab))
+            grp.complete_tables |= 1 << (table_id & 0xf);
+        result = TableTracker::OK;
+    }
+
+    bool now_complete = group_complete(grp);
+    if (now_complete && !was_complete)
+        ++complete_groups_;
+    else if (was_complete && !now_complete)
+        --complete_groups_;
+
+    if (now_complete)
+    {
+        if (result == TableTracker::REPEAT)
+            return TableTracker::REPEAT_COMPLETE;
+        else if (!was_complete)
+            return TableTracker::COMPLETE;
+    }
+    return result;
+}
+
+bool EITTracker::payload_changed(const EITSection &sec)
+{
+    auto it = sub_tables_.find((service_key(sec.original_network_id(),
+                sec.transport_stream_id(), sec.service_id()) << 8) |
+            sec.table_id());
+    if (it == sub_tables_.end())
+        return true;
+
+    // Between the header and the CRC
+    unsigned len = sec.section_length() + 3;
+    len = len >= 18 ? len - 18 : 0;
+    auto h = hash_payload(sec.get_data().data() + sec.get_offset() + 14,
+            len);
+    auto &payloads = it->second.payloads;
+    unsigned sn = sec.section_number();
+    if (payloads.size() <= sn)
+        payloads.resize(sn + 1);
+    bool changed = payloads[sn] != h;
+    payloads[sn] = h;
+    return changed;
+}
+
+bool EITTracker::service_complete(std::uint16_t orig_nw_id,
+        std::uint16_t ts_id, std::uint16_t service_id, Group group) const
+{
+    auto it = groups_.find((service_key(orig_nw_id, ts_id, service_id) << 2)
+            | group);
+    return it != groups_.end() && group_complete(it->second);
+}
+
+bool EITTracker::segment_complete(std::uint16_t orig_nw_id,
+        std::uint16_t ts_id, std::uint16_t service_id, std::uint8_t table_id,
+        unsigned segment) const
+{
+    auto it = sub_tables_.find((service_key(orig_nw_id, ts_id, service_id)
+                << 8) | table_id);
+    if (it == sub_tables_.end() || segment >= 32)
+        return false;
+    const auto &tab = it->second;
+    if (!tab.segments_seen.test(segment))
+        return false;
+    for (unsigned n = segment * 8; n < segment * 8 + 8; ++n)
+    {
+        if (tab.expected.test(n) && !tab.received.test(n))
+            return false;
+    }
+    return true;
+}
+
+EITTracker::Group EITTracker::group_for_table(std::uint8_t table_id)
+{
+    if (table_id == Section::EIT_PF_TABLE)
+        return PF_ACTUAL;
+    else if (table_id == Section::OTHER_EIT_PF_TABLE)
+        return PF_OTHER;
+    else if (table_id < Section::OTHER_EIT_SCHEDULE_TABLE)
+        return SCHEDULE_ACTUAL;
+    return SCHEDULE_OTHER;
+}
+
+bool EITTracker::sub_table_complete(const SubTable &tab)
+{
+    unsigned nsegs = tab.last_section_number / 8 + 1;
+    std::uint32_t segs_mask = nsegs == 32 ? 0xffffffff : (1u << nsegs) - 1;
+    if ((tab.segments_seen.to_ulong() & segs_mask) != segs_mask)
+        return false;
+    return (tab.expected & ~tab.received).none();
+}
+
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <bitset>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "table-tracker.h"
+
+namespace logi
+{
+
+class EITSection;
+
+/**
+ * EITTracker:
+ * Keeps track of which EIT sections have been received, per service and per
+ * segment. TableTracker can't do this because schedule sub-tables have gaps
+ * between the segments' last sections. Any change of version number restarts
+ * the sub-table, because p/f tables change whenever an event ends.
+ */
+class EITTracker
+{
+public:
+    using Result = TableTracker::Result;
+
+    /// Service groups, for service_complete()
+    enum Group
+    {
+        PF_ACTUAL,
+        PF_OTHER,
+        SCHEDULE_ACTUAL,
+        SCHEDULE_OTHER,
+    };
+private:
+    struct SubTable
+    {
+        std::int8_t version_number = -1;
+        std::uint8_t last_section_number = 0;
+        std::bitset<32> segments_seen;
+        std::bitset<256> received;
+        std::bitset<256> expected;
+        // Hash of each section's event loop, kept across versions
+        std::vector<std::uint64_t> payloads;
+    };
+
+    struct ServiceGroup
+    {
+        // Bit per table_id & 0xf
+        std::uint16_t required_tables = 0;
+        std::uint16_t complete_tables = 0;
+    };
+
+    std::unordered_map<std::uint64_t, SubTable> sub_tables_;
+    std::unordered_map<std::uint64_t, ServiceGroup> groups_;
+    unsigned complete_groups_ = 0;
+public:
+    EITTracker() = default;
+
+    EITTracker(const EITTracker &) = delete;
+    EITTracker(EITTracker &&) = delete;
+    EITTracker &operator=(const EITTracker &) = delete;
+    EITTracker &operator=(EITTracker &&) = delete;
+
+    void reset();
+
+    /**
+     * track:
+     * Returns: OK for a new section, COMPLETE if it completes its service
+     *          group (all its p/f or schedule tables), REPEAT or
+     *          REPEAT_COMPLETE for a section already received, or ERROR if
+     *          it isn't an EIT section.
+     */
+    Result track(const EITSection &sec);
+
+    /**
+     * payload_changed:
+     * Call after track() for each new section.
+     * Returns: false if @sec's events are byte for byte the same as those in
+     *          the previous version of the same section, which happens to
+     *          most sections of a sub-table when one of its segments changes.
+     */
+    bool payload_changed(const EITSection &sec);
+
+    bool service_complete(std::uint16_t orig_nw_id, std::uint16_t ts_id,
+            std::uint16_t service_id, Group group) const;
+
+    bool segment_complete(std::uint16_t orig_nw_id, std::uint16_t ts_id,
+            std::uint16_t service_id, std::uint8_t table_id,
+            unsigned segment) const;
+
+    /// Number of service groups seen
+    unsigned size() const { return groups_.size(); }
+
+    unsigned complete_size() const { return complete_groups_; }
+
+    /// true if every service group seen so far is complete
+    bool complete() const
+    {
+        return groups_.size() && complete_groups_ == groups_.size();
+    }
+private:
+    static std::uint64_t service_key(std::uint16_t orig_nw_id,
+            std::uint16_t ts_id, std::uint16_t service_id)
+    {
+        return (std::uint64_t(orig_nw_id) << 32) |
+            (std::uint64_t(ts_id) << 16) | service_id;
+    }
+
+    static Group group_for_table(std::uint8_t table_id);
+
+    static bool sub_table_complete(const SubTable &tab);
+
+    static bool group_complete(const ServiceGroup &grp)
+    {
+        return grp.required_tables &&
+            (grp.complete_tables & grp.required_tables) == grp.required_tables;
+    }
+};
+
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "decode-string.h"
+#include "descriptor.h"
+
+namespace logi
+{
+
+/**
+ * ExtendedEventDescriptor:
+ * Long descriptions are split over several of these, numbered from 0 to
+ * last_descriptor_number().
+ */
+class ExtendedEventDescriptor : public Descriptor
+{
+public:
+    ExtendedEventDescriptor(const Descriptor &source) : Descriptor(source)
+    {}
+
+    std::uint8_t descriptor_number() const { return word8(2) >> 4; }
+
+    std::uint8_t last_descriptor_number() const { return word8(2) & 0xf; }
+
+    /// ISO 639-2 code packed into the bottom 24 bits
+    std::uint32_t language_code() const { return word24(3); }
+
+    std::uint8_t length_of_items() const { return word8(6); }
+
+    std::uint8_t text_length() const
+    { return word8(length_of_items() + 7); }
+
+    /// Calls @f(description, item) for each item
+    template<class F> void for_each_item(F f) const
+    {
+        unsigned o = 7;
+        unsigned end = o + length_of_items();
+        while (o < end)
+        {
+            unsigned dlen = word8(o);
+            unsigned ilen = word8(o + dlen + 1);
+            f(decode_string(get_data(), get_offset() + o + 1, dlen).take(),
+                    decode_string(get_data(), get_offset() + o + dlen + 2,
+                        ilen).take());
+            o += dlen + ilen + 2;
+        }
+    }
+
+    Glib::ustring text() const
+    {
+        return decode_string(get_data(),
+                get_offset() + 8 + length_of_items(), text_length()).take();
+    }
+};
+
+}
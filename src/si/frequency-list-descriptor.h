@@ -0,0 +1,80 @@
+#pragma once
+
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "descriptor.h"
+
+namespace logi
+{
+
+/**
+ * FrequencyListDescriptor:
+ * Lists the other frequencies a transport can be received on, in addition to
+ * the one in its delivery system descriptor.
+ */
+class FrequencyListDescriptor : public Descriptor
+{
+public:
+    enum CodingType
+    {
+        UNDEFINED,
+        SATELLITE,
+        CABLE,
+        TERRESTRIAL
+    };
+
+    FrequencyListDescriptor(const Descriptor &source) :
+        Descriptor(source)
+    {}
+
+    CodingType coding_type() const { return CodingType(word8(2) & 3); }
+
+    /**
+     * for_each_frequency:
+     * Calls f(frequency) for each frequency, in the same units as the
+     * corresponding delivery system descriptor: KHz for satellite, Hz for
+     * cable and terrestrial.
+     */
+    template<class F> void for_each_frequency(F f) const
+    {
+        auto type = coding_type();
+        unsigned end = length() + 2;
+
+        for (unsigned o = 3; o + 4 <= end; o += 4)
+        {
+            switch (type)
+            {
+                case SATELLITE:
+                    f(bcd32(o) * 10);
+                    break;
+                case CABLE:
+                    f(bcd32(o) * 100);
+                    break;
+                case TERRESTRIAL:
+                    f(word32(o) * 10);
+                    break;
+                default:
+                    return;
+            }
+        }
+    }
+};
+
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <ctime>
+
+#include "descriptor.h"
+
+namespace logi
+{
+
+/**
+ * LocalTimeOffsetDescriptor:
+ * Carried in the TOT. Gives each country's (and region's) offset from UTC,
+ * and when it's next due to change for daylight saving.
+ */
+class LocalTimeOffsetDescriptor : public Descriptor
+{
+public:
+    LocalTimeOffsetDescriptor(const Descriptor &source) : Descriptor(source)
+    {}
+
+    /**
+     * for_each_offset:
+     * Calls @f(country_code, region_id, offset, time_of_change, next_offset)
+     * for each region. Offsets are in seconds, positive east of Greenwich;
+     * time_of_change is in UTC seconds since the Unix epoch.
+     */
+    template<class F> void for_each_offset(F f) const
+    {
+        for (unsigned o = 2; o + 12 < unsigned(length()) + 2; o += 13)
+        {
+            int sign = (word8(o + 3) & 1) ? -1 : 1;
+            f(word24(o), std::uint8_t(word8(o + 3) >> 2),
+                    sign * bcd_offset(o + 4), std::time_t(mjd_time(o + 6)),
+                    sign * bcd_offset(o + 11));
+        }
+    }
+private:
+    /// hhmm in BCD
+    int bcd_offset(unsigned o) const
+    {
+        return int(bcd8(o)) * 3600 + int(bcd8(o + 1)) * 60;
+    }
+};
+
+}
@@ -33,7 +33,7 @@ public:
 
     Glib::ustring get_network_name() const
     {
-        return decode_string(data_, offset_ + 2, length());
+        return decode_string(data_, offset_ + 2, length()).take();
     }
 };
 
@@ -18,7 +18,6 @@
 */
 
 #include "nit-section.h"
-#include "ts-data.h"
 
 namespace logi
 {
@@ -26,18 +25,10 @@ namespace logi
 std::vector<TSSectionData> NITSection::get_transport_stream_loop() const
 {
     std::vector<TSSectionData> loop;
-    unsigned o = network_descriptors_length() + 10;
-    unsigned end = word12(o) + o + 2;
-
-    o += 2;
-
-    while (o < end)
+    for_each_transport_stream([&loop](const TSSectionData &ts)
     {
-        loop.emplace_back(TSSectionData(*this, o));
-
-        o += word12(o + 4) + 6;
-    }
-
+        loop.push_back(ts);
+    });
     return loop;
 }
 
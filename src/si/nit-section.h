@@ -21,12 +21,11 @@
 
 #include "descriptor.h"
 #include "section.h"
+#include "ts-data.h"
 
 namespace logi
 {
 
-class TSSectionData;
-
 class NITSection : public Section
 {
 public:
@@ -59,12 +58,31 @@ public:
         return get_descriptors(8);
     }
 
+    template<class F> void for_each_network_descriptor(F f) const
+    {
+        for_each_descriptor(8, f);
+    }
+
     unsigned transport_stream_loop_length() const
     {
         return word12(network_descriptors_length() + 10);
     }
 
     std::vector<TSSectionData> get_transport_stream_loop() const;
+
+    /// Calls @f with each TSSectionData without building a vector
+    template<class F> void for_each_transport_stream(F f) const
+    {
+        unsigned o = network_descriptors_length() + 10;
+        unsigned end = word12(o) + o + 2;
+
+        o += 2;
+        while (o < end)
+        {
+            f(TSSectionData(*this, o));
+            o += word12(o + 4) + 6;
+        }
+    }
 };
 
 using BATSection = NITSection;
@@ -0,0 +1,50 @@
+#pragma once
+
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "descriptor.h"
+
+namespace logi
+{
+
+class ParentalRatingDescriptor : public Descriptor
+{
+public:
+    ParentalRatingDescriptor(const Descriptor &source) : Descriptor(source)
+    {}
+
+    /**
+     * for_each_rating:
+     * Calls @f(country_code, rating) for each country. Ratings 1-15 mean a
+     * minimum age of rating + 3; others are undefined or broadcaster-defined.
+     */
+    template<class F> void for_each_rating(F f) const
+    {
+        for (unsigned o = 2; o + 3 < unsigned(length()) + 2; o += 4)
+            f(word24(o), word8(o + 3));
+    }
+
+    static std::uint8_t min_age(std::uint8_t rating)
+    {
+        return (rating && rating <= 0x0f) ? rating + 3 : 0;
+    }
+};
+
+}
@@ -37,19 +37,19 @@ fe_modulation_t SatelliteDeliverySystemDescriptor::modulation_type() const
     return QAM_AUTO;
 }
 
-TuningProperties *
+TuningProperties
 SatelliteDeliverySystemDescriptor::get_tuning_properties() const
 {
     std::uint32_t freq, tone;
     freq = frequency();
     TuningProperties::sat_freq_to_props(freq, tone);
 
-    return new TuningProperties({
+    return TuningProperties({
         { DTV_DELIVERY_SYSTEM, modulation_system() ? SYS_DVBS2 : SYS_DVBS },
         { DTV_FREQUENCY, freq },
         { DTV_TONE, tone },
         { DTV_VOLTAGE,
-            (int(polarization()) & 1) ? SEC_VOLTAGE_13 : SEC_VOLTAGE_13 },
+            (int(polarization()) & 1) ? SEC_VOLTAGE_13 : SEC_VOLTAGE_18 },
         { DTV_ROLLOFF, roll_off() },
         { DTV_MODULATION, modulation_type() },
         { DTV_SYMBOL_RATE, symbol_rate() },
@@ -83,8 +83,7 @@ public:
         return code_rate(word8(12) & 0xf);
     }
 
-    /// Result is heap-allocated
-    virtual class TuningProperties *get_tuning_properties() const override;
+    virtual TuningProperties get_tuning_properties() const override;
 };
 
 }
@@ -28,13 +28,10 @@ namespace logi
 std::vector<SDTSectionServiceData> SDTSection::get_services() const
 {
     std::vector<SDTSectionServiceData> svcs;
-    unsigned o = 11;
-    while (o < unsigned(section_length())
-            + 3 /* table_id and length */ - 4 /* CRC */)
+    for_each_service([&svcs](const SDTSectionServiceData &svc)
     {
-        svcs.emplace_back(get_data(), get_offset() + o);
-        o += 5 + word12(o + 3);
-    }
+        svcs.push_back(svc);
+    });
     return svcs;
 }
 
@@ -62,6 +62,11 @@ public:
     {
         return SectionData::get_descriptors(3);
     }
+
+    template<class F> void for_each_descriptor(F f) const
+    {
+        SectionData::for_each_descriptor(3, f);
+    }
 };
 
 class SDTSection : public Section
@@ -81,6 +86,18 @@ public:
     }
 
     std::vector<SDTSectionServiceData> get_services() const;
+
+    /// Calls @f with each SDTSectionServiceData without building a vector
+    template<class F> void for_each_service(F f) const
+    {
+        unsigned o = 11;
+        while (o < unsigned(section_length())
+                + 3 /* table_id and length */ - 4 /* CRC */)
+        {
+            f(SDTSectionServiceData(get_data(), get_offset() + o));
+            o += 5 + word12(o + 3);
+        }
+    }
 };
 
 }
@@ -25,17 +25,11 @@ namespace logi
 
 std::vector<Descriptor> SectionData::get_descriptors(unsigned o) const
 {
-    unsigned end = o + word12(o) + 2;
     std::vector<Descriptor> descs;
-
-    o += 2;
-    while (o < end)
+    for_each_descriptor(o, [&descs](const Descriptor &desc)
     {
-        unsigned e = o + word8(o + 1) + 2;
-
-        descs.emplace_back(Descriptor(*this, o + offset_));
-        o = e;
-    }
+        descs.push_back(desc);
+    });
     return descs;
 }
 
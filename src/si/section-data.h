@@ -108,6 +108,20 @@ public:
                 bcd8(o + 2);
     }
 
+    /**
+     * mjd_time:
+     * Decodes a 40-bit start_time field (16-bit Modified Julian Date followed
+     * by 24-bit BCD UTC) at @o.
+     * Returns: Seconds since the Unix epoch, or 0 if the field is undefined
+     *          (all bits set).
+     */
+    std::int64_t mjd_time(unsigned o) const
+    {
+        if (word16(o) == 0xffff)
+            return 0;
+        return (std::int64_t(word16(o)) - 40587) * 86400 + bcd_time(o + 2);
+    }
+
     /**
      * get_descriptors:
      * @o:  Offset of a length field (bottom 12-bits of 2 bytes) immediately
@@ -115,6 +129,13 @@ public:
      * Returns: A vector of descriptors found at the given offset.
      */
     std::vector<Descriptor> get_descriptors(unsigned o) const;
+
+    /**
+     * for_each_descriptor:
+     * Like get_descriptors, but calls @f with each descriptor in turn instead
+     * of building a vector. Defined in descriptor.h.
+     */
+    template<class F> void for_each_descriptor(unsigned o, F f) const;
 };
 
 }
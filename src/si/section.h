@@ -34,6 +34,9 @@ public:
     constexpr static std::uint16_t NIT_PID = 0x10;
     constexpr static std::uint16_t SDT_PID = 0x11;
     constexpr static std::uint16_t BAT_PID = 0x11;
+    constexpr static std::uint16_t EIT_PID = 0x12;
+    constexpr static std::uint16_t TDT_PID = 0x14;
+    constexpr static std::uint16_t TOT_PID = 0x14;
 
     constexpr static std::uint8_t PAT_TABLE = 0x00;
     constexpr static std::uint8_t PMT_TABLE = 0x01;
@@ -42,6 +45,14 @@ public:
     constexpr static std::uint8_t SDT_TABLE = 0x42;
     constexpr static std::uint8_t OTHER_SDT_TABLE = 0x46;
     constexpr static std::uint8_t BAT_TABLE = 0x4A;
+    constexpr static std::uint8_t EIT_PF_TABLE = 0x4E;
+    constexpr static std::uint8_t OTHER_EIT_PF_TABLE = 0x4F;
+    /// Schedule tables are 0x50-0x5F for actual and 0x60-0x6F for other
+    constexpr static std::uint8_t EIT_SCHEDULE_TABLE = 0x50;
+    constexpr static std::uint8_t OTHER_EIT_SCHEDULE_TABLE = 0x60;
+    constexpr static std::uint8_t LAST_EIT_TABLE = 0x6F;
+    constexpr static std::uint8_t TDT_TABLE = 0x70;
+    constexpr static std::uint8_t TOT_TABLE = 0x73;
 protected:
     std::vector<std::uint8_t> sec_;
 public:
@@ -41,14 +41,14 @@ public:
     Glib::ustring service_provider_name() const
     {
         return decode_string(get_data(), get_offset() + 4,
-                service_provider_name_length());
+                service_provider_name_length()).take();
     }
 
     Glib::ustring service_name() const
     {
         return decode_string(get_data(),
                 get_offset() + 5 + service_provider_name_length(),
-                service_name_length());
+                service_name_length()).take();
     }
 };
 
@@ -26,10 +26,11 @@ std::vector<ServiceInfo>
 ServiceListDescriptor::get_services() const
 {
     std::vector<ServiceInfo> svcs;
-    for (unsigned n = 0; n < get_services_length(); n += 3)
+    svcs.reserve(get_services_length() / 3);
+    for_each_service([&svcs](const ServiceInfo &s)
     {
-        svcs.emplace_back(word16(n + 2), word8(n + 4));
-    }
+        svcs.push_back(s);
+    });
     return svcs;
 }
 
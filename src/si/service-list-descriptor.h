@@ -52,6 +52,15 @@ public:
     std::uint8_t get_services_length() const { return length(); }
 
     std::vector<ServiceInfo> get_services() const;
+
+    /// Calls @f with each ServiceInfo without building a vector
+    template<class F> void for_each_service(F f) const
+    {
+        for (unsigned n = 0; n < get_services_length(); n += 3)
+        {
+            f(ServiceInfo(word16(n + 2), word8(n + 4)));
+        }
+    }
 };
 
 }
@@ -0,0 +1,55 @@
+#pragma once
+
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "decode-string.h"
+#include "descriptor.h"
+
+namespace logi
+{
+
+class ShortEventDescriptor : public Descriptor
+{
+public:
+    ShortEventDescriptor(const Descriptor &source) : Descriptor(source)
+    {}
+
+    /// ISO 639-2 code packed into the bottom 24 bits
+    std::uint32_t language_code() const { return word24(2); }
+
+    std::uint8_t event_name_length() const { return word8(5); }
+
+    std::uint8_t text_length() const
+    { return word8(event_name_length() + 6); }
+
+    DecodedString event_name() const
+    {
+        return decode_string(get_data(), get_offset() + 6,
+                event_name_length());
+    }
+
+    DecodedString text() const
+    {
+        return decode_string(get_data(),
+                get_offset() + 7 + event_name_length(), text_length());
+    }
+};
+
+}
@@ -0,0 +1,59 @@
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "t2-delsys-descriptor.h"
+
+namespace logi
+{
+
+TuningProperties T2DeliverySystemDescriptor::get_tuning_properties() const
+{
+    std::uint32_t first = 0;
+
+    for_each_frequency([&first](std::uint16_t, std::uint32_t freq)
+    {
+        if (!first)
+            first = freq;
+    });
+    if (!first)
+        return TuningProperties();
+    return get_tuning_properties(first);
+}
+
+TuningProperties
+T2DeliverySystemDescriptor::get_tuning_properties(std::uint32_t frequency)
+    const
+{
+    // Code rate and constellation are per-PLP in T2 so they aren't in the
+    // descriptor; the frontend has to detect them.
+    return TuningProperties({
+        { DTV_DELIVERY_SYSTEM, SYS_DVBT2 },
+        { DTV_STREAM_ID, plp_id() },
+        { DTV_FREQUENCY, frequency },
+        { DTV_BANDWIDTH_HZ, bandwidth() },
+        { DTV_CODE_RATE_HP, FEC_AUTO },
+        { DTV_CODE_RATE_LP, FEC_AUTO },
+        { DTV_MODULATION, QAM_AUTO },
+        { DTV_TRANSMISSION_MODE, transmission_mode() },
+        { DTV_GUARD_INTERVAL, guard_interval() },
+        { DTV_HIERARCHY, HIERARCHY_NONE },
+    });
+}
+
+}
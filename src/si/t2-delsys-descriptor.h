@@ -24,6 +24,13 @@
 namespace logi
 {
 
+/**
+ * T2DeliverySystemDescriptor:
+ * An extension descriptor (tag_extension() == T2_DELIVERY_SYSTEM). Unlike
+ * the other delivery system descriptors the frequencies are in a loop of
+ * cells, each of which may have several frequencies if tfs_flag() is set
+ * and transposers in a subcell loop.
+ */
 class T2DeliverySystemDescriptor : public ExtensionDescriptor
 {
 public:
@@ -31,6 +38,9 @@ public:
         ExtensionDescriptor(source)
     {}
 
+    /// Returns true if the descriptor has the optional system and cell info
+    bool has_system_info() const { return length() > 4; }
+
     std::uint8_t plp_id() const { return word8(3); }
 
     std::uint16_t t2_system_id() const { return word16(4); }
@@ -59,6 +69,57 @@ public:
 
     bool tfs_flag() const { return (word8(7) & 1) != 0; }
 
+    /**
+     * for_each_frequency:
+     * Calls f(cell_id, frequency) for each centre frequency in the cell loop,
+     * followed by the cell's transposer frequencies, in the order they
+     * appear. Frequencies are in Hz.
+     */
+    template<class F> void for_each_frequency(F f) const;
+
+    /**
+     * Uses the first centre frequency. Returns an empty TuningProperties if
+     * the descriptor doesn't have any frequencies.
+     */
+    TuningProperties get_tuning_properties() const;
+
+    TuningProperties get_tuning_properties(std::uint32_t frequency) const;
 };
 
+template<class F> void T2DeliverySystemDescriptor::for_each_frequency(F f) const
+{
+    if (!has_system_info())
+        return;
+
+    unsigned end = length() + 2;
+    unsigned o = 8;
+    bool tfs = tfs_flag();
+
+    while (o + 2 < end)
+    {
+        std::uint16_t cell_id = word16(o);
+        o += 2;
+        if (tfs)
+        {
+            unsigned loop_end = o + 1 + word8(o);
+            for (o += 1; o + 4 <= loop_end && o + 4 <= end; o += 4)
+                f(cell_id, word32(o) * 10);
+            o = loop_end;
+        }
+        else
+        {
+            if (o + 4 > end)
+                break;
+            f(cell_id, word32(o) * 10);
+            o += 4;
+        }
+        if (o >= end)
+            break;
+        unsigned subcell_end = o + 1 + word8(o);
+        for (o += 1; o + 5 <= subcell_end && o + 5 <= end; o += 5)
+            f(cell_id, word32(o + 1) * 10);
+        o = subcell_end;
+    }
+}
+
 }
@@ -38,6 +38,9 @@ TableTracker::Result TableTracker::track(const Section &sec)
     auto result = track_for_id(sec);
     if (result == REPEAT_COMPLETE)
     {
+        // Cheap path for repeats of an unchanged table
+        if (complete_)
+            return result;
         if (!std::all_of(tables_.begin(), tables_.end(),
             [](const std::pair<std::uint16_t, TableInfo> &p)
             {
@@ -68,12 +71,18 @@ TableTracker::Result TableTracker::track_for_id(const Section &sec)
     {
         // This is the first section with the given id
         tab.version_number = vn;
+        complete_ = false;
     }
-    else if (vn > tab.version_number || (vn < 12 && tab.version_number >= 24))
+    else if (vn != tab.version_number && (tab.all_complete ||
+            vn > tab.version_number || (vn < 12 && tab.version_number >= 24)))
     {
-        // New version
-        reset();
+        // New version; a different version of a table which has already been
+        // completed can't be an old one still being broadcast. Only this
+        // sub-table has to be collected again; the others are still valid,
+        // which matters when monitoring for changes.
+        tab = TableInfo();
         tab.version_number = vn;
+        complete_ = false;
     }
     else if (vn != tab.version_number)
     {
@@ -43,7 +43,7 @@ private:
         std::vector<bool> completeness;
     };
     std::map<std::uint16_t, TableInfo> tables_;
-    bool complete_;
+    bool complete_ = false;
 public:
     enum Result
     {
@@ -0,0 +1,49 @@
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "tdt-section.h"
+
+namespace logi
+{
+
+/// MPEG-2's CRC32: polynomial 0x04C11DB7, not reflected, no final XOR
+static std::uint32_t crc32(const std::uint8_t *data, unsigned len)
+{
+    std::uint32_t crc = 0xffffffff;
+    for (unsigned n = 0; n < len; ++n)
+    {
+        crc ^= std::uint32_t(data[n]) << 24;
+        for (int b = 0; b < 8; ++b)
+            crc = (crc << 1) ^ ((crc & 0x80000000) ? 0x04c11db7 : 0);
+    }
+    return crc;
+}
+
+bool TDTSection::is_valid() const
+{
+    unsigned len = section_length() + 3;
+    if (table_id() == TDT_TABLE)
+        return len >= 8 && len <= sec_.size();
+    else if (table_id() != TOT_TABLE || len < 14 || len > sec_.size())
+        return false;
+    // Including the CRC in the calculation gives 0 if it's correct
+    return word12(8) + 14u <= len && !crc32(sec_.data(), len);
+}
+
+}
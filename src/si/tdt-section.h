@@ -0,0 +1,68 @@
+#pragma once
+
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <ctime>
+
+#include "descriptor.h"
+#include "section.h"
+
+namespace logi
+{
+
+/**
+ * TDTSection:
+ * A TDT or TOT, which share the UTC_time field. They don't have the long
+ * section header, so the fields inherited from Section after the length are
+ * meaningless.
+ */
+class TDTSection : public Section
+{
+public:
+    TDTSection() : Section()
+    {}
+
+    bool is_tot() const
+    {
+        return table_id() == TOT_TABLE;
+    }
+
+    /// Seconds since the Unix epoch, 0 if undefined
+    std::time_t utc_time() const
+    {
+        return mjd_time(3);
+    }
+
+    /**
+     * is_valid:
+     * Checks the length and, for a TOT, the CRC. The kernel only checks CRCs
+     * of sections with section_syntax_indicator set, which a TOT doesn't
+     * have.
+     */
+    bool is_valid() const;
+
+    /// TOT only
+    template<class F> void for_each_descriptor(F f) const
+    {
+        SectionData::for_each_descriptor(8, f);
+    }
+};
+
+}
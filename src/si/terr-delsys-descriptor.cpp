@@ -56,10 +56,10 @@ fe_hierarchy_t TerrestrialDeliverySystemDescriptor::hierarchy() const
     return HIERARCHY_AUTO;
 }
 
-TuningProperties *
+TuningProperties
 TerrestrialDeliverySystemDescriptor::get_tuning_properties() const
 {
-    return new TuningProperties({
+    return TuningProperties({
         { DTV_DELIVERY_SYSTEM, SYS_DVBT },
         { DTV_FREQUENCY, centre_frequency()},
         { DTV_BANDWIDTH_HZ, bandwidth() },
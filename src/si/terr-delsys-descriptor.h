@@ -70,8 +70,7 @@ public:
 
     bool other_frequency() const { return (word8(8) & 1) != 0; }
 
-    /// Result is heap-allocated
-    virtual class TuningProperties *get_tuning_properties() const override;
+    virtual TuningProperties get_tuning_properties() const override;
 };
 
 }
@@ -19,7 +19,7 @@
     Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 */
 
-#include "section-data.h"
+#include "descriptor.h"
 
 namespace logi
 {
@@ -53,6 +53,11 @@ public:
     {
         return get_descriptors(4);
     }
+
+    template<class F> void for_each_transport_descriptor(F f) const
+    {
+        for_each_descriptor(4, f);
+    }
 };
 
 }
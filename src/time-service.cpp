@@ -0,0 +1,236 @@
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <glib.h>
+
+#include <glibmm/main.h>
+
+#include <linux/dvb/dmx.h>
+
+#include "time-service.h"
+
+#include "si/local-time-offset-descriptor.h"
+
+namespace logi
+{
+
+void TimeService::start()
+{
+    stop();
+    // 0x70-0x73, of which we only want the TDT and TOT; they're tiny and
+    // arrive every few seconds, so the default buffer is plenty
+    struct dmx_sct_filter_params params;
+    logi_priv::SectionFilterBase::get_params(params, Section::TDT_PID,
+            Section::TDT_TABLE, 0, 0, 0xfc, 0);
+    filter_.reset(new SectionFilter<TDTSection, TimeService>
+            (rcv_, &params, *this, &TimeService::filter_cb));
+}
+
+void TimeService::stop()
+{
+    // A sync_signal handler may stop or restart us from inside the filter's
+    // callback, so the filter is destroyed when that has returned
+    if (!filter_)
+        return;
+    filter_->stop();
+    stopped_filters_.push_back(std::move(filter_));
+    if (!reap_conn_.connected())
+    {
+        reap_conn_ = Glib::signal_idle().connect([this]()
+        {
+            stopped_filters_.clear();
+            return false;
+        });
+    }
+}
+
+void TimeService::reset()
+{
+    samples_.clear();
+    outliers_ = 0;
+    offset_ = 0;
+    stats_ = Stats();
+    local_offsets_.clear();
+    first_country_key_ = 0;
+}
+
+void TimeService::filter_cb(int reason, std::shared_ptr<TDTSection> section)
+{
+    if (reason == EOVERFLOW)
+        g_warning("TDT filter overflowed");
+    else if (reason)
+        g_critical("TDT filter error: %s", std::strerror(reason));
+    else if (section)
+        process_section(*section, g_get_real_time());
+}
+
+void TimeService::process_section(const TDTSection &sec,
+        std::int64_t received)
+{
+    auto table_id = sec.table_id();
+    if (table_id != Section::TDT_TABLE && table_id != Section::TOT_TABLE)
+        return;
+    ++stats_.sections;
+    auto utc = sec.utc_time();
+    if (!sec.is_valid() || !utc)
+    {
+        ++stats_.rejected;
+        return;
+    }
+    add_sample(received, std::int64_t(utc) * 1000000 + 500000 - received);
+    if (sec.is_tot())
+        process_tot(sec);
+}
+
+void TimeService::add_sample(std::int64_t system, std::int64_t offset)
+{
+    bool was_synced = is_synced();
+    if (was_synced && std::llabs(offset - offset_) > MAX_STEP)
+    {
+        if (++outliers_ < MAX_OUTLIERS)
+        {
+            ++stats_.rejected;
+            return;
+        }
+        g_warning("Broadcast time is now %.1fs from the system clock, "
+                "assuming the system clock has been changed",
+                offset / 1000000.0);
+        samples_.clear();
+        ++stats_.resets;
+        was_synced = false;
+    }
+    outliers_ = 0;
+
+    samples_.push_back({ system, offset });
+    if (samples_.size() > WINDOW)
+        samples_.pop_front();
+    ++stats_.samples;
+    stats_.last_sample = system;
+    update_stats();
+    if (!was_synced && is_synced())
+    {
+        g_debug("Broadcast time is %.3fs from the system clock",
+                offset_ / 1000000.0);
+        sync_signal_.emit();
+    }
+}
+
+void TimeService::update_stats()
+{
+    std::vector<std::int64_t> offsets;
+    offsets.reserve(samples_.size());
+    for (const auto &s: samples_)
+        offsets.push_back(s.offset);
+    auto mid = offsets.begin() + offsets.size() / 2;
+    std::nth_element(offsets.begin(), mid, offsets.end());
+    offset_ = *mid;
+    stats_.offset = offset_ / 1000000.0;
+
+    double dev = 0;
+    for (auto o: offsets)
+        dev += std::llabs(o - offset_);
+    stats_.jitter = dev / offsets.size() / 1000000.0;
+
+    auto x0 = samples_.front().system;
+    if (samples_.back().system - x0 < MIN_DRIFT_SPAN)
+    {
+        stats_.drift = 0;
+        return;
+    }
+    // Relative to the first sample so that the sums don't lose precision
+    double mx = 0, my = 0;
+    for (const auto &s: samples_)
+    {
+        mx += s.system - x0;
+        my += s.offset - offset_;
+    }
+    mx /= samples_.size();
+    my /= samples_.size();
+    double sxy = 0, sxx = 0;
+    for (const auto &s: samples_)
+    {
+        double dx = (s.system - x0) - mx;
+        sxy += dx * ((s.offset - offset_) - my);
+        sxx += dx * dx;
+    }
+    stats_.drift = sxx ? sxy / sxx * 1000000.0 : 0;
+}
+
+void TimeService::process_tot(const TDTSection &sec)
+{
+    bool first = true;
+    sec.for_each_descriptor([this, &first](const Descriptor &desc)
+    {
+        if (desc.tag() != Descriptor::LOCAL_TIME_OFFSET)
+            return;
+        LocalTimeOffsetDescriptor(desc).for_each_offset(
+                [this, &first](std::uint32_t country, std::uint8_t region,
+                    int offset, std::time_t time_of_change, int next_offset)
+        {
+            auto key = (country << 8) | region;
+            if (first)
+            {
+                first_country_key_ = key;
+                first = false;
+            }
+            local_offsets_[key] = { offset, time_of_change, next_offset };
+        });
+    });
+}
+
+std::int64_t TimeService::real_time() const
+{
+    return g_get_real_time() + offset();
+}
+
+unsigned TimeService::ms_until(std::time_t t) const
+{
+    auto us = std::int64_t(t) * 1000000 - real_time();
+    if (us <= 0)
+        return 0;
+    return unsigned(std::min<std::int64_t>(us / 1000, UINT_MAX));
+}
+
+void TimeService::set_country(std::uint32_t country_code,
+        std::uint8_t region)
+{
+    country_key_ = (country_code << 8) | region;
+}
+
+int TimeService::local_offset(std::time_t t) const
+{
+    auto key = country_key_ ? country_key_ : first_country_key_;
+    auto it = local_offsets_.find(key);
+    // Fall back to the whole country
+    if (it == local_offsets_.end())
+        it = local_offsets_.find(key & ~0xffu);
+    if (it == local_offsets_.end())
+        return 0;
+    const auto &lo = it->second;
+    return t >= lo.time_of_change ? lo.next_offset : lo.offset;
+}
+
+}
@@ -0,0 +1,215 @@
+#pragma once
+
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <sigc++/sigc++.h>
+
+#include "receiver.h"
+#include "section-filter.h"
+#include "si/tdt-section.h"
+
+namespace logi
+{
+
+/**
+ * TimeService:
+ * Follows the TDT and TOT on PID 0x14 of whichever multiplex is tuned and
+ * estimates the offset of broadcast UTC from the system clock, so that
+ * recordings can be scheduled against the broadcasters' clock, which is what
+ * EIT times are based on. The TOT's local time offset descriptors are kept
+ * too. The filter is separate from EIT's and only sees a section every few
+ * seconds.
+ * The TDT only has a resolution of one second, so each sample is taken as
+ * the middle of that second. The offset is the median of recent samples;
+ * jitter is their mean deviation from it, and drift is the rate the offset
+ * is changing at, from a least squares fit.
+ */
+class TimeService
+{
+public:
+    struct Stats
+    {
+        unsigned long sections = 0;
+        unsigned long samples = 0;
+        unsigned long rejected = 0;     // Invalid or outliers
+        unsigned long resets = 0;       // System clock steps
+        double offset = 0;              // Seconds, broadcast - system
+        double jitter = 0;              // Seconds
+        double drift = 0;               // ppm, positive if system is slow
+        std::int64_t last_sample = 0;   // System time in microseconds
+    };
+
+    /// Recent samples used for the statistics
+    constexpr static unsigned WINDOW = 64;
+    /// The offset isn't used until there are this many samples
+    constexpr static unsigned MIN_SAMPLES = 3;
+    /// Samples further than this from the offset are ignored...
+    constexpr static std::int64_t MAX_STEP = 5000000;
+    /// ...unless there are this many in a row, when the system clock is
+    /// assumed to have been stepped
+    constexpr static unsigned MAX_OUTLIERS = 4;
+    /// Drift isn't estimated from samples spanning less than this
+    constexpr static std::int64_t MIN_DRIFT_SPAN = 600000000;
+
+    /// Raised when the first usable offset is available after start or reset
+    using SyncSignal = sigc::signal<void>;
+private:
+    struct Sample
+    {
+        std::int64_t system;            // Microseconds since epoch
+        std::int64_t offset;            // Microseconds
+    };
+
+    struct LocalOffset
+    {
+        int offset;
+        std::time_t time_of_change;
+        int next_offset;
+    };
+
+    using FilterPtr = std::unique_ptr<SectionFilter<TDTSection, TimeService>>;
+
+    std::shared_ptr<Receiver> rcv_;
+    FilterPtr filter_;
+    // A stopped filter waits for an idle callback to destroy it
+    std::vector<FilterPtr> stopped_filters_;
+    sigc::connection reap_conn_;
+    std::deque<Sample> samples_;
+    unsigned outliers_ = 0;
+    std::int64_t offset_ = 0;
+    Stats stats_;
+    std::unordered_map<std::uint32_t, LocalOffset> local_offsets_;
+    std::uint32_t country_key_ = 0;
+    std::uint32_t first_country_key_ = 0;
+    SyncSignal sync_signal_;
+public:
+    /// @rcv may be null if sections are fed with process_section()
+    TimeService(std::shared_ptr<Receiver> rcv = nullptr) : rcv_(rcv)
+    {}
+
+    ~TimeService()
+    {
+        stop();
+        reap_conn_.disconnect();
+    }
+
+    TimeService(const TimeService &) = delete;
+    TimeService(TimeService &&) = delete;
+    TimeService &operator=(const TimeService &) = delete;
+    TimeService &operator=(TimeService &&) = delete;
+
+    /**
+     * start:
+     * Filters the TDT and TOT. The receiver must already be tuned; call
+     * again after retuning. Samples from the previous multiplex are kept.
+     */
+    void start();
+
+    void stop();
+
+    /// Forgets the samples and local time offsets
+    void reset();
+
+    /**
+     * process_section:
+     * Public so that sections can be fed from other sources.
+     * @received:   System (real) time in microseconds when the section
+     *              arrived.
+     */
+    void process_section(const TDTSection &sec, std::int64_t received);
+
+    bool is_synced() const
+    {
+        return samples_.size() >= MIN_SAMPLES;
+    }
+
+    /// Returns: Microseconds to add to the system clock to get broadcast
+    ///          time, or 0 if not synced
+    std::int64_t offset() const
+    {
+        return is_synced() ? offset_ : 0;
+    }
+
+    /// Returns: Broadcast UTC in microseconds since the epoch
+    std::int64_t real_time() const;
+
+    std::time_t now() const
+    {
+        return std::time_t(real_time() / 1000000);
+    }
+
+    /**
+     * ms_until:
+     * For scheduling a timeout for broadcast time @t, eg from the EPG.
+     * Returns: Milliseconds until then by the system clock, 0 if it's past.
+     */
+    unsigned ms_until(std::time_t t) const;
+
+    /**
+     * set_country:
+     * Chooses which of the TOT's local time offsets to use. @country_code is
+     * ISO 3166 alpha-3 packed into 24 bits, eg from country_code().
+     * If it isn't set, the first country in the TOT is used.
+     */
+    void set_country(std::uint32_t country_code, std::uint8_t region = 0);
+
+    static std::uint32_t country_code(const char *code)
+    {
+        return (std::uint32_t(std::uint8_t(code[0])) << 16) |
+            (std::uint32_t(std::uint8_t(code[1])) << 8) |
+            std::uint8_t(code[2]);
+    }
+
+    bool has_local_offset() const
+    {
+        return !local_offsets_.empty();
+    }
+
+    /// Returns: Seconds to add to UTC time @t to get local time, taking the
+    ///          next change into account. 0 if no TOT has been received.
+    int local_offset(std::time_t t) const;
+
+    const Stats &stats() const
+    {
+        return stats_;
+    }
+
+    SyncSignal &sync_signal()
+    {
+        return sync_signal_;
+    }
+private:
+    void filter_cb(int reason, std::shared_ptr<TDTSection> section);
+
+    void add_sample(std::int64_t system, std::int64_t offset);
+
+    void update_stats();
+
+    void process_tot(const TDTSection &sec);
+};
+
+}
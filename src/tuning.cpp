@@ -108,7 +108,7 @@ static struct prop_table_t_ roll_off_table[] = {
 
 
 
-TuningProperties::TuningProperties(const char *s)
+TuningProperties::TuningProperties(const char *s) : num_(0)
 {
     if (s[0] != 'S' && s[0] != 'T')
     {
@@ -141,54 +141,16 @@ TuningProperties::TuningProperties(const char *s)
     else
         parse_dvb_t(n, tokens.get(), s);
 
-    append_prop_priv(DTV_INVERSION, INVERSION_AUTO);
-    append_prop_priv(DTV_TUNE, 1);
-
-    fix_props();
+    append_prop(DTV_INVERSION, INVERSION_AUTO);
 }
 
 TuningProperties::TuningProperties(
-        std::initializer_list<std::pair<guint32, guint32> >&&props)
+        std::initializer_list<std::pair<guint32, guint32> >&&props) : num_(0)
 {
     for (const auto &prop: props)
     {
-        append_prop_priv(prop.first, prop.second);
+        append_prop(prop.first, prop.second);
     }
-    fix_props();
-}
-
-TuningProperties::TuningProperties(const TuningProperties &other) :
-    props_v_(other.props_v_)
-{
-    props_.props = props_v_.data();
-    props_.num = props_v_.size();
-}
-
-TuningProperties::TuningProperties(TuningProperties &&other) :
-    props_v_(std::move(other.props_v_))
-{
-    props_.props = props_v_.data();
-    props_.num = props_v_.size();
-    other.props_.props = nullptr;
-    other.props_.num = 0;
-}
-
-TuningProperties &TuningProperties::operator=(const TuningProperties &other)
-{
-    props_v_ = other.props_v_;
-    props_.props = props_v_.data();
-    props_.num = props_v_.size();
-    return *this;
-}
-
-TuningProperties &TuningProperties::operator=(TuningProperties &&other)
-{
-    props_v_ = std::move(other.props_v_);
-    props_.props = props_v_.data();
-    props_.num = props_v_.size();
-    other.props_.props = nullptr;
-    other.props_.num = 0;
-    return *this;
 }
 
 bool TuningProperties::operator==(const TuningProperties &other) const
@@ -201,7 +163,7 @@ bool TuningProperties::operator==(const TuningProperties &other) const
     query_key_props(t1, f1, v1, d1);
     other.query_key_props(t2, f2, v2, d2);
 
-    return t1 == t2 && (f1 / d1 / 2 == f2 / d2 / 2) && v1 && v2;
+    return t1 == t2 && (f1 / d1 / 2 == f2 / d2 / 2) && v1 == v2;
 }
 
 std::uint32_t TuningProperties::get_equivalence_value() const
@@ -217,6 +179,56 @@ std::uint32_t TuningProperties::get_equivalence_value() const
     return (f1 / d1 / 2) | (v1 << 29) /* | (gen2 ? (1 << 28) : 0) */;
 }
 
+std::size_t TuningProperties::hash() const
+{
+    fe_delivery_system_t t;
+    guint32 f;
+    fe_sec_voltage_t v;
+    guint32 d;
+
+    query_key_props(t, f, v, d);
+
+    std::uint64_t key = (std::uint64_t(t) << 40) | (std::uint64_t(v) << 32) |
+        (f / d / 2);
+    return std::hash<std::uint64_t>()(key);
+}
+
+std::uint64_t TuningProperties::get_scan_key() const
+{
+    fe_delivery_system_t t;
+    guint32 f;
+    fe_sec_voltage_t v;
+    guint32 d;
+
+    query_key_props(t, f, v, d);
+
+    bool gen2 = false;
+    std::uint32_t stream_id = 0;
+    for (const auto &prop: *this)
+    {
+        if (prop.cmd == DTV_DELIVERY_SYSTEM)
+            gen2 = prop.data == SYS_DVBT2 || prop.data == SYS_DVBS2;
+        else if (prop.cmd == DTV_STREAM_ID)
+            stream_id = prop.data;
+    }
+
+    return (std::uint64_t(stream_id) << 32) | (std::uint32_t(t) << 24) |
+        (gen2 ? (1u << 23) : 0) | (std::uint32_t(v) << 21) | (f / d / 2);
+}
+
+unsigned TuningProperties::expand(struct dtv_property *props) const
+{
+    std::memset(props, 0, sizeof(struct dtv_property) * (num_ + 1));
+    for (unsigned n = 0; n < num_; ++n)
+    {
+        props[n].cmd = props_[n].cmd;
+        props[n].u.data = props_[n].data;
+    }
+    props[num_].cmd = DTV_TUNE;
+    props[num_].u.data = 1;
+    return num_ + 1;
+}
+
 std::string TuningProperties::describe() const
 {
     fe_delivery_system_t t;
@@ -248,13 +260,6 @@ std::string TuningProperties::describe() const
     return result;
 }
 
-void TuningProperties::clear()
-{
-    props_.num = 0;
-    props_.props = nullptr;
-    props_v_.clear();
-}
-
 GQuark TuningProperties::get_error_quark()
 {
     return g_quark_from_static_string("logi-tuning-properties-error");
@@ -270,12 +275,12 @@ void TuningProperties::query_key_props(fe_delivery_system_t &t, guint32 &f,
     v = SEC_VOLTAGE_OFF;
     d = 1000000;
 
-    for (guint n = 0; n < props_v_.size(); ++n)
+    for (const auto &prop: *this)
     {
-        switch (props_v_[n].cmd)
+        switch (prop.cmd)
         {
             case DTV_DELIVERY_SYSTEM:
-                t = (fe_delivery_system_t) props_v_[n].u.data;
+                t = (fe_delivery_system_t) prop.data;
                 switch (t)
                 {
                     case SYS_DVBS2:
@@ -291,13 +296,13 @@ void TuningProperties::query_key_props(fe_delivery_system_t &t, guint32 &f,
                 }
                 break;
             case DTV_FREQUENCY:
-                f = props_v_[n].u.data;
+                f = prop.data;
                 break;
             case DTV_VOLTAGE:
-                v = (fe_sec_voltage_t) props_v_[n].u.data;
+                v = (fe_sec_voltage_t) prop.data;
                 break;
             case DTV_TONE:
-                tone = (fe_sec_tone_mode_t) props_v_[n].u.data;
+                tone = (fe_sec_tone_mode_t) prop.data;
                 break;
             default:
                 break;
@@ -333,8 +338,36 @@ void TuningProperties::sat_freq_to_props(std::uint32_t freq)
 {
     std::uint32_t tone;
     sat_freq_to_props(freq, tone);
-    append_prop_priv(DTV_FREQUENCY, freq);
-    append_prop_priv(DTV_TONE, tone);
+    append_prop(DTV_FREQUENCY, freq);
+    append_prop(DTV_TONE, tone);
+}
+
+TuningProperties TuningProperties::with_frequency(std::uint32_t freq) const
+{
+    TuningProperties result(*this);
+    std::uint32_t tone = SEC_TONE_OFF;
+    bool sat = false;
+
+    for (const auto &prop: *this)
+    {
+        if (prop.cmd == DTV_DELIVERY_SYSTEM)
+        {
+            sat = prop.data == SYS_DVBS || prop.data == SYS_DVBS2;
+            break;
+        }
+    }
+    if (sat)
+        sat_freq_to_props(freq, tone);
+
+    for (unsigned n = 0; n < result.num_; ++n)
+    {
+        auto &prop = result.props_[n];
+        if (prop.cmd == DTV_FREQUENCY)
+            prop.data = freq;
+        else if (sat && prop.cmd == DTV_TONE)
+            prop.data = tone;
+    }
+    return result;
 }
 
 void TuningProperties::parse_dvb_t(unsigned n, char **tokens, const char *s)
@@ -361,12 +394,12 @@ void TuningProperties::parse_dvb_t(unsigned n, char **tokens, const char *s)
         default:
             throw report_parse_error("Invalid type", s);
     }
-    append_prop_priv(DTV_DELIVERY_SYSTEM, val);
+    append_prop(DTV_DELIVERY_SYSTEM, val);
 
     if (val == SYS_DVBT2)
     {
         i = 3;
-        append_prop_priv(DTV_STREAM_ID, parse_number(tokens[1], s));
+        append_prop(DTV_STREAM_ID, parse_number(tokens[1], s));
     }
     else
     {
@@ -378,22 +411,20 @@ void TuningProperties::parse_dvb_t(unsigned n, char **tokens, const char *s)
         val *= 1000000;
     else if (val < 1000000)
         val *= 1000;
-    append_prop_priv(DTV_FREQUENCY, val);
+    append_prop(DTV_FREQUENCY, val);
 
     val = parse_bandwidth(tokens[i + 1], s);
     if (val != G_MAXUINT32)
-        append_prop_priv(DTV_BANDWIDTH_HZ, val);
+        append_prop(DTV_BANDWIDTH_HZ, val);
 
-    append_prop_priv(DTV_CODE_RATE_HP, parse_code_rate(tokens[i + 2], s));
-    append_prop_priv(DTV_CODE_RATE_LP, parse_code_rate(tokens[i + 3], s));
-    append_prop_priv(DTV_MODULATION, parse_modulation(tokens[i + 4], s));
-    append_prop_priv(DTV_TRANSMISSION_MODE,
+    append_prop(DTV_CODE_RATE_HP, parse_code_rate(tokens[i + 2], s));
+    append_prop(DTV_CODE_RATE_LP, parse_code_rate(tokens[i + 3], s));
+    append_prop(DTV_MODULATION, parse_modulation(tokens[i + 4], s));
+    append_prop(DTV_TRANSMISSION_MODE,
             parse_transmission_mode(tokens[i + 5], s));
-    append_prop_priv(DTV_GUARD_INTERVAL,
+    append_prop(DTV_GUARD_INTERVAL,
             parse_guard_interval(tokens[i + 6], s));
-    append_prop_priv(DTV_HIERARCHY, parse_hierarchy(tokens[i + 7], s));
-
-    fix_props();
+    append_prop(DTV_HIERARCHY, parse_hierarchy(tokens[i + 7], s));
 }
 
 void TuningProperties::parse_dvb_s(guint n, char **tokens, const char *s)
@@ -418,7 +449,7 @@ void TuningProperties::parse_dvb_s(guint n, char **tokens, const char *s)
         default:
             throw report_parse_error("Invalid type", s);
     }
-    append_prop_priv(DTV_DELIVERY_SYSTEM, val);
+    append_prop(DTV_DELIVERY_SYSTEM, val);
 
     val = parse_number(tokens[1], s);
     sat_freq_to_props(val);
@@ -429,19 +460,17 @@ void TuningProperties::parse_dvb_s(guint n, char **tokens, const char *s)
         val = SEC_VOLTAGE_13;
     else
         throw report_parse_error("Invalid polarity", s);
-    append_prop_priv(DTV_VOLTAGE, val);
+    append_prop(DTV_VOLTAGE, val);
 
-    append_prop_priv(DTV_SYMBOL_RATE, parse_number(tokens[3], s));
-    append_prop_priv(DTV_INNER_FEC, parse_code_rate(tokens[4], s));
+    append_prop(DTV_SYMBOL_RATE, parse_number(tokens[3], s));
+    append_prop(DTV_INNER_FEC, parse_code_rate(tokens[4], s));
 
     if (n > 5 && tokens[0][1] != '1')
     {
-        append_prop_priv(DTV_PILOT, PILOT_AUTO);
-        append_prop_priv(DTV_ROLLOFF, parse_roll_off(tokens[5], s));
-        append_prop_priv(DTV_MODULATION, parse_modulation(tokens[6], s));
+        append_prop(DTV_PILOT, PILOT_AUTO);
+        append_prop(DTV_ROLLOFF, parse_roll_off(tokens[5], s));
+        append_prop(DTV_MODULATION, parse_modulation(tokens[6], s));
     }
-
-    fix_props();
 }
 
 guint32 TuningProperties::parse_number(const char *n, const char *s)
@@ -551,34 +580,11 @@ guint32 TuningProperties::parse_modulation(const char *v, const char *s)
 
 void TuningProperties::append_prop(guint32 cmd, guint32 data)
 {
-    auto &back = props_v_.back();
-    if (back.cmd == DTV_TUNE)
-    {
-        back.cmd = cmd;
-        back.u.data = data;
-    }
-    else
-    {
-        append_prop_priv(cmd, data);
-    }
-    fix_props();
-}
-
-void TuningProperties::append_prop_priv(guint32 cmd, guint32 data)
-{
-    auto l = props_v_.size();
-
-    props_v_.resize(l + 1);
-    props_v_[l].cmd = cmd;
-    props_v_[l].u.data = data;
-}
-
-void TuningProperties::fix_props()
-{
-    if (props_v_.back().cmd != DTV_TUNE)
-        append_prop_priv(DTV_TUNE, 1);
-    props_.props = props_v_.data();
-    props_.num = props_v_.size();
+    if (num_ == MAX_PROPS)
+        throw report_error(TuningError::TOO_MANY_PROPS, "Too many properties");
+    props_[num_].cmd = cmd;
+    props_[num_].data = data;
+    ++num_;
 }
 
 Glib::Error TuningProperties::report_error(TuningError code, const char *desc)
@@ -663,10 +669,9 @@ std::string TuningProperties::linuxtv_description() const
 
 TuningProperties::prop_map_t &TuningProperties::map_props(prop_map_t &m) const
 {
-    for (unsigned n = 0; n < props_.num; ++n)
+    for (const auto &prop: *this)
     {
-        if (props_v_[n].cmd != DTV_TUNE)
-            m[props_v_[n].cmd] = props_v_[n].u.data;
+        m[prop.cmd] = prop.data;
     }
     return m;
 }
@@ -675,10 +680,10 @@ TuningProperties &TuningProperties::merge(const TuningProperties &other)
 {
     auto m = other.map_props();
     map_props(m);
-    props_v_.clear();
+    clear();
     for (const auto &p: m)
     {
-        append_prop_priv(p.first, p.second);
+        append_prop(p.first, p.second);
     }
     return *this;
 }
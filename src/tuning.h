@@ -19,10 +19,11 @@
     Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 */
 
+#include <cstdint>
+#include <functional>
 #include <initializer_list>
 #include <map>
 #include <string>
-#include <vector>
 
 #include <linux/dvb/frontend.h>
 
@@ -34,24 +35,41 @@ namespace logi
 enum class TuningError
 {
     PARSE,
+    TOO_MANY_PROPS,
+    IMPORT,
 };
 
 /**
  * TuningProperties:
  * Encapsulates frontend tuning properties and provides related utilities.
+ * It's a small value type: the (cmd, data) pairs are stored inline, and are
+ * only expanded into the kernel's much larger struct dtv_property, with
+ * DTV_TUNE appended, by expand() when actually tuning. An empty
+ * TuningProperties is false, and is used to mean "no tuning".
  */
 class TuningProperties
 {
+public:
+    struct Property
+    {
+        std::uint32_t cmd;
+        std::uint32_t data;
+    };
+
+    /// A tuning needs about a dozen properties at most
+    constexpr static unsigned MAX_PROPS = 15;
+
+    /// Size of an array passed to expand(); allows for DTV_TUNE
+    constexpr static unsigned MAX_KERNEL_PROPS = MAX_PROPS + 1;
 private:
-    struct dtv_properties props_;
-    std::vector<struct dtv_property> props_v_;
+    Property props_[MAX_PROPS];
+    std::uint32_t num_;
 public:
-    TuningProperties() : props_{ .num = 0, .props = nullptr }
+    TuningProperties() : num_(0)
     {}
 
     /**
      * TuningProperties:
-     * @T: Iterable container of std::pair<guint32, guint32>.
      * @props: A list of {cmd, data} properties.
      */
     TuningProperties(std::initializer_list<std::pair<guint32,guint32>> &&props);
@@ -61,11 +79,11 @@ public:
      */
     TuningProperties(const char *tuning_str);
 
-    TuningProperties(const TuningProperties &other);
-    TuningProperties(TuningProperties &&other);
+    TuningProperties(const TuningProperties &other) = default;
+    TuningProperties(TuningProperties &&other) = default;
 
-    TuningProperties &operator=(const TuningProperties &other);
-    TuningProperties &operator=(TuningProperties &&other);
+    TuningProperties &operator=(const TuningProperties &other) = default;
+    TuningProperties &operator=(TuningProperties &&other) = default;
 
     /**
      * Returns: Whether the properties are equivalent. Only checks a few key
@@ -73,16 +91,43 @@ public:
      */
     bool operator==(const TuningProperties &other) const;
 
+    bool operator!=(const TuningProperties &other) const
+    {
+        return !(*this == other);
+    }
+
     /**
      * Returns: A rounded frequency or'd with other bits for testing
      * equivalence.
      */
     std::uint32_t get_equivalence_value() const;
 
-    struct dtv_properties const *get_props() const
-    {
-        return &props_;
-    }
+    /**
+     * Returns: A hash of the same key properties compared by operator==, so
+     * equivalent tunings have the same hash.
+     */
+    std::size_t hash() const;
+
+    /**
+     * Returns: A key identifying the tuning for a scan. Unlike operator==
+     * it distinguishes second generation delivery systems and PLPs, because
+     * a T2 mux may share a frequency with a T one.
+     */
+    std::uint64_t get_scan_key() const;
+
+    const Property *begin() const { return props_; }
+
+    const Property *end() const { return props_ + num_; }
+
+    unsigned size() const { return num_; }
+
+    /**
+     * expand:
+     * @props: Array of at least MAX_KERNEL_PROPS elements.
+     * Fills in @props for the FE_SET_PROPERTY ioctl, ending with DTV_TUNE.
+     * Returns: Number of elements used.
+     */
+    unsigned expand(struct dtv_property *props) const;
 
     /**
      * Returns: A brief description of the frequency etc.
@@ -94,16 +139,18 @@ public:
      */
     std::string linuxtv_description() const;
 
-    void clear();
+    void clear()
+    {
+        num_ = 0;
+    }
 
     static GQuark get_error_quark();
 
     operator bool() const
     {
-        return props_.num;
+        return num_;
     }
 
-    // Public version also updates props_ and makes sure DTV_TUNE is last
     void append_prop(guint32 cmd, guint32 data);
 
     /**
@@ -113,6 +160,13 @@ public:
      */
     TuningProperties &merge(const TuningProperties &other);
 
+    /**
+     * Returns: A copy of this tuned to a different frequency, which is in the
+     * same units as in delivery system descriptors, ie KHz for satellite,
+     * otherwise Hz.
+     */
+    TuningProperties with_frequency(std::uint32_t freq) const;
+
     /**
      * Satellite frequencies require some weird magic to turn them into
      * tuning properties.
@@ -125,18 +179,13 @@ private:
     constexpr static long LOF1 = 9750000;
     constexpr static long LOF2 = 10600000;
 
-    // Private version doesn't update props_
-    void append_prop_priv(guint32 cmd, guint32 data);
-
-    void fix_props();
-
     /**
-     * Adds this' properties to m, excluding DTV_TUNE.
+     * Adds this' properties to m.
      * Returns: m
      */
     prop_map_t &map_props(prop_map_t &m) const;
 
-    /// Creates a new map of this' properties excluding DTV_TUNE.
+    /// Creates a new map of this' properties.
     prop_map_t map_props() const
     {
         prop_map_t m;
@@ -180,3 +229,16 @@ private:
 };
 
 }
+
+namespace std
+{
+
+template<> struct hash<logi::TuningProperties>
+{
+    std::size_t operator()(const logi::TuningProperties &tuning) const
+    {
+        return tuning.hash();
+    }
+};
+
+}
@@ -0,0 +1,234 @@
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/*
+ * Counts heap allocations made while parsing a synthetic network's NIT and
+ * SDT sections, and reports them per service. The first pass is what a scan
+ * costs when it discovers the services; the second is what every later
+ * repeat of the same tables costs.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include "scan/multi-scanner.h"
+#include "scan/nit-processor.h"
+#include "scan/sdt-processor.h"
+#include "scan/single-channel-scanner.h"
+
+#include "synth-section.h"
+
+using namespace logi;
+
+static std::size_t allocations = 0;
+
+void *operator new(std::size_t size)
+{
+    ++allocations;
+    void *p = std::malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+constexpr unsigned NUM_TRANSPORTS = 64;
+constexpr unsigned SERVICES_PER_TS = 16;
+constexpr std::uint16_t NETWORK_ID = 0x3005;
+constexpr std::uint16_t ORIG_NETWORK_ID = 0x233a;
+
+static std::uint16_t service_id(unsigned ts, unsigned n)
+{
+    return std::uint16_t(0x1000 + ts * SERVICES_PER_TS + n);
+}
+
+static std::shared_ptr<NITSection> build_nit(unsigned ts)
+{
+    auto sec = std::make_shared<SynthSection<NITSection>>();
+    auto &v = sec->bytes();
+    v.push_back(Section::NIT_TABLE);
+    put16(v, 0);
+    put16(v, NETWORK_ID);
+    v.push_back(0xc1);
+    v.push_back(std::uint8_t(ts));
+    v.push_back(std::uint8_t(NUM_TRANSPORTS - 1));
+
+    const char *nw_name = "Synthetic terrestrial network";
+    put16(v, 0xf000 | (std::strlen(nw_name) + 2));
+    v.push_back(Descriptor::NETWORK_NAME);
+    put_string(v, nw_name);
+
+    put16(v, 0xf000 | (6 + 2 + SERVICES_PER_TS * 3 + 2 + 11));
+    put16(v, ts + 1);
+    put16(v, ORIG_NETWORK_ID);
+    put16(v, 0xf000 | (2 + SERVICES_PER_TS * 3 + 2 + 11));
+    v.push_back(Descriptor::SERVICE_LIST);
+    v.push_back(SERVICES_PER_TS * 3);
+    for (unsigned n = 0; n < SERVICES_PER_TS; ++n)
+    {
+        put16(v, service_id(ts, n));
+        v.push_back(1);
+    }
+    v.push_back(Descriptor::TERRESTRIAL_DELIVERY_SYSTEM);
+    v.push_back(11);
+    // Centre frequency in units of 10Hz
+    std::uint32_t f = (474000000 + ts * 8000000) / 10;
+    put16(v, f >> 16);
+    put16(v, f & 0xffff);
+    v.insert(v.end(), { 0x1f, 0x82, 0x41, 0xff, 0xff, 0xff, 0xff });
+
+    finish_section(v);
+    return sec;
+}
+
+static std::shared_ptr<SDTSection> build_sdt(unsigned ts)
+{
+    auto sec = std::make_shared<SynthSection<SDTSection>>();
+    auto &v = sec->bytes();
+    v.push_back(Section::OTHER_SDT_TABLE);
+    put16(v, 0);
+    put16(v, ts + 1);
+    v.push_back(0xc1);
+    v.push_back(0);
+    v.push_back(0);
+    put16(v, ORIG_NETWORK_ID);
+    v.push_back(0xff);
+
+    for (unsigned n = 0; n < SERVICES_PER_TS; ++n)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "Synthetic Channel %u HD",
+                ts * SERVICES_PER_TS + n);
+        const char *provider = "Synthetic Broadcasting";
+        unsigned dlen = 3 + std::strlen(provider) + std::strlen(name);
+
+        put16(v, service_id(ts, n));
+        v.push_back(0xfd);
+        put16(v, 0x8000 | (dlen + 2));
+        v.push_back(Descriptor::SERVICE);
+        v.push_back(std::uint8_t(dlen));
+        v.push_back(1);
+        put_string(v, provider);
+        put_string(v, name);
+    }
+
+    finish_section(v);
+    return sec;
+}
+
+/// There's no receiver, so MultiScanner mustn't find anything to tune
+class EmptyIterator : public TuningIterator
+{
+public:
+    virtual TuningProperties next() override
+    {
+        return TuningProperties();
+    }
+
+    virtual void reset() override
+    {}
+};
+
+static std::size_t parse_pass(
+        const std::vector<std::shared_ptr<NITSection>> &nits,
+        const std::vector<std::shared_ptr<SDTSection>> &sdts,
+        MultiScanner &ms, NITProcessor &nitp, SDTProcessor &sdtp)
+{
+    nitp.reset_tracker();
+    sdtp.reset_tracker();
+    auto before = allocations;
+    for (const auto &sec: nits)
+        nitp.process(sec, &ms);
+    for (const auto &sec: sdts)
+        sdtp.process(sec, &ms);
+    return allocations - before;
+}
+
+int main()
+{
+    std::vector<std::shared_ptr<NITSection>> nits;
+    std::vector<std::shared_ptr<SDTSection>> sdts;
+    for (unsigned ts = 0; ts < NUM_TRANSPORTS; ++ts)
+    {
+        nits.push_back(build_nit(ts));
+        sdts.push_back(build_sdt(ts));
+    }
+
+    MultiScanner ms(nullptr, std::make_shared<SingleChannelScanner>(),
+            std::make_shared<EmptyIterator>());
+    NITProcessor nitp;
+    SDTProcessor sdtp;
+
+    constexpr double num_services = NUM_TRANSPORTS * SERVICES_PER_TS;
+    auto first = parse_pass(nits, sdts, ms, nitp, sdtp);
+    auto repeat = parse_pass(nits, sdts, ms, nitp, sdtp);
+
+    unsigned found = 0;
+    for (unsigned ts = 0; ts < NUM_TRANSPORTS; ++ts)
+    {
+        for (unsigned n = 0; n < SERVICES_PER_TS; ++n)
+        {
+            auto &sdat = ms.get_service_data(ORIG_NETWORK_ID,
+                    service_id(ts, n));
+            if (sdat.get_scanned() && sdat.get_name().size())
+                ++found;
+        }
+    }
+    if (found != num_services)
+    {
+        g_print("Only parsed %u of %u services\n", found,
+                unsigned(num_services));
+        return 1;
+    }
+
+    g_print("Parsed %u services on %u transports\n",
+            unsigned(num_services), NUM_TRANSPORTS);
+    g_print("First pass:  %zu allocations, %.2f per service\n",
+            first, first / num_services);
+    g_print("Repeat pass: %zu allocations, %.2f per service\n",
+            repeat, repeat / num_services);
+
+    return 0;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/*
+ * The checks shared by the tests which verify rather than just benchmark.
+ * Each check prints "ok  " or "FAIL" and its description, and
+ * check_summary() gives main()'s exit status, 1 if any check failed.
+ */
+
+#include <glib.h>
+
+inline int failures = 0;
+
+inline void expect(bool cond, const char *what)
+{
+    g_print("%s %s\n", cond ? "ok  " : "FAIL", what);
+    if (!cond)
+        ++failures;
+}
+
+inline int check_summary()
+{
+    if (failures)
+        g_print("%d checks failed\n", failures);
+    else
+        g_print("All checks passed\n");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,432 @@
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/*
+ * Checks decoding of content identifier descriptors, resolution of relative
+ * CRIDs against default authorities from the SDT and NIT, and that the CRID
+ * index follows events as they're added, replaced, withdrawn and expired.
+ * Measures finding a series' upcoming episodes in a full EPG compared with
+ * scanning every event.
+ * Exits with status 1 if any check fails.
+ */
+
+#include <chrono>
+#include <cstring>
+
+#include "epg/epg-store.h"
+#include "si/content-identifier-descriptor.h"
+
+#include "check.h"
+#include "synth-section.h"
+
+using namespace logi;
+using Clock = std::chrono::steady_clock;
+
+// About 8 days for a satellite line-up
+constexpr unsigned NUM_SERVICES = 570;
+constexpr unsigned EVENTS_PER_SERVICE = 256;
+// Each service shows a few series, one of which has a long run
+constexpr unsigned SERIES_PER_SERVICE = 8;
+constexpr unsigned QUERY_RUNS = 200;
+// 2017-06-01 00:00:00 UTC
+constexpr std::uint32_t START_TIME = 1496275200;
+
+static double ms_since(Clock::time_point t0)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - t0)
+        .count();
+}
+
+static void put_crid(std::vector<std::uint8_t> &v, std::uint8_t type,
+        const char *crid)
+{
+    auto l = std::strlen(crid);
+    v.push_back(std::uint8_t(type << 2));
+    v.push_back(std::uint8_t(l));
+    v.insert(v.end(), crid, crid + l);
+}
+
+static std::vector<std::uint8_t> crid_descriptor()
+{
+    std::vector<std::uint8_t> v { Descriptor::CONTENT_IDENTIFIER, 0 };
+    put_crid(v, 0x31, "/FP6LKA");
+    // A reference into a CIT, which isn't carried in the UK
+    v.insert(v.end(), { (0x32 << 2) | 1, 0x12, 0x34 });
+    put_crid(v, 0x32, "/KNSLDS");
+    put_crid(v, 0x02, "crid://bbc.co.uk/b006q2x0");
+    put_crid(v, 0x33, "/REC1");
+    v[1] = std::uint8_t(v.size() - 2);
+    return v;
+}
+
+static void test_descriptor()
+{
+    g_print("Descriptor:\n");
+    auto data = crid_descriptor();
+    std::vector<std::pair<ContentIdentifierDescriptor::CRIDType,
+        std::string>> crids;
+    auto collect = [&crids](auto type, std::string_view crid)
+    {
+        crids.emplace_back(type, std::string(crid));
+    };
+    ContentIdentifierDescriptor(Descriptor(SectionData(data, 0), 0))
+        .for_each_crid(collect);
+    expect(crids.size() == 4 &&
+            crids[0].first == ContentIdentifierDescriptor::PROGRAMME &&
+            crids[0].second == "/FP6LKA" &&
+            crids[1].first == ContentIdentifierDescriptor::SERIES &&
+            crids[1].second == "/KNSLDS" &&
+            crids[2].first == ContentIdentifierDescriptor::SERIES &&
+            crids[3].first == ContentIdentifierDescriptor::RECOMMENDATION,
+            "CRID types and CIT references");
+
+    // Cut off in the middle of the second CRID
+    data[1] = 14;
+    crids.clear();
+    ContentIdentifierDescriptor(Descriptor(SectionData(data, 0), 0))
+        .for_each_crid(collect);
+    expect(crids.size() == 1, "truncated CRID is ignored");
+
+    // Now decode it as part of an event
+    SynthSection<EITSection> sec;
+    auto &v = sec.bytes();
+    v.insert(v.end(), { Section::EIT_SCHEDULE_TABLE, 0, 0 });
+    put16(v, 0x1041);
+    v.insert(v.end(), { 0xc1, 0, 0 });
+    put16(v, 2041);
+    put16(v, 2);
+    v.insert(v.end(), { 0, Section::EIT_SCHEDULE_TABLE });
+    put16(v, 1);
+    v.insert(v.end(), { 0xe0, 0x6b, 0x00, 0x00, 0x00, 0x00, 0x30, 0x00 });
+    data = crid_descriptor();
+    put16(v, 0x8000 | data.size());
+    v.insert(v.end(), data.begin(), data.end());
+    v.insert(v.end(), 4, 0);
+    unsigned l = v.size() - 3;
+    v[1] = std::uint8_t(0xf0 | (l >> 8));
+    v[2] = std::uint8_t(l);
+
+    EITEvent event;
+    event.clear();
+    event.series_crids.emplace_back("stale");
+    event.clear();
+    sec.for_each_event([&event](const EITSectionEventData &ev)
+    {
+        EITHarvester::decode_event(ev, event);
+    });
+    expect(event.programme_crid == "/FP6LKA" &&
+            event.series_crids == std::vector<std::string>
+                { "/KNSLDS", "crid://bbc.co.uk/b006q2x0" },
+            "harvester decodes programme and series CRIDs");
+}
+
+static EITEvent make_event(std::uint16_t event_id, std::uint32_t start,
+        const char *programme, std::vector<std::string> series = {},
+        std::uint32_t duration = 1800)
+{
+    EITEvent ev;
+    ev.clear();
+    ev.event_id = event_id;
+    ev.start = start;
+    ev.duration = duration;
+    ev.running_status = 1;
+    ev.free_CA_mode = false;
+    ev.title = "Title";
+    if (programme)
+        ev.programme_crid = programme;
+    ev.series_crids = std::move(series);
+    return ev;
+}
+
+static void test_resolve()
+{
+    g_print("Resolution:\n");
+    CRIDIndex index;
+    auto bbc1 = EPGStore::service_key(2, 2041, 0x1041);
+    auto bbc2 = EPGStore::service_key(2, 2041, 0x1042);
+    auto itv = EPGStore::service_key(2, 2049, 0x2001);
+    index.set_default_authority(bbc1, "fp.bbc.co.uk");
+    index.set_default_authority(bbc2, "fp.bbc.co.uk");
+    expect(index.resolve(bbc1, "/FP6LKA") == "crid://fp.bbc.co.uk/fp6lka",
+            "relative CRID uses the service's authority");
+    expect(index.resolve(bbc1, "FP6LKA") == index.resolve(bbc1, "/fp6lka"),
+            "missing slash and case are normalised");
+    expect(index.resolve(itv, "CRID://www.itv.com/ABC") ==
+            "crid://www.itv.com/abc", "absolute CRID is kept");
+    expect(index.resolve(itv, "/ABC") != index.resolve(bbc1, "/ABC") &&
+            index.resolve(itv, "/ABC") !=
+            index.resolve(EPGStore::service_key(2, 2049, 0x2002), "/ABC"),
+            "default pseudo-authority is per service");
+
+    index.add(bbc1, 1, START_TIME, 1800, "/EP1", { "/SERIES" });
+    index.add(bbc2, 7, START_TIME + 86400, 1800, "/ep1", { "/series" });
+    auto &showings = index.programme("crid://fp.bbc.co.uk/ep1");
+    expect(showings.size() == 2 && showings[0].service == bbc1 &&
+            showings[1].service == bbc2,
+            "a repeat on a sister channel shares the CRID");
+    auto crids = index.find(bbc2, 7);
+    expect(crids && crids->programme && crids->series.size() == 1 &&
+            *crids->series[0] == "crid://fp.bbc.co.uk/series",
+            "event's CRIDs can be looked up");
+    expect(!index.find(bbc2, 8), "unindexed event isn't found");
+
+    index.add(bbc1, 2, START_TIME + 1800, 1800, "", { "/REPEAT", "/repeat" });
+    crids = index.find(bbc1, 2);
+    expect(crids && crids->series.size() == 1 &&
+            index.series("crid://fp.bbc.co.uk/repeat").size() == 1,
+            "repeated series CRID only lists the event once");
+}
+
+static void put_authority(std::vector<std::uint8_t> &v, const char *auth)
+{
+    v.push_back(Descriptor::DEFAULT_AUTHORITY);
+    put_string(v, auth);
+}
+
+static void test_authority()
+{
+    g_print("Default authority descriptors:\n");
+    CRIDIndex index;
+
+    // SDT with an authority for the first service only
+    SynthSection<SDTSection> sdt;
+    auto &v = sdt.bytes();
+    v.insert(v.end(), { Section::OTHER_SDT_TABLE, 0, 0 });
+    put16(v, 2049);
+    v.insert(v.end(), { 0xc1, 0, 0 });
+    put16(v, 2);
+    v.push_back(0xff);
+    std::vector<std::uint8_t> desc;
+    put_authority(desc, "www.itv.com");
+    put16(v, 0x2001);
+    v.push_back(0xfd);
+    put16(v, 0x8000 | desc.size());
+    v.insert(v.end(), desc.begin(), desc.end());
+    put16(v, 0x2002);
+    v.push_back(0xfd);
+    put16(v, 0x8000);
+    finish_section(v);
+    index.process_sdt(sdt);
+
+    // NIT with a network authority and one for transport stream 2041
+    SynthSection<NITSection> nit;
+    auto &n = nit.bytes();
+    n.insert(n.end(), { Section::NIT_TABLE, 0, 0 });
+    put16(n, 0x3005);
+    n.insert(n.end(), { 0xc1, 0, 0 });
+    desc.clear();
+    put_authority(desc, "network.example");
+    put16(n, 0xf000 | desc.size());
+    n.insert(n.end(), desc.begin(), desc.end());
+    auto loop_start = n.size();
+    put16(n, 0);
+    desc.clear();
+    put_authority(desc, "fp.bbc.co.uk");
+    put16(n, 2041);
+    put16(n, 2);
+    put16(n, 0xf000 | desc.size());
+    n.insert(n.end(), desc.begin(), desc.end());
+    put16(n, 2050);
+    put16(n, 2);
+    put16(n, 0xf000);
+    unsigned loop_len = n.size() - loop_start - 2;
+    n[loop_start] = std::uint8_t(0xf0 | (loop_len >> 8));
+    n[loop_start + 1] = std::uint8_t(loop_len);
+    finish_section(n);
+    index.process_nit(nit);
+
+    expect(index.resolve(EPGStore::service_key(2, 2049, 0x2001), "/abc") ==
+            "crid://www.itv.com/abc", "SDT authority applies to its service");
+    expect(index.resolve(EPGStore::service_key(2, 2041, 0x1041), "/abc") ==
+            "crid://fp.bbc.co.uk/abc" &&
+            index.resolve(EPGStore::service_key(2, 2041, 0x1042), "/abc") ==
+            "crid://fp.bbc.co.uk/abc",
+            "NIT transport stream authority applies to its services");
+    expect(index.resolve(EPGStore::service_key(2, 2050, 0x2101), "/abc") ==
+            "crid://network.example/abc",
+            "NIT network authority is the fallback for transport streams");
+    index.set_default_authority(EPGStore::service_key(2, 2041, 0x1041),
+            "bbc.co.uk");
+    expect(index.resolve(EPGStore::service_key(2, 2041, 0x1041), "/abc") ==
+            "crid://bbc.co.uk/abc", "service authority takes precedence");
+    expect(index.resolve(EPGStore::service_key(2, 2049, 0x2002), "/abc") ==
+            "crid://0002.0801.2002.dvb/abc",
+            "service without an authority gets its own pseudo-authority");
+}
+
+static void test_store()
+{
+    g_print("Incremental updates:\n");
+    EPGStore store;
+    auto svc = EPGStore::service_key(2, 2041, 0x1041);
+    store.add_event(svc, make_event(1, START_TIME, "/ep1", { "/s1" }));
+    store.enable_crid_index();
+    auto index = store.crid_index();
+    index->set_default_authority(svc, "fp.bbc.co.uk");
+    auto series = index->resolve(svc, "/s1");
+
+    for (unsigned n = 0; n < 6; ++n)
+    {
+        store.add_event(svc, make_event(10 + n, START_TIME + 3600 * (n + 1),
+                    n == 0 || n == 5 ? "/ep1" : n == 4 ? "/ep2" : nullptr,
+                    { "/s1" }));
+    }
+    // The second part of a film interrupted by the news
+    store.add_event(svc, make_event(20, START_TIME + 8 * 3600, "/film",
+                {}, 3000));
+    store.add_event(svc, make_event(21, START_TIME + 8 * 3600 + 3000,
+                nullptr, {}, 600));
+    store.add_event(svc, make_event(22, START_TIME + 9 * 3600, "/film",
+                {}, 3600));
+    expect(index->num_events() == 8 && index->series(series).size() == 6,
+            "events are indexed as they arrive, not before enabling");
+
+    std::vector<std::uint16_t> ids;
+    index->for_each_upcoming(series, START_TIME + 3 * 3600 + 60,
+            [&ids](const CRIDIndex::Event &ev) { ids.push_back(ev.event_id); });
+    expect(ids == std::vector<std::uint16_t> { 12, 13, 14, 15 },
+            "upcoming episodes include the one on now");
+
+    const auto &film = index->programme(index->resolve(svc, "/film"));
+    expect(film.size() == 2 && CRIDIndex::is_split(film[0], film[1]),
+            "split event is recognised");
+    const auto &ep1 = index->programme(index->resolve(svc, "/ep1"));
+    expect(ep1.size() == 2 && !CRIDIndex::is_split(ep1[0], ep1[1]),
+            "repeat isn't a split event");
+
+    // A different episode replacing one in the series
+    store.add_event(svc, make_event(30, START_TIME + 2 * 3600, "/other"));
+    store.add_event(svc, make_event(13, START_TIME + 4 * 3600, nullptr,
+                { "/s2" }));
+    expect(index->series(series).size() == 4 &&
+            index->series(index->resolve(svc, "/s2")).size() == 1 &&
+            !index->find(svc, 11),
+            "replaced events are updated");
+    store.add_event(svc, make_event(13, START_TIME + 4 * 3600, nullptr,
+                { "/s1" }));
+    expect(index->series(series).size() == 5 &&
+            index->series(index->resolve(svc, "/s2")).empty() &&
+            index->num_series() == 1,
+            "changed CRID of an unchanged event is updated");
+
+    EITSegment seg { 2, 2041, 0x1041, Section::EIT_SCHEDULE_TABLE, 1,
+        START_TIME + 3 * 3600, START_TIME + 6 * 3600, { 12, 14 } };
+    store.apply_segment(seg);
+    expect(!index->find(svc, 13) && index->series(series).size() == 4,
+            "withdrawn event is removed");
+
+    store.expire(START_TIME + 4 * 3600);
+    expect(index->series(series).size() == 2 &&
+            index->programme(index->resolve(svc, "/ep1")).size() == 1,
+            "expired events are removed");
+
+    store.clear();
+    expect(!index->num_events() && !index->num_series() &&
+            !index->num_programmes(), "clear empties the index");
+}
+
+static void test_bench()
+{
+    g_print("Benchmark:\n");
+    EPGStore store;
+    store.enable_crid_index();
+    auto index = store.crid_index();
+    char programme[32];
+    std::vector<std::string> series(1);
+    char buf[32];
+    auto t0 = Clock::now();
+    for (unsigned s = 0; s < NUM_SERVICES; ++s)
+    {
+        auto svc = EPGStore::service_key(2 + s / 100, 2000 + s / 10,
+                0x1000 + s);
+        for (unsigned n = 0; n < EVENTS_PER_SERVICE; ++n)
+        {
+            snprintf(programme, sizeof(programme), "/p%u_%u", s, n);
+            snprintf(buf, sizeof(buf), "/s%u_%u", s, n % SERIES_PER_SERVICE);
+            series[0] = buf;
+            store.add_event(svc, make_event(n, START_TIME + n * 2700,
+                        programme, series, 2700));
+        }
+    }
+    double build_ms = ms_since(t0);
+    g_print("%zu events, %zu programmes, %zu series, built in %.0f ms\n",
+            index->num_events(), index->num_programmes(),
+            index->num_series(), build_ms);
+    expect(index->num_events() == NUM_SERVICES * EVENTS_PER_SERVICE,
+            "every event is indexed");
+
+    // What a scheduler without the index has to do: look at each event's
+    // CRIDs
+    auto key = EPGStore::service_key(2 + 300 / 100, 2000 + 300 / 10,
+            0x1000 + 300);
+    auto crid = index->resolve(key, "/s300_3");
+    std::uint32_t now = START_TIME + 86400;
+    std::vector<std::pair<CRIDIndex::ServiceKey, std::uint16_t>> all_ids;
+    for (unsigned s = 0; s < NUM_SERVICES; ++s)
+    {
+        auto svc = EPGStore::service_key(2 + s / 100, 2000 + s / 10,
+                0x1000 + s);
+        for (unsigned n = 0; n < EVENTS_PER_SERVICE; ++n)
+            all_ids.emplace_back(svc, n);
+    }
+    std::size_t scanned = 0;
+    t0 = Clock::now();
+    for (unsigned r = 0; r < QUERY_RUNS; ++r)
+    {
+        scanned = 0;
+        for (const auto &id: all_ids)
+        {
+            auto crids = index->find(id.first, id.second);
+            if (crids && crids->start + 2700 > now)
+            {
+                for (auto s: crids->series)
+                {
+                    if (*s == crid)
+                        ++scanned;
+                }
+            }
+        }
+    }
+    double scan_ms = ms_since(t0) / QUERY_RUNS;
+
+    std::size_t found = 0;
+    t0 = Clock::now();
+    for (unsigned r = 0; r < QUERY_RUNS; ++r)
+    {
+        found = 0;
+        index->for_each_upcoming(crid, now,
+                [&found](const CRIDIndex::Event &) { ++found; });
+    }
+    double index_ms = ms_since(t0) / QUERY_RUNS;
+    g_print("Upcoming episodes: %zu, scan %.3f ms, index %.4f ms\n",
+            found, scan_ms, index_ms);
+    expect(found == scanned && found == (EVENTS_PER_SERVICE - 32) /
+            SERIES_PER_SERVICE, "index finds the same episodes as a scan");
+    expect(index_ms * 100 < scan_ms, "index is over 100x faster than a scan");
+}
+
+int main()
+{
+    test_descriptor();
+    test_resolve();
+    test_authority();
+    test_store();
+    test_bench();
+    return check_summary();
+}
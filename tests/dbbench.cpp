@@ -0,0 +1,143 @@
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/*
+ * Benchmarks fetching a large EPG-like result set through the materialised
+ * Vector query path (with and without a reserve hint) and the row visitor
+ * path. Usage: dbbench [ROWS [RUNS]]
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <future>
+
+#include "db/logi-sqlite.h"
+
+using namespace logi;
+using id_t = Database::id_t;
+
+using Clock = std::chrono::steady_clock;
+
+static const char *EPG_SQL =
+    "SELECT service_id, start, duration, title, synopsis FROM bench_epg "
+    "ORDER BY service_id, start";
+
+static void fill_table(Sqlite3Database &db, unsigned n_rows)
+{
+    db.execute("DROP TABLE IF EXISTS bench_epg");
+    db.execute("CREATE TABLE bench_epg (service_id INTEGER, start INTEGER, "
+            "duration INTEGER, title TEXT, synopsis TEXT)");
+    auto ins = db.compile_sql_statement
+        <id_t, std::int64_t, id_t, Glib::ustring, Glib::ustring>
+        ("INSERT INTO bench_epg (service_id, start, duration, title, synopsis) "
+         "VALUES (?, ?, ?, ?, ?)");
+    Database::Vector<id_t, std::int64_t, id_t, Glib::ustring, Glib::ustring>
+        rows;
+    rows.reserve(n_rows);
+    for (unsigned n = 0; n < n_rows; ++n)
+    {
+        auto title = Glib::ustring::compose("Programme title %1", n % 997);
+        auto synopsis = Glib::ustring::compose("A synopsis of episode %1 "
+                "which is long enough to need a heap allocation when it's "
+                "copied into a string.", n);
+        rows.emplace_back(n % 500, 1500000000 + std::int64_t(n) * 1800, 1800,
+                title, synopsis);
+    }
+    db.execute("BEGIN");
+    db.run_statement(ins, rows);
+    db.execute("COMMIT");
+}
+
+template<class F> static double time_runs(int runs, F fn)
+{
+    auto start = Clock::now();
+    for (int n = 0; n < runs; ++n)
+        fn();
+    std::chrono::duration<double, std::milli> t = Clock::now() - start;
+    return t.count() / runs;
+}
+
+static void report(const char *label, double ms, unsigned n_rows,
+        std::size_t check)
+{
+    g_print("%-24s %8.2fms per query, %10.0f rows/s (check %lu)\n",
+            label, ms, n_rows / ms * 1000.0, (unsigned long) check);
+}
+
+static void run_benchmarks(Sqlite3Database &db, unsigned n_rows, int runs)
+{
+    g_print("Filling table with %u rows\n", n_rows);
+    fill_table(db, n_rows);
+
+    std::size_t check = 0;
+    using Row = Database::Vector<id_t, std::int64_t, id_t,
+          Glib::ustring, Glib::ustring>;
+
+    auto vq = db.compile_sql_query<Row>(EPG_SQL);
+    auto ms = time_runs(runs, [&]()
+    {
+        auto v = vq->query({});
+        check = 0;
+        for (const auto &r: v)
+            check += std::get<3>(r).size() + std::get<4>(r).size();
+    });
+    report("Vector", ms, n_rows, check);
+
+    auto hq = db.compile_sql_query<Row>(EPG_SQL);
+    hq->set_reserve_hint(n_rows);
+    ms = time_runs(runs, [&]()
+    {
+        auto v = hq->query({});
+        check = 0;
+        for (const auto &r: v)
+            check += std::get<3>(r).size() + std::get<4>(r).size();
+    });
+    report("Vector + reserve hint", ms, n_rows, check);
+
+    auto rq = db.compile_sql_row_query<Database::Tuple<id_t, std::int64_t,
+         id_t, std::string_view, std::string_view>>(EPG_SQL);
+    ms = time_runs(runs, [&]()
+    {
+        check = 0;
+        rq->visit({}, [&check](const auto &r)
+        {
+            check += std::get<3>(r).size() + std::get<4>(r).size();
+        });
+    });
+    report("Row visitor", ms, n_rows, check);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned n_rows = argc > 1 ? std::atoi(argv[1]) : 100000;
+    int runs = argc > 2 ? std::atoi(argv[2]) : 10;
+
+    Sqlite3Database db(":memory:");
+    db.start();
+
+    std::promise<void> done;
+    db.queue_function([&]()
+    {
+        run_benchmarks(db, n_rows, runs);
+        done.set_value();
+    });
+    done.get_future().get();
+
+    return 0;
+}
@@ -0,0 +1,187 @@
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/*
+ * Checks that Database's queues keep their order and don't deadlock when
+ * the main thread queues more statements than the queues hold without
+ * running the main loop, and that futures and continuations are completed
+ * on the main thread.
+ * Exits with status 1 if any check fails.
+ */
+
+#include <chrono>
+#include <future>
+#include <thread>
+
+#include <glibmm/main.h>
+
+#include "db/logi-sqlite.h"
+
+#include "check.h"
+
+using namespace logi;
+using id_t = Database::id_t;
+using Numbers = Database::Vector<id_t>;
+
+// Several times the queues' capacity
+constexpr unsigned NUM_CALLBACKS = 10000;
+
+static void test_overflow()
+{
+    g_print("Overflow:\n");
+    Sqlite3Database db(":memory:");
+    db.start();
+
+    // The database thread fills the result queue while we fill the
+    // statement queue, and neither may wait for the other
+    std::vector<unsigned> order;
+    unsigned on_db_thread = 0;
+    for (unsigned n = 0; n < NUM_CALLBACKS; ++n)
+    {
+        db.queue_function([&on_db_thread]() { ++on_db_thread; });
+        db.queue_callback([&order, n]() { order.push_back(n); });
+    }
+    auto ctx = Glib::MainContext::get_default();
+    while (order.size() < NUM_CALLBACKS)
+        ctx->iteration(true);
+
+    bool in_order = true;
+    for (unsigned n = 0; n < NUM_CALLBACKS; ++n)
+        in_order = in_order && order[n] == n;
+    expect(in_order && on_db_thread == NUM_CALLBACKS,
+            "every statement and result arrives, in order");
+    auto stats = db.get_queue_stats();
+    g_print("%lu statements, %lu results, %lu overflowed\n",
+            (unsigned long) stats.statements, (unsigned long) stats.results,
+            (unsigned long) stats.overflows);
+    expect(stats.overflows > 0, "the queues overflowed rather than waiting");
+}
+
+static std::shared_ptr<Numbers> numbers(std::initializer_list<id_t> ns)
+{
+    auto v = std::make_shared<Numbers>();
+    for (auto n: ns)
+        v->emplace_back(n);
+    return v;
+}
+
+static void test_futures()
+{
+    g_print("Futures:\n");
+    Sqlite3Database db(":memory:");
+    db.start();
+    auto ctx = Glib::MainContext::get_default();
+
+    using Query = Database::QueryPtr<Numbers, id_t>;
+    using Statement = Database::StatementPtr<id_t>;
+    std::promise<std::pair<Query, Statement>> compiled;
+    db.queue_function([&db, &compiled]()
+    {
+        db.execute("CREATE TABLE numbers (n INTEGER UNIQUE)");
+        compiled.set_value({
+            db.compile_sql_query<Numbers, id_t>
+                ("SELECT n FROM numbers WHERE n >= ? ORDER BY n"),
+            db.compile_sql_statement<id_t>
+                ("INSERT INTO numbers (n) VALUES (?)") });
+    });
+    auto [query, insert] = compiled.get_future().get();
+
+    auto inserted = db.queue_statement_future(insert, numbers({ 1, 2, 3 }));
+    std::promise<void> executed;
+    db.queue_function([&executed]() { executed.set_value(); });
+    executed.get_future().wait();
+    expect(inserted.wait_for(std::chrono::seconds(0)) ==
+            std::future_status::timeout,
+            "future isn't ready until the main loop has run");
+    while (inserted.wait_for(std::chrono::seconds(0)) !=
+            std::future_status::ready)
+    {
+        ctx->iteration(true);
+    }
+    inserted.get();
+
+    // Each step depends on the last, without blocking the main loop
+    auto main_thread = std::this_thread::get_id();
+    bool on_main_thread = true;
+    bool done = false;
+    std::size_t rows = 0;
+    db.queue_query(query, std::make_shared<Database::Tuple<id_t>>(2),
+            [&](std::future<Numbers> &&f)
+    {
+        on_main_thread = on_main_thread &&
+            std::this_thread::get_id() == main_thread;
+        auto next = std::get<0>(f.get().back()) + 1;
+        db.queue_statement_future(insert, numbers({ next }),
+                [&](std::future<void> &&f)
+        {
+            on_main_thread = on_main_thread &&
+                std::this_thread::get_id() == main_thread;
+            f.get();
+            db.queue_query(query, std::make_shared<Database::Tuple<id_t>>(0),
+                    [&](std::future<Numbers> &&f)
+            {
+                on_main_thread = on_main_thread &&
+                    std::this_thread::get_id() == main_thread;
+                rows = f.get().size();
+                done = true;
+            });
+        });
+    });
+    while (!done)
+        ctx->iteration(true);
+    expect(on_main_thread && rows == 4,
+            "continuations run on the main thread, in sequence");
+
+    bool failed = false;
+    done = false;
+    db.queue_statement_future(insert, numbers({ 1 }),
+            [&](std::future<void> &&f)
+    {
+        try
+        {
+            f.get();
+        }
+        catch (std::exception &)
+        {
+            failed = true;
+        }
+        done = true;
+    });
+    while (!done)
+        ctx->iteration(true);
+    expect(failed, "errors are passed on by the future");
+
+    Database::Batch batch;
+    auto small = batch.add_query(query,
+            std::make_shared<Database::Tuple<id_t>>(3));
+    auto all = batch.add_query(query,
+            std::make_shared<Database::Tuple<id_t>>(0));
+    db.queue_batch(std::move(batch));
+    while (all.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        ctx->iteration(true);
+    expect(small.get().size() == 2 && all.get().size() == 4,
+            "a batch's futures are completed together");
+}
+
+int main()
+{
+    test_overflow();
+    test_futures();
+    return check_summary();
+}
@@ -0,0 +1,252 @@
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/*
+ * Checks DecodeCache's hits, evictions and sharing between threads, and
+ * measures its hit rate and speed on a simulated Freesat EIT carousel.
+ * Usage: decodecache [CYCLES]
+ * Exits with status 1 if any check fails.
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <random>
+#include <thread>
+
+#include "si/decode-cache.h"
+#include "si/decode-string.h"
+
+#include "check.h"
+
+using namespace logi;
+
+using Clock = std::chrono::steady_clock;
+
+constexpr unsigned NUM_EVENTS = 3000;
+constexpr unsigned NUM_TITLES = 600;
+// Proportion of events replaced per carousel cycle, in percent
+constexpr unsigned CHURN = 2;
+constexpr unsigned NUM_THREADS = 4;
+
+static std::mt19937 rng(1);
+
+// Random Huffman-encoded string, as it would appear in an EIT descriptor
+static std::vector<std::uint8_t> make_string(unsigned min_len,
+        unsigned max_len)
+{
+    std::vector<std::uint8_t> v(min_len + rng() % (max_len - min_len + 1));
+    v[0] = 0x1f;
+    v[1] = 1 + rng() % 2;
+    for (unsigned n = 2; n < v.size(); ++n)
+        v[n] = rng();
+    return v;
+}
+
+static void test_hits()
+{
+    g_print("Hits and misses:\n");
+    DecodeCache cache(64);
+    auto s = make_string(20, 40);
+    auto v1 = cache.get(s, 0, s.size(), decode_string_uncached);
+    auto v2 = cache.get(s, 0, s.size(), decode_string_uncached);
+    expect(*v1 == decode_string_uncached(s, 0, s.size()),
+            "cached string matches the full decoding");
+    expect(v1 == v2, "repeats share the interned value");
+    auto st = cache.stats();
+    expect(st.hits == 1 && st.misses == 1 && st.size == 1,
+            "one miss then one hit");
+
+    // Same payload with the other table is a different string
+    auto t = s;
+    t[1] ^= 3;
+    auto v3 = cache.get(t, 0, t.size(), decode_string_uncached);
+    expect(v3 != v1 && cache.stats().misses == 2,
+            "table selector is part of the key");
+
+    // Same bytes at a different offset
+    std::vector<std::uint8_t> padded(5, 0);
+    padded.insert(padded.end(), s.begin(), s.end());
+    expect(cache.get(padded, 5, s.size(), decode_string_uncached) == v1,
+            "key doesn't depend on position in the section");
+
+    cache.clear();
+    st = cache.stats();
+    expect(!st.hits && !st.misses && !st.size, "clear resets the cache");
+
+    DecodeCache::shared().clear();
+    auto d1 = decode_string(s, 0, s.size());
+    auto d2 = decode_string(s, 0, s.size());
+    expect(&d1.get() == &d2.get() && d1.get() == *v1,
+            "decode_string hits share the cached string without copying");
+}
+
+static void test_eviction()
+{
+    g_print("Eviction:\n");
+    DecodeCache cache(DecodeCache::NUM_SHARDS * 4);
+    std::vector<std::vector<std::uint8_t>> strings;
+    for (unsigned n = 0; n < 1000; ++n)
+        strings.push_back(make_string(10, 30));
+
+    // Keep referring to one string while streaming the others through
+    const auto &hot = strings[0];
+    auto hot_val = cache.get(hot, 0, hot.size(), decode_string_uncached);
+    bool all_match = true;
+    for (const auto &s: strings)
+    {
+        auto v = cache.get(s, 0, s.size(), decode_string_uncached);
+        all_match = all_match && *v == decode_string_uncached(s, 0, s.size());
+        cache.get(hot, 0, hot.size(), decode_string_uncached);
+    }
+    auto st = cache.stats();
+    expect(all_match, "strings decode correctly while being evicted");
+    expect(st.size <= cache.capacity(), "size is bounded by capacity");
+    expect(st.evictions >= 1000 - cache.capacity(), "evictions are counted");
+    expect(cache.get(hot, 0, hot.size(), decode_string_uncached) == hot_val,
+            "frequently used string survives");
+}
+
+static void test_threads()
+{
+    g_print("Threads:\n");
+    DecodeCache cache(1024);
+    std::vector<std::vector<std::uint8_t>> strings;
+    std::vector<Glib::ustring> expected;
+    for (unsigned n = 0; n < 500; ++n)
+    {
+        strings.push_back(make_string(10, 120));
+        expected.push_back(decode_string_uncached(strings.back(), 0,
+                    strings.back().size()));
+    }
+
+    std::vector<std::thread> threads;
+    std::vector<unsigned> mismatches(NUM_THREADS);
+    for (unsigned t = 0; t < NUM_THREADS; ++t)
+    {
+        threads.emplace_back([&, t]()
+        {
+            for (unsigned pass = 0; pass < 20; ++pass)
+            {
+                for (unsigned n = 0; n < strings.size(); ++n)
+                {
+                    // Each thread visits the strings in a different order
+                    unsigned i = (n * (t + 1) * 7 + pass) % strings.size();
+                    auto v = cache.get(strings[i], 0, strings[i].size(),
+                            decode_string_uncached);
+                    if (*v != expected[i])
+                        ++mismatches[t];
+                }
+            }
+        });
+    }
+    for (auto &th: threads)
+        th.join();
+
+    unsigned bad = 0;
+    for (auto m: mismatches)
+        bad += m;
+    auto st = cache.stats();
+    expect(!bad, "all threads get the right strings");
+    expect(st.hits + st.misses == NUM_THREADS * 20 * strings.size(),
+            "every lookup is counted");
+    expect(st.size == strings.size(), "each string is only cached once");
+}
+
+// A carousel of event titles and descriptions. Each cycle replaces a few
+// events, as programmes finish and new ones come into the schedule.
+static void test_carousel(unsigned cycles)
+{
+    g_print("EIT carousel, %u events x %u cycles:\n", NUM_EVENTS, cycles);
+    std::vector<std::vector<std::uint8_t>> titles;
+    for (unsigned n = 0; n < NUM_TITLES; ++n)
+        titles.push_back(make_string(8, 40));
+    std::vector<unsigned> event_titles;
+    std::vector<std::vector<std::uint8_t>> descriptions;
+    for (unsigned n = 0; n < NUM_EVENTS; ++n)
+    {
+        event_titles.push_back(rng() % NUM_TITLES);
+        descriptions.push_back(make_string(60, 200));
+    }
+
+    std::vector<const std::vector<std::uint8_t> *> stream;
+    for (unsigned c = 0; c < cycles; ++c)
+    {
+        for (unsigned n = 0; n < NUM_EVENTS; ++n)
+        {
+            if (c && rng() % 100 < CHURN)
+            {
+                event_titles[n] = rng() % NUM_TITLES;
+                descriptions[n] = make_string(60, 200);
+            }
+            // Copy so that replaced descriptions stay valid in the stream
+            stream.push_back(&titles[event_titles[n]]);
+            stream.push_back(new std::vector<std::uint8_t>(descriptions[n]));
+        }
+    }
+
+    std::size_t chars = 0;
+    auto t0 = Clock::now();
+    for (auto s: stream)
+        chars += decode_string_uncached(*s, 0, s->size()).size();
+    auto t1 = Clock::now();
+
+    auto &cache = DecodeCache::shared();
+    cache.clear();
+    std::size_t cached_chars = 0;
+    DecodeCache::Stats warm;
+    for (std::size_t n = 0; n < stream.size(); ++n)
+    {
+        if (n == 2 * NUM_EVENTS)
+            warm = cache.stats();
+        cached_chars += decode_string(*stream[n], 0, stream[n]->size())
+            .get().size();
+    }
+    auto t2 = Clock::now();
+    auto st = cache.stats();
+
+    double uncached_ms =
+        std::chrono::duration<double, std::milli>(t1 - t0).count();
+    double cached_ms =
+        std::chrono::duration<double, std::milli>(t2 - t1).count();
+    double steady = double(st.hits - warm.hits) /
+        (st.hits + st.misses - warm.hits - warm.misses);
+    g_print("Uncached %.2f ms, cached %.2f ms (x%.1f)\n",
+            uncached_ms, cached_ms, uncached_ms / cached_ms);
+    g_print("%lu hits, %lu misses, %lu evictions, %zu cached; "
+            "steady state hit rate %.1f%%\n",
+            (unsigned long) st.hits, (unsigned long) st.misses,
+            (unsigned long) st.evictions, st.size, steady * 100);
+    expect(chars == cached_chars, "cached decoding gives the same text");
+    if (cycles > 1)
+        expect(steady > 0.9, "steady state hit rate is over 90%");
+
+    for (std::size_t n = 1; n < stream.size(); n += 2)
+        delete stream[n];
+}
+
+int main(int argc, char **argv)
+{
+    unsigned cycles = argc > 1 ? std::atoi(argv[1]) : 10;
+
+    test_hits();
+    test_eviction();
+    test_threads();
+    test_carousel(cycles ? cycles : 1);
+    return check_summary();
+}
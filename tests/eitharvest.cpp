@@ -0,0 +1,341 @@
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/*
+ * Checks EIT decoding and the harvester's per-service/per-segment tracking
+ * with a synthetic 8 day schedule for a whole multiplex, and measures how
+ * quickly it gets through the carousel compared with the maximum data rate
+ * of an EIT PID. Exits with status 1 if any check fails.
+ */
+
+#include <chrono>
+#include <cstring>
+
+#include "epg/eit-harvester.h"
+
+#include "check.h"
+#include "synth-eit.h"
+
+using namespace logi;
+
+constexpr unsigned NUM_SERVICES = 150;
+constexpr unsigned NUM_DAYS = 8;
+constexpr unsigned SEGMENTS = NUM_DAYS * 8;
+constexpr unsigned SECTIONS_PER_SEGMENT = 2;
+constexpr unsigned EVENTS_PER_SECTION = 3;
+constexpr std::uint16_t ORIG_NETWORK_ID = 2;
+constexpr std::uint16_t TS_ID = 2041;
+// 2017-06-01 00:00:00 UTC
+constexpr std::time_t START_TIME = 1496275200;
+// Worst case for one PID, comfortably above any real EIT PID
+constexpr double MAX_PID_MBITS = 10.0;
+
+static void start_section(std::vector<std::uint8_t> &v,
+        std::uint8_t table_id, std::uint16_t service_id, unsigned version,
+        unsigned section_number, unsigned last_section_number,
+        unsigned segment_last, std::uint8_t last_table_id)
+{
+    start_eit_section(v, table_id, service_id, TS_ID, ORIG_NETWORK_ID,
+            version, section_number, last_section_number, segment_last,
+            last_table_id);
+}
+
+static void put_event(std::vector<std::uint8_t> &v, std::uint16_t event_id,
+        std::time_t start, unsigned duration, unsigned n)
+{
+    char title[48];
+    snprintf(title, sizeof(title), "Programme number %u", n);
+    const char *text = "A description of the programme, long enough to be "
+        "typical of the summaries broadcast on UK channels, which usually "
+        "fill most of the 250 characters available.";
+
+    auto o = start_event(v, event_id, start, duration);
+    put_short_event(v, title, text);
+    v.insert(v.end(), { Descriptor::CONTENT, 2, 0x10, 0 });
+    v.insert(v.end(),
+            { Descriptor::PARENTAL_RATING, 4, 'G', 'B', 'R', 0x09 });
+    end_event(v, o);
+}
+
+static std::uint16_t service_id(unsigned n)
+{
+    return std::uint16_t(0x2000 + n);
+}
+
+/// Schedule sections in carousel order, interleaving services
+static std::vector<EITPtr> build_schedule(unsigned version)
+{
+    std::vector<EITPtr> secs;
+    for (unsigned seg = 0; seg < SEGMENTS; ++seg)
+    {
+        std::uint8_t table_id = Section::EIT_SCHEDULE_TABLE + seg / 32;
+        unsigned seg_in_table = seg % 32;
+        for (unsigned svc = 0; svc < NUM_SERVICES; ++svc)
+        {
+            for (unsigned s = 0; s < SECTIONS_PER_SEGMENT; ++s)
+            {
+                auto sec = std::make_shared<SynthEIT>();
+                auto &v = sec->bytes();
+                unsigned sn = seg_in_table * 8 + s;
+                start_section(v, table_id, service_id(svc), version,
+                        sn, 255, seg_in_table * 8 + SECTIONS_PER_SEGMENT - 1,
+                        Section::EIT_SCHEDULE_TABLE + (SEGMENTS - 1) / 32);
+                for (unsigned e = 0; e < EVENTS_PER_SECTION; ++e)
+                {
+                    unsigned n = (seg * SECTIONS_PER_SEGMENT + s) *
+                        EVENTS_PER_SECTION + e;
+                    put_event(v, std::uint16_t(n), START_TIME + n * 1800,
+                            1800, n);
+                }
+                finish_section(v);
+                secs.push_back(sec);
+            }
+        }
+    }
+    return secs;
+}
+
+static std::vector<EITPtr> build_pf(unsigned version)
+{
+    std::vector<EITPtr> secs;
+    for (unsigned svc = 0; svc < NUM_SERVICES; ++svc)
+    {
+        for (unsigned s = 0; s < 2; ++s)
+        {
+            auto sec = std::make_shared<SynthEIT>();
+            auto &v = sec->bytes();
+            start_section(v, Section::EIT_PF_TABLE, service_id(svc), version,
+                    s, 1, 1, Section::EIT_PF_TABLE);
+            put_event(v, std::uint16_t(s), START_TIME + s * 1800, 1800, s);
+            finish_section(v);
+            secs.push_back(sec);
+        }
+    }
+    return secs;
+}
+
+static void test_decode()
+{
+    g_print("Decoding:\n");
+    auto sec = std::make_shared<SynthEIT>();
+    auto &v = sec->bytes();
+    start_section(v, Section::EIT_PF_TABLE, 0x1234, 3, 0, 1, 1,
+            Section::EIT_PF_TABLE);
+    put16(v, 0x4321);
+    put_time(v, START_TIME + 12 * 3600 + 30 * 60);
+    put_duration(v, 5400);
+    unsigned o = v.size();
+    put16(v, 0x8000 | 0x1000);      // Running, free CA bit set
+    put_short_event(v, "News", "The headlines.");
+    // Two extended event descriptors, the first with an item
+    unsigned o1 = v.size();
+    v.insert(v.end(), { Descriptor::EXTENDED_EVENT, 0, 0x01,
+            'e', 'n', 'g', 13 });
+    put_string(v, "Director");
+    put_string(v, "Ann");
+    put_string(v, "First half. ");
+    v[o1 + 1] = std::uint8_t(v.size() - o1 - 2);
+    unsigned o2 = v.size();
+    v.insert(v.end(), { Descriptor::EXTENDED_EVENT, 0, 0x11,
+            'e', 'n', 'g', 0 });
+    put_string(v, "Second half.");
+    v[o2 + 1] = std::uint8_t(v.size() - o2 - 2);
+    v.insert(v.end(), { Descriptor::CONTENT, 4, 0x20, 0, 0x23, 0 });
+    v.insert(v.end(), { Descriptor::PARENTAL_RATING, 8,
+            'G', 'B', 'R', 0x09, 'F', 'R', 'A', 0x0c });
+    unsigned dlen = v.size() - o - 2;
+    v[o] |= dlen >> 8;
+    v[o + 1] = std::uint8_t(dlen);
+    finish_section(v);
+
+    expect(sec->service_id() == 0x1234 && sec->transport_stream_id() == TS_ID
+            && sec->original_network_id() == ORIG_NETWORK_ID &&
+            sec->is_present_following() && sec->is_actual(),
+            "section header");
+    auto evs = sec->get_events();
+    expect(evs.size() == 1, "one event");
+    if (evs.size() != 1)
+        return;
+
+    EITEvent event;
+    EITHarvester::decode_event(evs[0], event);
+    expect(event.event_id == 0x4321 &&
+            event.start == START_TIME + 12 * 3600 + 30 * 60 &&
+            event.duration == 5400,
+            "event id, MJD/BCD start time and duration");
+    expect(event.running_status == 4 && event.free_CA_mode,
+            "running status and free CA mode");
+    expect(event.title.get() == "News" &&
+            event.summary.get() == "The headlines." &&
+            event.language == (('e' << 16) | ('n' << 8) | 'g'),
+            "short event");
+    expect(event.description == "First half. Second half." &&
+            event.items.size() == 1 && event.items[0].first == "Director" &&
+            event.items[0].second == "Ann",
+            "extended event texts are concatenated with items");
+    expect(event.content == std::vector<std::uint8_t> { 0x20, 0x23 },
+            "content nibbles");
+    expect(event.min_age == 12, "first parental rating");
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point t0)
+{
+    return std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - t0).count();
+}
+
+static std::size_t total_bytes(const std::vector<EITPtr> &secs)
+{
+    std::size_t bytes = 0;
+    for (const auto &s: secs)
+        bytes += s->section_length() + 3;
+    return bytes;
+}
+
+static void test_harvest()
+{
+    g_print("Harvesting %u services x %u days:\n", NUM_SERVICES, NUM_DAYS);
+    auto sched = build_schedule(0);
+    auto pf = build_pf(0);
+
+    // Interleave p/f with the schedule like a real carousel
+    std::vector<EITPtr> carousel;
+    std::size_t pf_step = sched.size() / pf.size();
+    for (std::size_t n = 0; n < sched.size(); ++n)
+    {
+        carousel.push_back(sched[n]);
+        if (n % pf_step == 0 && n / pf_step < pf.size())
+            carousel.push_back(pf[n / pf_step]);
+    }
+    auto bytes = total_bytes(carousel);
+    g_print("%zu sections, %zu bytes\n", carousel.size(), bytes);
+
+    EITHarvester harvester(nullptr);
+    unsigned long events = 0;
+    unsigned completions = 0;
+    harvester.events_signal().connect(
+            [&events](const EITSection &, const std::vector<EITEvent> &evs)
+    {
+        events += evs.size();
+    });
+    harvester.complete_signal().connect([&completions]()
+    {
+        ++completions;
+    });
+
+    auto t0 = std::chrono::steady_clock::now();
+    for (std::size_t n = 0; n + 1 < carousel.size(); ++n)
+        harvester.process_section(*carousel[n]);
+    expect(!harvester.tracker().complete() && !completions,
+            "not complete until the last section");
+    harvester.process_section(*carousel.back());
+    double t = seconds_since(t0);
+    double mbits = bytes * 8 / t / 1e6;
+    g_print("First pass: %.0f sections/s, %.1f Mbit/s\n",
+            carousel.size() / t, mbits);
+
+    const auto &tracker = harvester.tracker();
+    expect(tracker.complete() && completions == 1,
+            "complete after the last section, signalled once");
+    expect(tracker.size() == NUM_SERVICES * 2,
+            "p/f and schedule tracked per service");
+    expect(events == carousel.size() * EVENTS_PER_SECTION -
+            pf.size() * (EVENTS_PER_SECTION - 1),
+            "every event decoded once");
+    expect(mbits > MAX_PID_MBITS, "decoding keeps up with a full EIT PID");
+
+    t0 = std::chrono::steady_clock::now();
+    for (unsigned pass = 0; pass < 10; ++pass)
+    {
+        for (const auto &sec: carousel)
+            harvester.process_section(*sec);
+    }
+    t = seconds_since(t0);
+    g_print("Repeats: %.0f sections/s, %.1f Mbit/s\n",
+            carousel.size() * 10 / t, bytes * 80 / t / 1e6);
+    expect(harvester.stats().new_sections == carousel.size(),
+            "repeated carousel isn't decoded again");
+
+    // A new p/f version for one service
+    auto pf1 = build_pf(1);
+    auto before = harvester.stats().new_sections;
+    harvester.process_section(*pf1[0]);
+    expect(!tracker.service_complete(ORIG_NETWORK_ID, TS_ID, service_id(0),
+                EITTracker::PF_ACTUAL) && !tracker.complete(),
+            "new p/f version restarts that service's p/f");
+    harvester.process_section(*pf1[1]);
+    expect(harvester.stats().new_sections == before + 2 &&
+            tracker.service_complete(ORIG_NETWORK_ID, TS_ID, service_id(0),
+                EITTracker::PF_ACTUAL) && tracker.complete(),
+            "only the new version is decoded");
+}
+
+static void test_segments()
+{
+    g_print("Segments:\n");
+    auto sched = build_schedule(0);
+    EITTracker tracker;
+
+    // Skip the second section of service 0's segment 3
+    std::size_t skip = (3 * NUM_SERVICES) * SECTIONS_PER_SEGMENT + 1;
+    for (std::size_t n = 0; n < sched.size(); ++n)
+    {
+        if (n != skip)
+            tracker.track(*sched[n]);
+    }
+    expect(tracker.segment_complete(ORIG_NETWORK_ID, TS_ID, service_id(0),
+                Section::EIT_SCHEDULE_TABLE, 2) &&
+            !tracker.segment_complete(ORIG_NETWORK_ID, TS_ID, service_id(0),
+                Section::EIT_SCHEDULE_TABLE, 3),
+            "a missing section only affects its own segment");
+    expect(!tracker.service_complete(ORIG_NETWORK_ID, TS_ID, service_id(0),
+                EITTracker::SCHEDULE_ACTUAL) &&
+            tracker.service_complete(ORIG_NETWORK_ID, TS_ID, service_id(1),
+                EITTracker::SCHEDULE_ACTUAL),
+            "completeness is per service");
+    expect(tracker.track(*sched[skip]) == TableTracker::COMPLETE &&
+            tracker.complete(), "the missing section completes it");
+
+    // An empty segment is a single section with no events
+    auto sec = std::make_shared<SynthEIT>();
+    auto &v = sec->bytes();
+    start_section(v, Section::OTHER_EIT_SCHEDULE_TABLE, 0x3000, 0,
+            8, 15, 8, Section::OTHER_EIT_SCHEDULE_TABLE);
+    finish_section(v);
+    tracker.track(*sec);
+    expect(!tracker.service_complete(ORIG_NETWORK_ID, TS_ID, 0x3000,
+                EITTracker::SCHEDULE_OTHER),
+            "other segments are still needed");
+    auto sec0 = std::make_shared<SynthEIT>();
+    auto &v0 = sec0->bytes();
+    start_section(v0, Section::OTHER_EIT_SCHEDULE_TABLE, 0x3000, 0,
+            0, 15, 0, Section::OTHER_EIT_SCHEDULE_TABLE);
+    finish_section(v0);
+    expect(tracker.track(*sec0) == TableTracker::COMPLETE &&
+            sec0->get_events().empty(),
+            "segments with one section each complete the table");
+}
+
+int main()
+{
+    test_decode();
+    test_segments();
+    test_harvest();
+    return check_summary();
+}
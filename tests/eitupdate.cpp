@@ -0,0 +1,374 @@
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/*
+ * Checks that a new version of an EIT schedule sub-table only updates the
+ * events which have changed, removes events which have been withdrawn, and
+ * only writes the changes to the database. Measures the CPU time for a
+ * carousel cycle in which some services' schedules have changed, compared
+ * with decoding and merging every section of each new version.
+ * Exits with status 1 if any check fails.
+ */
+
+#include <cstring>
+#include <ctime>
+#include <future>
+
+#include <glibmm/main.h>
+
+#include "db/logi-sqlite.h"
+#include "epg/eit-harvester.h"
+#include "epg/epg-store.h"
+
+#include "check.h"
+#include "synth-eit.h"
+
+using namespace logi;
+using id_t = Database::id_t;
+
+// A multiplex carrying EIT other for a whole network
+constexpr unsigned NUM_SERVICES = 150;
+constexpr unsigned NUM_DAYS = 8;
+constexpr unsigned SEGMENTS = NUM_DAYS * 8;
+constexpr unsigned SECTIONS_PER_SEGMENT = 2;
+constexpr unsigned EVENTS_PER_SECTION = 3;
+constexpr unsigned EVENTS_PER_SERVICE = SEGMENTS * SECTIONS_PER_SEGMENT *
+    EVENTS_PER_SECTION;
+// Every CHANGE_STEP'th service gets a new version of its first table
+constexpr unsigned CHANGE_STEP = 10;
+// In the new version, this event's title changes...
+constexpr unsigned CHANGED_EVENT = 5 * 6 + 1;
+// ...and this one is withdrawn
+constexpr unsigned WITHDRAWN_EVENT = 9 * 6 + 4;
+// Cycles in which the changed services' tables alternate between the two
+// versions, ending with the new one
+constexpr unsigned UPDATE_CYCLES = 21;
+// Then cycles in which nothing changes
+constexpr unsigned REPEAT_CYCLES = 20;
+constexpr std::uint16_t ORIG_NETWORK_ID = 2;
+constexpr std::uint16_t TS_ID = 2041;
+// 2017-06-01 00:00:00 UTC
+constexpr std::time_t START_TIME = 1496275200;
+
+static std::time_t event_start(unsigned n)
+{
+    return START_TIME + n * 1800;
+}
+
+static void put_event(std::vector<std::uint8_t> &v, unsigned n,
+        const char *title)
+{
+    const char *text = "A description of the programme, long enough to be "
+        "typical of the summaries broadcast on UK channels, which usually "
+        "fill most of the 250 characters available.";
+
+    auto o = start_event(v, n, event_start(n), 1800);
+    put_short_event(v, title, text);
+    v.insert(v.end(), { Descriptor::CONTENT, 2, 0x10, 0 });
+    end_event(v, o);
+}
+
+static std::uint16_t service_id(unsigned n)
+{
+    return std::uint16_t(0x2000 + n);
+}
+
+static bool is_changed(unsigned svc)
+{
+    return svc % CHANGE_STEP == 0;
+}
+
+/**
+ * Schedule sections in carousel order, interleaving services. If @changed,
+ * the services chosen by is_changed() have a new version of their first
+ * table.
+ */
+static std::vector<EITPtr> build_schedule(bool changed)
+{
+    std::vector<EITPtr> secs;
+    for (unsigned seg = 0; seg < SEGMENTS; ++seg)
+    {
+        std::uint8_t table_id = Section::EIT_SCHEDULE_TABLE + seg / 32;
+        unsigned seg_in_table = seg % 32;
+        for (unsigned svc = 0; svc < NUM_SERVICES; ++svc)
+        {
+            bool new_version = changed && is_changed(svc) && seg < 32;
+            for (unsigned s = 0; s < SECTIONS_PER_SEGMENT; ++s)
+            {
+                auto sec = std::make_shared<SynthEIT>();
+                auto &v = sec->bytes();
+                unsigned sn = seg_in_table * 8 + s;
+                start_eit_section(v, table_id, service_id(svc), TS_ID,
+                        ORIG_NETWORK_ID, new_version, sn, 255,
+                        seg_in_table * 8 + SECTIONS_PER_SEGMENT - 1,
+                        Section::EIT_SCHEDULE_TABLE + (SEGMENTS - 1) / 32);
+                for (unsigned e = 0; e < EVENTS_PER_SECTION; ++e)
+                {
+                    unsigned n = (seg * SECTIONS_PER_SEGMENT + s) *
+                        EVENTS_PER_SECTION + e;
+                    char title[48];
+                    if (new_version && n == WITHDRAWN_EVENT)
+                        continue;
+                    else if (new_version && n == CHANGED_EVENT)
+                        snprintf(title, sizeof(title), "Breaking News");
+                    else
+                        snprintf(title, sizeof(title), "Programme %u", n);
+                    put_event(v, n, title);
+                }
+                finish_section(v);
+                secs.push_back(sec);
+            }
+        }
+    }
+    return secs;
+}
+
+/// What the harvester did before it was version-aware
+class NaivePipeline
+{
+public:
+    EITTracker tracker;
+    EPGStore store;
+    unsigned long decoded = 0;
+
+    void process_section(const EITSection &sec)
+    {
+        auto r = tracker.track(sec);
+        if (r != TableTracker::OK && r != TableTracker::COMPLETE)
+            return;
+        events_.clear();
+        sec.for_each_event([this, &sec](const EITSectionEventData &ev)
+        {
+            events_.emplace_back();
+            auto &event = events_.back();
+            event.original_network_id = sec.original_network_id();
+            event.transport_stream_id = sec.transport_stream_id();
+            event.service_id = sec.service_id();
+            EITHarvester::decode_event(ev, event);
+        });
+        decoded += events_.size();
+        store.add_events(sec, events_);
+    }
+private:
+    std::vector<EITEvent> events_;
+};
+
+static double cpu_ms(std::clock_t c0)
+{
+    return (std::clock() - c0) * 1000.0 / CLOCKS_PER_SEC;
+}
+
+static EPGStore::ServiceKey service_key(unsigned svc)
+{
+    return EPGStore::service_key(ORIG_NETWORK_ID, TS_ID, service_id(svc));
+}
+
+static void wait_for(Database &db)
+{
+    bool done = false;
+    db.queue_callback([&done]() { done = true; });
+    auto ctx = Glib::MainContext::get_default();
+    while (!done)
+        ctx->iteration(true);
+}
+
+static std::size_t count_rows(Sqlite3Database &db, const char *where)
+{
+    std::promise<std::size_t> rows;
+    db.queue_function([&db, &rows, where]()
+    {
+        auto q = db.compile_sql_query<Database::Vector<id_t>>(
+                std::string("SELECT COUNT(*) FROM EPG_epg_events") + where);
+        rows.set_value(std::get<0>(q->query({})[0]));
+    });
+    return rows.get_future().get();
+}
+
+static void test_updates()
+{
+    auto v0 = build_schedule(false);
+    auto v1 = build_schedule(true);
+    unsigned num_changed = (NUM_SERVICES + CHANGE_STEP - 1) / CHANGE_STEP;
+    g_print("%u services, %zu sections per cycle, %u services change\n",
+            NUM_SERVICES, v0.size(), num_changed);
+
+    Sqlite3Database db(":memory:");
+    db.start();
+    db.ensure_tables("EPG");
+
+    EITHarvester harvester(nullptr);
+    EPGStore store;
+    harvester.events_signal().connect(
+            sigc::mem_fun(store, &EPGStore::add_events));
+    harvester.segment_signal().connect(
+            sigc::mem_fun(store, &EPGStore::apply_segment));
+    NaivePipeline naive;
+
+    for (const auto &sec: v0)
+    {
+        harvester.process_section(*sec);
+        naive.process_section(*sec);
+    }
+    store.commit_to_database(db, "EPG");
+    wait_for(db);
+    expect(store.num_events() == NUM_SERVICES * EVENTS_PER_SERVICE &&
+            count_rows(db, "") == store.num_events(),
+            "first version is stored and committed");
+    auto first = harvester.stats();
+
+    // The database is written on another thread, so leave it out of the
+    // CPU time
+    g_print("%u update cycles, %u repeats:\n", UPDATE_CYCLES, REPEAT_CYCLES);
+    double update_ms = 0;
+    unsigned long events = 0;
+    for (unsigned c = 0; c < UPDATE_CYCLES; ++c)
+    {
+        auto c0 = std::clock();
+        for (const auto &sec: (c & 1) ? v0 : v1)
+            harvester.process_section(*sec);
+        update_ms += cpu_ms(c0);
+        store.commit_to_database(db, "EPG");
+        wait_for(db);
+        events += num_changed * ((c & 1) ? 2 * EVENTS_PER_SECTION :
+                2 * EVENTS_PER_SECTION - 1);
+    }
+    auto c0 = std::clock();
+    for (unsigned c = 0; c < REPEAT_CYCLES; ++c)
+    {
+        for (const auto &sec: v1)
+            harvester.process_section(*sec);
+    }
+    double repeat_ms = cpu_ms(c0);
+    auto stats = harvester.stats();
+
+    double naive_update_ms = 0;
+    auto naive_before = naive.decoded;
+    for (unsigned c = 0; c < UPDATE_CYCLES; ++c)
+    {
+        c0 = std::clock();
+        for (const auto &sec: (c & 1) ? v0 : v1)
+            naive.process_section(*sec);
+        naive_update_ms += cpu_ms(c0);
+    }
+    auto naive_decoded = naive.decoded - naive_before;
+    c0 = std::clock();
+    for (unsigned c = 0; c < REPEAT_CYCLES; ++c)
+    {
+        for (const auto &sec: v1)
+            naive.process_section(*sec);
+    }
+    double naive_repeat_ms = cpu_ms(c0);
+
+    g_print("Version-aware: %.2f ms CPU per update cycle, %.2f ms per repeat;"
+            " %lu events decoded\n", update_ms / UPDATE_CYCLES,
+            repeat_ms / REPEAT_CYCLES, stats.events - first.events);
+    g_print("Decoding every new section: %.2f ms CPU per update cycle, "
+            "%.2f ms per repeat; %lu events decoded\n",
+            naive_update_ms / UPDATE_CYCLES, naive_repeat_ms / REPEAT_CYCLES,
+            naive_decoded);
+    expect(stats.unchanged_sections - first.unchanged_sections ==
+            UPDATE_CYCLES * num_changed * (32 * SECTIONS_PER_SEGMENT - 2),
+            "only the changed sections are decoded");
+    expect(stats.events - first.events == events,
+            "only their events reach the store");
+
+    // Check the results
+    bool ok = true;
+    bool naive_kept = true;
+    for (unsigned svc = 0; svc < NUM_SERVICES; ++svc)
+    {
+        auto key = service_key(svc);
+        auto ev = store.event_at(key, event_start(CHANGED_EVENT));
+        bool changed = is_changed(svc);
+        ok = ok && ev && store.get_string(ev->title) ==
+            (changed ? "Breaking News" :
+             "Programme " + std::to_string(CHANGED_EVENT));
+        ev = store.event_at(key, event_start(WITHDRAWN_EVENT));
+        ok = ok && bool(ev) == !changed;
+        if (changed)
+        {
+            naive_kept = naive_kept &&
+                naive.store.event_at(key, event_start(WITHDRAWN_EVENT));
+        }
+    }
+    expect(ok, "changed events are updated and withdrawn ones removed");
+    expect(naive_kept, "decoding every section doesn't remove withdrawn "
+            "events");
+    expect(store.num_events() == NUM_SERVICES * EVENTS_PER_SERVICE -
+            num_changed, "other events are kept");
+
+    std::string where = " WHERE start = " +
+        std::to_string(event_start(WITHDRAWN_EVENT));
+    expect(count_rows(db, "") == store.num_events() &&
+            count_rows(db, where.c_str()) == NUM_SERVICES - num_changed,
+            "database matches the store");
+    where = " WHERE title = 'Breaking News'";
+    expect(count_rows(db, where.c_str()) == num_changed,
+            "changed events are written to the database");
+    g_print("Database: %u rows changed, a whole-service rewrite would write "
+            "%u\n", num_changed * 2, num_changed * EVENTS_PER_SERVICE);
+}
+
+static void test_misplaced()
+{
+    g_print("Misplaced events:\n");
+    EITHarvester harvester(nullptr);
+    unsigned segments = 0;
+    harvester.segment_signal().connect([&segments](const EITSegment &seg)
+    {
+        ++segments;
+        expect(seg.start == event_start(6) && seg.end == event_start(12) &&
+                seg.segment == 1 && seg.event_ids ==
+                    std::vector<std::uint16_t> { 6, 7, 8 },
+                "segment's window is found from its events");
+    });
+
+    // Segment 1 with the events for segment 1, then for segment 3
+    for (unsigned n: { 6u, 18u })
+    {
+        auto sec = std::make_shared<SynthEIT>();
+        auto &v = sec->bytes();
+        v.push_back(Section::EIT_SCHEDULE_TABLE);
+        put16(v, 0);
+        put16(v, service_id(n));
+        v.push_back(0xc1);
+        v.push_back(8);
+        v.push_back(8);
+        put16(v, TS_ID);
+        put16(v, ORIG_NETWORK_ID);
+        v.push_back(8);
+        v.push_back(Section::EIT_SCHEDULE_TABLE);
+        for (unsigned e = n; e < n + 3; ++e)
+            put_event(v, e, "Programme");
+        v.insert(v.end(), 4, 0);
+        unsigned l = v.size() - 3;
+        v[1] = std::uint8_t(0xf0 | (l >> 8));
+        v[2] = std::uint8_t(l);
+        harvester.process_section(*sec);
+    }
+    expect(segments == 1 && harvester.stats().segments == 1,
+            "segment with events from another segment is ignored");
+}
+
+int main()
+{
+    test_updates();
+    test_misplaced();
+    return check_summary();
+}
@@ -0,0 +1,375 @@
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/*
+ * Checks EPGStore's merging, now/next index, expiry, compaction and
+ * persistence, and benchmarks a grid query over 500 services x 8 days
+ * against the equivalent SQLite query. Usage: epgbench [GRID_RUNS]
+ * Exits with status 1 if any check fails.
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+
+#include <glibmm/main.h>
+
+#include "db/logi-sqlite.h"
+#include "epg/epg-store.h"
+
+#include "check.h"
+#include "synth-eit.h"
+
+using namespace logi;
+using id_t = Database::id_t;
+
+using Clock = std::chrono::steady_clock;
+
+constexpr unsigned NUM_SERVICES = 500;
+constexpr unsigned NUM_DAYS = 8;
+constexpr unsigned NUM_TITLES = 2000;
+constexpr unsigned GRID_HOURS = 3;
+constexpr unsigned NOW_SERVICES = 200;
+constexpr std::uint16_t ORIG_NETWORK_ID = 2;
+constexpr std::uint16_t TS_ID = 2041;
+// 2017-06-01 00:00:00 UTC
+constexpr std::uint32_t START_TIME = 1496275200;
+constexpr std::uint32_t END_TIME = START_TIME + NUM_DAYS * 86400;
+constexpr std::uint32_t DURATIONS[] = { 1800, 3600, 900, 2700, 5400, 1800 };
+constexpr unsigned NUM_DURATIONS = sizeof(DURATIONS) / sizeof(DURATIONS[0]);
+
+static double ms_since(Clock::time_point t0)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - t0)
+        .count();
+}
+
+static EPGStore::ServiceKey service_key(unsigned n)
+{
+    return EPGStore::service_key(ORIG_NETWORK_ID, TS_ID, 0x2000 + n);
+}
+
+static void make_event(EITEvent &ev, unsigned svc, unsigned n,
+        std::uint32_t start)
+{
+    char buf[160];
+    ev.clear();
+    ev.event_id = n;
+    ev.start = start;
+    ev.duration = DURATIONS[(svc + n) % NUM_DURATIONS];
+    ev.running_status = 1;
+    ev.free_CA_mode = false;
+    snprintf(buf, sizeof(buf), "Programme title %u", (n * 7 + svc) %
+            NUM_TITLES);
+    ev.title = buf;
+    snprintf(buf, sizeof(buf), "Episode %u of a series on service %u, "
+            "with a summary about as long as a typical broadcast one.",
+            n, svc);
+    ev.summary = buf;
+    ev.content.push_back(0x10);
+}
+
+/// Returns: Number of events
+static std::size_t fill_store(EPGStore &store)
+{
+    std::size_t count = 0;
+    EITEvent ev;
+    for (unsigned svc = 0; svc < NUM_SERVICES; ++svc)
+    {
+        std::uint32_t t = START_TIME;
+        for (unsigned n = 0; t < END_TIME; ++n)
+        {
+            make_event(ev, svc, n, t);
+            store.add_event(service_key(svc), ev);
+            t += ev.duration;
+            ++count;
+        }
+    }
+    return count;
+}
+
+/// A p/f section header, events are passed separately to add_events
+static void build_pf(SynthEIT &sec, unsigned svc, unsigned section_number)
+{
+    auto &v = sec.bytes();
+    start_eit_section(v, Section::EIT_PF_TABLE, 0x2000 + svc, TS_ID,
+            ORIG_NETWORK_ID, 0, section_number, 1, 1, Section::EIT_PF_TABLE);
+    finish_section(v);
+}
+
+static void test_store(EPGStore &store, std::size_t count)
+{
+    g_print("Store:\n");
+    expect(store.num_events() == count && store.num_services() == NUM_SERVICES,
+            "all events stored");
+    expect(store.strings().interned_size() == NUM_TITLES,
+            "titles are interned");
+
+    // Compare a grid with a linear scan
+    std::uint32_t from = START_TIME + 3 * 86400 + 1234;
+    std::uint32_t to = from + GRID_HOURS * 3600;
+    std::size_t grid_n = 0, scan_n = 0;
+    bool ordered = true;
+    std::uint32_t last_start = 0;
+    EPGStore::ServiceKey last_key = 0;
+    std::vector<EPGStore::ServiceKey> keys;
+    for (unsigned svc = 0; svc < NUM_SERVICES; ++svc)
+        keys.push_back(service_key(svc));
+    store.grid(keys, from, to, [&](EPGStore::ServiceKey key,
+                const EPGEvent &ev)
+    {
+        if (key == last_key && ev.start <= last_start)
+            ordered = false;
+        last_key = key;
+        last_start = ev.start;
+        ++grid_n;
+    });
+    for (auto key: keys)
+    {
+        store.for_each_in_range(key, 0, 0xffffffff,
+                [&scan_n, from, to](const EPGEvent &ev)
+        {
+            if (ev.start < to && ev.end() > from)
+                ++scan_n;
+        });
+    }
+    expect(grid_n == scan_n && grid_n > NUM_SERVICES * 2 && ordered,
+            "grid matches a linear scan, in order");
+
+    auto key = service_key(7);
+    auto ev = store.event_at(key, from);
+    expect(ev && ev->start <= from && ev->end() > from &&
+            store.get_string(ev->title).substr(0, 15) == "Programme title",
+            "event_at finds the current event");
+
+    // A 2 hour special replaces everything it overlaps
+    EITEvent special;
+    make_event(special, 7, 9999, from);
+    special.duration = 7200;
+    special.title = "Special";
+    special.items.emplace_back("Presenter", "Someone");
+    special.description = "Details.";
+    auto before = store.num_events();
+    store.add_event(key, special);
+    unsigned overlaps = 0;
+    store.for_each_in_range(key, from, from + 7200,
+            [&overlaps](const EPGEvent &) { ++overlaps; });
+    ev = store.event_at(key, from + 3600);
+    expect(overlaps == 1 && ev && ev->event_id == 9999 &&
+            store.get_string(ev->description) ==
+                "Presenter: Someone\nDetails." &&
+            store.num_events() < before,
+            "a new event replaces the events it overlaps");
+    auto bytes = store.strings().bytes();
+    store.add_event(key, special);
+    expect(store.strings().bytes() == bytes, "unchanged repeats cost nothing");
+}
+
+static void test_now_next(EPGStore &store)
+{
+    g_print("Now/next:\n");
+    unsigned signals = 0;
+    store.now_next_signal().connect([&signals](EPGStore::ServiceKey)
+    {
+        ++signals;
+    });
+
+    std::uint32_t now = START_TIME + 86400 + 600;
+    SynthEIT sec;
+    std::vector<EITEvent> events(1);
+    for (unsigned svc = 0; svc < NOW_SERVICES; ++svc)
+    {
+        auto cur = store.event_at(service_key(svc), now);
+        make_event(events[0], svc, cur->event_id, cur->start);
+        build_pf(sec, svc, 0);
+        store.add_events(sec, events);
+        auto next = store.event_at(service_key(svc), cur->end());
+        make_event(events[0], svc, next->event_id, next->start);
+        build_pf(sec, svc, 1);
+        store.add_events(sec, events);
+    }
+    expect(signals == NOW_SERVICES * 2, "p/f updates raise signals");
+    build_pf(sec, 0, 1);
+    store.add_events(sec, events = std::vector<EITEvent>(1,
+                events[0]));
+    unsigned old_signals = signals;
+    store.add_events(sec, events);
+    expect(signals == old_signals, "unchanged p/f doesn't raise a signal");
+
+    auto t0 = Clock::now();
+    unsigned n = 0;
+    constexpr unsigned RUNS = 1000;
+    for (unsigned r = 0; r < RUNS; ++r)
+    {
+        for (const auto &nn: store.now_next())
+            n += nn.has_present;
+    }
+    double ms = ms_since(t0);
+    g_print("Now/next across %u services: %.2fus\n", NOW_SERVICES,
+            ms * 1000 / RUNS);
+    expect(n == NOW_SERVICES * RUNS, "now/next index covers every service");
+    auto nn = store.now_next(service_key(3));
+    expect(nn && nn->has_present && nn->has_following &&
+            nn->present.start <= now && nn->present.end() > now &&
+            nn->following.start == nn->present.end(),
+            "present and following events");
+}
+
+static void test_maintenance(EPGStore &store)
+{
+    g_print("Maintenance:\n");
+    // Replace a day's worth of summaries to leave garbage in the arena
+    EITEvent ev;
+    auto key = service_key(11);
+    std::vector<std::uint32_t> starts;
+    store.for_each_in_range(key, START_TIME, START_TIME + 86400,
+            [&starts](const EPGEvent &e) { starts.push_back(e.start); });
+    for (unsigned n = 0; n < starts.size(); ++n)
+    {
+        make_event(ev, 11, n, starts[n]);
+        ev.summary = ev.summary.get() + " Updated.";
+        store.add_event(key, ev);
+    }
+    auto bytes = store.strings().bytes();
+    auto count = store.num_events();
+    store.compact();
+    auto e = store.event_at(key, starts[1]);
+    expect(store.strings().bytes() < bytes && store.num_events() == count &&
+            e && std::string(store.get_string(e->summary)).find("Updated.") !=
+                std::string::npos,
+            "compaction reclaims replaced strings");
+
+    store.expire(START_TIME + 86400);
+    bool none_before = true;
+    for (unsigned svc = 0; svc < NUM_SERVICES; ++svc)
+    {
+        store.for_each_in_range(service_key(svc), 0, START_TIME + 86400,
+                [&none_before](const EPGEvent &ev)
+        {
+            if (ev.end() <= START_TIME + 86400)
+                none_before = false;
+        });
+    }
+    expect(none_before && store.num_events() < count, "expiry");
+}
+
+static void run_grid_benchmark(EPGStore &store, unsigned runs)
+{
+    std::vector<EPGStore::ServiceKey> keys;
+    for (unsigned svc = 0; svc < NUM_SERVICES; ++svc)
+        keys.push_back(service_key(svc));
+
+    std::size_t check = 0;
+    auto t0 = Clock::now();
+    for (unsigned r = 0; r < runs; ++r)
+    {
+        std::uint32_t from = START_TIME + (r * 7919) % ((NUM_DAYS - 1) * 86400);
+        store.grid(keys, from, from + GRID_HOURS * 3600,
+                [&check, &store](EPGStore::ServiceKey, const EPGEvent &ev)
+        {
+            check += store.get_string(ev.title).size();
+        });
+    }
+    double ms = ms_since(t0);
+    g_print("Store grid, %u services x %uh: %.3fms per query (check %zu)\n",
+            NUM_SERVICES, GRID_HOURS, ms / runs, check);
+}
+
+static void test_database(EPGStore &store, unsigned runs)
+{
+    g_print("Database:\n");
+    Sqlite3Database db(":memory:");
+    db.start();
+    db.ensure_tables("EPG");
+
+    auto t0 = Clock::now();
+    store.commit_to_database(db, "EPG");
+    g_print("commit_to_database returned after %.2fms\n", ms_since(t0));
+
+    std::promise<std::size_t> rows_p;
+    std::promise<double> sql_p;
+    db.queue_function([&]()
+    {
+        auto cq = db.compile_sql_query<Database::Vector<id_t>>(
+                "SELECT COUNT(*) FROM EPG_epg_events");
+        rows_p.set_value(std::get<0>(cq->query({})[0]));
+
+        auto gq = db.compile_sql_row_query<Database::Tuple<id_t, id_t,
+             std::string_view>, id_t, id_t>(
+                 "SELECT service_id, start, title FROM EPG_epg_events "
+                 "WHERE start < ? AND start + duration > ? "
+                 "ORDER BY service_id, start");
+        std::size_t check = 0;
+        auto t = Clock::now();
+        unsigned sql_runs = runs / 10 + 1;
+        for (unsigned r = 0; r < sql_runs; ++r)
+        {
+            std::uint32_t from = START_TIME + 86400 +
+                (r * 7919) % ((NUM_DAYS - 2) * 86400);
+            gq->visit({ from + GRID_HOURS * 3600, from },
+                    [&check](const auto &row)
+            {
+                check += std::get<2>(row).size();
+            });
+        }
+        sql_p.set_value(ms_since(t) / sql_runs);
+    });
+    auto rows = rows_p.get_future().get();
+    g_print("SQLite grid: %.3fms per query\n", sql_p.get_future().get());
+    expect(rows == store.num_events(), "every event committed");
+
+    EPGStore loaded;
+    bool done = false;
+    loaded.load_from_database(db, "EPG", [&done]() { done = true; });
+    auto ctx = Glib::MainContext::get_default();
+    auto deadline = Clock::now() + std::chrono::seconds(30);
+    while (!done && Clock::now() < deadline)
+        ctx->iteration(true);
+    auto key = service_key(7);
+    auto a = store.event_at(key, START_TIME + 3 * 86400 + 1234);
+    auto b = loaded.event_at(key, START_TIME + 3 * 86400 + 1234);
+    expect(done && loaded.num_events() == store.num_events() && a && b &&
+            a->start == b->start && a->duration == b->duration &&
+            loaded.get_string(b->title) == store.get_string(a->title) &&
+            loaded.get_string(b->description) ==
+                store.get_string(a->description),
+            "events load back from the database");
+}
+
+int main(int argc, char **argv)
+{
+    unsigned runs = argc > 1 ? std::atoi(argv[1]) : 1000;
+
+    EPGStore store;
+    auto t0 = Clock::now();
+    auto count = fill_store(store);
+    double ms = ms_since(t0);
+    g_print("Added %zu events in %.1fms (%.0f events/s), "
+            "%zu string bytes\n", count, ms, count / ms * 1000,
+            store.strings().bytes());
+
+    test_store(store, count);
+    test_now_next(store);
+    run_grid_benchmark(store, runs);
+    test_maintenance(store);
+    test_database(store, runs);
+
+    return check_summary();
+}
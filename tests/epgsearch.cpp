@@ -0,0 +1,290 @@
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/*
+ * Checks EPGSearchIndex's matching and its incremental updates through
+ * EPGStore, then measures query latency over 1M events, compared with a
+ * linear scan like SQL's LIKE '%...%'. Usage: epgsearch [NUM_EVENTS]
+ * Exits with status 1 if any check fails.
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <random>
+
+#include "epg/epg-store.h"
+
+#include "check.h"
+
+using namespace logi;
+
+using Clock = std::chrono::steady_clock;
+
+constexpr unsigned NUM_SERVICES = 1000;
+constexpr unsigned NUM_WORDS = 5000;
+constexpr unsigned NUM_TITLES = 20000;
+constexpr unsigned NUM_SUMMARIES = 200000;
+constexpr unsigned QUERY_RUNS = 20;
+// 2017-06-01 00:00:00 UTC
+constexpr std::uint32_t START_TIME = 1496275200;
+
+static double ms_since(Clock::time_point t0)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - t0)
+        .count();
+}
+
+static EITEvent make_event(std::uint16_t event_id, std::uint32_t start,
+        const char *title, const char *summary)
+{
+    EITEvent ev;
+    ev.clear();
+    ev.event_id = event_id;
+    ev.start = start;
+    ev.duration = 1800;
+    ev.running_status = 1;
+    ev.free_CA_mode = false;
+    ev.title = title;
+    ev.summary = summary;
+    return ev;
+}
+
+static bool has_event(const std::vector<EPGSearchIndex::Hit> &hits,
+        std::uint16_t event_id)
+{
+    for (const auto &h: hits)
+    {
+        if (h.event_id == event_id)
+            return true;
+    }
+    return false;
+}
+
+static void test_matching()
+{
+    g_print("Matching:\n");
+    EPGStore store;
+    auto bbc1 = EPGStore::service_key(2, 2041, 0x1041);
+    auto bbc2 = EPGStore::service_key(2, 2041, 0x1042);
+    store.add_event(bbc1, make_event(1, START_TIME, "Doctor Who",
+                "The Doctor lands on Skaro."));
+    store.add_event(bbc1, make_event(2, START_TIME + 1800, "News",
+                "National and international news."));
+    store.enable_search();
+    store.add_event(bbc2, make_event(3, START_TIME, "Undoing the Past",
+                "History programme."));
+    store.add_event(bbc2, make_event(4, START_TIME + 1800,
+                "Doctor Who Confidential", "Behind the scenes of DOCTOR "
+                "WHO, with the cast."));
+    auto search = store.search_index();
+
+    auto hits = search->search("doctor who");
+    expect(hits.size() == 2 && hits[0].event_id == 1 &&
+            hits[1].event_id == 4 && hits[1].service == bbc2,
+            "phrase matches titles and summaries, in time order");
+    expect(search->search("DOCTOR-WHO?").size() == 2,
+            "case and punctuation are ignored");
+    expect(search->search("who doctor").empty(), "word order matters");
+    expect(search->search("skaro").size() == 1 &&
+            search->search("octo").size() == 2, "substrings match");
+    hits = search->search("do");
+    expect(hits.size() == 2 && !has_event(hits, 3),
+            "two letters only match the start of a word");
+    expect(search->search("d").empty() && search->search("").empty(),
+            "shorter queries match nothing");
+    expect(search->search("doctor", 1).size() == 1, "limit");
+    expect(search->num_events() == 4, "events added before enabling "
+            "are indexed");
+
+    // Replacing an event by one overlapping it
+    store.add_event(bbc1, make_event(5, START_TIME, "Gardeners' World",
+                "Monty Don plants bulbs."));
+    hits = search->search("doctor");
+    expect(hits.size() == 1 && hits[0].event_id == 4,
+            "replaced event is removed from the index");
+    expect(search->search("gardeners world").size() == 1,
+            "replacement is indexed");
+
+    store.expire(START_TIME + 1800);
+    expect(search->search("gardeners").empty() &&
+            search->search("history").empty() &&
+            search->num_events() == 2, "expired events are removed");
+    expect(search->num_strings() == 4, "unused strings are dropped");
+
+    store.clear();
+    expect(!search->num_events() && search->search("news").empty(),
+            "clear empties the index");
+}
+
+struct Corpus
+{
+    std::vector<std::string> titles;
+    std::vector<std::string> summaries;
+};
+
+static Corpus make_corpus()
+{
+    std::mt19937 rng(1);
+    static const char *syllables[] = { "ba", "co", "de", "fi", "gu", "ha",
+        "jo", "ki", "lu", "ma", "ne", "po", "ra", "si", "tu", "ve", "wo",
+        "ya", "zu", "ch", "st", "th", "an", "er", "in", "on" };
+    constexpr unsigned NUM_SYLLABLES =
+        sizeof(syllables) / sizeof(syllables[0]);
+    std::vector<std::string> words;
+    for (unsigned n = 0; n < NUM_WORDS; ++n)
+    {
+        std::string w;
+        unsigned len = 2 + rng() % 3;
+        for (unsigned s = 0; s < len; ++s)
+            w += syllables[rng() % NUM_SYLLABLES];
+        words.push_back(w);
+    }
+    auto phrase = [&](unsigned len)
+    {
+        std::string s;
+        for (unsigned n = 0; n < len; ++n)
+        {
+            if (n)
+                s += ' ';
+            // Skewed towards common words
+            auto w = rng() % NUM_WORDS;
+            s += words[w * (rng() % 4 + 1) / 4];
+        }
+        return s;
+    };
+
+    Corpus c;
+    for (unsigned n = 0; n < NUM_TITLES; ++n)
+    {
+        if (n % 1000 == 0)
+            c.titles.push_back("Doctor Who");
+        else
+            c.titles.push_back(phrase(1 + rng() % 4));
+    }
+    for (unsigned n = 0; n < NUM_SUMMARIES; ++n)
+        c.summaries.push_back(phrase(15 + rng() % 10) + ".");
+    return c;
+}
+
+static void test_scale(unsigned num_events)
+{
+    g_print("%u events:\n", num_events);
+    auto corpus = make_corpus();
+    unsigned per_service = num_events / NUM_SERVICES;
+
+    // Summaries are shared by repeats, so each title has a few of its own
+    auto title_of = [&](unsigned svc, unsigned n) -> const std::string &
+    {
+        return corpus.titles[(svc * 7919 + n * 31) % NUM_TITLES];
+    };
+    auto summary_of = [&](unsigned svc, unsigned n) -> const std::string &
+    {
+        return corpus.summaries[(svc * 104729 + n * 17) % NUM_SUMMARIES];
+    };
+
+    EPGSearchIndex index;
+    auto t0 = Clock::now();
+    for (unsigned svc = 0; svc < NUM_SERVICES; ++svc)
+    {
+        for (unsigned n = 0; n < per_service; ++n)
+        {
+            index.add(svc, n, START_TIME + n * 1800,
+                    title_of(svc, n), summary_of(svc, n));
+        }
+    }
+    g_print("Indexed %zu events, %zu strings in %.0f ms, ~%zu MB\n",
+            index.num_events(), index.num_strings(), ms_since(t0),
+            index.memory_size() >> 20);
+    expect(index.num_events() == per_service * NUM_SERVICES,
+            "all events are indexed");
+
+    const char *queries[] = { "doctor who", "chan", "jokiba", "st" };
+    for (auto q: queries)
+    {
+        std::size_t n = 0;
+        t0 = Clock::now();
+        for (unsigned r = 0; r < QUERY_RUNS; ++r)
+            n = index.search(q).size();
+        double indexed = ms_since(t0) / QUERY_RUNS;
+
+        // What LIKE '%q%' would have to do
+        std::string needle, text;
+        EPGSearchIndex::normalise(q, needle);
+        needle.erase(0, 1);
+        bool word_start = needle.size() < 3;
+        if (word_start)
+            needle.insert(0, 1, ' ');
+        std::size_t scanned = 0;
+        t0 = Clock::now();
+        for (unsigned svc = 0; svc < NUM_SERVICES; ++svc)
+        {
+            for (unsigned i = 0; i < per_service; ++i)
+            {
+                EPGSearchIndex::normalise(title_of(svc, i), text);
+                bool match = text.find(needle) != std::string::npos;
+                if (!match)
+                {
+                    EPGSearchIndex::normalise(summary_of(svc, i), text);
+                    match = text.find(needle) != std::string::npos;
+                }
+                scanned += match;
+            }
+        }
+        double linear = ms_since(t0);
+        g_print("'%s': %zu hits, index %.2f ms, linear scan %.0f ms\n",
+                q, n, indexed, linear);
+        expect(n == scanned, word_start ?
+                "word prefix matches the same events as a scan" :
+                "index finds the same events as a scan");
+    }
+
+    // A day's worth of events expiring and the same number arriving
+    unsigned day = 48;
+    t0 = Clock::now();
+    for (unsigned svc = 0; svc < NUM_SERVICES; ++svc)
+    {
+        for (unsigned n = 0; n < day && n < per_service; ++n)
+            index.remove(svc, n, START_TIME + n * 1800);
+        for (unsigned n = per_service; n < per_service + day; ++n)
+        {
+            index.add(svc, n, START_TIME + n * 1800,
+                    title_of(svc, n), summary_of(svc, n));
+        }
+    }
+    g_print("Expired and added %u events in %.0f ms\n",
+            2 * day * NUM_SERVICES, ms_since(t0));
+    expect(index.num_events() == per_service * NUM_SERVICES,
+            "incremental updates keep the count");
+    auto hits = index.search("doctor who");
+    bool in_range = true;
+    for (const auto &h: hits)
+        in_range = in_range && h.start >= START_TIME + day * 1800;
+    expect(in_range, "expired events aren't found");
+}
+
+int main(int argc, char **argv)
+{
+    unsigned num_events = argc > 1 ? std::atoi(argv[1]) : 1000000;
+    if (num_events < NUM_SERVICES)
+        num_events = NUM_SERVICES;
+
+    test_matching();
+    test_scale(num_events);
+    return check_summary();
+}
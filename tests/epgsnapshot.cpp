@@ -0,0 +1,338 @@
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/*
+ * Saves an 8 day EPG the size of Freesat + Freeview as an EPGSnapshot and
+ * measures how long a restart takes to get a usable EPG from it, compared
+ * with loading the same events from SQLite. Also checks that live events
+ * overlay the snapshot, and that bad files are rejected.
+ * Exits with status 1 if any check fails.
+ */
+
+#include <chrono>
+#include <future>
+
+#include <unistd.h>
+
+#include <glibmm/main.h>
+
+#include "db/logi-sqlite.h"
+#include "epg/epg-store.h"
+
+#include "check.h"
+
+using namespace logi;
+
+using Clock = std::chrono::steady_clock;
+
+// Freesat including radio, then Freeview
+constexpr unsigned FREESAT_SERVICES = 450;
+constexpr unsigned FREEVIEW_SERVICES = 120;
+constexpr unsigned NUM_SERVICES = FREESAT_SERVICES + FREEVIEW_SERVICES;
+constexpr unsigned NUM_DAYS = 8;
+constexpr unsigned NUM_TITLES = 4000;
+constexpr unsigned GRID_HOURS = 3;
+// 2017-06-01 00:00:00 UTC
+constexpr std::uint32_t START_TIME = 1496275200;
+constexpr std::uint32_t END_TIME = START_TIME + NUM_DAYS * 86400;
+constexpr std::uint32_t DURATIONS[] = { 1800, 3600, 900, 2700, 5400, 1800 };
+constexpr unsigned NUM_DURATIONS = sizeof(DURATIONS) / sizeof(DURATIONS[0]);
+
+static double ms_since(Clock::time_point t0)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - t0)
+        .count();
+}
+
+static EPGStore::ServiceKey service_key(unsigned n)
+{
+    if (n < FREESAT_SERVICES)
+        return EPGStore::service_key(59, 2000 + n / 20, 0x1000 + n);
+    return EPGStore::service_key(9018, 4000 + n / 15, 0x4000 + n);
+}
+
+static void make_event(EITEvent &ev, unsigned svc, unsigned n,
+        std::uint32_t start)
+{
+    char buf[200];
+    ev.clear();
+    ev.event_id = n;
+    ev.start = start;
+    ev.duration = DURATIONS[(svc + n) % NUM_DURATIONS];
+    ev.running_status = 1;
+    ev.free_CA_mode = false;
+    snprintf(buf, sizeof(buf), "Programme title %u", (n * 7 + svc) %
+            NUM_TITLES);
+    ev.title = buf;
+    snprintf(buf, sizeof(buf), "Episode %u of a series on service %u, "
+            "with a summary about as long as a typical broadcast one.",
+            n, svc);
+    ev.summary = buf;
+    if (n % 4 == 0)
+        ev.description = "Presented by someone off the telly.";
+    ev.content.push_back(0x10);
+}
+
+static std::size_t fill_store(EPGStore &store)
+{
+    std::size_t count = 0;
+    EITEvent ev;
+    for (unsigned svc = 0; svc < NUM_SERVICES; ++svc)
+    {
+        std::uint32_t t = START_TIME;
+        for (unsigned n = 0; t < END_TIME; ++n)
+        {
+            make_event(ev, svc, n, t);
+            store.add_event(service_key(svc), ev);
+            t += ev.duration;
+            ++count;
+        }
+    }
+    return count;
+}
+
+/// Sums the lengths of the strings in a grid, as a check that two stores
+/// have the same contents
+static std::size_t grid_check(const EPGStore &store, std::uint32_t from)
+{
+    static std::vector<EPGStore::ServiceKey> keys;
+    if (keys.empty())
+    {
+        for (unsigned svc = 0; svc < NUM_SERVICES; ++svc)
+            keys.push_back(service_key(svc));
+    }
+    std::size_t check = 0;
+    store.grid(keys, from, from + GRID_HOURS * 3600,
+            [&store, &check](EPGStore::ServiceKey, const EPGEvent &ev)
+    {
+        check += ev.start + ev.event_id + store.get_string(ev.title).size() +
+            store.get_string(ev.summary).size() +
+            store.get_string(ev.description).size();
+    });
+    return check;
+}
+
+static bool same_contents(const EPGStore &a, const EPGStore &b)
+{
+    if (a.num_events() != b.num_events())
+        return false;
+    for (std::uint32_t t = START_TIME; t < END_TIME; t += 6 * 3600)
+    {
+        if (grid_check(a, t) != grid_check(b, t))
+            return false;
+    }
+    return true;
+}
+
+static double load_from_sqlite(const EPGStore &store, EPGStore &loaded)
+{
+    Sqlite3Database db(":memory:");
+    db.start();
+    db.ensure_tables("EPG");
+    // commit_to_database only writes dirty services, so copy the store
+    const_cast<EPGStore &>(store).commit_to_database(db, "EPG");
+    std::promise<void> committed;
+    db.queue_function([&committed]() { committed.set_value(); });
+    committed.get_future().get();
+
+    bool done = false;
+    auto t0 = Clock::now();
+    loaded.load_from_database(db, "EPG", [&done]() { done = true; });
+    auto ctx = Glib::MainContext::get_default();
+    auto deadline = Clock::now() + std::chrono::seconds(60);
+    while (!done && Clock::now() < deadline)
+        ctx->iteration(true);
+    return ms_since(t0);
+}
+
+static void test_overlay(EPGStore &store, const std::string &path)
+{
+    g_print("Live overlay:\n");
+    auto key = service_key(3);
+    auto other = service_key(4);
+    std::uint32_t t = START_TIME + 2 * 86400 + 600;
+    auto before = store.event_at(key, t);
+    auto other_before = store.event_at(other, t);
+    std::string other_title(store.get_string(other_before->title));
+
+    // A repeat of an event that's already in the snapshot
+    EITEvent same;
+    same.clear();
+    same.event_id = other_before->event_id;
+    same.start = other_before->start;
+    same.duration = other_before->duration;
+    same.running_status = other_before->flags & 7;
+    same.free_CA_mode = other_before->flags >> 3;
+    same.min_age = other_before->min_age;
+    if (other_before->content)
+        same.content.push_back(other_before->content);
+    same.title = Glib::ustring(std::string(
+                store.get_string(other_before->title)));
+    same.summary = Glib::ustring(std::string(
+                store.get_string(other_before->summary)));
+    same.description = Glib::ustring(std::string(
+                store.get_string(other_before->description)));
+    store.add_event(other, same);
+    expect(store.event_at(other, t) == other_before,
+            "unchanged repeat doesn't copy its service out of the snapshot");
+
+    EITEvent ev;
+    make_event(ev, 3, 60000, before->start);
+    ev.duration = before->duration;
+    ev.title = "Breaking News";
+    store.add_event(key, ev);
+    auto after = store.event_at(key, t);
+    expect(after && after->event_id == 60000 &&
+            store.get_string(after->title) == "Breaking News",
+            "live event replaces the snapshot's");
+    auto other_after = store.event_at(other, t);
+    expect(other_after == other_before &&
+            store.get_string(other_after->title) == other_title,
+            "other services are still read from the snapshot");
+    auto prev = store.event_at(key, before->start - 1);
+    expect(prev && !store.get_string(prev->title).empty(),
+            "rest of the changed service is kept");
+
+    auto n = store.num_events();
+    store.expire(START_TIME + 86400);
+    expect(store.num_events() < n && !store.event_at(other, START_TIME),
+            "expiry copies services out of the snapshot");
+
+    store.compact();
+    after = store.event_at(key, t);
+    expect(store.get_string(after->title) == "Breaking News" &&
+            store.get_string(store.event_at(other, t)->title) ==
+                other_title, "compaction keeps both kinds of string");
+
+    // Save over the snapshot that's in use
+    store.save_snapshot(path);
+    expect(store.get_string(store.event_at(other, t)->title) == other_title,
+            "replacing the file doesn't disturb the mapped snapshot");
+    expect(access((path + ".tmp").c_str(), F_OK) != 0,
+            "temporary file is renamed");
+    EPGStore reloaded;
+    reloaded.use_snapshot(EPGSnapshot::open(path));
+    expect(same_contents(store, reloaded), "overlaid store saves and loads");
+}
+
+static void test_periodic(EPGStore &store, const std::string &path)
+{
+    g_print("Periodic saving:\n");
+    Sqlite3Database db(":memory:");
+    db.start();
+    auto periodic = path + ".periodic";
+    auto conn = store.save_snapshot_periodically(db, periodic, 1);
+
+    EITEvent ev;
+    make_event(ev, 5, 60001, START_TIME + 3 * 86400);
+    ev.title = "Newsflash";
+    store.add_event(service_key(5), ev);
+
+    auto ctx = Glib::MainContext::get_default();
+    auto deadline = Clock::now() + std::chrono::seconds(10);
+    std::shared_ptr<EPGSnapshot> snap;
+    while (!snap && Clock::now() < deadline)
+    {
+        ctx->iteration(true);
+        if (access(periodic.c_str(), F_OK) == 0)
+            snap = EPGSnapshot::open(periodic);
+    }
+    conn.disconnect();
+    // The save's callback on the main thread comes before this one
+    bool done = false;
+    db.queue_callback([&done]() { done = true; });
+    while (!done && Clock::now() < deadline)
+        ctx->iteration(true);
+    expect(snap != nullptr, "changes are saved by the timer");
+    if (snap)
+    {
+        EPGStore reloaded;
+        reloaded.use_snapshot(snap);
+        expect(same_contents(store, reloaded),
+                "periodic snapshot matches the store");
+    }
+    std::remove(periodic.c_str());
+}
+
+static void test_bad_files(const std::string &path)
+{
+    g_print("Bad files:\n");
+    expect(!EPGSnapshot::open(path + ".missing"), "missing file");
+
+    auto bad = path + ".bad";
+    auto f = std::fopen(bad.c_str(), "w");
+    std::string junk(1000, 'x');
+    std::fwrite(junk.data(), 1, junk.size(), f);
+    std::fclose(f);
+    expect(!EPGSnapshot::open(bad), "not a snapshot");
+
+    auto snap = EPGSnapshot::open(path);
+    auto size = snap->header().file_size;
+    std::string cmd = "head -c " + std::to_string(size / 2) + " " + path +
+        " > " + bad;
+    expect(std::system(cmd.c_str()) == 0 && !EPGSnapshot::open(bad),
+            "truncated snapshot");
+    std::remove(bad.c_str());
+}
+
+int main()
+{
+    std::string path = std::string(g_get_tmp_dir()) + "/epgsnapshot-" +
+        std::to_string(getpid()) + ".epg";
+
+    EPGStore store;
+    auto count = fill_store(store);
+    g_print("%zu events for %u services over %u days\n",
+            count, NUM_SERVICES, NUM_DAYS);
+
+    auto t0 = Clock::now();
+    store.save_snapshot(path);
+    auto snap = EPGSnapshot::open(path);
+    g_print("Saved %.1f MB snapshot in %.0f ms\n",
+            snap ? snap->header().file_size / 1048576.0 : 0,
+            ms_since(t0));
+    snap.reset();
+
+    // Startup: map the file and answer a first grid query
+    t0 = Clock::now();
+    EPGStore restored;
+    restored.use_snapshot(EPGSnapshot::open(path));
+    double map_ms = ms_since(t0);
+    auto check = grid_check(restored, START_TIME + 86400);
+    double first_ms = ms_since(t0);
+    g_print("Startup from snapshot: %.2f ms to map, %.2f ms to first grid\n",
+            map_ms, first_ms);
+    expect(restored.num_events() == count &&
+            check == grid_check(store, START_TIME + 86400),
+            "snapshot has the same events as the store");
+    expect(same_contents(store, restored), "whole EPG matches");
+
+    EPGStore loaded;
+    double sql_ms = load_from_sqlite(store, loaded);
+    g_print("Startup from SQLite: %.0f ms (x%.0f)\n", sql_ms,
+            sql_ms / first_ms);
+    expect(same_contents(store, loaded), "SQLite load matches");
+
+    test_overlay(restored, path);
+    test_periodic(restored, path);
+    test_bad_files(path);
+    std::remove(path.c_str());
+
+    return check_summary();
+}
@@ -72,6 +72,9 @@ static Glib::RefPtr<Glib::MainLoop> main_loop;
 
 static std::shared_ptr<Sqlite3Database> database;
 
+// Name used to refer to the staging copy of the Freesat tables
+static std::string staging_source;
+
 static const char *bouquet_name;
 static const char *region_name;
 
@@ -104,7 +107,8 @@ static bool check_region_name(const char *nm,
 static void lcn_fn()
 {
     g_print("Committed SI data to database\n");
-    auto nq = database->get_all_network_ids_query("Freesat");
+    auto nq = database->get_all_network_ids_query(
+            staging_source.c_str());
     auto bqs = database->run_query(nq);
     if (!bqs.size())
     {
@@ -131,7 +135,8 @@ static void lcn_fn()
         }
     }
 
-    auto rq = database->get_regions_for_bouquet_query("Freesat");
+    auto rq = database->get_regions_for_bouquet_query(
+            staging_source.c_str());
     auto regs = database->run_query(rq, {std::get<0>(bqs[0])});
     if (region_name)
     {
@@ -157,7 +162,7 @@ static void lcn_fn()
     g_print("Processing LCNs for bouquet '%s', region '%s'\n",
             bouquet_name, region_name);
     FreesatLCNProcessor lp(*database);
-    lp.process("Freesat", bouquet_name, region_name);
+    lp.process(staging_source.c_str(), bouquet_name, region_name);
 }
 
 void finished_cb(MultiScanner &scanner, MultiScanner::Status status)
@@ -182,8 +187,16 @@ void finished_cb(MultiScanner &scanner, MultiScanner::Status status)
     {
         // Use shared_ptr to keep db alive in its own thread
         // when we exit this scope. Scanner is kept alive in main().
-        scanner.commit_to_database(*database, "Freesat");
+        // Most of the data has already been streamed to the staging tables
+        // during the scan; the published data is only replaced when the
+        // whole commit, including LCNs, is done.
+        scanner.commit_to_database(*database, staging_source.c_str());
         database->queue_function(lcn_fn);
+        database->queue_function([]()
+        {
+            database->publish_staging("Freesat");
+            g_print("Published scan data\n");
+        });
         database->queue_callback([]()
         {
             database.reset();
@@ -231,6 +244,14 @@ int main(int argc, char **argv)
         std::shared_ptr<FreesatTuningIterator>
             { new FreesatTuningIterator() } };
 
+    // Write each channel's data while the next one is being scanned
+    staging_source = database->staging_source("Freesat");
+    database->queue_function([]()
+    {
+        database->begin_staging("Freesat");
+    });
+    scanner.set_streaming_commit(*database, staging_source.c_str());
+
     main_loop = Glib::MainLoop::create();
 
     scanner.finished_signal().connect(sigc::ptr_fun(finished_cb));
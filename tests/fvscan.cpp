@@ -72,12 +72,16 @@ static Glib::RefPtr<Glib::MainLoop> main_loop;
 
 static std::shared_ptr<Sqlite3Database> database;
 
+// Name used to refer to the staging copy of the Freeview tables
+static std::string staging_source;
+
 static const char *network_name;
 
 static void lcn_fn()
 {
     g_print("Committed SI data to database\n");
-    auto nq = database->get_all_network_ids_query("Freeview");
+    auto nq = database->get_all_network_ids_query(
+            staging_source.c_str());
     auto nws = database->run_query(nq);
     if (!nws.size())
     {
@@ -110,7 +114,7 @@ static void lcn_fn()
     g_print("Processing LCNs for network '%s'\n", nn.c_str());
             
     FreeviewLCNProcessor lp(*database);
-    lp.process("Freeview", nn, "");
+    lp.process(staging_source.c_str(), nn, "");
 }
 
 static void finished_cb(MultiScanner &scanner, MultiScanner::Status status)
@@ -135,8 +139,16 @@ static void finished_cb(MultiScanner &scanner, MultiScanner::Status status)
     {
         // Use shared_ptr to keep db alive in its own thread
         // when we exit this scope. Scanner is kept alive in main().
-        scanner.commit_to_database(*database, "Freeview");
+        // Most of the data has already been streamed to the staging tables
+        // during the scan; the published data is only replaced when the
+        // whole commit, including LCNs, is done.
+        scanner.commit_to_database(*database, staging_source.c_str());
         database->queue_function(lcn_fn);
+        database->queue_function([]()
+        {
+            database->publish_staging("Freeview");
+            g_print("Published scan data\n");
+        });
         database->queue_callback([]()
         {
             database.reset();
@@ -177,6 +189,14 @@ int main(int argc, char **argv)
         std::shared_ptr<SingleChannelScanner> { new FreeviewChannelScanner() },
         std::shared_ptr<DvbtTuningIterator> { new DvbtTuningIterator() } };
 
+    // Write each channel's data while the next one is being scanned
+    staging_source = database->staging_source("Freeview");
+    database->queue_function([]()
+    {
+        database->begin_staging("Freeview");
+    });
+    scanner.set_streaming_commit(*database, staging_source.c_str());
+
     main_loop = Glib::MainLoop::create();
 
     scanner.finished_signal().connect(sigc::ptr_fun(finished_cb));
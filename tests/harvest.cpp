@@ -0,0 +1,161 @@
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/*
+ * Checks MultiScanner::check_harvest's handling of each CheckHarvestPolicy
+ * as transports and services are discovered and scanned. Exits with status 1
+ * if any check fails.
+ */
+
+#include "scan/multi-scanner.h"
+#include "scan/single-channel-scanner.h"
+
+#include "check.h"
+
+using namespace logi;
+
+class PolicyScanner : public SingleChannelScanner
+{
+public:
+    PolicyScanner(CheckHarvestPolicy policy) : policy_(policy)
+    {}
+
+    virtual CheckHarvestPolicy check_harvest_policy() const override
+    {
+        return policy_;
+    }
+private:
+    CheckHarvestPolicy policy_;
+};
+
+/// There's no receiver, so MultiScanner mustn't find anything to tune
+class EmptyIterator : public TuningIterator
+{
+public:
+    virtual TuningProperties next() override
+    {
+        return TuningProperties();
+    }
+
+    virtual void reset() override
+    {}
+};
+
+static std::unique_ptr<MultiScanner>
+new_scanner(SingleChannelScanner::CheckHarvestPolicy policy)
+{
+    return std::unique_ptr<MultiScanner>(new MultiScanner(nullptr,
+                std::make_shared<PolicyScanner>(policy),
+                std::make_shared<EmptyIterator>()));
+}
+
+static void test_blank()
+{
+    g_print("No data:\n");
+    auto ms = new_scanner(SingleChannelScanner::SCAN_ALL_DISCOVERED_TS);
+    expect(!ms->check_harvest(), "incomplete");
+    expect(ms->get_status() == MultiScanner::BLANK, "status is BLANK");
+}
+
+static void test_all_discovered_ts()
+{
+    g_print("SCAN_ALL_DISCOVERED_TS:\n");
+    auto ms = new_scanner(SingleChannelScanner::SCAN_ALL_DISCOVERED_TS);
+    auto &ts1 = ms->get_transport_stream_data(1, 1);
+    ms->get_service_data(1, 1);
+    expect(!ms->check_harvest(), "incomplete with a pending transport");
+    expect(ms->get_status() == MultiScanner::PARTIAL, "status is PARTIAL");
+
+    ts1.set_scan_status(TransportStreamData::SCANNED);
+    expect(ms->check_harvest(), "complete when transport is scanned");
+    expect(ms->get_status() == MultiScanner::COMPLETE, "status is COMPLETE");
+
+    // Looking up an existing transport mustn't count it again
+    ms->get_transport_stream_data(1, 1);
+    expect(ms->check_harvest(), "still complete after looking it up again");
+
+    ts1.set_scan_status(TransportStreamData::PENDING);
+    expect(!ms->check_harvest(), "incomplete when reset to pending");
+    ts1.set_scan_status(TransportStreamData::FAILED);
+    expect(ms->check_harvest(), "complete when transport failed");
+
+    auto &ts2 = ms->get_transport_stream_data(1, 2);
+    expect(!ms->check_harvest(), "incomplete when another is discovered");
+    ts2.set_scan_status(TransportStreamData::SCANNED);
+    ts2.set_scan_status(TransportStreamData::SCANNED);
+    expect(ms->check_harvest(), "complete when both are done");
+}
+
+static void test_find_all_services()
+{
+    g_print("FIND_ALL_SERVICES:\n");
+    auto ms = new_scanner(SingleChannelScanner::FIND_ALL_SERVICES);
+    ms->get_transport_stream_data(1, 1);
+    auto &s1 = ms->get_service_data(1, 1);
+    auto &s2 = ms->get_service_data(1, 2);
+    expect(!ms->check_harvest(), "incomplete with no services found");
+    s1.set_scanned();
+    expect(!ms->check_harvest(), "incomplete with one service missing");
+    s2.set_scanned();
+    expect(ms->check_harvest(), "complete when all services are found");
+    s2.set_scanned();
+    ms->get_service_data(1, 2);
+    expect(ms->check_harvest(), "still complete after repeats");
+    ms->get_service_data(2, 1);
+    expect(!ms->check_harvest(), "incomplete when another is referenced");
+}
+
+static void test_at_least_2()
+{
+    g_print("SCAN_AT_LEAST_2:\n");
+    auto ms = new_scanner(SingleChannelScanner::SCAN_AT_LEAST_2);
+    ms->get_transport_stream_data(1, 1);
+    ms->get_service_data(1, 1);
+    expect(!ms->check_harvest(), "incomplete after no scans");
+    ms->channel_finished(true);
+    expect(!ms->check_harvest(), "incomplete after 1 scan");
+    ms->channel_finished(false);
+    expect(!ms->check_harvest(), "failed scans don't count");
+    ms->channel_finished(true);
+    expect(ms->check_harvest(), "complete after 2 scans");
+}
+
+static void test_combined()
+{
+    g_print("SCAN_ALL_DISCOVERED_TS | FIND_ALL_SERVICES:\n");
+    auto ms = new_scanner(SingleChannelScanner::CheckHarvestPolicy
+            (SingleChannelScanner::SCAN_ALL_DISCOVERED_TS |
+             SingleChannelScanner::FIND_ALL_SERVICES));
+    auto &ts = ms->get_transport_stream_data(1, 1);
+    auto &s = ms->get_service_data(1, 1);
+    ts.set_scan_status(TransportStreamData::SCANNED);
+    expect(!ms->check_harvest(), "incomplete with a service missing");
+    s.set_scanned();
+    expect(ms->check_harvest(), "complete when both are satisfied");
+}
+
+int main()
+{
+    test_blank();
+    test_all_discovered_ts();
+    test_find_all_services();
+    test_at_least_2();
+    test_combined();
+    return check_summary();
+}
@@ -0,0 +1,289 @@
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/*
+ * Benchmarks TuningImporter on a synthetic file mixing zap, VDR and dvbv5
+ * formats, with many channels per transport as in real files, and checks
+ * that the expected transports were loaded.
+ * Usage: importbench [FILE...]
+ * If files are given they're imported instead and their stats are shown.
+ */
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include <unistd.h>
+
+#include "scan/list-tuning-iterator.h"
+#include "scan/tuning-importer.h"
+
+#include "check.h"
+
+using namespace logi;
+
+static const unsigned CHANNELS_PER_TS = 50;
+static const unsigned ZAP_T_TS = 24;
+static const unsigned VDR_T_TS = 16;
+static const unsigned DVBV5_T_TS = 8;
+static const unsigned ZAP_S_TS = 25;
+static const unsigned VDR_S_TS = 25;
+static const unsigned DVBV5_S_TS = 20;
+static const unsigned REPEATS = 20;
+
+static unsigned uhf_mhz(unsigned chan)
+{
+    return chan * 8 + 306;
+}
+
+static void appendf(std::string &s, const char *fmt, ...)
+{
+    char buf[512];
+    va_list args;
+    va_start(args, fmt);
+    std::vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    s += buf;
+}
+
+static std::string build_data()
+{
+    std::string s;
+    unsigned sid = 1;
+
+    s += "# zap (tzap) DVB-T\n";
+    for (unsigned ts = 0; ts < ZAP_T_TS; ++ts)
+    {
+        for (unsigned c = 0; c < CHANNELS_PER_TS; ++c)
+        {
+            appendf(s, "Channel %u:%u:INVERSION_AUTO:BANDWIDTH_8_MHZ:FEC_2_3:"
+                    "FEC_NONE:QAM_64:TRANSMISSION_MODE_8K:GUARD_INTERVAL_1_32:"
+                    "HIERARCHY_NONE:101:102:%u\n",
+                    sid, uhf_mhz(21 + ts) * 1000000, sid);
+            ++sid;
+        }
+    }
+
+    s += "# szap DVB-S\n";
+    for (unsigned ts = 0; ts < ZAP_S_TS; ++ts)
+    {
+        for (unsigned c = 0; c < CHANNELS_PER_TS; ++c)
+        {
+            appendf(s, "Channel %u:%u:%c:0:27500:101:102:%u\n",
+                    sid, 10720 + ts * 20, ts & 1 ? 'v' : 'h', sid);
+            ++sid;
+        }
+    }
+
+    s += ":VDR group\n";
+    for (unsigned ts = 0; ts < VDR_T_TS; ++ts)
+    {
+        for (unsigned c = 0; c < CHANNELS_PER_TS; ++c)
+        {
+            appendf(s, "Channel %u;Provider:%u:B8C23D12G32M64S0T8Y0:T:27500:"
+                    "101=2:102=eng@3:0:0:%u:9018:%u:0\n",
+                    sid, uhf_mhz(45 + ts), sid, ts + 1);
+            ++sid;
+        }
+    }
+    for (unsigned ts = 0; ts < VDR_S_TS; ++ts)
+    {
+        for (unsigned c = 0; c < CHANNELS_PER_TS; ++c)
+        {
+            appendf(s, "Channel %u;Provider:%u:%cC23M5O35S1:S28.2E:23000:"
+                    "101=2:102=eng@3:0:0:%u:2:%u:0\n",
+                    sid, 11720 + ts * 20, ts & 1 ? 'V' : 'H', sid, 2000 + ts);
+            ++sid;
+        }
+    }
+
+    for (unsigned ts = 0; ts < DVBV5_T_TS; ++ts)
+    {
+        for (unsigned c = 0; c < CHANNELS_PER_TS; ++c)
+        {
+            appendf(s, "[Channel %u]\n"
+                    "\tSERVICE_ID = %u\n"
+                    "\tVIDEO_PID = 101\n"
+                    "\tAUDIO_PID = 102\n"
+                    "\tDELIVERY_SYSTEM = DVBT2\n"
+                    "\tFREQUENCY = %u\n"
+                    "\tBANDWIDTH_HZ = 8000000\n"
+                    "\tCODE_RATE_HP = 2/3\n"
+                    "\tCODE_RATE_LP = NONE\n"
+                    "\tMODULATION = QAM/256\n"
+                    "\tTRANSMISSION_MODE = 32K\n"
+                    "\tGUARD_INTERVAL = 1/128\n"
+                    "\tHIERARCHY = NONE\n"
+                    "\tSTREAM_ID = 0\n"
+                    "\tINVERSION = AUTO\n\n",
+                    sid, sid, uhf_mhz(61 + ts) * 1000000);
+            ++sid;
+        }
+    }
+    for (unsigned ts = 0; ts < DVBV5_S_TS; ++ts)
+    {
+        for (unsigned c = 0; c < CHANNELS_PER_TS; ++c)
+        {
+            appendf(s, "[Channel %u]\n"
+                    "\tSERVICE_ID = %u\n"
+                    "\tDELIVERY_SYSTEM = DVBS2\n"
+                    "\tFREQUENCY = %u\n"
+                    "\tPOLARIZATION = %s\n"
+                    "\tSYMBOL_RATE = 23000000\n"
+                    "\tINNER_FEC = 3/4\n"
+                    "\tMODULATION = PSK/8\n"
+                    "\tROLLOFF = 35\n"
+                    "\tINVERSION = AUTO\n\n",
+                    sid, sid, (12220 + ts * 20) * 1000,
+                    ts & 1 ? "VERTICAL" : "HORIZONTAL");
+            ++sid;
+        }
+    }
+
+    // These should be rejected
+    s += "Cable;Provider:314:M64:C:6900:101:102:0:0:1:1:1:0\n";
+    s += "Not a tuning line\n";
+
+    return s;
+}
+
+static unsigned expected_channels()
+{
+    return (ZAP_T_TS + ZAP_S_TS + VDR_T_TS + VDR_S_TS +
+            DVBV5_T_TS + DVBV5_S_TS) * CHANNELS_PER_TS;
+}
+
+static unsigned expected_transports()
+{
+    return ZAP_T_TS + ZAP_S_TS + VDR_T_TS + VDR_S_TS + DVBV5_T_TS + DVBV5_S_TS;
+}
+
+static void print_stats(const TuningImporter::Stats &stats)
+{
+    g_print("%u lines, %u tunings, %u duplicates, %u rejected "
+            "in %.2fms: %.0f lines/s\n",
+            stats.lines, stats.tunings, stats.duplicates, stats.rejected,
+            stats.seconds * 1000, stats.lines_per_second());
+}
+
+static void check(const TuningImporter &imp)
+{
+    const auto &stats = imp.get_stats();
+    const auto &entries = imp.get_entries();
+    expect(stats.tunings == expected_transports(),
+            "one tuning per transport");
+    expect(stats.duplicates == expected_channels() - expected_transports(),
+            "other channels are duplicates");
+    expect(stats.rejected == 2, "cable and garbage lines are rejected");
+
+    TuningProperties zap_t("T 474000000 8MHz 2/3 NONE QAM64 8K 1/32 NONE");
+    expect(entries.size() && entries[0].tuning == zap_t &&
+            entries[0].tuning.linuxtv_description() ==
+                zap_t.linuxtv_description(),
+            "zap DVB-T matches the equivalent scan table line");
+
+    TuningProperties zap_s("S1 10720000 H 27500000 AUTO");
+    auto &e = entries[ZAP_T_TS];
+    expect(e.tuning == zap_s, "szap DVB-S matches");
+
+    auto &vdr = entries[ZAP_T_TS + ZAP_S_TS];
+    expect(vdr.original_network_id == 9018 && vdr.transport_stream_id == 1,
+            "VDR entries have network and transport ids");
+
+    ListTuningIterator iter(imp.get_tunings());
+    unsigned n = 0;
+    while (iter.next())
+        ++n;
+    expect(n == expected_transports(), "iterator yields every tuning");
+}
+
+/// Each PLP of a T2 channel is a separate transport
+static void check_plps()
+{
+    std::string s;
+    for (unsigned plp: { 0, 1, 1 })
+    {
+        appendf(s, "[Channel PLP %u]\n"
+                "\tSERVICE_ID = %u\n"
+                "\tDELIVERY_SYSTEM = DVBT2\n"
+                "\tFREQUENCY = %u\n"
+                "\tBANDWIDTH_HZ = 8000000\n"
+                "\tSTREAM_ID = %u\n\n",
+                plp, plp + 1, uhf_mhz(30) * 1000000, plp);
+    }
+    TuningImporter imp;
+    imp.import_data(s.data(), s.size());
+    const auto &stats = imp.get_stats();
+    const auto &entries = imp.get_entries();
+    expect(stats.tunings == 2 && stats.duplicates == 1 &&
+            entries.size() == 2 &&
+            entries[0].tuning.get_scan_key() !=
+                entries[1].tuning.get_scan_key(),
+            "T2 PLPs on the same frequency aren't duplicates");
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1)
+    {
+        TuningImporter imp;
+        for (int n = 1; n < argc; ++n)
+            imp.import_file(argv[n]);
+        print_stats(imp.get_stats());
+        return 0;
+    }
+
+    auto data = build_data();
+
+    // Write it out so that the chunked file reader is tested too
+    char filename[] = "/tmp/logi-importbench-XXXXXX";
+    int fd = mkstemp(filename);
+    if (fd == -1 || write(fd, data.data(), data.size()) != ssize_t(data.size()))
+    {
+        g_critical("Unable to write %s", filename);
+        return 1;
+    }
+    close(fd);
+
+    TuningImporter imp;
+    imp.import_file(filename);
+    unlink(filename);
+    g_print("From file (%zu bytes):\n", data.size());
+    print_stats(imp.get_stats());
+    check(imp);
+    check_plps();
+
+    TuningImporter::Stats total;
+    for (unsigned r = 0; r < REPEATS; ++r)
+    {
+        TuningImporter mem;
+        mem.import_data(data.data(), data.size());
+        const auto &stats = mem.get_stats();
+        total.lines += stats.lines;
+        total.tunings += stats.tunings;
+        total.duplicates += stats.duplicates;
+        total.rejected += stats.rejected;
+        total.seconds += stats.seconds;
+    }
+    g_print("From memory, %u runs:\n", REPEATS);
+    print_stats(total);
+
+    return check_summary();
+}
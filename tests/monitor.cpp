@@ -0,0 +1,385 @@
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/*
+ * Checks the version tracking that SI monitor mode relies on: repeats of
+ * unchanged tables aren't parsed, a new version of one transport's SDT is
+ * parsed without disturbing the others, and the resulting changes show up in
+ * the scanner's data. Then runs a monitor against a database seeded by an
+ * earlier scan and checks what it writes and reports when new versions of the
+ * actual SDT and NIT arrive. Exits with status 1 if any check fails.
+ */
+
+#include <chrono>
+#include <cstring>
+#include <future>
+#include <set>
+
+#include <glibmm/main.h>
+
+#include "db/logi-sqlite.h"
+#include "scan/multi-scanner.h"
+#include "scan/sdt-processor.h"
+#include "scan/single-channel-scanner.h"
+
+#include "check.h"
+#include "synth-section.h"
+
+using namespace logi;
+
+constexpr unsigned NUM_TRANSPORTS = 3;
+constexpr unsigned SERVICES_PER_TS = 4;
+constexpr std::uint16_t ORIG_NETWORK_ID = 0x233a;
+
+static std::uint16_t service_id(unsigned ts, unsigned n)
+{
+    return std::uint16_t(0x1000 + ts * SERVICES_PER_TS + n);
+}
+
+/// provider0 overrides the first service's provider name
+static std::shared_ptr<SDTSection> build_sdt(unsigned ts, unsigned version,
+        const char *rename = nullptr,
+        std::uint8_t table_id = Section::OTHER_SDT_TABLE,
+        const char *provider0 = nullptr)
+{
+    auto sec = std::make_shared<SynthSection<SDTSection>>();
+    auto &v = sec->bytes();
+    v.push_back(table_id);
+    put16(v, 0);
+    put16(v, ts + 1);
+    v.push_back(0xc1 | (version << 1));
+    v.push_back(0);
+    v.push_back(0);
+    put16(v, ORIG_NETWORK_ID);
+    v.push_back(0xff);
+
+    for (unsigned n = 0; n < SERVICES_PER_TS; ++n)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "Channel %u", ts * SERVICES_PER_TS + n);
+        const char *nm = (rename && n == 0) ? rename : name;
+        const char *provider = (provider0 && n == 0) ?
+            provider0 : "Broadcaster";
+        unsigned dlen = 3 + std::strlen(provider) + std::strlen(nm);
+
+        put16(v, service_id(ts, n));
+        v.push_back(0xfd);
+        put16(v, 0x8000 | (dlen + 2));
+        v.push_back(Descriptor::SERVICE);
+        v.push_back(std::uint8_t(dlen));
+        v.push_back(1);
+        put_string(v, provider);
+        put_string(v, nm);
+    }
+
+    finish_section(v);
+    return sec;
+}
+
+constexpr std::uint16_t NETWORK_ID = 0x3005;
+
+/// An actual NIT describing transport stream ts on frequency
+static std::shared_ptr<NITSection> build_nit(unsigned ts, unsigned version,
+        std::uint32_t frequency)
+{
+    auto sec = std::make_shared<SynthSection<NITSection>>();
+    auto &v = sec->bytes();
+    v.insert(v.end(), { Section::NIT_TABLE, 0, 0 });
+    put16(v, NETWORK_ID);
+    v.insert(v.end(), { std::uint8_t(0xc1 | (version << 1)), 0, 0 });
+    const char *name = "Test Network";
+    put16(v, 0xf000 | (std::strlen(name) + 2));
+    v.push_back(Descriptor::NETWORK_NAME);
+    put_string(v, name);
+    put16(v, 0xf000 | 19);
+    put16(v, ts + 1);
+    put16(v, ORIG_NETWORK_ID);
+    put16(v, 0xf000 | 13);
+    v.insert(v.end(), { Descriptor::TERRESTRIAL_DELIVERY_SYSTEM, 11 });
+    put16(v, (frequency / 10) >> 16);
+    put16(v, frequency / 10);
+    v.insert(v.end(), { 0x1f, 0x82, 0x41, 0xff, 0xff, 0xff, 0xff });
+    finish_section(v);
+    return sec;
+}
+
+/// There's no receiver, so MultiScanner mustn't find anything to tune
+class EmptyIterator : public TuningIterator
+{
+public:
+    virtual TuningProperties next() override
+    {
+        return TuningProperties();
+    }
+
+    virtual void reset() override
+    {}
+};
+
+/// Fed sections directly instead of opening filters on a receiver
+class DirectChannelScanner : public SingleChannelScanner
+{
+public:
+    std::vector<std::pair<std::uint16_t, std::uint8_t>>
+        nit_rearms, sdt_rearms;
+
+    void feed_nit(std::shared_ptr<NITSection> section)
+    {
+        nit_filter_cb(0, section);
+    }
+
+    void feed_sdt(std::shared_ptr<SDTSection> section)
+    {
+        this_sdt_filter_cb(0, section);
+    }
+protected:
+    virtual void open_filters() override
+    {}
+
+    virtual void rearm_nit_filter(std::uint16_t network_id,
+            std::uint8_t version) override
+    {
+        nit_rearms.emplace_back(network_id, version);
+    }
+
+    virtual void rearm_this_sdt_filter(std::uint16_t ts_id,
+            std::uint8_t version) override
+    {
+        sdt_rearms.emplace_back(ts_id, version);
+    }
+};
+
+/// Returns the number of sections which were parsed rather than skipped
+static unsigned feed(const std::vector<std::shared_ptr<SDTSection>> &sdts,
+        MultiScanner &ms, SDTProcessor &proc)
+{
+    unsigned parsed = 0;
+    for (const auto &sec: sdts)
+    {
+        auto result = proc.process(sec, &ms);
+        if (result == TableTracker::OK || result == TableTracker::COMPLETE)
+            ++parsed;
+    }
+    return parsed;
+}
+
+using id_t = Database::id_t;
+
+constexpr const char *SOURCE = "monitor";
+constexpr id_t STALE_TUNING_KEY = 999;
+
+static void seed_database(Sqlite3Database &db)
+{
+    db.run_statement(db.get_insert_provider_name_statement(SOURCE),
+            Database::Vector<id_t, Glib::ustring>{
+                { 1, "Other Broadcaster" }, { 2, "Broadcaster" } });
+    db.run_statement(db.get_insert_service_provider_id_statement(SOURCE),
+            Database::Vector<id_t, id_t, id_t>{
+                { ORIG_NETWORK_ID, service_id(0, 0), 2 },
+                { ORIG_NETWORK_ID, service_id(2, 0), 1 } });
+    db.run_statement(db.get_insert_service_name_statement(SOURCE),
+            Database::Vector<id_t, id_t, Glib::ustring>{
+                { ORIG_NETWORK_ID, service_id(0, 0), "Channel 0" },
+                { ORIG_NETWORK_ID, service_id(2, 0), "Channel 8" } });
+    db.run_statement(db.get_insert_tuning_statement(SOURCE),
+            Database::Vector<id_t, id_t, id_t, id_t, id_t>{
+                { ORIG_NETWORK_ID, 1, NETWORK_ID, DTV_FREQUENCY, 498000000 },
+                { ORIG_NETWORK_ID, 1, NETWORK_ID, STALE_TUNING_KEY, 1 },
+                { ORIG_NETWORK_ID, 2, NETWORK_ID, DTV_FREQUENCY, 506000000 }
+            });
+}
+
+/// Runs the main loop until done is set or a few seconds have passed
+static void run_until(const bool &done)
+{
+    auto ctx = Glib::MainContext::get_default();
+    auto deadline = std::chrono::steady_clock::now() +
+        std::chrono::seconds(5);
+    while (!done && std::chrono::steady_clock::now() < deadline)
+        ctx->iteration(true);
+}
+
+/// Returns the results of sql, which must have two integer columns
+static std::set<std::pair<id_t, id_t>> query_pairs(Sqlite3Database &db,
+        const std::string &sql)
+{
+    std::promise<std::set<std::pair<id_t, id_t>>> result;
+    db.queue_function([&]()
+    {
+        std::set<std::pair<id_t, id_t>> pairs;
+        for (const auto &row:
+                db.compile_sql_query<Database::Vector<id_t, id_t>>(sql)
+                    ->query({}))
+        {
+            pairs.emplace(std::get<0>(row), std::get<1>(row));
+        }
+        result.set_value(std::move(pairs));
+    });
+    return result.get_future().get();
+}
+
+static void test_monitor_database()
+{
+    Sqlite3Database db(":memory:");
+    db.start();
+    db.ensure_tables(SOURCE);
+    db.queue_function([&db]() { seed_database(db); });
+
+    auto scanner = std::make_shared<DirectChannelScanner>();
+    MultiScanner ms(nullptr, scanner, std::make_shared<EmptyIterator>());
+    std::vector<MultiScanner::MonitorChanges> changes;
+    ms.changed_signal().connect([&changes](MultiScanner &,
+                const MultiScanner::MonitorChanges &c)
+    {
+        changes.push_back(c);
+    });
+    ms.start_monitor(db, SOURCE);
+    expect(ms.is_monitoring(), "monitor starts without a receiver");
+
+    // Each table is sent twice, and the repeat should rearm its filter
+    auto sdt = build_sdt(0, 3, "Renamed", Section::SDT_TABLE, "New Provider");
+    scanner->feed_sdt(sdt);
+    scanner->feed_sdt(sdt);
+    const std::uint32_t frequency = 530000000;
+    auto nit = build_nit(0, 7, frequency);
+    scanner->feed_nit(nit);
+    scanner->feed_nit(nit);
+
+    bool changed = false;
+    auto conn = ms.changed_signal().connect([&changed](MultiScanner &,
+                const MultiScanner::MonitorChanges &)
+    {
+        changed = true;
+    });
+    run_until(changed);
+    conn.disconnect();
+
+    expect(changes.size() == 1, "changes are written in one batch");
+    if (changes.size())
+    {
+        const auto &c = changes[0];
+        std::vector<std::uint32_t> services;
+        for (unsigned n = 0; n < SERVICES_PER_TS; ++n)
+            services.push_back((ORIG_NETWORK_ID << 16) | service_id(0, n));
+        expect(c.services == services,
+                "MonitorChanges lists the new SDT's services");
+        expect(c.transports == std::vector<std::uint32_t>
+                    { (ORIG_NETWORK_ID << 16) | 1 },
+                "MonitorChanges lists the retuned transport");
+        expect(c.networks == 1, "MonitorChanges counts the renamed network");
+    }
+    expect(scanner->sdt_rearms ==
+                decltype(scanner->sdt_rearms) { { 1, 3 } },
+            "SDT filter rearmed for a version other than 3");
+    expect(scanner->nit_rearms ==
+                decltype(scanner->nit_rearms) { { NETWORK_ID, 7 } },
+            "NIT filter rearmed for a version other than 7");
+
+    std::string table_prefix = std::string(SOURCE) + '_';
+    auto providers = query_pairs(db,
+            "SELECT provider_id, provider_name = 'New Provider' FROM " +
+            table_prefix + "provider_names");
+    expect(providers == std::set<std::pair<id_t, id_t>>
+                { { 1, 0 }, { 2, 0 }, { 3, 1 } },
+            "existing provider ids kept and a new one appended");
+    auto serv_provs = query_pairs(db,
+            "SELECT service_id, provider_id FROM " + table_prefix +
+            "service_provider_id");
+    std::set<std::pair<id_t, id_t>> expected_provs
+        { { service_id(0, 0), 3 }, { service_id(2, 0), 1 } };
+    for (unsigned n = 1; n < SERVICES_PER_TS; ++n)
+        expected_provs.emplace(service_id(0, n), 2);
+    expect(serv_provs == expected_provs,
+            "service providers refer to the database's ids");
+
+    auto tuning = query_pairs(db,
+            "SELECT tuning_key, tuning_val FROM " + table_prefix +
+            "tuning WHERE transport_stream_id = 1");
+    std::set<std::pair<id_t, id_t>> expected_tuning;
+    for (const auto &prop: ms.get_transport_stream_data(ORIG_NETWORK_ID, 1)
+            .get_tuning())
+    {
+        expected_tuning.emplace(prop.cmd, prop.data);
+    }
+    expect(tuning == expected_tuning &&
+                tuning.count({ DTV_FREQUENCY, frequency }),
+            "a retuned transport's rows are replaced");
+    expect(query_pairs(db, "SELECT tuning_key, tuning_val FROM " +
+                table_prefix + "tuning WHERE transport_stream_id = 2") ==
+                std::set<std::pair<id_t, id_t>>
+                    { { DTV_FREQUENCY, 506000000 } },
+            "other transports' tuning is untouched");
+
+    auto names = query_pairs(db,
+            "SELECT service_id, name = 'Renamed' FROM " + table_prefix +
+            "service_names WHERE service_id IN (" +
+            std::to_string(service_id(0, 0)) + ", " +
+            std::to_string(service_id(2, 0)) + ")");
+    expect(names == std::set<std::pair<id_t, id_t>>
+                { { service_id(0, 0), 1 }, { service_id(2, 0), 0 } },
+            "service names updated and others kept");
+
+    // A repeat of the same versions after rearming changes nothing
+    scanner->feed_sdt(sdt);
+    scanner->feed_nit(nit);
+    auto ctx = Glib::MainContext::get_default();
+    while (ctx->iteration(false));
+    ms.stop_monitor();
+    expect(changes.size() == 1, "repeated versions cause no more writes");
+}
+
+int main()
+{
+    MultiScanner ms(nullptr, std::make_shared<SingleChannelScanner>(),
+            std::make_shared<EmptyIterator>());
+    SDTProcessor proc;
+    std::vector<std::shared_ptr<SDTSection>> sdts;
+    for (unsigned ts = 0; ts < NUM_TRANSPORTS; ++ts)
+        sdts.push_back(build_sdt(ts, 5));
+
+    expect(feed(sdts, ms, proc) == NUM_TRANSPORTS,
+            "first pass parses every sub-table");
+    unsigned parsed = 0;
+    for (unsigned n = 0; n < 100; ++n)
+        parsed += feed(sdts, ms, proc);
+    expect(parsed == 0, "repeats of unchanged tables aren't parsed");
+
+    sdts[1] = build_sdt(1, 6, "Renamed");
+    expect(feed(sdts, ms, proc) == 1,
+            "only the changed sub-table is parsed");
+    expect(ms.get_service_data(ORIG_NETWORK_ID, service_id(1, 0)).get_name()
+            == "Renamed", "the change reaches the scanner's data");
+    expect(feed(sdts, ms, proc) == 0, "the new version's repeats are skipped");
+
+    // Versions are modulo 32, and a different version of a table which was
+    // complete must be newer even if the number is lower
+    sdts[2] = build_sdt(2, 1, "Wrapped");
+    expect(feed(sdts, ms, proc) == 1 &&
+            ms.get_service_data(ORIG_NETWORK_ID, service_id(2, 0)).get_name()
+                == "Wrapped",
+            "a lower version of a complete table is a new version");
+
+    proc.process(build_sdt(0, 4, "Lower"), &ms);
+    expect(ms.get_service_data(ORIG_NETWORK_ID, service_id(0, 0)).get_name()
+            == "Lower", "a completed table accepts any different version");
+
+    test_monitor_database();
+
+    return check_summary();
+}
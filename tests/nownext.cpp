@@ -0,0 +1,214 @@
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/*
+ * Checks NowNextTracker's in-place updates and change notifications over a
+ * sequence of programme boundaries, and measures the cost of repeated
+ * sections. Exits with status 1 if any check fails.
+ */
+
+#include <chrono>
+#include <cstring>
+
+#include "epg/now-next-tracker.h"
+
+#include "check.h"
+#include "synth-eit.h"
+
+using namespace logi;
+
+constexpr unsigned NUM_SERVICES = 200;
+constexpr unsigned REPEATS = 500;
+constexpr std::uint16_t ORIG_NETWORK_ID = 2;
+constexpr std::uint16_t TS_ID = 2041;
+constexpr std::uint16_t OTHER_TS_ID = 2042;
+// 2017-06-01 00:00:00 UTC
+constexpr std::time_t START_TIME = 1496275200;
+
+static Glib::ustring title_of(unsigned n)
+{
+    char title[32];
+    snprintf(title, sizeof(title), "Programme %u", n);
+    return title;
+}
+
+/// Programme @n starts at n half hours after START_TIME. If @n is negative
+/// the section has no event.
+static EITPtr make_pf(std::uint8_t table_id, std::uint16_t ts_id,
+        std::uint16_t service_id, unsigned version, unsigned section_number,
+        int n, unsigned running_status = 1)
+{
+    auto sec = std::make_shared<SynthEIT>();
+    auto &v = sec->bytes();
+    start_eit_section(v, table_id, service_id, ts_id, ORIG_NETWORK_ID,
+            version, section_number, 1, 1, table_id);
+    if (n >= 0)
+    {
+        auto o = start_event(v, n, START_TIME + n * 1800, 1800,
+                running_status);
+        put_short_event(v, title_of(n).c_str(), "");
+        end_event(v, o);
+    }
+    finish_section(v);
+    return sec;
+}
+
+/// p/f sections for every service, with programme @n on now
+static std::vector<EITPtr> build_pf(unsigned version, int n)
+{
+    std::vector<EITPtr> secs;
+    for (unsigned svc = 0; svc < NUM_SERVICES; ++svc)
+    {
+        for (unsigned s = 0; s < 2; ++s)
+        {
+            secs.push_back(make_pf(Section::EIT_PF_TABLE, TS_ID,
+                        0x2000 + svc, version, s, n + s));
+        }
+    }
+    return secs;
+}
+
+struct Change
+{
+    NowNextTracker::ServiceKey service;
+    unsigned what;
+    Glib::ustring present;
+    Glib::ustring following;
+};
+
+static void test_updates()
+{
+    g_print("Updates:\n");
+    NowNextTracker tracker;
+    std::vector<Change> changes;
+    tracker.changed_signal().connect(
+            [&changes](const NowNextTracker::Slot &slot, unsigned what)
+    {
+        changes.push_back({ NowNextTracker::service_key(
+                    slot.original_network_id, slot.transport_stream_id,
+                    slot.service_id), what,
+                slot.present.title, slot.following.title });
+    });
+
+    for (auto &sec: build_pf(3, 10))
+        tracker.process_section(*sec);
+    expect(tracker.slots().size() == NUM_SERVICES, "a slot per service");
+    expect(changes.size() == NUM_SERVICES * 2, "first sections notify");
+    auto key = NowNextTracker::service_key(ORIG_NETWORK_ID, TS_ID, 0x2005);
+    auto slot = tracker.find(key);
+    expect(slot && slot->present.valid && slot->following.valid &&
+            slot->present.title == title_of(10) &&
+            slot->following.title == title_of(11) &&
+            slot->present.start == START_TIME + 10 * 1800 &&
+            slot->present.duration == 1800,
+            "present and following events are decoded");
+
+    changes.clear();
+    auto updates = tracker.stats().updates;
+    for (auto &sec: build_pf(3, 10))
+        tracker.process_section(*sec);
+    expect(changes.empty() && tracker.stats().updates == updates,
+            "repeated sections are ignored");
+
+    // Running status changes on the following event
+    changes.clear();
+    tracker.process_section(*make_pf(Section::EIT_PF_TABLE, TS_ID, 0x2005,
+                4, 1, 11, 2));
+    expect(changes.size() == 1 &&
+            changes[0].what == NowNextTracker::FOLLOWING &&
+            tracker.find(key)->following.running_status == 2 &&
+            tracker.find(key)->following.title == title_of(11),
+            "running status change updates the slot in place");
+    tracker.process_section(*make_pf(Section::EIT_PF_TABLE, TS_ID, 0x2005,
+                4, 0, 10));
+    expect(changes.size() == 1,
+            "unchanged event in a new version doesn't notify");
+
+    // Programme boundary
+    changes.clear();
+    tracker.process_section(*make_pf(Section::EIT_PF_TABLE, TS_ID, 0x2005,
+                5, 0, 11));
+    tracker.process_section(*make_pf(Section::EIT_PF_TABLE, TS_ID, 0x2005,
+                5, 1, 12));
+    expect(changes.size() == 2 &&
+            changes[0].what == NowNextTracker::PRESENT &&
+            changes[0].present == title_of(11) &&
+            changes[1].what == NowNextTracker::FOLLOWING &&
+            changes[1].following == title_of(12) &&
+            changes[1].service == key,
+            "programme boundary notifies present then following");
+
+    // Close down
+    changes.clear();
+    tracker.process_section(*make_pf(Section::EIT_PF_TABLE, TS_ID, 0x2005,
+                6, 1, -1));
+    expect(changes.size() == 1 && !tracker.find(key)->following.valid &&
+            tracker.find(key)->present.valid,
+            "empty section clears the event");
+
+    // Another multiplex's p/f
+    tracker.process_section(*make_pf(Section::OTHER_EIT_PF_TABLE,
+                OTHER_TS_ID, 0x2005, 0, 0, 20));
+    auto other = tracker.find(NowNextTracker::service_key(ORIG_NETWORK_ID,
+                OTHER_TS_ID, 0x2005));
+    expect(other && other->present.title == title_of(20) &&
+            tracker.slots().size() == NUM_SERVICES + 1,
+            "other multiplexes' p/f tables are tracked");
+
+    tracker.clear();
+    expect(tracker.slots().empty() &&
+            !tracker.find(key), "clear forgets services");
+}
+
+static void test_cost()
+{
+    g_print("Cost of a repeated carousel:\n");
+    NowNextTracker tracker;
+    unsigned changes = 0;
+    tracker.changed_signal().connect(
+            [&changes](const NowNextTracker::Slot &, unsigned)
+    {
+        ++changes;
+    });
+    auto secs = build_pf(7, 30);
+    for (auto &sec: secs)
+        tracker.process_section(*sec);
+
+    auto t0 = std::chrono::steady_clock::now();
+    for (unsigned r = 0; r < REPEATS; ++r)
+    {
+        for (auto &sec: secs)
+            tracker.process_section(*sec);
+    }
+    double ns = std::chrono::duration<double, std::nano>(
+            std::chrono::steady_clock::now() - t0).count() /
+        (REPEATS * secs.size());
+    g_print("%.1f ns per repeated section\n", ns);
+    expect(changes == secs.size(), "repeats don't notify");
+    expect(tracker.stats().updates == secs.size() &&
+            tracker.stats().sections == secs.size() * (REPEATS + 1),
+            "repeats are counted but not decoded");
+}
+
+int main()
+{
+    test_updates();
+    test_cost();
+    return check_summary();
+}
@@ -0,0 +1,190 @@
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/*
+ * Replays a synthetic EIT capture from several multiplexes through
+ * EITHarvester, decoding on the main thread and then with EITParserPool on
+ * increasing numbers of workers. Checks that every run delivers the same
+ * events in the same order for each service, and prints the throughput.
+ * Usage: parserpool [MAX_WORKERS]
+ * Exits with status 1 if any check fails.
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <thread>
+
+#include "epg/eit-harvester.h"
+#include "epg/eit-parser-pool.h"
+#include "si/decode-cache.h"
+
+#include "check.h"
+#include "synth-eit.h"
+
+using namespace logi;
+
+using Clock = std::chrono::steady_clock;
+
+constexpr unsigned NUM_MUXES = 6;
+constexpr unsigned SERVICES_PER_MUX = 40;
+constexpr unsigned SEGMENTS = 16;
+constexpr unsigned EVENTS_PER_SECTION = 3;
+constexpr std::uint16_t ORIG_NETWORK_ID = 59;
+// 2017-06-01 00:00:00 UTC
+constexpr std::time_t START_TIME = 1496275200;
+
+static std::mt19937 rng(1);
+
+/// Random Freesat-style Huffman string with its length byte
+static void put_huffman(std::vector<std::uint8_t> &v, unsigned len)
+{
+    v.push_back(std::uint8_t(len));
+    v.push_back(0x1f);
+    v.push_back(1);
+    for (unsigned n = 2; n < len; ++n)
+        v.push_back(std::uint8_t(rng()));
+}
+
+static void put_event(std::vector<std::uint8_t> &v, std::uint16_t event_id,
+        std::time_t start)
+{
+    auto o = start_event(v, event_id, start, 1800);
+    unsigned title_len = 10 + rng() % 20;
+    unsigned text_len = 120 + rng() % 80;
+    v.push_back(Descriptor::SHORT_EVENT);
+    v.push_back(std::uint8_t(5 + title_len + text_len));
+    v.insert(v.end(), { 'e', 'n', 'g' });
+    put_huffman(v, title_len);
+    put_huffman(v, text_len);
+    end_event(v, o);
+}
+
+/// Sections in carousel order, multiplexes interleaved as if several
+/// EIT PIDs had been captured at once
+static std::vector<std::shared_ptr<EITSection>> build_capture()
+{
+    std::vector<std::shared_ptr<EITSection>> secs;
+    for (unsigned seg = 0; seg < SEGMENTS; ++seg)
+    {
+        for (unsigned svc = 0; svc < SERVICES_PER_MUX; ++svc)
+        {
+            for (unsigned mux = 0; mux < NUM_MUXES; ++mux)
+            {
+                auto sec = std::make_shared<SynthEIT>();
+                auto &v = sec->bytes();
+                start_eit_section(v, Section::EIT_SCHEDULE_TABLE,
+                        0x1000 + svc, 2000 + mux, ORIG_NETWORK_ID, 0,
+                        seg * 8, (SEGMENTS - 1) * 8, seg * 8,
+                        Section::EIT_SCHEDULE_TABLE);
+                for (unsigned e = 0; e < EVENTS_PER_SECTION; ++e)
+                {
+                    unsigned n = seg * EVENTS_PER_SECTION + e;
+                    put_event(v, std::uint16_t(n), START_TIME + n * 1800);
+                }
+                finish_section(v);
+                secs.push_back(sec);
+            }
+        }
+    }
+    return secs;
+}
+
+using ServiceEvents =
+    std::map<std::uint64_t, std::vector<std::pair<unsigned, std::string>>>;
+
+struct Run
+{
+    ServiceEvents events;
+    double ms;
+    bool complete_after_events;
+};
+
+static Run replay(const std::vector<std::shared_ptr<EITSection>> &secs,
+        unsigned workers)
+{
+    Run run;
+    run.complete_after_events = false;
+    EITHarvester harvester(nullptr);
+    if (workers)
+        harvester.use_parser_pool(workers);
+    std::size_t num_events = 0;
+    harvester.events_signal().connect(
+            [&run, &num_events](const EITSection &sec,
+                const std::vector<EITEvent> &events)
+    {
+        auto key = (std::uint64_t(sec.transport_stream_id()) << 16) |
+            sec.service_id();
+        auto &v = run.events[key];
+        for (const auto &ev: events)
+            v.emplace_back(ev.event_id, ev.title.raw() + ev.summary.raw());
+        num_events += events.size();
+    });
+    harvester.complete_signal().connect([&run, &num_events]()
+    {
+        run.complete_after_events = num_events ==
+            NUM_MUXES * SERVICES_PER_MUX * SEGMENTS * EVENTS_PER_SECTION;
+    });
+
+    DecodeCache::shared().clear();
+    auto t0 = Clock::now();
+    for (const auto &sec: secs)
+        harvester.process_section(sec);
+    if (workers)
+        harvester.parser_pool()->flush();
+    run.ms = std::chrono::duration<double, std::milli>(Clock::now() - t0)
+        .count();
+    return run;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned max_workers = argc > 1 ? std::atoi(argv[1]) : 8;
+    auto secs = build_capture();
+    g_print("%zu sections, %u services\n", secs.size(),
+            NUM_MUXES * SERVICES_PER_MUX);
+
+    auto inline_run = replay(secs, 0);
+    g_print("Main thread: %.0f ms\n", inline_run.ms);
+    expect(inline_run.complete_after_events,
+            "main thread decoding completes after all events");
+
+    {
+        EITHarvester harvester(nullptr);
+        harvester.use_parser_pool();
+        expect(!harvester.parser_pool() ==
+                (std::thread::hardware_concurrency() <= 1),
+                "automatic pool decodes inline with only one CPU");
+    }
+
+    for (unsigned w = 1; w <= max_workers; w *= 2)
+    {
+        auto run = replay(secs, w);
+        g_print("%u worker%s: %.0f ms, x%.2f\n", w, w == 1 ? "" : "s",
+                run.ms, inline_run.ms / run.ms);
+        expect(run.events == inline_run.events,
+                "same events in the same order for each service");
+        expect(run.complete_after_events,
+                "complete is signalled after the last events");
+    }
+
+    return check_summary();
+}
@@ -0,0 +1,171 @@
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/*
+ * Fills a source's tables with a large synthetic data set and checks the
+ * EXPLAIN QUERY PLAN of every query Database exposes, and of the
+ * statements which search for rows to delete. Fails if a query with
+ * arguments scans a whole table instead of searching an index, or if any
+ * query needs a temporary b-tree for sorting.
+ * Usage: queryplan [SERVICES]
+ */
+
+#include <cstdlib>
+#include <future>
+#include <string>
+#include <vector>
+
+#include "db/logi-sqlite.h"
+
+using namespace logi;
+using id_t = Database::id_t;
+
+static const char *SOURCE = "Test";
+
+static void fill_tables(Sqlite3Database &db, unsigned n_services)
+{
+    std::vector<std::tuple<id_t, Glib::ustring>> nw_v;
+    std::vector<std::tuple<id_t, id_t, id_t, id_t>> trans_serv_v;
+    std::vector<std::tuple<id_t, id_t, id_t, id_t, id_t>> serv_id_v;
+    std::vector<std::tuple<id_t, Glib::ustring>> prov_nm_v;
+    std::vector<std::tuple<id_t, id_t, id_t, id_t, id_t>> nw_lcn_v;
+    std::vector<std::tuple<id_t, id_t, Glib::ustring>> region_v;
+
+    for (id_t nw = 1; nw <= 50; ++nw)
+    {
+        nw_v.emplace_back(nw, Glib::ustring::compose("Network %1", nw));
+        for (id_t r = 0; r < 40; ++r)
+        {
+            region_v.emplace_back(nw, r,
+                    Glib::ustring::compose("Region %1/%2", nw, r));
+        }
+    }
+    for (id_t n = 1; n <= n_services / 20; ++n)
+        prov_nm_v.emplace_back(n, Glib::ustring::compose("Provider %1", n));
+    for (id_t n = 0; n < n_services; ++n)
+    {
+        id_t onid = 1 + n % 50;
+        id_t sid = 1 + n;
+        id_t tsid = 1 + n / 10;
+        trans_serv_v.emplace_back(onid, onid, tsid, sid);
+        serv_id_v.emplace_back(onid, sid, tsid, 1, 0);
+        for (id_t r = 0; r < 4; ++r)
+            nw_lcn_v.emplace_back(onid, sid, r, 100 + n % 1000, n);
+    }
+
+    db.run_statement(db.get_insert_network_info_statement(SOURCE), nw_v);
+    db.run_statement(db.get_insert_transport_services_statement(SOURCE),
+            trans_serv_v);
+    db.run_statement(db.get_insert_service_id_statement(SOURCE), serv_id_v);
+    db.run_statement(db.get_insert_provider_name_statement(SOURCE),
+            prov_nm_v);
+    db.run_statement(db.get_insert_network_lcn_statement(SOURCE), nw_lcn_v);
+    db.run_statement(db.get_insert_region_statement(SOURCE), region_v);
+
+    // A week of half-hour programmes on a tenth of the services
+    Database::Vector<id_t, id_t, id_t, id_t, id_t, id_t, id_t, id_t,
+        Glib::ustring, Glib::ustring, Glib::ustring> epg_v;
+    for (id_t n = 0; n < n_services / 10; ++n)
+    {
+        for (id_t e = 0; e < 7 * 48; ++e)
+        {
+            epg_v.emplace_back(1 + n % 50, 1 + n / 10, 1 + n, e,
+                    1500000000 + e * 1800, 1800, 0, 0,
+                    Glib::ustring::compose("Title %1", e), "Summary", "");
+        }
+    }
+    db.run_statement(db.get_insert_epg_event_statement(SOURCE), epg_v);
+    // Let the planner see realistic statistics
+    db.execute("ANALYZE");
+}
+
+/// whole_table is for queries which are expected to read every row
+template<class Ptr>
+static bool check_plan(Sqlite3Database &db, const char *name,
+        const Ptr &query, bool whole_table = false)
+{
+    bool ok = true;
+    g_print("%s:\n", name);
+    for (const auto &step: db.explain_query_plan(query))
+    {
+        bool bad = step.find("TEMP B-TREE") != std::string::npos ||
+            (!whole_table && step.compare(0, 4, "SCAN") == 0);
+        g_print("  %s %s\n", bad ? "FAIL" : "ok  ", step.c_str());
+        if (bad)
+            ok = false;
+    }
+    return ok;
+}
+
+static bool check_plans(Sqlite3Database &db, unsigned n_services)
+{
+    fill_tables(db, n_services);
+
+    bool ok = true;
+    ok = check_plan(db, "get_provider_id_query",
+            db.get_provider_id_query(SOURCE)) && ok;
+    ok = check_plan(db, "get_network_lcns_query",
+            db.get_network_lcns_query(SOURCE), true) && ok;
+    ok = check_plan(db, "get_lcns_for_network_query",
+            db.get_lcns_for_network_query(SOURCE)) && ok;
+    ok = check_plan(db, "get_ids_for_network_lcn_query",
+            db.get_ids_for_network_lcn_query(SOURCE)) && ok;
+    ok = check_plan(db, "get_network_id_for_name_query",
+            db.get_network_id_for_name_query(SOURCE)) && ok;
+    ok = check_plan(db, "get_all_network_ids_query",
+            db.get_all_network_ids_query(SOURCE), true) && ok;
+    ok = check_plan(db, "get_region_code_for_name_and_bouquet_query",
+            db.get_region_code_for_name_and_bouquet_query(SOURCE)) && ok;
+    ok = check_plan(db, "get_regions_for_bouquet_query",
+            db.get_regions_for_bouquet_query(SOURCE)) && ok;
+    ok = check_plan(db,
+            "get_original_network_id_for_network_and_service_id_query",
+            db.get_original_network_id_for_network_and_service_id_query
+                (SOURCE)) && ok;
+    ok = check_plan(db, "get_original_network_id_for_service_id_query",
+            db.get_original_network_id_for_service_id_query(SOURCE)) && ok;
+    ok = check_plan(db, "get_delete_tuning_statement",
+            db.get_delete_tuning_statement(SOURCE)) && ok;
+    ok = check_plan(db, "get_delete_epg_event_statement",
+            db.get_delete_epg_event_statement(SOURCE)) && ok;
+    ok = check_plan(db, "get_delete_old_epg_events_statement",
+            db.get_delete_old_epg_events_statement(SOURCE)) && ok;
+    ok = check_plan(db, "get_epg_events_query",
+            db.get_epg_events_query(SOURCE), true) && ok;
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned n_services = argc > 1 ? std::atoi(argv[1]) : 10000;
+
+    Sqlite3Database db(":memory:");
+    db.start();
+    db.ensure_tables(SOURCE);
+
+    std::promise<bool> result;
+    db.queue_function([&]()
+    {
+        result.set_value(check_plans(db, n_services));
+    });
+    bool ok = result.get_future().get();
+
+    g_print(ok ? "All queries use indexes\n" : "Some queries scan tables\n");
+    return ok ? 0 : 1;
+}
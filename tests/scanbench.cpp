@@ -0,0 +1,162 @@
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/*
+ * Benchmarks MultiScanner's bookkeeping by feeding it the sequence of calls
+ * the NIT/BAT and SDT processors would make for a synthetic network, with
+ * each table seen several times as it is during a real scan. The same
+ * pattern is run against std::map for comparison.
+ * Usage: scanbench [SERVICES [REPEATS]]
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <map>
+
+#include "scan/multi-scanner.h"
+#include "scan/single-channel-scanner.h"
+
+using namespace logi;
+
+using Clock = std::chrono::steady_clock;
+
+static const unsigned SERVICES_PER_TS = 20;
+static const unsigned REGIONS = 4;
+static const unsigned ONIDS = 8;
+
+static std::uint16_t onid_for_ts(unsigned ts)
+{
+    return 1 + ts % ONIDS;
+}
+
+static std::uint16_t sid_for(unsigned ts, unsigned n)
+{
+    return ts * SERVICES_PER_TS + n + 1;
+}
+
+static void feed_scanner(MultiScanner &scanner, unsigned n_services,
+        unsigned repeats)
+{
+    unsigned n_ts = n_services / SERVICES_PER_TS;
+    for (unsigned r = 0; r < repeats; ++r)
+    {
+        // NIT/BAT: service lists and LCNs
+        for (unsigned ts = 0; ts < n_ts; ++ts)
+        {
+            auto onid = onid_for_ts(ts);
+            auto &tsdat = scanner.get_transport_stream_data(onid, ts + 1);
+            tsdat.set_network_id(onid);
+            for (unsigned n = 0; n < SERVICES_PER_TS; ++n)
+            {
+                auto sid = sid_for(ts, n);
+                tsdat.add_service_id(sid);
+                scanner.get_service_data(onid, sid).set_ts_id(ts + 1);
+                for (unsigned reg = 0; reg < REGIONS; ++reg)
+                    scanner.set_lcn(onid, sid, reg, 100 + sid % 900, sid);
+            }
+        }
+        // SDT
+        for (unsigned ts = 0; ts < n_ts; ++ts)
+        {
+            auto onid = onid_for_ts(ts);
+            for (unsigned n = 0; n < SERVICES_PER_TS; ++n)
+            {
+                auto &sdat = scanner.get_service_data(onid, sid_for(ts, n));
+                sdat.set_scanned();
+                sdat.set_service_type(1);
+            }
+        }
+    }
+}
+
+/// The same pattern with the containers MultiScanner used to have
+static std::size_t feed_maps(unsigned n_services, unsigned repeats)
+{
+    std::map<std::uint32_t, std::map<std::uint16_t, bool>> ts_data;
+    std::map<std::uint32_t, ServiceData> service_data;
+    std::map<std::uint64_t, std::uint16_t> lcn_data;
+
+    unsigned n_ts = n_services / SERVICES_PER_TS;
+    for (unsigned r = 0; r < repeats; ++r)
+    {
+        for (unsigned ts = 0; ts < n_ts; ++ts)
+        {
+            std::uint32_t onid = onid_for_ts(ts);
+            auto &tsdat = ts_data[(onid << 16) | (ts + 1)];
+            for (unsigned n = 0; n < SERVICES_PER_TS; ++n)
+            {
+                std::uint32_t sid = sid_for(ts, n);
+                tsdat[sid] = true;
+                service_data[(onid << 16) | sid].set_ts_id(ts + 1);
+                for (std::uint64_t reg = 0; reg < REGIONS; ++reg)
+                {
+                    lcn_data[(std::uint64_t(sid) << 48) | (reg << 32) |
+                        (onid << 16) | sid] = 100 + sid % 900;
+                }
+            }
+        }
+        for (unsigned ts = 0; ts < n_ts; ++ts)
+        {
+            std::uint32_t onid = onid_for_ts(ts);
+            for (unsigned n = 0; n < SERVICES_PER_TS; ++n)
+            {
+                auto &sdat = service_data[(onid << 16) | sid_for(ts, n)];
+                sdat.set_scanned();
+                sdat.set_service_type(1);
+            }
+        }
+    }
+    return ts_data.size() + service_data.size() + lcn_data.size();
+}
+
+template<class F> static double time_ms(F f)
+{
+    auto start = Clock::now();
+    f();
+    std::chrono::duration<double, std::milli> t = Clock::now() - start;
+    return t.count();
+}
+
+int main(int argc, char **argv)
+{
+    unsigned n_services = argc > 1 ? std::atoi(argv[1]) : 10000;
+    unsigned repeats = argc > 2 ? std::atoi(argv[2]) : 10;
+    // Service ids are 16-bit
+    if (n_services > 60000)
+        n_services = 60000;
+
+    auto ms = time_ms([n_services, repeats]()
+    {
+        MultiScanner scanner(nullptr,
+                std::make_shared<SingleChannelScanner>(), nullptr);
+        feed_scanner(scanner, n_services, repeats);
+    });
+    g_print("MultiScanner: %u services x %u repeats in %.2fms\n",
+            n_services, repeats, ms);
+
+    std::size_t check = 0;
+    ms = time_ms([n_services, repeats, &check]()
+    {
+        check = feed_maps(n_services, repeats);
+    });
+    g_print("std::map:     %u services x %u repeats in %.2fms (%lu entries)\n",
+            n_services, repeats, ms, (unsigned long) check);
+
+    return 0;
+}
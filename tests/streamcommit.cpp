@@ -0,0 +1,288 @@
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/*
+ * Runs the same synthetic scan twice, once streaming each channel's results
+ * to the database as it finishes and once committing everything at the end,
+ * checks that both leave identical tables, and reports how long each takes
+ * from the start of the scan until the database is usable. Each channel
+ * spends DWELL ms "waiting for the tuner and filters", which is the time
+ * streaming overlaps with database writes. Exits with status 1 if the
+ * tables differ.
+ * Usage: streamcommit [TRANSPORTS [DWELL]]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <map>
+#include <thread>
+
+#include <sqlite3.h>
+
+#include "db/logi-sqlite.h"
+#include "scan/multi-scanner.h"
+#include "scan/sdt-processor.h"
+#include "scan/single-channel-scanner.h"
+
+#include "check.h"
+#include "synth-section.h"
+
+using namespace logi;
+
+using Clock = std::chrono::steady_clock;
+
+constexpr unsigned SERVICES_PER_TS = 20;
+constexpr unsigned REGIONS = 4;
+constexpr std::uint16_t ORIG_NETWORK_ID = 0x233a;
+constexpr std::uint16_t NETWORK_ID = 0x3005;
+constexpr const char *SOURCE = "scan";
+
+static std::uint16_t service_id(unsigned ts, unsigned n)
+{
+    return std::uint16_t(0x1000 + ts * SERVICES_PER_TS + n);
+}
+
+/// rename overrides the first service's name
+static std::shared_ptr<SDTSection> build_sdt(unsigned ts, unsigned version,
+        std::uint8_t table_id, const char *rename = nullptr)
+{
+    static const char *providers[] = { "BBC", "ITV", "Channel 4" };
+    auto sec = std::make_shared<SynthSection<SDTSection>>();
+    auto &v = sec->bytes();
+    v.push_back(table_id);
+    put16(v, 0);
+    put16(v, ts + 1);
+    v.push_back(0xc1 | (version << 1));
+    v.push_back(0);
+    v.push_back(0);
+    put16(v, ORIG_NETWORK_ID);
+    v.push_back(0xff);
+
+    for (unsigned n = 0; n < SERVICES_PER_TS; ++n)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "Channel %u", ts * SERVICES_PER_TS + n);
+        const char *nm = (rename && n == 0) ? rename : name;
+        const char *provider = providers[(ts + n) % 3];
+        unsigned dlen = 3 + std::strlen(provider) + std::strlen(nm);
+
+        put16(v, service_id(ts, n));
+        v.push_back(0xfd);
+        put16(v, 0x8000 | (dlen + 2));
+        v.push_back(Descriptor::SERVICE);
+        v.push_back(std::uint8_t(dlen));
+        v.push_back(1);
+        put_string(v, provider);
+        put_string(v, nm);
+    }
+
+    finish_section(v);
+    return sec;
+}
+
+/// There's no receiver, so MultiScanner mustn't find anything to tune
+class EmptyIterator : public TuningIterator
+{
+public:
+    virtual TuningProperties next() override
+    {
+        return TuningProperties();
+    }
+
+    virtual void reset() override
+    {}
+};
+
+/**
+ * Feeds ms what a scan of n_ts transports would find, calling
+ * channel_finished() after each. Every channel repeats the whole NIT, and
+ * one channel's SDT other renames a service which was already found, so
+ * that a streamed batch has to be superseded.
+ */
+static void scan(MultiScanner &ms, unsigned n_ts, unsigned dwell)
+{
+    SDTProcessor this_sdt, other_sdt;
+    for (unsigned channel = 0; channel < n_ts; ++channel)
+    {
+        ms.process_network_name(NETWORK_ID, "Test Network");
+        for (unsigned ts = 0; ts < n_ts; ++ts)
+        {
+            auto &tsdat = ms.get_transport_stream_data(ORIG_NETWORK_ID,
+                    ts + 1);
+            tsdat.set_network_id(NETWORK_ID);
+            tsdat.set_tuning(TuningProperties({
+                    { DTV_DELIVERY_SYSTEM, SYS_DVBT },
+                    { DTV_FREQUENCY, 474000000 + 8000000 * (ts % 40) },
+                    { DTV_STREAM_ID, ts / 40 } }));
+            for (unsigned n = 0; n < SERVICES_PER_TS; ++n)
+            {
+                auto sid = service_id(ts, n);
+                tsdat.add_service_id(sid);
+                ms.get_service_data(ORIG_NETWORK_ID, sid).set_ts_id(ts + 1);
+                for (unsigned reg = 0; reg < REGIONS; ++reg)
+                {
+                    ms.set_lcn(NETWORK_ID, sid, reg,
+                            1 + (ts * SERVICES_PER_TS + n + reg) % 999, 0);
+                }
+            }
+        }
+        this_sdt.process(build_sdt(channel, 1, Section::SDT_TABLE), &ms);
+        if (channel == n_ts / 2)
+        {
+            other_sdt.process(build_sdt(0, 2, Section::OTHER_SDT_TABLE,
+                        "Renamed"), &ms);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(dwell));
+        ms.channel_finished(true);
+    }
+}
+
+static double ms_since(Clock::time_point t)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - t)
+        .count();
+}
+
+/// Waits until the database thread has done everything queued so far
+static void wait_for_db(Database &db)
+{
+    std::promise<void> done;
+    db.queue_function([&done]() { done.set_value(); });
+    done.get_future().get();
+}
+
+/**
+ * Scans into a new database file, streaming if stream is true, and returns
+ * the time until the database was usable.
+ */
+static double scan_to_db(const std::string &filename, unsigned n_ts,
+        unsigned dwell, bool stream)
+{
+    std::remove(filename.c_str());
+    Sqlite3Database db(filename.c_str());
+    db.start();
+    db.ensure_tables(SOURCE);
+    wait_for_db(db);
+
+    MultiScanner ms(nullptr, std::make_shared<SingleChannelScanner>(),
+            std::make_shared<EmptyIterator>());
+    auto t0 = Clock::now();
+    if (stream)
+        ms.set_streaming_commit(db, SOURCE);
+    scan(ms, n_ts, dwell);
+    auto scanned = ms_since(t0);
+    ms.commit_to_database(db, SOURCE);
+    wait_for_db(db);
+    auto total = ms_since(t0);
+    g_print("%s: scan %.1fms, usable after %.1fms (%.1fms after the scan)\n",
+            stream ? "Streaming" : "One-shot ", scanned, total,
+            total - scanned);
+    return total;
+}
+
+/// Every row of each table, as sorted strings
+static std::map<std::string, std::vector<std::string>>
+dump_tables(const std::string &filename)
+{
+    std::map<std::string, std::vector<std::string>> tables;
+    sqlite3 *sqlite = nullptr;
+    if (sqlite3_open_v2(filename.c_str(), &sqlite, SQLITE_OPEN_READONLY,
+                nullptr) != SQLITE_OK)
+    {
+        sqlite3_close(sqlite);
+        return tables;
+    }
+    std::vector<std::string> names;
+    sqlite3_stmt *stmt = nullptr;
+    sqlite3_prepare_v2(sqlite, "SELECT name FROM sqlite_master "
+            "WHERE type = 'table' ORDER BY name", -1, &stmt, nullptr);
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        names.emplace_back(reinterpret_cast<const char *>
+                (sqlite3_column_text(stmt, 0)));
+    }
+    sqlite3_finalize(stmt);
+
+    for (const auto &name: names)
+    {
+        auto &rows = tables[name];
+        sqlite3_prepare_v2(sqlite, ("SELECT * FROM " + name).c_str(), -1,
+                &stmt, nullptr);
+        while (sqlite3_step(stmt) == SQLITE_ROW)
+        {
+            std::string row;
+            for (int c = 0; c < sqlite3_column_count(stmt); ++c)
+            {
+                auto text = sqlite3_column_text(stmt, c);
+                if (text)
+                    row += reinterpret_cast<const char *>(text);
+                row += '|';
+            }
+            rows.push_back(std::move(row));
+        }
+        sqlite3_finalize(stmt);
+        std::sort(rows.begin(), rows.end());
+    }
+    sqlite3_close(sqlite);
+    return tables;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned n_ts = argc > 1 ? std::atoi(argv[1]) : 50;
+    unsigned dwell = argc > 2 ? std::atoi(argv[2]) : 20;
+    // Service ids are 16-bit
+    n_ts = std::min(n_ts, 3000u);
+
+    std::string dir = g_get_tmp_dir();
+    auto oneshot_file = dir + "/streamcommit-oneshot.db";
+    auto stream_file = dir + "/streamcommit-stream.db";
+
+    g_print("%u transports, %u services, %ums per channel\n",
+            n_ts, n_ts * SERVICES_PER_TS, dwell);
+    auto oneshot_ms = scan_to_db(oneshot_file, n_ts, dwell, false);
+    auto stream_ms = scan_to_db(stream_file, n_ts, dwell, true);
+    g_print("Streaming saved %.1fms\n", oneshot_ms - stream_ms);
+
+    auto oneshot = dump_tables(oneshot_file);
+    auto streamed = dump_tables(stream_file);
+    expect(oneshot.size() > 1 && oneshot.size() == streamed.size(),
+            "both databases have the same tables");
+    for (const auto &table: oneshot)
+    {
+        g_print("%s: %zu rows\n", table.first.c_str(), table.second.size());
+        auto it = streamed.find(table.first);
+        expect(it != streamed.end() && it->second == table.second,
+                ("streamed " + table.first + " matches one-shot").c_str());
+    }
+    auto names = oneshot.find(std::string(SOURCE) + "_service_names");
+    expect(names != oneshot.end() &&
+            std::count(names->second.begin(), names->second.end(),
+                std::to_string(ORIG_NETWORK_ID) + '|' +
+                std::to_string(service_id(0, 0)) + "|Renamed|"),
+            "a service renamed after it was streamed has its new name");
+
+    std::remove(oneshot_file.c_str());
+    std::remove(stream_file.c_str());
+    return check_summary();
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#pragma once
+
+/*
+ * Builds synthetic EIT sections for the EPG tests. A section is put
+ * together with start_eit_section(), then each event's start_event(), its
+ * descriptors and end_event(), and finally finish_section().
+ */
+
+#include <memory>
+
+#include "si/descriptor.h"
+#include "si/eit-section.h"
+
+#include "synth-section.h"
+
+using SynthEIT = SynthSection<logi::EITSection>;
+using EITPtr = std::shared_ptr<SynthEIT>;
+
+/// Everything before the event loop
+inline void start_eit_section(std::vector<std::uint8_t> &v,
+        std::uint8_t table_id, std::uint16_t service_id,
+        std::uint16_t ts_id, std::uint16_t orig_nw_id, unsigned version,
+        unsigned section_number, unsigned last_section_number,
+        unsigned segment_last_section_number, std::uint8_t last_table_id)
+{
+    v.push_back(table_id);
+    put16(v, 0);
+    put16(v, service_id);
+    v.push_back(0xc1 | (version << 1));
+    v.push_back(std::uint8_t(section_number));
+    v.push_back(std::uint8_t(last_section_number));
+    put16(v, ts_id);
+    put16(v, orig_nw_id);
+    v.push_back(std::uint8_t(segment_last_section_number));
+    v.push_back(last_table_id);
+}
+
+/**
+ * An event's fixed fields. running_status 4 is running.
+ * Returns: The offset to pass to end_event() after adding the descriptors
+ */
+inline std::size_t start_event(std::vector<std::uint8_t> &v,
+        std::uint16_t event_id, std::time_t start, unsigned duration,
+        unsigned running_status = 4)
+{
+    put16(v, event_id);
+    put_time(v, start);
+    put_duration(v, duration);
+    auto o = v.size();
+    put16(v, running_status << 13);
+    return o;
+}
+
+/// Fills in the descriptors_loop_length
+inline void end_event(std::vector<std::uint8_t> &v, std::size_t o)
+{
+    unsigned dlen = v.size() - o - 2;
+    v[o] |= dlen >> 8;
+    v[o + 1] = std::uint8_t(dlen);
+}
+
+inline void put_short_event(std::vector<std::uint8_t> &v,
+        const char *title, const char *text)
+{
+    v.push_back(logi::Descriptor::SHORT_EVENT);
+    v.push_back(std::uint8_t(5 + std::strlen(title) + std::strlen(text)));
+    v.insert(v.end(), { 'e', 'n', 'g' });
+    put_string(v, title);
+    put_string(v, text);
+}
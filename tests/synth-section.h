@@ -0,0 +1,87 @@
+#pragma once
+
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/*
+ * Helpers for building synthetic SI sections in tests. The demux checks
+ * CRCs, so the parsers don't and a dummy one will do, except in a TOT.
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+/// Gives access to a section's buffer so we can fill it in
+template<class S> class SynthSection : public S
+{
+public:
+    std::vector<std::uint8_t> &bytes()
+    {
+        this->sec_.clear();
+        return this->sec_;
+    }
+};
+
+inline void put16(std::vector<std::uint8_t> &v, unsigned w)
+{
+    v.push_back(std::uint8_t(w >> 8));
+    v.push_back(std::uint8_t(w));
+}
+
+/// A string with its length byte
+inline void put_string(std::vector<std::uint8_t> &v, const char *s)
+{
+    auto l = std::strlen(s);
+    v.push_back(std::uint8_t(l));
+    v.insert(v.end(), s, s + l);
+}
+
+/// Sets section_length at offset 1 and appends a dummy CRC
+inline void finish_section(std::vector<std::uint8_t> &v)
+{
+    v.insert(v.end(), 4, 0);
+    unsigned l = v.size() - 3;
+    v[1] = std::uint8_t(0xf0 | (l >> 8));
+    v[2] = std::uint8_t(l);
+}
+
+inline std::uint8_t bcd(unsigned n)
+{
+    return std::uint8_t(((n / 10) << 4) | (n % 10));
+}
+
+/// A UTC time as MJD and BCD hours, minutes and seconds
+inline void put_time(std::vector<std::uint8_t> &v, std::time_t t)
+{
+    put16(v, t / 86400 + 40587);
+    unsigned s = t % 86400;
+    v.push_back(bcd(s / 3600));
+    v.push_back(bcd(s / 60 % 60));
+    v.push_back(bcd(s % 60));
+}
+
+/// A duration in seconds as BCD hours, minutes and seconds
+inline void put_duration(std::vector<std::uint8_t> &v, unsigned s)
+{
+    v.push_back(bcd(s / 3600));
+    v.push_back(bcd(s / 60 % 60));
+    v.push_back(bcd(s % 60));
+}
@@ -0,0 +1,254 @@
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/*
+ * Checks decoding of the TDT and TOT, and TimeService's estimates of the
+ * broadcast clock's offset, jitter and drift from the system clock, its
+ * handling of outliers and system clock steps, and local time offsets.
+ * Exits with status 1 if any check fails.
+ */
+
+#include <cmath>
+#include <cstring>
+#include <ctime>
+
+#include "time-service.h"
+
+#include "check.h"
+#include "synth-section.h"
+
+using namespace logi;
+
+// 2017-10-28 12:00:00 UTC, the day before the clocks go back in the UK
+constexpr std::time_t START_TIME = 1509192000;
+// 2017-10-29 01:00:00 UTC
+constexpr std::time_t CHANGE_TIME = 1509238800;
+
+class SynthTDT : public SynthSection<TDTSection>
+{
+public:
+    /// The buffer without clearing it
+    std::vector<std::uint8_t> &raw()
+    {
+        return sec_;
+    }
+};
+
+static std::uint32_t crc32(const std::uint8_t *data, unsigned len)
+{
+    std::uint32_t crc = 0xffffffff;
+    for (unsigned n = 0; n < len; ++n)
+    {
+        crc ^= std::uint32_t(data[n]) << 24;
+        for (int b = 0; b < 8; ++b)
+            crc = (crc << 1) ^ ((crc & 0x80000000) ? 0x04c11db7 : 0);
+    }
+    return crc;
+}
+
+static void make_tdt(SynthTDT &sec, std::time_t utc)
+{
+    auto &v = sec.bytes();
+    v.insert(v.end(), { Section::TDT_TABLE, 0x70, 5 });
+    put_time(v, utc);
+}
+
+static void put_offset(std::vector<std::uint8_t> &v, const char *country,
+        unsigned region, int offset, std::time_t change, int next)
+{
+    v.insert(v.end(), country, country + 3);
+    v.push_back(std::uint8_t((region << 2) | 2 | (offset < 0)));
+    v.push_back(bcd(std::abs(offset) / 60));
+    v.push_back(bcd(std::abs(offset) % 60));
+    put_time(v, change);
+    v.push_back(bcd(std::abs(next) / 60));
+    v.push_back(bcd(std::abs(next) % 60));
+}
+
+/// Offsets in minutes
+static void make_tot(SynthTDT &sec, std::time_t utc)
+{
+    auto &v = sec.bytes();
+    v.insert(v.end(), { Section::TOT_TABLE, 0x70, 0 });
+    put_time(v, utc);
+    put16(v, 0xf000);
+    v.insert(v.end(), { Descriptor::LOCAL_TIME_OFFSET, 0 });
+    put_offset(v, "GBR", 0, 60, CHANGE_TIME, 0);
+    put_offset(v, "IRL", 0, 60, CHANGE_TIME, 0);
+    put_offset(v, "ESP", 1, 120, CHANGE_TIME, 60);
+    put_offset(v, "USA", 0, -300, START_TIME - 86400, -300);
+    v[9] = std::uint8_t(v.size() - 10);
+    v[11] = std::uint8_t(v.size() - 12);
+    v[2] = std::uint8_t(v.size() + 4 - 3);
+    auto crc = crc32(v.data(), v.size());
+    put16(v, crc >> 16);
+    put16(v, crc & 0xffff);
+}
+
+static void test_sections()
+{
+    g_print("Sections:\n");
+    SynthTDT sec;
+    make_tdt(sec, START_TIME + 3723);
+    expect(sec.is_valid() && !sec.is_tot() &&
+            sec.utc_time() == START_TIME + 3723, "TDT time");
+    sec.bytes().insert(sec.bytes().end(), { Section::TDT_TABLE, 0x70, 3,
+            0xd0, 0x81, 0x12 });
+    expect(!sec.is_valid(), "short TDT is invalid");
+
+    make_tot(sec, START_TIME);
+    expect(sec.is_valid() && sec.is_tot() && sec.utc_time() == START_TIME,
+            "TOT time and CRC");
+    sec.raw()[15] ^= 1;
+    expect(!sec.is_valid(), "TOT with a bad CRC is invalid");
+
+    TimeService ts;
+    make_tdt(sec, START_TIME);
+    sec.raw()[3] = sec.raw()[4] = 0xff;
+    ts.process_section(sec, std::int64_t(START_TIME) * 1000000);
+    make_tot(sec, START_TIME);
+    sec.raw()[15] ^= 1;
+    ts.process_section(sec, std::int64_t(START_TIME) * 1000000);
+    make_tdt(sec, START_TIME);
+    sec.raw()[0] = 0x71;
+    ts.process_section(sec, std::int64_t(START_TIME) * 1000000);
+    expect(ts.stats().sections == 2 && ts.stats().rejected == 2 &&
+            !ts.stats().samples && !ts.has_local_offset(),
+            "undefined time and bad CRC are rejected, other tables ignored");
+}
+
+/**
+ * Feeds a TDT every @interval seconds, starting at broadcast time @t0,
+ * received by a system clock which is @offset seconds ahead and gains
+ * @ppm, with a latency of up to 40ms.
+ */
+static std::time_t feed(TimeService &ts, double t0, unsigned n,
+        double interval, double offset, double ppm)
+{
+    SynthTDT sec;
+    double t = t0;
+    for (unsigned i = 0; i < n; ++i, t += interval)
+    {
+        double system = t + offset + (t - START_TIME) * ppm / 1e6 +
+            (i % 5) * 0.01;
+        make_tdt(sec, std::time_t(std::floor(t)));
+        ts.process_section(sec, std::int64_t(system * 1e6));
+    }
+    return std::time_t(t);
+}
+
+static void test_offset()
+{
+    g_print("Offset:\n");
+    TimeService ts;
+    unsigned syncs = 0;
+    ts.sync_signal().connect([&syncs]() { ++syncs; });
+
+    // Sent part way through each second, with the system clock 2.3s fast
+    auto t = feed(ts, START_TIME + 0.25, 2, 5, 2.3, 0);
+    expect(!ts.is_synced() && !ts.offset(), "not synced after two samples");
+    t = feed(ts, t + 0.25, 30, 5, 2.3, 0);
+    auto &stats = ts.stats();
+    g_print("Offset %.3fs, jitter %.3fs, drift %.1fppm\n",
+            stats.offset, stats.jitter, stats.drift);
+    expect(ts.is_synced() && syncs == 1, "synced after three samples");
+    expect(std::fabs(stats.offset + 2.3) < 0.5 &&
+            std::fabs(ts.offset() / 1e6 - stats.offset) < 1e-6,
+            "offset is within the TDT's resolution");
+    expect(stats.jitter > 0 && stats.jitter < 0.05, "jitter is small");
+    expect(!stats.drift, "drift needs 10 minutes of samples");
+
+    // A glitch
+    SynthTDT sec;
+    make_tdt(sec, t + 30);
+    ts.process_section(sec, std::int64_t((t + 2.3) * 1e6));
+    expect(std::fabs(stats.offset + 2.3) < 0.5 && stats.rejected == 1,
+            "outlier is ignored");
+    t = feed(ts, t + 5.25, 1, 5, 2.3, 0);
+
+    // Someone sets the system clock back a minute
+    t = feed(ts, t + 5.25, TimeService::MAX_OUTLIERS, 5, -57.7, 0);
+    expect(stats.resets == 1 && !ts.is_synced() && syncs == 1,
+            "several outliers in a row reset the samples");
+    expect(stats.rejected == TimeService::MAX_OUTLIERS,
+            "samples before the reset are rejected");
+    feed(ts, t + 0.25, 2, 5, -57.7, 0);
+    expect(ts.is_synced() && syncs == 2 &&
+            std::fabs(stats.offset - 57.7) < 0.5, "resynced to new offset");
+
+    // Slow to the TDT by 100ppm, sent every 30s for an hour
+    ts.reset();
+    feed(ts, START_TIME + 0.25, 120, 30, 0, -100);
+    g_print("Offset %.3fs, jitter %.3fs, drift %.1fppm\n",
+            stats.offset, stats.jitter, stats.drift);
+    expect(std::fabs(stats.drift - 100) < 10, "drift is estimated");
+}
+
+static void test_clock()
+{
+    g_print("Scheduling:\n");
+    TimeService ts;
+    SynthTDT sec;
+    // The broadcaster is a minute ahead of us
+    for (unsigned n = 0; n < 3; ++n)
+    {
+        auto now = g_get_real_time();
+        make_tdt(sec, std::time_t(now / 1000000) + 60);
+        ts.process_section(sec, now);
+    }
+    auto now = std::time(nullptr);
+    expect(std::labs(long(ts.now() - now - 60)) <= 1,
+            "now() is broadcast time");
+    auto ms = ts.ms_until(now + 120);
+    expect(ms > 58000 && ms < 62000, "timeouts are by broadcast time");
+    expect(!ts.ms_until(now + 30), "a broadcast time already past is due");
+}
+
+static void test_local()
+{
+    g_print("Local time offsets:\n");
+    TimeService ts;
+    expect(!ts.local_offset(START_TIME), "no offset before a TOT");
+    SynthTDT sec;
+    make_tot(sec, START_TIME);
+    ts.process_section(sec, std::int64_t(START_TIME) * 1000000);
+    expect(ts.has_local_offset() && ts.stats().samples == 1,
+            "TOT is a time sample too");
+    expect(ts.local_offset(START_TIME) == 3600 &&
+            ts.local_offset(CHANGE_TIME - 1) == 3600 &&
+            !ts.local_offset(CHANGE_TIME),
+            "first country, with daylight saving ending");
+    ts.set_country(TimeService::country_code("ESP"), 1);
+    expect(ts.local_offset(START_TIME) == 7200 &&
+            ts.local_offset(CHANGE_TIME) == 3600, "country and region");
+    ts.set_country(TimeService::country_code("USA"), 3);
+    expect(ts.local_offset(START_TIME) == -5 * 3600,
+            "negative offset, region falls back to whole country");
+    ts.set_country(TimeService::country_code("FRA"));
+    expect(!ts.local_offset(START_TIME), "unknown country");
+}
+
+int main()
+{
+    test_sections();
+    test_offset();
+    test_clock();
+    test_local();
+    return check_summary();
+}
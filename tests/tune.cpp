@@ -47,7 +47,7 @@ int main(int argc, char **argv)
 
     try
     {
-        std::shared_ptr<TuningProperties> props(new TuningProperties(argv[3]));
+        TuningProperties props(argv[3]);
         std::shared_ptr<Frontend> frontend(new Frontend(std::atoi(argv[1]),
                         std::atoi(argv[2])));
         Receiver rcv(frontend, SYS_DVBS);
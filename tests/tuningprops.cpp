@@ -0,0 +1,257 @@
+/*
+    logi - A DVB DVR designed for web-based clients.
+    Copyright (C) 2017 Tony Houghton <h@realh.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/*
+ * Checks TuningProperties' value semantics, hashing and expansion into
+ * kernel properties, and conversion of T2 delivery system and alternative
+ * frequency descriptors.
+ * Exits with status 1 if any check fails.
+ */
+
+#include <cstring>
+#include <unordered_set>
+
+#include "tuning.h"
+#include "si/cell-frequency-link-descriptor.h"
+#include "si/frequency-list-descriptor.h"
+#include "si/t2-delsys-descriptor.h"
+
+#include "check.h"
+
+using namespace logi;
+
+static void test_value()
+{
+    g_print("Value semantics:\n");
+    TuningProperties empty;
+    expect(!empty, "default is empty");
+    TuningProperties t("T 490000000 8MHz 2/3 NONE QAM64 8K 1/32 NONE");
+    expect(bool(t), "parsed string isn't empty");
+    auto copy = t;
+    expect(copy.size() == t.size() &&
+            !std::memcmp(copy.begin(), t.begin(),
+                t.size() * sizeof(TuningProperties::Property)),
+            "copy has the same properties");
+    copy.clear();
+    expect(!copy && t, "clearing a copy leaves the original");
+    expect(t.linuxtv_description() ==
+            "T 490000000 8MHZ 2/3 NONE QAM64 8K 1/32 NONE",
+            "linuxtv description round trips");
+}
+
+static void test_hash()
+{
+    g_print("Hashing:\n");
+    TuningProperties s1("S1 11428000 H 27500000 2/3");
+    TuningProperties s2("S2 11428000 H 27500000 2/3 35 8PSK");
+    TuningProperties v("S1 11428000 V 27500000 2/3");
+    TuningProperties t({
+            { DTV_DELIVERY_SYSTEM, SYS_DVBT },
+            { DTV_FREQUENCY, 490000000 },
+            { DTV_BANDWIDTH_HZ, 8000000 } });
+    TuningProperties t2({
+            { DTV_DELIVERY_SYSTEM, SYS_DVBT2 },
+            { DTV_FREQUENCY, 490000000 },
+            { DTV_BANDWIDTH_HZ, 8000000 },
+            { DTV_STREAM_ID, 0 } });
+
+    expect(s1 == s2 && s1.hash() == s2.hash(),
+            "S and S2 on the same transponder are equivalent");
+    expect(s1 != v, "polarisations are distinguished");
+    expect(t == t2 && t.hash() == t2.hash(),
+            "T and T2 on the same frequency are equivalent");
+    expect(s1 != t, "satellite and terrestrial are distinguished");
+
+    std::unordered_set<TuningProperties> set { s1, s2, v, t, t2 };
+    expect(set.size() == 3, "hash set deduplicates equivalent tunings");
+
+    TuningProperties plp1({
+            { DTV_DELIVERY_SYSTEM, SYS_DVBT2 },
+            { DTV_FREQUENCY, 490000000 },
+            { DTV_BANDWIDTH_HZ, 8000000 },
+            { DTV_STREAM_ID, 1 } });
+    TuningProperties t_near({
+            { DTV_DELIVERY_SYSTEM, SYS_DVBT },
+            { DTV_FREQUENCY, 490166000 },
+            { DTV_BANDWIDTH_HZ, 8000000 } });
+    expect(t.get_scan_key() != t2.get_scan_key() &&
+            t2.get_scan_key() != plp1.get_scan_key(),
+            "scan keys distinguish T2 and its PLPs from T");
+    expect(t.get_scan_key() == t_near.get_scan_key() &&
+            s1.get_scan_key() != v.get_scan_key(),
+            "scan keys round frequencies but distinguish polarisations");
+}
+
+static void test_expand()
+{
+    g_print("Expansion:\n");
+    TuningProperties t({
+            { DTV_DELIVERY_SYSTEM, SYS_DVBT },
+            { DTV_FREQUENCY, 490000000 } });
+    struct dtv_property props[TuningProperties::MAX_KERNEL_PROPS];
+    auto n = t.expand(props);
+    expect(n == 3, "DTV_TUNE is appended");
+    expect(props[0].cmd == DTV_DELIVERY_SYSTEM &&
+            props[0].u.data == SYS_DVBT &&
+            props[1].cmd == DTV_FREQUENCY &&
+            props[1].u.data == 490000000 &&
+            props[2].cmd == DTV_TUNE,
+            "properties are expanded in order");
+
+    TuningProperties full;
+    for (unsigned i = 0; i < TuningProperties::MAX_PROPS; ++i)
+        full.append_prop(DTV_FREQUENCY, i);
+    bool threw = false;
+    try
+    {
+        full.append_prop(DTV_FREQUENCY, 0);
+    }
+    catch (Glib::Error &)
+    {
+        threw = true;
+    }
+    expect(threw, "overflowing the inline storage throws");
+    expect(full.expand(props) == TuningProperties::MAX_KERNEL_PROPS,
+            "a full set fits the kernel array");
+}
+
+static void test_t2_descriptor()
+{
+    g_print("T2 delivery system descriptor:\n");
+
+    // PLP 1, 8MHz, 32K, 1/128, two cells, the first with a transposer
+    std::vector<std::uint8_t> data {
+        0x7f, 0, 0x04, 1, 0x30, 0x01, 0x00, 0x94,
+        0x00, 0x01, 0x03, 0x41, 0x21, 0x40,
+            5, 0x00, 0x03, 0x28, 0xb7, 0x40,
+        0x00, 0x02, 0x02, 0xdf, 0x79, 0x40,
+            0,
+    };
+    data[1] = data.size() - 2;
+
+    T2DeliverySystemDescriptor desc(Descriptor(SectionData(data, 0), 0));
+    expect(desc.tag_extension() == ExtensionDescriptor::T2_DELIVERY_SYSTEM,
+            "T2 descriptor tag extension");
+
+    std::vector<std::uint32_t> freqs;
+    desc.for_each_frequency([&freqs](std::uint16_t, std::uint32_t f)
+    {
+        freqs.push_back(f);
+    });
+    expect(freqs == std::vector<std::uint32_t>
+            { 546000000, 530000000, 482000000 },
+            "T2 cell and transposer frequencies are in order");
+
+    auto t = desc.get_tuning_properties();
+    expect(t == TuningProperties("T2 1 0 546000000 8MHz AUTO AUTO AUTO "
+                "32K 1/128 NONE") &&
+            t.linuxtv_description() ==
+                "T2 1 0 546000000 8MHZ AUTO AUTO AUTO 32K 1/128 NONE",
+            "T2 descriptor converts to DVB-T2 tuning with PLP");
+
+    // A NIT received during a sweep claims the tuned transport if its tuning
+    // has the same scan key
+    TuningProperties tuned_t({
+            { DTV_DELIVERY_SYSTEM, SYS_DVBT },
+            { DTV_FREQUENCY, 546000000 },
+            { DTV_BANDWIDTH_HZ, 8000000 } });
+    TuningProperties tuned_plp0("T2 0 0 546000000 8MHz AUTO AUTO AUTO "
+            "32K 1/128 NONE");
+    TuningProperties tuned_plp1("T2 1 0 546000000 8MHz AUTO AUTO AUTO "
+            "32K 1/128 NONE");
+    expect(t == tuned_t && t == tuned_plp0 &&
+            t.get_scan_key() != tuned_t.get_scan_key() &&
+            t.get_scan_key() != tuned_plp0.get_scan_key() &&
+            t.get_scan_key() == tuned_plp1.get_scan_key(),
+            "T2 descriptor only matches the scan key of its own PLP");
+
+    data[1] = 4;
+    T2DeliverySystemDescriptor short_desc(Descriptor(SectionData(data, 0), 0));
+    expect(!short_desc.get_tuning_properties(),
+            "T2 descriptor without cells has no tuning");
+}
+
+static void test_alternative_frequencies()
+{
+    g_print("Alternative frequencies:\n");
+
+    // Terrestrial, 490MHz and 514MHz
+    std::vector<std::uint8_t> fl_data {
+        0x62, 9, 0xfc | 3,
+        0x02, 0xeb, 0xae, 0x40,
+        0x03, 0x10, 0x4d, 0x40,
+    };
+    std::vector<std::uint32_t> freqs;
+    FrequencyListDescriptor fl(Descriptor(SectionData(fl_data, 0), 0));
+    fl.for_each_frequency([&freqs](std::uint32_t f) { freqs.push_back(f); });
+    expect(freqs == std::vector<std::uint32_t> { 490000000, 514000000 },
+            "terrestrial frequency list");
+
+    // Satellite, 11.72800GHz in BCD
+    std::vector<std::uint8_t> sat_data { 0x62, 5, 0xfc | 1,
+        0x01, 0x17, 0x28, 0x00 };
+    freqs.clear();
+    FrequencyListDescriptor sfl(Descriptor(SectionData(sat_data, 0), 0));
+    sfl.for_each_frequency([&freqs](std::uint32_t f) { freqs.push_back(f); });
+    expect(freqs == std::vector<std::uint32_t> { 11728000 },
+            "satellite frequency list is in KHz");
+
+    // One cell on 490MHz with a transposer on 514MHz
+    std::vector<std::uint8_t> cfl_data {
+        0x6d, 12, 0x00, 0x07,
+        0x02, 0xeb, 0xae, 0x40,
+        5, 0x01, 0x03, 0x10, 0x4d, 0x40,
+    };
+    unsigned transposers = 0;
+    freqs.clear();
+    CellFrequencyLinkDescriptor cfl(Descriptor(SectionData(cfl_data, 0), 0));
+    cfl.for_each_frequency([&](std::uint16_t cell_id, std::uint32_t f, bool t)
+    {
+        if (cell_id == 7)
+            freqs.push_back(f);
+        transposers += t;
+    });
+    expect(freqs == std::vector<std::uint32_t> { 490000000, 514000000 } &&
+            transposers == 1, "cell frequency link with transposer");
+
+    TuningProperties t("T 474000000 8MHz 2/3 NONE QAM64 8K 1/32 NONE");
+    auto alt = t.with_frequency(490000000);
+    expect(alt == TuningProperties("T 490000000 8MHz 2/3 NONE QAM64 8K "
+                "1/32 NONE") && alt.size() == t.size(),
+            "terrestrial tuning moved to another frequency");
+
+    TuningProperties s("S 10847000 V 22000000 5/6");
+    expect(s.with_frequency(11728000) ==
+            TuningProperties("S 11728000 V 22000000 5/6") &&
+            s.with_frequency(11728000).linuxtv_description() ==
+            TuningProperties("S 11728000 V 22000000 5/6")
+                .linuxtv_description(),
+            "satellite tuning moved across the LNB band");
+}
+
+int main()
+{
+    g_print("sizeof(TuningProperties) = %zu\n", sizeof(TuningProperties));
+    test_value();
+    test_hash();
+    test_expand();
+    test_t2_descriptor();
+    test_alternative_frequencies();
+    return check_summary();
+}